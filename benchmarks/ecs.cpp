@@ -0,0 +1,540 @@
+#include <ply/core/Clock.h>
+#include <ply/core/Scheduler.h>
+#include <ply/ecs/World.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <span>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+using namespace ply;
+
+///////////////////////////////////////////////////////////
+/// ECS benchmark suite
+///
+/// Usage: polygine_bench_ecs [--full] [--filter <name>] [--out <file>]
+///
+/// --filter runs the benchmark sets whose name contains the given string
+/// (entity, query_each, query_each_chunk, fragmented, component, observer,
+/// world_tick).
+///
+/// Results are written as JSON to stdout (or to the --out file), and
+/// progress is printed to stderr. --full adds the 10M entity sizes.
+///
+///////////////////////////////////////////////////////////
+
+namespace {
+
+///////////////////////////////////////////////////////////
+template <int I>
+struct Comp {
+    float v[4];
+};
+
+struct Tag {
+    uint32_t value;
+};
+
+///////////////////////////////////////////////////////////
+/// \brief A single benchmark measurement
+///////////////////////////////////////////////////////////
+struct Result {
+    std::string m_name;     //!< Benchmark name
+    std::string m_variant;  //!< Parameters of the run
+    size_t m_entities;      //!< Number of entities
+    size_t m_ops;           //!< Number of operations per iteration
+    uint32_t m_iterations;  //!< Number of timed iterations
+    double m_minMs;         //!< Fastest iteration
+    double m_medianMs;      //!< Median iteration
+};
+
+///////////////////////////////////////////////////////////
+/// \brief Benchmark settings from the command line
+///////////////////////////////////////////////////////////
+struct Settings {
+    bool m_full = false;
+    std::string m_filter;
+    std::string m_out;
+};
+
+std::vector<Result> s_results;
+Settings s_settings;
+
+///////////////////////////////////////////////////////////
+bool isEnabled(const char* name) {
+    return s_settings.m_filter.empty() || strstr(name, s_settings.m_filter.c_str());
+}
+
+///////////////////////////////////////////////////////////
+std::vector<size_t> getEntityCounts() {
+    std::vector<size_t> counts = {10000, 100000, 1000000};
+    if (s_settings.m_full)
+        counts.push_back(10000000);
+
+    return counts;
+}
+
+///////////////////////////////////////////////////////////
+/// \brief Fewer iterations for larger runs, so every benchmark takes similar time
+///////////////////////////////////////////////////////////
+uint32_t getIterations(size_t entities) {
+    return (uint32_t)std::clamp<size_t>(10000000 / std::max<size_t>(entities, 1), 3, 50);
+}
+
+///////////////////////////////////////////////////////////
+/// \brief Time a function over several iterations, with a setup step that isn't timed
+///////////////////////////////////////////////////////////
+template <typename Setup, typename Func>
+void measure(
+    const std::string& name,
+    const std::string& variant,
+    size_t entities,
+    size_t ops,
+    uint32_t iterations,
+    Setup&& setup,
+    Func&& func
+) {
+    std::vector<double> times;
+    times.reserve(iterations);
+
+    for (uint32_t i = 0; i < iterations; ++i) {
+        setup();
+
+        Clock clock;
+        func();
+        times.push_back(clock.getElapsedTime().microseconds() / 1000.0);
+    }
+
+    std::sort(times.begin(), times.end());
+    Result result{name, variant, entities, ops, iterations, times.front(), times[times.size() / 2]};
+    s_results.push_back(result);
+
+    fprintf(
+        stderr,
+        "%-24s %-28s %10zu entities  min %9.3f ms  median %9.3f ms  %8.2f ns/op\n",
+        name.c_str(),
+        variant.c_str(),
+        entities,
+        result.m_minMs,
+        result.m_medianMs,
+        result.m_medianMs * 1.0e6 / std::max<size_t>(ops, 1)
+    );
+}
+
+///////////////////////////////////////////////////////////
+template <typename Func>
+void measure(
+    const std::string& name,
+    const std::string& variant,
+    size_t entities,
+    size_t ops,
+    uint32_t iterations,
+    Func&& func
+) {
+    measure(name, variant, entities, ops, iterations, [] {}, std::forward<Func>(func));
+}
+
+///////////////////////////////////////////////////////////
+/// \brief Create entities with the first N test components
+///////////////////////////////////////////////////////////
+template <int... Is>
+std::vector<EntityId> createEntities(World& world, size_t count, std::integer_sequence<int, Is...>) {
+    EntityBuilder builder = world.entity();
+    (builder.add(Comp<Is>{}), ...);
+    return builder.create((uint32_t)count);
+}
+
+///////////////////////////////////////////////////////////
+/// \brief Iterate entities with a query on the first N test components
+///////////////////////////////////////////////////////////
+template <int... Is>
+void iterateQuery(
+    const char* name,
+    World& world,
+    size_t entities,
+    std::integer_sequence<int, Is...>
+) {
+    constexpr int numComponents = sizeof...(Is);
+
+    Query query = world.query().match<Comp<Is>...>().compile();
+
+    // Count matched entities, so the time per entity is comparable between layouts
+    size_t matched = 0;
+    query.each([&](const Comp<Is>&...) { ++matched; });
+
+    measure(
+        name,
+        std::to_string(numComponents) + " components",
+        entities,
+        matched,
+        getIterations(entities),
+        [&] {
+            query.each([](Comp<Is>&... comps) {
+                float sum = (comps.v[0] + ...);
+                ((comps.v[1] += sum), ...);
+            });
+        }
+    );
+}
+
+///////////////////////////////////////////////////////////
+/// \brief The same as iterateQuery(), with one call per chunk of spans
+///////////////////////////////////////////////////////////
+template <int... Is>
+void iterateQueryChunks(
+    const char* name,
+    World& world,
+    size_t entities,
+    std::integer_sequence<int, Is...>
+) {
+    constexpr int numComponents = sizeof...(Is);
+
+    Query query = world.query().match<Comp<Is>...>().compile();
+
+    size_t matched = 0;
+    query.each([&](const Comp<Is>&...) { ++matched; });
+
+    measure(
+        name,
+        std::to_string(numComponents) + " components",
+        entities,
+        matched,
+        getIterations(entities),
+        [&] {
+            query.eachChunk([](std::span<Comp<Is>>... comps) {
+                size_t size = std::get<0>(std::tie(comps...)).size();
+                for (size_t i = 0; i < size; ++i) {
+                    float sum = (comps[i].v[0] + ...);
+                    ((comps[i].v[1] += sum), ...);
+                }
+            });
+        }
+    );
+}
+
+///////////////////////////////////////////////////////////
+void benchCreateDestroy() {
+    for (size_t count : getEntityCounts()) {
+        uint32_t iterations = std::min<uint32_t>(getIterations(count), 10);
+
+        World world;
+        std::vector<EntityId> ids;
+
+        measure(
+            "entity_create",
+            "4 components",
+            count,
+            count,
+            iterations,
+            [&] {
+                if (!ids.empty())
+                    world.remove(ids);
+            },
+            [&] { ids = createEntities(world, count, std::make_integer_sequence<int, 4>()); }
+        );
+
+        measure(
+            "entity_remove",
+            "4 components",
+            count,
+            count,
+            iterations,
+            [&] {
+                if (ids.empty())
+                    ids = createEntities(world, count, std::make_integer_sequence<int, 4>());
+            },
+            [&] {
+                world.remove(ids);
+                ids.clear();
+            }
+        );
+
+        // Creating one entity at a time goes through the per call overhead
+        measure(
+            "entity_create_single",
+            "4 components",
+            count,
+            count,
+            3,
+            [&] {
+                for (EntityId id : ids)
+                    world.remove(id);
+                ids.clear();
+            },
+            [&] {
+                for (size_t i = 0; i < count; ++i) {
+                    ids.push_back(world.entity()
+                                      .add(Comp<0>{})
+                                      .add(Comp<1>{})
+                                      .add(Comp<2>{})
+                                      .add(Comp<3>{})
+                                      .create(1u)[0]);
+                }
+            }
+        );
+    }
+}
+
+///////////////////////////////////////////////////////////
+void benchQueryEach() {
+    for (size_t count : getEntityCounts()) {
+        World world;
+        createEntities(world, count, std::make_integer_sequence<int, 8>());
+
+        iterateQuery("query_each", world, count, std::make_integer_sequence<int, 1>());
+        iterateQuery("query_each", world, count, std::make_integer_sequence<int, 2>());
+        iterateQuery("query_each", world, count, std::make_integer_sequence<int, 3>());
+        iterateQuery("query_each", world, count, std::make_integer_sequence<int, 4>());
+        iterateQuery("query_each", world, count, std::make_integer_sequence<int, 5>());
+        iterateQuery("query_each", world, count, std::make_integer_sequence<int, 6>());
+        iterateQuery("query_each", world, count, std::make_integer_sequence<int, 7>());
+        iterateQuery("query_each", world, count, std::make_integer_sequence<int, 8>());
+
+        iterateQueryChunks("query_each_chunk", world, count, std::make_integer_sequence<int, 1>());
+        iterateQueryChunks("query_each_chunk", world, count, std::make_integer_sequence<int, 2>());
+        iterateQueryChunks("query_each_chunk", world, count, std::make_integer_sequence<int, 4>());
+        iterateQueryChunks("query_each_chunk", world, count, std::make_integer_sequence<int, 8>());
+    }
+}
+
+///////////////////////////////////////////////////////////
+void benchFragmented() {
+    for (size_t count : getEntityCounts()) {
+        // 256 archetypes, every combination of 8 optional components besides Comp<0>
+        constexpr uint32_t numGroups = 256;
+
+        World world;
+        for (uint32_t g = 0; g < numGroups; ++g) {
+            EntityBuilder builder = world.entity();
+            builder.add(Comp<0>{});
+            if (g & 1)
+                builder.add(Comp<1>{});
+            if (g & 2)
+                builder.add(Comp<2>{});
+            if (g & 4)
+                builder.add(Comp<3>{});
+            if (g & 8)
+                builder.add(Comp<4>{});
+            if (g & 16)
+                builder.add(Comp<5>{});
+            if (g & 32)
+                builder.add(Comp<6>{});
+            if (g & 64)
+                builder.add(Comp<7>{});
+            if (g & 128)
+                builder.add(Tag{g});
+
+            builder.create((uint32_t)(count / numGroups));
+        }
+
+        size_t total = count / numGroups * numGroups;
+        iterateQuery("fragmented_each", world, total, std::make_integer_sequence<int, 1>());
+        iterateQuery("fragmented_each", world, total, std::make_integer_sequence<int, 2>());
+        iterateQuery("fragmented_each", world, total, std::make_integer_sequence<int, 4>());
+    }
+}
+
+///////////////////////////////////////////////////////////
+void benchComponentChurn() {
+    for (size_t count : getEntityCounts()) {
+        size_t churn = std::min<size_t>(count, 100000);
+
+        World world;
+        std::vector<EntityId> ids = createEntities(world, count, std::make_integer_sequence<int, 4>());
+        ids.resize(churn);
+
+        measure("component_add", "4 -> 5 components", count, churn, 5, [&] {
+            for (EntityId id : ids)
+                world.addComponent(id, Tag{1});
+        });
+
+        measure("component_remove", "5 -> 4 components", count, churn, 5, [&] {
+            for (EntityId id : ids)
+                world.removeComponent<Tag>(id);
+        });
+    }
+}
+
+///////////////////////////////////////////////////////////
+void benchObservers() {
+    for (size_t count : getEntityCounts()) {
+        constexpr int numObservers = 16;
+        size_t churn = std::min<size_t>(count, 100000);
+
+        World world;
+        size_t events = 0;
+        for (int i = 0; i < numObservers; ++i) {
+            world.observer(World::OnCreate).match<Comp<0>>().each([&](const Comp<0>&) { ++events; });
+            world.observer(World::OnRemove).match<Comp<0>>().each([&](const Comp<0>&) { ++events; });
+            world.observer(World::OnEnter).match<Comp<0>, Tag>().each([&](const Tag&) { ++events; });
+            world.observer(World::OnExit).match<Comp<0>, Tag>().each([&](const Tag&) { ++events; });
+        }
+
+        std::vector<EntityId> ids;
+        measure(
+            "observer_create_remove",
+            std::to_string(numObservers * 2) + " observers",
+            count,
+            count * 2,
+            std::min<uint32_t>(getIterations(count), 10),
+            [&] { ids.clear(); },
+            [&] {
+                ids = createEntities(world, count, std::make_integer_sequence<int, 2>());
+                world.remove(ids);
+            }
+        );
+
+        ids = createEntities(world, count, std::make_integer_sequence<int, 2>());
+        ids.resize(churn);
+
+        // Enter and exit events are dispatched in batches at the end of the tick
+        measure(
+            "observer_enter_exit",
+            std::to_string(numObservers * 2) + " observers",
+            count,
+            churn * 2,
+            5,
+            [&] {
+                for (EntityId id : ids)
+                    world.addComponent(id, Tag{1});
+                world.tick(0.0f);
+                for (EntityId id : ids)
+                    world.removeComponent<Tag>(id);
+                world.tick(0.0f);
+            }
+        );
+
+        if (events == 0)
+            fprintf(stderr, "warning: observers were never invoked\n");
+    }
+}
+
+///////////////////////////////////////////////////////////
+void benchSystems(Scheduler* scheduler) {
+    constexpr int numSystems = 64;
+
+    for (size_t count : getEntityCounts()) {
+        World world;
+        world.setScheduler(scheduler);
+
+        // Spread entities over a few archetypes so systems overlap partially
+        size_t perGroup = count / 4;
+        createEntities(world, perGroup, std::make_integer_sequence<int, 8>());
+        createEntities(world, perGroup, std::make_integer_sequence<int, 6>());
+        createEntities(world, perGroup, std::make_integer_sequence<int, 4>());
+        createEntities(world, perGroup, std::make_integer_sequence<int, 2>());
+
+        // Each system reads one component and writes another, forming chains
+        // of conflicting access, plus some explicit dependencies
+        std::vector<System*> systems;
+        auto addSystem = [&]<int R, int W>(std::integral_constant<int, R>, std::integral_constant<int, W>) {
+            System* system = world.system().match<Comp<R>, Comp<W>>().each(
+                [](const Comp<R>& r, Comp<W>& w) { w.v[0] += r.v[0] * 0.5f; }
+            );
+            if (systems.size() >= 8 && systems.size() % 4 == 0)
+                system->after(systems[systems.size() - 8]);
+            systems.push_back(system);
+        };
+
+        for (int i = 0; i < numSystems / 8; ++i) {
+            addSystem(std::integral_constant<int, 0>(), std::integral_constant<int, 1>());
+            addSystem(std::integral_constant<int, 2>(), std::integral_constant<int, 3>());
+            addSystem(std::integral_constant<int, 4>(), std::integral_constant<int, 5>());
+            addSystem(std::integral_constant<int, 6>(), std::integral_constant<int, 7>());
+            addSystem(std::integral_constant<int, 1>(), std::integral_constant<int, 2>());
+            addSystem(std::integral_constant<int, 3>(), std::integral_constant<int, 4>());
+            addSystem(std::integral_constant<int, 5>(), std::integral_constant<int, 6>());
+            addSystem(std::integral_constant<int, 7>(), std::integral_constant<int, 0>());
+        }
+
+        // Build the schedule outside of the timed section
+        world.tick(0.0f);
+
+        measure(
+            "world_tick",
+            std::to_string(numSystems) + (scheduler ? " systems, scheduler" : " systems, 1 thread"),
+            count,
+            count,
+            std::min<uint32_t>(getIterations(count), 20),
+            [&] { world.tick(0.016f); }
+        );
+    }
+}
+
+///////////////////////////////////////////////////////////
+void writeJson(FILE* file) {
+    fprintf(file, "{\n  \"benchmarks\": [\n");
+    for (size_t i = 0; i < s_results.size(); ++i) {
+        const Result& r = s_results[i];
+        fprintf(
+            file,
+            "    {\"name\": \"%s\", \"variant\": \"%s\", \"entities\": %zu, \"ops\": %zu, "
+            "\"iterations\": %u, \"min_ms\": %.4f, \"median_ms\": %.4f, \"ns_per_op\": %.3f}%s\n",
+            r.m_name.c_str(),
+            r.m_variant.c_str(),
+            r.m_entities,
+            r.m_ops,
+            r.m_iterations,
+            r.m_minMs,
+            r.m_medianMs,
+            r.m_medianMs * 1.0e6 / std::max<size_t>(r.m_ops, 1),
+            i + 1 < s_results.size() ? "," : ""
+        );
+    }
+    fprintf(file, "  ]\n}\n");
+}
+
+} // namespace
+
+///////////////////////////////////////////////////////////
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--full") == 0)
+            s_settings.m_full = true;
+        else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+            s_settings.m_filter = argv[++i];
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+            s_settings.m_out = argv[++i];
+        else {
+            fprintf(stderr, "usage: %s [--full] [--filter <name>] [--out <file>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (isEnabled("entity"))
+        benchCreateDestroy();
+    if (isEnabled("query_each"))
+        benchQueryEach();
+    if (isEnabled("fragmented"))
+        benchFragmented();
+    if (isEnabled("component"))
+        benchComponentChurn();
+    if (isEnabled("observer"))
+        benchObservers();
+    if (isEnabled("world_tick")) {
+        Scheduler scheduler(std::max(std::thread::hardware_concurrency(), 1u));
+        benchSystems(nullptr);
+        benchSystems(&scheduler);
+    }
+
+    FILE* file = stdout;
+    if (!s_settings.m_out.empty()) {
+        file = fopen(s_settings.m_out.c_str(), "w");
+        if (!file) {
+            fprintf(stderr, "could not open %s\n", s_settings.m_out.c_str());
+            return 1;
+        }
+    }
+
+    writeJson(file);
+
+    if (file != stdout)
+        fclose(file);
+
+    return 0;
+}
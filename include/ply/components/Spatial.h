@@ -1,5 +1,8 @@
 #pragma once
 
+#include <ply/ecs/Types.h>
+#include <ply/math/BoundingBox.h>
+#include <ply/math/Transform.h>
 #include <ply/math/Types.h>
 
 namespace ply {
@@ -16,6 +19,94 @@ struct Transform {
     Vector3f scale = Vector3f(1.0f);                  //!< The scale
 };
 
+///////////////////////////////////////////////////////////
+/// \brief Create the transform matrices of an array of Transform components
+///
+/// Uses the batch kernel of toTransformMatrices(), reading the fields of
+/// the components directly, so component arrays (i.e. the columns of an
+/// entity group) can be converted without copying them first.
+///
+/// \param transforms The array of transforms
+/// \param out The array to write the transform matrices to
+/// \param count The number of transforms
+///
+///////////////////////////////////////////////////////////
+inline void toTransformMatrices(const Transform* transforms, Matrix4f* out, size_t count) {
+    if (count)
+        toTransformMatrices(
+            &transforms->position,
+            &transforms->rotation,
+            &transforms->scale,
+            out,
+            count,
+            sizeof(Transform)
+        );
+}
+
+///////////////////////////////////////////////////////////
+/// \brief Create affine 3x4 matrices of an array of Transform components
+///
+/// \param transforms The array of transforms
+/// \param out The array to write the matrix rows to (3 rows per transform)
+/// \param count The number of transforms
+///
+/// \see toAffineMatrices()
+///
+///////////////////////////////////////////////////////////
+inline void toAffineMatrices(const Transform* transforms, Vector4f* out, size_t count) {
+    if (count)
+        toAffineMatrices(
+            &transforms->position,
+            &transforms->rotation,
+            &transforms->scale,
+            out,
+            count,
+            sizeof(Transform)
+        );
+}
+
+///////////////////////////////////////////////////////////
+/// \brief An engine component that attaches an entity to a parent entity
+/// \ingroup Components
+///
+/// The entity's Transform is then relative to the parent's world transform.
+/// Entities whose parent is removed, or doesn't have a Transform, become roots.
+///
+/// \see Hierarchy
+///
+///////////////////////////////////////////////////////////
+struct Parent {
+    EntityId entity; //!< The parent entity
+};
+
+///////////////////////////////////////////////////////////
+/// \brief An engine component that holds an entity's world space transform
+/// \ingroup Components
+///
+/// Computed by Hierarchy from the entity's Transform and the transforms of
+/// its parents. Only entities with both Transform and WorldTransform are
+/// part of the hierarchy.
+///
+///////////////////////////////////////////////////////////
+struct WorldTransform {
+    Matrix4f matrix = Matrix4f(1.0f); //!< The world transform matrix
+};
+
+///////////////////////////////////////////////////////////
+/// \brief An engine component that holds the bounding box of an entity
+/// \ingroup Components
+///
+/// The box is in the entity's local space, and is transformed by its
+/// Transform (or WorldTransform, if it has one) to place the entity in
+/// a SpatialIndex.
+///
+/// \see SpatialIndex
+///
+///////////////////////////////////////////////////////////
+struct Bounds {
+    BoundingBox box; //!< The local space bounding box
+};
+
 ///////////////////////////////////////////////////////////
 /// \brief Dynamic spatial component tag
 /// \ingroup Components
@@ -2,6 +2,7 @@
 
 #include <ply/core/Handle.h>
 
+#include <algorithm>
 #include <cstdint>
 #include <vector>
 
@@ -97,6 +98,91 @@ class HandleArray {
     ///////////////////////////////////////////////////////////
     void remove(Handle handle);
 
+    ///////////////////////////////////////////////////////////
+    /// \brief Take all free handles out of the free list
+    ///
+    /// The handles are appended in the order push() would have
+    /// returned them. Taken handles are reserved: they are not
+    /// valid and won't be returned by push(), until an element is
+    /// added for them with insert(), or they are given back with
+    /// release(). This allows handles to be handed out before the
+    /// array is modified, for example by several threads at once.
+    ///
+    /// \param handles The list to append the free handles to
+    ///
+    /// \see insert
+    ///
+    ///////////////////////////////////////////////////////////
+    void takeFreeHandles(std::vector<Handle>& handles);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Add an element for a reserved handle
+    ///
+    /// The handle must have been taken with takeFreeHandles(),
+    /// or be a new handle with an index past the end of the
+    /// handle table. New handles grow the table, and any indices
+    /// that are skipped over are reserved.
+    ///
+    /// \param handle The reserved handle
+    /// \param element The element to add
+    ///
+    /// \see takeFreeHandles
+    ///
+    ///////////////////////////////////////////////////////////
+    void insert(Handle handle, const T& element);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Give reserved handles back to the free list
+    ///
+    /// The first handle of the list will be the first to be
+    /// reused.
+    ///
+    /// \param handles The reserved handles
+    /// \param num The number of handles
+    ///
+    ///////////////////////////////////////////////////////////
+    void release(const Handle* handles, uint32_t num);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Check if a handle in the handle table is reserved
+    ///
+    /// \return True if the handle was taken with takeFreeHandles() and
+    /// no element was added for it yet
+    ///
+    ///////////////////////////////////////////////////////////
+    bool isReserved(Handle handle) const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Check if the free list has a handle push() can reuse
+    ///
+    /// \return False if push() would have to add a new handle
+    ///
+    ///////////////////////////////////////////////////////////
+    bool hasFreeHandle() const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Reserve space for a number of elements
+    ///
+    /// Use this before pushing many elements at once so that the
+    /// internal arrays are only reallocated once.
+    ///
+    /// \param size The total number of elements to reserve space for
+    ///
+    ///////////////////////////////////////////////////////////
+    void reserve(uint32_t size);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Make sure there is space for a number of elements
+    ///
+    /// Unlike reserve(), the capacity is at least doubled when it
+    /// runs out, so adding a few elements at a time stays amortized
+    /// constant.
+    ///
+    /// \param size The total number of elements that need space
+    ///
+    ///////////////////////////////////////////////////////////
+    void grow(uint32_t size);
+
     ///////////////////////////////////////////////////////////
     /// \brief Completely reset the handle array
     ///
@@ -206,7 +292,78 @@ class HandleArray {
     ///////////////////////////////////////////////////////////
     Handle getHandle(uint32_t index) const;
 
+    ///////////////////////////////////////////////////////////
+    /// \brief Get the table that maps handle indices to internal indices
+    ///
+    /// Entries that are not in use form the free list, where the
+    /// index of each entry is the next free handle index. Together
+    /// with getIndexTable(), getNextFree(), and data(), this is the
+    /// complete state of the array, and can be used to save it.
+    ///
+    /// \return The handle table
+    ///
+    ///////////////////////////////////////////////////////////
+    const std::vector<Handle>& getHandleTable() const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Get the table that maps internal indices to handle indices
+    ///
+    /// \return The index table
+    ///
+    ///////////////////////////////////////////////////////////
+    const std::vector<uint32_t>& getIndexTable() const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Get the index of the next free handle
+    ///
+    ///////////////////////////////////////////////////////////
+    uint32_t getNextFree() const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Replace the complete state of the array
+    ///
+    /// Takes ownership of a data array and tables that were
+    /// previously retrieved with data(), getHandleTable(),
+    /// getIndexTable(), and getNextFree(). Handles that were valid
+    /// when the state was retrieved are valid again afterwards.
+    ///
+    /// \param data The internal data array
+    /// \param handleTable The handle table
+    /// \param indexTable The index table
+    /// \param nextFree The index of the next free handle
+    ///
+    ///////////////////////////////////////////////////////////
+    void restore(
+        std::vector<T>&& data,
+        std::vector<Handle>&& handleTable,
+        std::vector<uint32_t>&& indexTable,
+        uint32_t nextFree
+    );
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Replace the complete state of the array with copies
+    ///
+    /// The same as the other overload, but the arrays are copied,
+    /// reusing the memory that is already allocated by this array.
+    /// This is meant for restoring the same state several times.
+    ///
+    /// \param data The internal data array
+    /// \param handleTable The handle table
+    /// \param indexTable The index table
+    /// \param nextFree The index of the next free handle
+    ///
+    ///////////////////////////////////////////////////////////
+    void restore(
+        const std::vector<T>& data,
+        const std::vector<Handle>& handleTable,
+        const std::vector<uint32_t>& indexTable,
+        uint32_t nextFree
+    );
+
    private:
+    static constexpr uint32_t END_INDEX = 0xFFFFFF;      //!< Marks the end of the free list
+    static constexpr uint32_t RESERVED_INDEX = 0xFFFFFE; //!< Marks handles that are reserved
+
     std::vector<T> m_data;                 //!< Internal data array
     std::vector<Handle> m_handleToData;    //!< Maps handle index to actual index, also keeps a counter to detect invalid handles
     std::vector<uint32_t> m_dataToHandle;  //!< Maps actual index to handle index
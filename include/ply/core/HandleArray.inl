@@ -17,7 +17,7 @@ inline HandleArray<T>::HandleArray(uint32_t size) :
 
     // Setup free list
     for (uint32_t i = 0; i < size; ++i)
-        m_handleToData[i].m_index = i + 1;
+        m_handleToData[i].m_index = i + 1 < size ? i + 1 : END_INDEX;
 }
 
 ///////////////////////////////////////////////////////////
@@ -30,7 +30,7 @@ inline T& HandleArray<T>::operator[](Handle handle) {
     );
     Handle entry = m_handleToData[handle.m_index];
     CHECK_F(
-        entry.m_counter == handle.m_counter,
+        entry.m_counter == handle.m_counter && entry.m_index < m_data.size(),
         "Invalid handle: %d",
         handle.m_index
     );
@@ -41,9 +41,10 @@ inline T& HandleArray<T>::operator[](Handle handle) {
 ///////////////////////////////////////////////////////////
 template <typename T>
 inline Handle HandleArray<T>::push(const T& element) {
-    // Resize the arrays if the next free handle is out of bounds
+    // Resize the arrays if the free list is empty
     if (m_nextFree >= m_handleToData.size()) {
-        m_handleToData.push_back(Handle((uint32_t)(m_handleToData.size() + 1)));
+        m_nextFree = (uint32_t)m_handleToData.size();
+        m_handleToData.push_back(Handle(END_INDEX));
         m_dataToHandle.push_back(0);
     }
 
@@ -68,9 +69,10 @@ inline Handle HandleArray<T>::push(const T& element) {
 ///////////////////////////////////////////////////////////
 template <typename T>
 inline Handle HandleArray<T>::push(T&& element) {
-    // Resize the arrays if the next free handle is out of bounds
+    // Resize the arrays if the free list is empty
     if (m_nextFree >= m_handleToData.size()) {
-        m_handleToData.push_back(Handle((uint32_t)(m_handleToData.size() + 1)));
+        m_nextFree = (uint32_t)m_handleToData.size();
+        m_handleToData.push_back(Handle(END_INDEX));
         m_dataToHandle.push_back(0);
     }
 
@@ -135,6 +137,90 @@ inline void HandleArray<T>::remove(Handle handle) {
     ++m_handleToData[handle.m_index].m_counter;
 }
 
+///////////////////////////////////////////////////////////
+template <typename T>
+inline void HandleArray<T>::takeFreeHandles(std::vector<Handle>& handles) {
+    // Walk the free list, marking each handle as reserved
+    uint32_t index = m_nextFree;
+    while (index < m_handleToData.size()) {
+        Handle& entry = m_handleToData[index];
+        handles.push_back(Handle(index, entry.m_counter));
+
+        index = entry.m_index;
+        entry.m_index = RESERVED_INDEX;
+    }
+
+    m_nextFree = END_INDEX;
+}
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline void HandleArray<T>::insert(Handle handle, const T& element) {
+    // New handles grow the table, skipped indices stay reserved for their owners. An
+    // empty free list ends at the table size, which has to stay past the end
+    if (handle.m_index >= m_handleToData.size() && m_nextFree >= m_handleToData.size())
+        m_nextFree = END_INDEX;
+
+    while (handle.m_index >= m_handleToData.size()) {
+        m_handleToData.push_back(Handle(RESERVED_INDEX));
+        m_dataToHandle.push_back(0);
+    }
+
+    Handle& entry = m_handleToData[handle.m_index];
+    CHECK_F(
+        entry.m_index == RESERVED_INDEX && entry.m_counter == handle.m_counter,
+        "Handle is not reserved: %d",
+        handle.m_index
+    );
+
+    // Add element to data array, and map the handle to it
+    m_data.push_back(element);
+    entry.m_index = (uint32_t)(m_data.size() - 1);
+    m_dataToHandle[m_data.size() - 1] = handle.m_index;
+}
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline void HandleArray<T>::release(const Handle* handles, uint32_t num) {
+    // Push in reverse so that the first handle ends up at the front of the free list
+    for (uint32_t i = num; i > 0; --i) {
+        Handle& entry = m_handleToData[handles[i - 1].m_index];
+        CHECK_F(entry.m_index == RESERVED_INDEX, "Handle is not reserved: %d", handles[i - 1].m_index);
+
+        entry.m_index = m_nextFree;
+        m_nextFree = handles[i - 1].m_index;
+    }
+}
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline bool HandleArray<T>::hasFreeHandle() const {
+    return m_nextFree < m_handleToData.size();
+}
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline bool HandleArray<T>::isReserved(Handle handle) const {
+    return handle.m_index < m_handleToData.size() &&
+           m_handleToData[handle.m_index].m_index == RESERVED_INDEX &&
+           m_handleToData[handle.m_index].m_counter == handle.m_counter;
+}
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline void HandleArray<T>::reserve(uint32_t size) {
+    m_data.reserve(size);
+    m_handleToData.reserve(size);
+    m_dataToHandle.reserve(size);
+}
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline void HandleArray<T>::grow(uint32_t size) {
+    if (size > m_data.capacity())
+        reserve((uint32_t)std::max<size_t>(size, m_data.capacity() * 2));
+}
+
 ///////////////////////////////////////////////////////////
 template <typename T>
 inline void HandleArray<T>::reset() {
@@ -163,6 +249,14 @@ inline bool HandleArray<T>::isEmpty() const {
     return m_data.empty();
 }
 
+///////////////////////////////////////////////////////////
+template <typename T>
+inline bool HandleArray<T>::isValid(Handle handle) const {
+    return handle.m_index < m_handleToData.size() &&
+           m_handleToData[handle.m_index].m_counter == handle.m_counter &&
+           m_handleToData[handle.m_index].m_index != RESERVED_INDEX;
+}
+
 ///////////////////////////////////////////////////////////
 template <typename T>
 inline std::vector<T>& HandleArray<T>::data() {
@@ -200,4 +294,60 @@ inline Handle HandleArray<T>::getHandle(uint32_t index) const {
     return Handle(handleIndex, entry.m_counter);
 }
 
+///////////////////////////////////////////////////////////
+template <typename T>
+inline const std::vector<Handle>& HandleArray<T>::getHandleTable() const {
+    return m_handleToData;
+}
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline const std::vector<uint32_t>& HandleArray<T>::getIndexTable() const {
+    return m_dataToHandle;
+}
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline uint32_t HandleArray<T>::getNextFree() const {
+    return m_nextFree;
+}
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline void HandleArray<T>::restore(
+    std::vector<T>&& data,
+    std::vector<Handle>&& handleTable,
+    std::vector<uint32_t>&& indexTable,
+    uint32_t nextFree
+) {
+    CHECK_F(
+        data.size() <= handleTable.size() && handleTable.size() == indexTable.size(),
+        "Invalid handle array tables"
+    );
+
+    m_data = std::move(data);
+    m_handleToData = std::move(handleTable);
+    m_dataToHandle = std::move(indexTable);
+    m_nextFree = nextFree;
+}
+
+///////////////////////////////////////////////////////////
+template <typename T>
+inline void HandleArray<T>::restore(
+    const std::vector<T>& data,
+    const std::vector<Handle>& handleTable,
+    const std::vector<uint32_t>& indexTable,
+    uint32_t nextFree
+) {
+    CHECK_F(
+        data.size() <= handleTable.size() && handleTable.size() == indexTable.size(),
+        "Invalid handle array tables"
+    );
+
+    m_data = data;
+    m_handleToData = handleTable;
+    m_dataToHandle = indexTable;
+    m_nextFree = nextFree;
+}
+
 } // namespace ply
\ No newline at end of file
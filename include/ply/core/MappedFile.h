@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace ply {
+
+///////////////////////////////////////////////////////////
+/// \brief A read only memory mapped file
+///
+///////////////////////////////////////////////////////////
+class MappedFile {
+public:
+    ///////////////////////////////////////////////////////////
+    /// \brief Default constructor
+    ///
+    ///////////////////////////////////////////////////////////
+    MappedFile();
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Open and map a file
+    ///
+    /// \param fname The file path to map
+    ///
+    /// \see open
+    ///
+    ///////////////////////////////////////////////////////////
+    MappedFile(const std::string& fname);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Unmaps the file if it is mapped
+    ///
+    ///////////////////////////////////////////////////////////
+    ~MappedFile();
+
+#ifndef DOXYGEN_SKIP
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+#endif
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Map a file into memory for reading
+    ///
+    /// Any previously mapped file is closed first. The contents
+    /// of the file are paged in by the operating system as they
+    /// are accessed, so opening a large file is cheap.
+    ///
+    /// \param fname The file path to map
+    ///
+    /// \return True if the file was mapped successfully
+    ///
+    ///////////////////////////////////////////////////////////
+    bool open(const std::string& fname);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Unmap the file
+    ///
+    ///////////////////////////////////////////////////////////
+    void close();
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Check if a file is mapped
+    ///
+    ///////////////////////////////////////////////////////////
+    bool isOpen() const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Get a pointer to the start of the mapped file
+    ///
+    /// \return A pointer to the file contents, or NULL if no file is mapped
+    ///
+    ///////////////////////////////////////////////////////////
+    const uint8_t* data() const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Get the size of the mapped file in bytes
+    ///
+    ///////////////////////////////////////////////////////////
+    size_t size() const;
+
+private:
+    const uint8_t* m_data; //!< Start of the mapped memory
+    size_t m_size;         //!< Size of the mapped file in bytes
+    void* m_handle;        //!< Platform file mapping handle (only used on Windows)
+};
+
+} // namespace ply
+
+///////////////////////////////////////////////////////////
+/// \class ply::MappedFile
+/// \ingroup Core
+///
+/// MappedFile maps a whole file into the address space of the
+/// process with mmap() (or a file mapping on Windows), so that
+/// large binary files can be read without first copying them
+/// into a separate buffer.
+///
+/// Usage example:
+/// \code
+///
+/// using namespace ply;
+///
+/// MappedFile file;
+/// if (file.open("level.bin")) {
+///     const uint8_t* data = file.data();
+///     size_t size = file.size();
+///     ...
+/// }
+///
+/// \endcode
+///
+///////////////////////////////////////////////////////////
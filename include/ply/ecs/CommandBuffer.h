@@ -0,0 +1,175 @@
+#pragma once
+
+#include <ply/ecs/Types.h>
+
+#include <cstdint>
+#include <typeindex>
+#include <vector>
+
+namespace ply {
+
+class EntityBuilder;
+
+namespace priv {
+    ///////////////////////////////////////////////////////////
+    /// \brief Structural changes recorded by a single thread
+    ///
+    /// Entity creation, removal, and component changes that can't be
+    /// applied immediately are recorded here, and applied by the world
+    /// at the end of the tick. Each thread records into its own buffer,
+    /// so recording doesn't need any locks. Component payloads are
+    /// copied into a linear arena that is reset after each tick.
+    ///
+    ///////////////////////////////////////////////////////////
+    class CommandBuffer {
+    public:
+        ///////////////////////////////////////////////////////////
+        /// \brief A deferred entity creation
+        ///////////////////////////////////////////////////////////
+        struct Create {
+            EntityBuilder* m_builder; //!< Builder that owns the entity components
+            uint32_t m_order;         //!< Order of the system that recorded the command
+        };
+
+        ///////////////////////////////////////////////////////////
+        /// \brief A deferred entity removal
+        ///////////////////////////////////////////////////////////
+        struct Remove {
+            EntityId m_id;    //!< Entity to remove
+            uint32_t m_order; //!< Order of the system that recorded the command
+        };
+
+        ///////////////////////////////////////////////////////////
+        /// \brief A deferred component addition or removal
+        ///////////////////////////////////////////////////////////
+        struct Change {
+            EntityId m_id;          //!< Entity that is changing
+            std::type_index m_type; //!< Type of component
+            void* m_component;      //!< Component to add (stored in the arena) or NULL for remove
+            uint32_t m_size;        //!< Type size
+            uint32_t m_align;       //!< Type alignment
+            uint32_t m_order;       //!< Order of the system that recorded the command
+        };
+
+        ///////////////////////////////////////////////////////////
+        /// \brief A deferred change of the enabled state of an entity
+        ///////////////////////////////////////////////////////////
+        struct Enable {
+            EntityId m_id;     //!< Entity that is enabled or disabled
+            bool m_isEnabled;  //!< The new state of the entity
+            uint32_t m_order;  //!< Order of the system that recorded the command
+        };
+
+        static constexpr uint32_t NO_SYSTEM = 0xFFFFFFFF; //!< Order of commands recorded outside of systems
+
+    public:
+        ///////////////////////////////////////////////////////////
+        /// \brief Default constructor
+        ///////////////////////////////////////////////////////////
+        CommandBuffer();
+
+        ///////////////////////////////////////////////////////////
+        /// \brief Destructor, discards all unapplied commands
+        ///////////////////////////////////////////////////////////
+        ~CommandBuffer();
+
+#ifndef DOXYGEN_SKIP
+        CommandBuffer(const CommandBuffer&) = delete;
+        CommandBuffer& operator=(const CommandBuffer&) = delete;
+#endif
+
+        ///////////////////////////////////////////////////////////
+        /// \brief Record an entity creation
+        ///
+        /// \param builder A heap allocated builder, owned by the buffer until the command is applied
+        /// \param order The order of the recording system
+        ///
+        ///////////////////////////////////////////////////////////
+        void create(EntityBuilder* builder, uint32_t order);
+
+        ///////////////////////////////////////////////////////////
+        /// \brief Record an entity removal
+        ///////////////////////////////////////////////////////////
+        void remove(EntityId id, uint32_t order);
+
+        ///////////////////////////////////////////////////////////
+        /// \brief Record a component addition
+        ///
+        /// The component is copied into the buffer's arena.
+        ///
+        ///////////////////////////////////////////////////////////
+        void addComponent(
+            EntityId id,
+            std::type_index type,
+            const void* component,
+            size_t size,
+            size_t align,
+            uint32_t order
+        );
+
+        ///////////////////////////////////////////////////////////
+        /// \brief Record a component removal
+        ///////////////////////////////////////////////////////////
+        void removeComponent(EntityId id, std::type_index type, uint32_t order);
+
+        ///////////////////////////////////////////////////////////
+        /// \brief Record enabling or disabling an entity
+        ///////////////////////////////////////////////////////////
+        void setEnabled(EntityId id, bool enabled, uint32_t order);
+
+        ///////////////////////////////////////////////////////////
+        /// \brief Check if there are no recorded commands
+        ///////////////////////////////////////////////////////////
+        bool empty() const;
+
+        ///////////////////////////////////////////////////////////
+        /// \brief Remove all commands and reset the arena
+        ///
+        /// Builders of unapplied creations are deleted.
+        ///
+        ///////////////////////////////////////////////////////////
+        void clear();
+
+        ///////////////////////////////////////////////////////////
+        /// \brief Get the recorded entity creations
+        ///
+        /// The world takes ownership of the builders, and clears the list.
+        ///
+        ///////////////////////////////////////////////////////////
+        std::vector<Create>& getCreates();
+
+        ///////////////////////////////////////////////////////////
+        /// \brief Get the recorded entity removals
+        ///////////////////////////////////////////////////////////
+        std::vector<Remove>& getRemoves();
+
+        ///////////////////////////////////////////////////////////
+        /// \brief Get the recorded component changes
+        ///////////////////////////////////////////////////////////
+        std::vector<Change>& getChanges();
+
+        ///////////////////////////////////////////////////////////
+        /// \brief Get the recorded enabled state changes
+        ///////////////////////////////////////////////////////////
+        std::vector<Enable>& getEnables();
+
+    private:
+        ///////////////////////////////////////////////////////////
+        /// \brief Allocate aligned memory from the arena
+        ///////////////////////////////////////////////////////////
+        void* allocate(size_t size, size_t align);
+
+        static constexpr size_t BLOCK_SIZE = 64 * 1024; //!< Size of arena blocks
+
+    private:
+        std::vector<Create> m_creates; //!< Recorded entity creations
+        std::vector<Remove> m_removes; //!< Recorded entity removals
+        std::vector<Change> m_changes; //!< Recorded component changes
+        std::vector<Enable> m_enables; //!< Recorded enabled state changes
+        std::vector<void*> m_blocks;   //!< Arena blocks (the last one is being filled)
+        size_t m_offset;               //!< Offset of the next allocation in the last block
+        size_t m_blockSize;            //!< Size of the last block
+    };
+} // namespace priv
+
+} // namespace ply
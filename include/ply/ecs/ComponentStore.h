@@ -1,6 +1,13 @@
 #pragma once
 
+#include <ply/ecs/Types.h>
+
 #include <cstdint>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <typeindex>
+#include <vector>
 
 namespace ply {
 
@@ -8,6 +15,12 @@ namespace priv {
     ///////////////////////////////////////////////////////////
     /// \brief Array similar to std::vector but untyped
     ///
+    /// The array is aligned to at least COMPONENT_ARRAY_ALIGN bytes.
+    ///
+    /// An array with a type size of 0 holds a tag type. Tag arrays
+    /// allocate nothing and only count their elements, so that they
+    /// can still track changes per chunk.
+    ///
     ///////////////////////////////////////////////////////////
     class ComponentStore {
     public:
@@ -49,6 +62,20 @@ namespace priv {
         ///////////////////////////////////////////////////////////
         void* push(const void* data, size_t instances);
 
+        ///////////////////////////////////////////////////////////
+        /// \brief Add a contiguous array of elements to the end of the array
+        ///
+        /// Copies all elements with a single memcpy(), so types with custom
+        /// copy constructors are not allowed.
+        ///
+        /// \param data A pointer to the first element to add
+        /// \param count The number of elements to add
+        ///
+        /// \return A pointer to the beggining of the added data
+        ///
+        ///////////////////////////////////////////////////////////
+        void* append(const void* data, size_t count);
+
         ///////////////////////////////////////////////////////////
         /// \brief Remove the element at the given index using a swap-pop
         ///
@@ -60,9 +87,24 @@ namespace priv {
         ///////////////////////////////////////////////////////////
         void remove(size_t index);
 
+        ///////////////////////////////////////////////////////////
+        /// \brief Set the number of elements in the array
+        ///
+        /// When growing, the new elements are left uninitialized. When
+        /// shrinking, the trailing elements are discarded without freeing
+        /// the reserved memory.
+        ///
+        /// \param size The new number of elements
+        ///
+        ///////////////////////////////////////////////////////////
+        void resize(size_t size);
+
         ///////////////////////////////////////////////////////////
         /// \brief Get pointer to data at the specified index
         ///
+        /// Tag arrays return the same pointer for every index, which
+        /// is valid for up to ENTITY_CHUNK_SIZE elements.
+        ///
         /// \param index The index of the element to get
         ///
         /// \return A pointer to the data
@@ -78,12 +120,70 @@ namespace priv {
         ///////////////////////////////////////////////////////////
         void reserve(size_t size);
 
+        ///////////////////////////////////////////////////////////
+        /// \brief Release reserved space that isn't used by elements
+        ///
+        /// The array is reallocated to fit its elements (with a small
+        /// minimum), so pointers to elements are invalidated.
+        ///
+        /// \return The number of bytes released
+        ///
+        ///////////////////////////////////////////////////////////
+        size_t shrinkToFit();
+
         ///////////////////////////////////////////////////////////
         /// \brief Get the number of elements in array
         ///
         ///////////////////////////////////////////////////////////
         size_t size() const;
 
+        ///////////////////////////////////////////////////////////
+        /// \brief Get the number of elements space is reserved for
+        ///
+        ///////////////////////////////////////////////////////////
+        size_t capacity() const;
+
+        ///////////////////////////////////////////////////////////
+        /// \brief Mark a range of elements as changed
+        ///
+        /// Change tracking is done per chunk of ENTITY_CHUNK_SIZE elements,
+        /// so every chunk that overlaps the range is stamped.
+        ///
+        /// \param index The index of the first changed element
+        /// \param count The number of changed elements
+        /// \param tick The change tick to stamp the chunks with
+        ///
+        ///////////////////////////////////////////////////////////
+        void markChanged(size_t index, size_t count, uint32_t tick);
+
+        ///////////////////////////////////////////////////////////
+        /// \brief Mark a range of elements as newly added
+        ///
+        /// Added elements are also marked as changed.
+        ///
+        /// \param index The index of the first added element
+        /// \param count The number of added elements
+        /// \param tick The change tick to stamp the chunks with
+        ///
+        ///////////////////////////////////////////////////////////
+        void markAdded(size_t index, size_t count, uint32_t tick);
+
+        ///////////////////////////////////////////////////////////
+        /// \brief Get the tick of the last change to a chunk
+        ///
+        /// \param chunk The index of the chunk
+        ///
+        ///////////////////////////////////////////////////////////
+        uint32_t getChangedTick(size_t chunk) const;
+
+        ///////////////////////////////////////////////////////////
+        /// \brief Get the tick of the last addition to a chunk
+        ///
+        /// \param chunk The index of the chunk
+        ///
+        ///////////////////////////////////////////////////////////
+        uint32_t getAddedTick(size_t chunk) const;
+
         ///////////////////////////////////////////////////////////
         /// \brief Get the size of elements in array
         ///
@@ -96,12 +196,78 @@ namespace priv {
         ///////////////////////////////////////////////////////////
         size_t getTypeAlign() const;
 
+        ///////////////////////////////////////////////////////////
+        /// \brief Check if the array holds a tag type, which has no data
+        ///
+        ///////////////////////////////////////////////////////////
+        bool isTag() const;
+
+    private:
+        ///////////////////////////////////////////////////////////
+        /// \brief Change ticks of a single chunk
+        ///////////////////////////////////////////////////////////
+        struct ChunkTicks {
+            uint32_t m_added;   //!< Tick of the last time elements were added
+            uint32_t m_changed; //!< Tick of the last time elements were changed
+        };
+
+        ///////////////////////////////////////////////////////////
+        /// \brief Make sure there is space for the given number of elements,
+        /// doubling capacity as needed
+        ///////////////////////////////////////////////////////////
+        void grow(size_t required);
+
+        ///////////////////////////////////////////////////////////
+        /// \brief Resize the chunk tick list to match the number of elements
+        ///////////////////////////////////////////////////////////
+        void updateChunks();
+
     private:
         uint8_t* m_start;   //!< Start of array
         uint8_t* m_last;    //!< Last element in array
         uint8_t* m_end;     //!< End of reserved memory
         size_t m_typeSize;  //!< Size of type this array holds
         size_t m_typeAlign; //!< ALign of type this array holds
+        size_t m_numTags;   //!< Number of elements, only used by tag arrays
+        std::vector<ChunkTicks> m_chunkTicks; //!< Change ticks for each chunk of elements
+    };
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Get the size a component type is stored with
+    ///
+    /// Empty types are tags, they are part of the group signature
+    /// of entities but are stored with a size of 0.
+    ///
+    ///////////////////////////////////////////////////////////
+    template <typename C> constexpr uint32_t getComponentSize() {
+        return std::is_empty_v<C> ? 0 : (uint32_t)sizeof(C);
+    }
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Pointer based access to a component array
+    ///
+    /// Tags have no data, so their columns hold no pointer and
+    /// every index refers to the same instance.
+    ///
+    ///////////////////////////////////////////////////////////
+    template <typename C, bool = std::is_empty_v<C>> struct ComponentColumn {
+        ComponentColumn(void* data) : m_data((C*)data) {}
+
+        C& operator[](size_t index) const {
+            return m_data[index];
+        }
+
+        C* m_data; //!< Start of the component array
+    };
+
+    template <typename C> struct ComponentColumn<C, true> {
+        ComponentColumn(void*) {}
+
+        C& operator[](size_t) const {
+            return s_tag;
+        }
+
+        inline static C s_tag; //!< The instance passed for every entity
     };
 
     ///////////////////////////////////////////////////////////
@@ -113,6 +279,44 @@ namespace priv {
         uint32_t m_align; //!< Align of component type
     };
 
+    ///////////////////////////////////////////////////////////
+    /// \brief Information about a registered component type
+    ///////////////////////////////////////////////////////////
+    struct ComponentTypeInfo {
+        std::type_index m_type; //!< The component type
+        uint32_t m_size;        //!< Size of component type
+        uint32_t m_align;       //!< Align of component type
+    };
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Register a component type so that it can be found by name
+    ///
+    /// Saved data identifies component types by their type name, which
+    /// is stable between runs of the same build of a program.
+    ///
+    ///////////////////////////////////////////////////////////
+    void registerComponentType(std::type_index type, uint32_t size, uint32_t align);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Register a component type, only the first call for each type
+    /// does any work
+    ///////////////////////////////////////////////////////////
+    template <typename C> void registerComponentType() {
+        static const bool registered =
+            (registerComponentType(typeid(C), getComponentSize<C>(), alignof(C)), true);
+        (void)registered;
+    }
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Find a registered component type by its type name
+    ///
+    /// \param name The name returned by std::type_index::name()
+    ///
+    /// \return The type info, or an empty optional if the type is not registered
+    ///
+    ///////////////////////////////////////////////////////////
+    std::optional<ComponentTypeInfo> findComponentType(const std::string& name);
+
 } // namespace priv
 
 } // namespace ply
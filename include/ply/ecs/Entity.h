@@ -85,6 +85,11 @@ public:
     /// The entity must have the component, or undefined behavior
     /// will occur. Use has<C>() to check first if unsure.
     ///
+    /// Non-const access marks the component's chunk as changed, which is
+    /// visible to changed() query filters. Use get<const C>() for read only
+    /// access that doesn't count as a change. Shared components can only be
+    /// read this way, since their value is shared by the entity's group.
+    ///
     /// \tparam C The component type to retrieve
     /// \return A reference to requested component
     ///
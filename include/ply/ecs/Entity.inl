@@ -11,7 +11,15 @@ template <ComponentType C> bool Entity::has() const {
     CHECK_F(m_group != nullptr, "entity is invalid");
 
     auto it = m_group->m_components.find(typeid(C));
-    return it != m_group->m_components.end() && it.value().data(m_index) != nullptr;
+    if (it != m_group->m_components.end())
+        return it.value().data(m_index) != nullptr;
+
+    if (m_group->m_shared.contains(typeid(C)))
+        return true;
+
+    // Check sparse storage
+    priv::SparseSet* sparse = m_world->findSparseSet(typeid(C));
+    return sparse && sparse->contains(m_id);
 }
 
 ///////////////////////////////////////////////////////////
@@ -19,8 +27,32 @@ template <ComponentType C> C& Entity::get() const {
     CHECK_F(m_group != nullptr, "entity is invalid");
 
     auto it = m_group->m_components.find(typeid(C));
-    auto ptr = it != m_group->m_components.end() ? (C*)it.value().data(m_index) : nullptr;
+    if (it == m_group->m_components.end()) {
+        // Shared components have one value for the whole group, which can't be modified in place
+        auto sharedIt = m_group->m_shared.find(typeid(C));
+        if (sharedIt != m_group->m_shared.end()) {
+            CHECK_F(std::is_const_v<C>, "shared component %s can only be accessed as const", typeid(C).name());
+            return *(C*)sharedIt.value().data();
+        }
+
+        // Check sparse storage
+        priv::SparseSet* sparse = m_world->findSparseSet(typeid(C));
+        auto ptr = sparse ? (C*)sparse->get(m_id) : nullptr;
+        CHECK_F(ptr != nullptr, "component %s not found", typeid(C).name());
+
+        if constexpr (!std::is_const_v<C>)
+            sparse->markChanged(m_id, m_world->nextChangeTick());
+
+        return *ptr;
+    }
+
+    auto ptr = (C*)it.value().data(m_index);
     CHECK_F(ptr != nullptr, "component %s not found", typeid(C).name());
+
+    // Non-const access counts as a change
+    if constexpr (!std::is_const_v<C>)
+        it.value().markChanged(m_index, 1, m_world->nextChangeTick());
+
     return *ptr;
 }
 
@@ -31,9 +63,7 @@ template <ComponentType C> void Entity::add(const C& component) {
     m_world->addComponent(m_id, component);
 
     // Group probably changed, update it
-    ReadLock lock(m_world->m_groupsMutex);
-    auto groupId = m_world->m_entities[m_id].m_group;
-    m_group = m_world->m_groups[groupId].get();
+    m_group = m_world->m_entities[m_id].m_group;
     m_group->m_mutex.lock_shared();
 }
 
@@ -44,9 +74,7 @@ template <ComponentType C> void Entity::remove() {
     m_world->removeComponent<C>(m_id);
 
     // Group probably changed, update it
-    ReadLock lock(m_world->m_groupsMutex);
-    auto groupId = m_world->m_entities[m_id].m_group;
-    m_group = m_world->m_groups[groupId].get();
+    m_group = m_world->m_entities[m_id].m_group;
     m_group->m_mutex.lock_shared();
 }
 
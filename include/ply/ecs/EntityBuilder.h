@@ -6,6 +6,9 @@
 #include <ply/ecs/ComponentStore.h>
 #include <ply/ecs/Types.h>
 
+#include <algorithm>
+#include <functional>
+#include <mutex>
 #include <typeindex>
 
 namespace ply {
@@ -60,6 +63,9 @@ class EntityBuilder {
     ///////////////////////////////////////////////////////////
     /// \brief Add tag to entity creation
     ///
+    /// Tags are empty types. They only change which group the
+    /// entity is placed in, and take no memory per entity.
+    ///
     ///	\param tag The tag to add
     ///
     /// \return The builder to chain commands
@@ -96,6 +102,10 @@ class EntityBuilder {
     /// If the first parameter of the function is an integer type,
     /// then the index of the entity within the batch will be provided.
     ///
+    /// If creation has to be deferred, the function is stored and invoked
+    /// when the entities are created during the next call to World::tick(),
+    /// and the returned ids are reserved until then.
+    ///
     /// \param onCreate The function that gets invoked for each created entity
     /// \param num The number of copies of the entity to create
     ///
@@ -108,6 +118,9 @@ class EntityBuilder {
     template <typename Func>
     std::vector<EntityId> create(Func&& onCreate, uint32_t num = 1);
 
+  private:
+    using CreateFn = std::function<void(const HashMap<std::type_index, void*>&, uint32_t)>;
+
   private:
     ///////////////////////////////////////////////////////////
     /// \brief Actual templated create implementation
@@ -127,6 +140,35 @@ class EntityBuilder {
         bool allowDefer = true
     );
 
+    ///////////////////////////////////////////////////////////
+    /// \brief Check that none of the types initialized in onCreate are shared
+    ///////////////////////////////////////////////////////////
+    void checkNotShared(const std::vector<std::type_index>& types) const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Add an array of component values, one for each entity
+    /// (used by World::spawn)
+    ///////////////////////////////////////////////////////////
+    void addColumn(std::type_index type, const void* data, uint32_t size, uint32_t align);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Add a copy of the builder to the world's creation queue
+    ///
+    /// \return The ids reserved for the entities
+    ///
+    ///////////////////////////////////////////////////////////
+    std::vector<EntityId> deferCreate(uint32_t num);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Replace component data with copies owned by the builder
+    ///////////////////////////////////////////////////////////
+    void copyComponents();
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Free component data owned by the builder
+    ///////////////////////////////////////////////////////////
+    void freeComponents();
+
     ///////////////////////////////////////////////////////////
     /// \brief Send entity event
     ///////////////////////////////////////////////////////////
@@ -142,9 +184,14 @@ class EntityBuilder {
         m_components;     //!< Map of component types to their instantiated data
     uint32_t m_numCreate; //!< Number of entities to create (used for deferred
                           //!< creation)
+    CreateFn m_onCreate;  //!< Per entity init function (kept for deferred creation)
+    std::vector<EntityId> m_ids; //!< Ids reserved for deferred creation
+    bool m_isSpawn;       //!< Component data are arrays of m_numCreate values
+    bool m_ownsColumns;   //!< Spawn arrays are owned copies rather than caller memory
 
     static HashMap<std::type_index, ObjectPool>
         s_pools; //!< Map of component types to their temp allocator
+    static std::mutex s_poolMutex; //!< Protects the temp allocators (builders are used from worker threads)
 };
 
 } // namespace ply
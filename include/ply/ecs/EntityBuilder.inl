@@ -11,19 +11,33 @@ namespace ply {
 ///////////////////////////////////////////////////////////
 template <ComponentType C> EntityBuilder& EntityBuilder::add(const C& component) {
     CHECK_F(VALID_COMPONENT_TYPE(C), "component type %s is not valid", typeid(C).name());
+    priv::registerComponentType<C>();
 
     std::type_index tid = typeid(C);
     auto it = m_components.find(tid);
 
     // Only add if not added
     if (it == m_components.end()) {
-        // Create pool allocator if needed
-        auto poolIt = s_pools.find(tid);
-        if (poolIt == s_pools.end())
-            poolIt = s_pools.emplace(std::make_pair(tid, ObjectPool(sizeof(C), 64))).first;
-
-        // Allocate temp component
-        C* ptr = (C*)poolIt.value().alloc();
+        // Tags have no data to allocate
+        if constexpr (std::is_empty_v<C>) {
+            m_components[tid] = priv::ComponentMetadata({nullptr, 0, alignof(C)});
+            return *this;
+        }
+
+        C* ptr = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(s_poolMutex);
+
+            // Create pool allocator if needed (slots hold the free list pointer when unused)
+            auto poolIt = s_pools.find(tid);
+            if (poolIt == s_pools.end()) {
+                uint32_t size = (uint32_t)std::max(sizeof(C), sizeof(void*));
+                poolIt = s_pools.emplace(std::make_pair(tid, ObjectPool(size, 64))).first;
+            }
+
+            // Allocate temp component
+            ptr = (C*)poolIt.value().alloc();
+        }
         *ptr = component;
 
         // Save data
@@ -33,6 +47,12 @@ template <ComponentType C> EntityBuilder& EntityBuilder::add(const C& component)
     return *this;
 }
 
+///////////////////////////////////////////////////////////
+template <ComponentType T> EntityBuilder& EntityBuilder::tag(const T& tag) {
+    static_assert(std::is_empty_v<T>, "tags must be empty types");
+    return add(tag);
+}
+
 ///////////////////////////////////////////////////////////
 template <typename Func>
 std::vector<EntityId> EntityBuilder::create(Func&& onCreate, uint32_t num) {
@@ -76,23 +96,37 @@ EntityBuilder::templateCreateImpl(Func&& onCreate, uint32_t num, type_wrapper<st
                 "entity: %s",
                 reqTypeIds[i].name()
             );
+
+        checkNotShared(reqTypeIds);
     }
 
+    // Store init function so that it can be invoked if creation gets deferred
+    m_onCreate = [onCreate = std::forward<Func>(onCreate)](
+                     const HashMap<std::type_index, void*>& ptrs, uint32_t num
+                 ) mutable {
+        // Create tuple bc it should be a little faster to access
+        Tuple<priv::ComponentColumn<Cs>...> tuple(priv::ComponentColumn<Cs>(ptrs.find(typeid(Cs)).value())...);
+
+        // Call function for each instance
+        for (uint32_t i = 0; i < num; ++i) {
+            if constexpr (std::is_integral_v<FirstParamType>)
+                onCreate(i, tuple.template get<priv::ComponentColumn<Cs>>()[i]...);
+            else
+                onCreate(tuple.template get<priv::ComponentColumn<Cs>>()[i]...);
+        }
+    };
+
     // Create
     HashMap<std::type_index, void*> ptrs;
-    // Create (can't allow defered bc no way to store function)
-    std::vector<EntityId> ids = createImpl(num, ptrs, false);
+    std::vector<EntityId> ids = createImpl(num, ptrs);
 
-    // Create tuple bc it should be a little faster to access
-    Tuple<Cs*...> tuple((Cs*)ptrs.find(typeid(Cs)).value()...);
+    // Deferred creation moves the builder to the queue, along with the function
+    if (!m_world || ids.empty())
+        return ids;
 
     // Call function for each instance
-    for (uint32_t i = 0; i < num; ++i) {
-        if constexpr (std::is_integral_v<FirstParamType>)
-            onCreate(i, tuple.template get<Cs*>()[i]...);
-        else
-            onCreate(tuple.template get<Cs*>()[i]...);
-    }
+    m_onCreate(ptrs, num);
+    m_onCreate = nullptr;
 
     // Send add event
     sendEvent(ids, ptrs);
@@ -5,28 +5,190 @@
 #include <ply/ecs/ComponentStore.h>
 #include <ply/ecs/Types.h>
 
+#include <bit>
 #include <typeindex>
+#include <vector>
 
 namespace ply {
 
+class Observer;
+
+namespace priv {
+    ///////////////////////////////////////////////////////////
+    /// \brief Enter or exit events of an observer for a single group
+    ///
+    /// Entities that enter or exit the group through component changes
+    /// are collected here, and sent to the observer in one batch during
+    /// the world tick.
+    ///
+    ///////////////////////////////////////////////////////////
+    struct ObserverBatch {
+        Observer* m_observer; //!< The observer the events are sent to
+        std::vector<ComponentStore*>
+            m_columns; //!< Component array of each observer parameter, or NULL if the group doesn't have it
+        std::vector<EntityId> m_ids; //!< Entities with pending events
+        std::vector<ComponentStore>
+            m_data; //!< Copies of the components of exited entities, one array per parameter
+    };
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Map of component arrays of an entity group
+    ///
+    /// Queries, systems, and observers keep pointers to the arrays
+    /// of the groups they match, so the set of arrays is fixed when
+    /// the group is created. Arrays can be modified, but none can be
+    /// added or removed, so the map is never rehashed.
+    ///
+    ///////////////////////////////////////////////////////////
+    class ComponentMap {
+    public:
+        typedef HashMap<std::type_index, ComponentStore> Map;
+        typedef Map::iterator iterator;
+        typedef Map::const_iterator const_iterator;
+
+        ComponentMap() = default;
+
+        explicit ComponentMap(Map&& map) : m_map(std::move(map)) {}
+
+        ComponentMap(const ComponentMap&) = delete;
+        ComponentMap& operator=(const ComponentMap&) = delete;
+
+        iterator begin() { return m_map.begin(); }
+        iterator end() { return m_map.end(); }
+        const_iterator begin() const { return m_map.begin(); }
+        const_iterator end() const { return m_map.end(); }
+
+        iterator find(std::type_index type) { return m_map.find(type); }
+        const_iterator find(std::type_index type) const { return m_map.find(type); }
+
+        ComponentStore& at(std::type_index type) { return m_map.at(type); }
+        const ComponentStore& at(std::type_index type) const { return m_map.at(type); }
+
+        bool contains(std::type_index type) const { return m_map.contains(type); }
+        size_t size() const { return m_map.size(); }
+        bool empty() const { return m_map.empty(); }
+
+    private:
+        Map m_map; //!< The component arrays, keyed by component type
+    };
+}
+
 ///////////////////////////////////////////////////////////
 /// \brief Container structure for entities with the same set of components
 ///
 ///////////////////////////////////////////////////////////
 struct EntityGroup {
+    ///////////////////////////////////////////////////////////
+    /// \brief Create a group with a fixed set of component arrays
+    ///
+    /// \param id The id of the group
+    /// \param components The component arrays, one per non-shared component type
+    /// \param shared The values of shared components, one element each
+    ///
+    ///////////////////////////////////////////////////////////
+    EntityGroup(EntityGroupId id, priv::ComponentMap::Map&& components, priv::ComponentMap::Map&& shared);
+
     EntityGroupId m_id;  //!< The id of the group
     SharedMutex m_mutex; //!< Mutex protecting access to entity group
-    HashMap<std::type_index, priv::ComponentStore>
-        m_components;                 //!< The set of components entities of this group have
+    priv::ComponentMap m_components;  //!< The set of components entities of this group have
+    priv::ComponentMap m_shared;      //!< Values of shared components, one element each
     std::vector<EntityId> m_entities; //!< A list of entity ids in this group that matches the order
                                       //!< their components appear in the component arrays
-    std::vector<EntityId> m_removeQueue; //!< List of entity handles to remove from this group
+    std::vector<priv::ObserverBatch>
+        m_enterObservers; //!< OnEnter observers that match the group, with their pending events
+    std::vector<priv::ObserverBatch>
+        m_exitObservers;          //!< OnExit observers that match the group, with their pending events
+    std::vector<uint64_t> m_disabled; //!< Bitmask of disabled entities, one bit per row (rows past the end are enabled)
+    uint32_t m_numDisabled = 0;       //!< Number of disabled entities in the group
+    bool m_hasPendingEvents = false; //!< Are there observer events waiting for the next tick
 };
 
+namespace priv {
+    ///////////////////////////////////////////////////////////
+    /// \brief Check if the entity at a row of a group is disabled
+    ///////////////////////////////////////////////////////////
+    inline bool isRowDisabled(const EntityGroup& group, size_t row) {
+        size_t word = row / 64;
+        return word < group.m_disabled.size() && (group.m_disabled[word] >> (row % 64) & 1);
+    }
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Set the disabled bit of a row of a group
+    ///////////////////////////////////////////////////////////
+    void setRowDisabled(EntityGroup& group, size_t row, bool disabled);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Update the disabled bits after a swap-pop removal
+    ///
+    /// The last row was moved into the removed row, and the entity
+    /// list has already been popped, so the moved row is at the
+    /// entity list's size.
+    ///
+    ///////////////////////////////////////////////////////////
+    void swapPopDisabled(EntityGroup& group, size_t row);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Split a range of rows into runs of enabled entities
+    ///
+    /// The disabled bits are tested 64 rows at a time, and disabled
+    /// rows are skipped with a count of trailing zeros. Groups without
+    /// disabled entities get a single call with the whole range.
+    ///
+    /// \param fn Function called with the first and past the end row of each run
+    ///
+    ///////////////////////////////////////////////////////////
+    template <typename Func>
+    void forEachEnabledRun(const EntityGroup& group, size_t start, size_t end, Func&& fn) {
+        if (group.m_numDisabled == 0) {
+            if (start < end)
+                fn(start, end);
+            return;
+        }
+
+        const std::vector<uint64_t>& disabled = group.m_disabled;
+        size_t runStart = start;
+        for (size_t i = start; i < end;) {
+            size_t word = i / 64;
+            uint64_t bits = word < disabled.size() ? disabled[word] >> (i % 64) : 0;
+
+            // Rest of the word is enabled
+            if (bits == 0) {
+                i = (word + 1) * 64;
+                continue;
+            }
+
+            // Flush the run before the first disabled row
+            size_t first = i + std::countr_zero(bits);
+            if (first >= end)
+                break;
+            if (runStart < first)
+                fn(runStart, first);
+
+            // Skip the disabled rows
+            uint64_t enabled = ~disabled[word] >> (first % 64);
+            i = enabled ? first + std::countr_zero(enabled) : (word + 1) * 64;
+            runStart = i;
+        }
+
+        if (runStart < end)
+            fn(runStart, end);
+    }
+}
+
 ///////////////////////////////////////////////////////////
 /// \brief Get hash from a list of type indexes
 ///
 ///////////////////////////////////////////////////////////
 EntityGroupId entityGroupHash(const std::vector<std::type_index>& ids);
 
+///////////////////////////////////////////////////////////
+/// \brief Get hash of the value of a shared component
+///
+/// Groups are also identified by the values of their shared
+/// components, so this is added to the hash of the type list.
+/// Values are compared bytewise.
+///
+///////////////////////////////////////////////////////////
+EntityGroupId sharedValueHash(std::type_index type, const void* data, size_t size);
+
 } // namespace ply
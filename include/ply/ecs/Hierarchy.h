@@ -0,0 +1,135 @@
+#pragma once
+
+#include <ply/components/Spatial.h>
+#include <ply/ecs/Query.h>
+#include <ply/math/Types.h>
+
+#include <atomic>
+#include <vector>
+
+namespace ply {
+
+class Observer;
+class Scheduler;
+class World;
+
+///////////////////////////////////////////////////////////
+/// \brief Computes world transforms of a scene hierarchy
+///
+///////////////////////////////////////////////////////////
+class Hierarchy {
+public:
+    ///////////////////////////////////////////////////////////
+    /// \brief Create a hierarchy for the entities of a world
+    ///
+    /// \param world The world containing the entities
+    /// \param scheduler The scheduler used to update levels in parallel (optional)
+    ///
+    ///////////////////////////////////////////////////////////
+    Hierarchy(World* world, Scheduler* scheduler = nullptr);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Destructor
+    ///
+    ///////////////////////////////////////////////////////////
+    ~Hierarchy();
+
+#ifndef DOXYGEN_SKIP
+    Hierarchy(const Hierarchy&) = delete;
+    Hierarchy& operator=(const Hierarchy&) = delete;
+#endif
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Update the world transforms of all entities in the hierarchy
+    ///
+    /// Only subtrees that contain changed Transform components are
+    /// recomputed. The node list is rebuilt after World::restoreState().
+    /// This should be called outside of World::tick(), because it waits
+    /// on the scheduler.
+    ///
+    ///////////////////////////////////////////////////////////
+    void update();
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Get the children of an entity, as of the last update
+    ///
+    ///////////////////////////////////////////////////////////
+    std::vector<EntityId> getChildren(EntityId id) const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Get the depth of an entity, as of the last update
+    ///
+    /// \return The depth, where roots have a depth of 0
+    ///
+    ///////////////////////////////////////////////////////////
+    uint32_t getDepth(EntityId id) const;
+
+    static constexpr uint32_t INVALID_NODE = 0xFFFFFFFF; //!< Node index of missing entities
+
+private:
+    ///////////////////////////////////////////////////////////
+    /// \brief Rebuild the depth sorted node list
+    ///////////////////////////////////////////////////////////
+    void rebuild();
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Compute the world transforms of a range of nodes in a single level
+    ///////////////////////////////////////////////////////////
+    void updateNodes(size_t start, size_t end);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Get the node index of an entity
+    ///////////////////////////////////////////////////////////
+    uint32_t getNode(EntityId id) const;
+
+private:
+    World* m_world;                      //!< The world containing the entities
+    Scheduler* m_scheduler;              //!< Scheduler used to update levels in parallel
+    Query m_roots;                       //!< Entities in the hierarchy without a parent
+    Query m_children;                    //!< Entities in the hierarchy with a parent
+    Query m_parentChanges;               //!< Entities whose parent component changed
+    Query m_localChanges;                //!< Entities whose local transform changed
+    Query m_outputs;                     //!< Entities to write world transforms to
+    std::vector<Observer*> m_observers;  //!< Observers that detect structural changes
+    std::atomic<bool> m_isDirty;         //!< Does the node list need to be rebuilt
+    uint32_t m_numRestores;              //!< Restore count of the world at the last update
+
+    std::vector<EntityId> m_entities;    //!< Entity of each node, sorted by depth
+    std::vector<uint32_t> m_parents;     //!< Parent node index of each node, or INVALID_NODE
+    std::vector<uint32_t> m_levels;      //!< First node of each level, followed by the node count
+    std::vector<uint32_t> m_nodes;       //!< Node index of each entity, by handle index
+    std::vector<Matrix4f> m_local;       //!< Local transform matrix of each node
+    std::vector<Matrix4f> m_transforms;  //!< World transform matrix of each node
+    std::vector<uint8_t> m_changed;      //!< Has the world transform of each node changed
+};
+
+} // namespace ply
+
+///////////////////////////////////////////////////////////
+/// \class ply::Hierarchy
+/// \ingroup ECS
+///
+/// Entities with Transform and WorldTransform components form a scene
+/// hierarchy, where entities with a Parent component are positioned
+/// relative to their parent. The hierarchy keeps its own copy of the
+/// entities sorted by depth (siblings are next to each other, and
+/// parents always come before their children), so world transforms
+/// are computed with linear passes over contiguous arrays, one level
+/// at a time. Each level is split across the scheduler's workers.
+///
+/// Usage example:
+/// \code
+/// ply::Hierarchy hierarchy(&world, &scheduler);
+///
+/// EntityId parent = world.entity().add(Transform()).add(WorldTransform()).create()[0];
+/// world.entity()
+///     .add(Transform())
+///     .add(WorldTransform())
+///     .add(Parent{parent})
+///     .create(10);
+///
+/// // Every frame
+/// world.tick();
+/// hierarchy.update();
+/// \endcode
+///
@@ -12,8 +12,17 @@ class Observer : public QueryBase {
     friend World;
 
 public:
-    using IteratorFn = std::function<
-        void(const std::vector<EntityId>&, const HashMap<std::type_index, void*>&, World*, EntityGroup*, float)>;
+    ///////////////////////////////////////////////////////////
+    /// \brief Typed iterator generated from the each() function
+    ///
+    /// Receives the component pointers of the event's entities in the
+    /// order the function declared its parameters.
+    ///
+    ///////////////////////////////////////////////////////////
+    using IteratorFn =
+        std::function<void(const std::vector<EntityId>&, void* const*, World*, EntityGroup*, float)>;
+
+    static constexpr size_t MAX_COLUMNS = 16; //!< Max number of component parameters
 
 public:
     Observer() = default;
@@ -29,25 +29,27 @@ namespace priv {
 
         return [fn](
                    const std::vector<EntityId>& ids,
-                   const HashMap<std::type_index, void*>& ptrs,
+                   void* const* ptrs,
                    World* world,
                    EntityGroup* group,
                    float dt
                ) {
             // Create tuple bc it should be a little faster to access
-            Tuple<Cs*...> tuple((Cs*)ptrs.find(typeid(Cs)).value()...);
+            auto tuple = [&]<size_t... Is>(std::index_sequence<Is...>) {
+                return Tuple<ComponentColumn<Cs>...>(ComponentColumn<Cs>(ptrs[Is])...);
+            }(std::index_sequence_for<Cs...>{});
 
             // Iterate number of entities, passing each component and id
             for (size_t i = 0; i < ids.size(); ++i) {
                 if constexpr (std::is_same_v<DecayedType, QueryIterator>) {
                     QueryIterator it(ids[i], i, world, group, i, dt);
-                    fn(it, tuple.template get<Cs*>()[i]...);
+                    fn(it, tuple.template get<ComponentColumn<Cs>>()[i]...);
                 } else if constexpr (std::is_same_v<DecayedType, EntityId>)
-                    fn(ids[i], tuple.template get<Cs*>()[i]...);
+                    fn(ids[i], tuple.template get<ComponentColumn<Cs>>()[i]...);
                 else if constexpr (std::is_integral_v<FirstParamType>)
-                    fn(i, tuple.template get<Cs*>()[i]...);
+                    fn(i, tuple.template get<ComponentColumn<Cs>>()[i]...);
                 else
-                    fn(tuple.template get<Cs*>()[i]...);
+                    fn(tuple.template get<ComponentColumn<Cs>>()[i]...);
             }
         };
     }
@@ -70,7 +72,10 @@ template <typename Func> Observer* Observer::each(Func&& fn) {
         typename rest_param_types<std::decay_t<decltype(fn)>>::type,
         typename param_types<std::decay_t<decltype(fn)>>::type>;
 
-    // Create iterator
+    static_assert(std::tuple_size_v<CTypes> <= MAX_COLUMNS, "too many observer parameters");
+
+    // Create iterator, with the parameter types as its columns
+    setColumnTypes(type_wrapper<CTypes>{});
     m_iterator =
         priv::makeObserverIteratorFn(std::forward<Func>(fn), type_wrapper<decayed_tuple_t<CTypes>>{});
 
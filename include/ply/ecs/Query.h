@@ -60,6 +60,28 @@ public:
     ///////////////////////////////////////////////////////////
     template <ComponentType... Cs> QueryFactory& exclude();
 
+    ///////////////////////////////////////////////////////////
+    /// \brief Only iterate entities whose components changed since the last run
+    ///
+    /// The component types are also added to the include type set. Change
+    /// tracking is done per chunk of ENTITY_CHUNK_SIZE entities, so whole
+    /// chunks are skipped when none of their components of the given types
+    /// were accessed mutably since the last time this query ran. Each Query
+    /// returned by compile() keeps its own last run, even when other queries
+    /// were compiled with the same filters.
+    ///
+    ///////////////////////////////////////////////////////////
+    template <ComponentType... Cs> QueryFactory& changed();
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Only iterate entities whose components were added since the last run
+    ///
+    /// The component types are also added to the include type set. Works at
+    /// chunk granularity, the same as changed().
+    ///
+    ///////////////////////////////////////////////////////////
+    template <ComponentType... Cs> QueryFactory& added();
+
     ///////////////////////////////////////////////////////////
     /// \brief Compile the query
     ///
@@ -67,8 +89,7 @@ public:
     Query compile();
 
 private:
-    World* m_world;                      //!< World access to iterate components
-    std::vector<EntityGroupId> m_groups; //!< List of entity groups that match query
+    World* m_world; //!< World access to iterate components
 };
 
 ///////////////////////////////////////////////////////////
@@ -76,26 +97,84 @@ private:
 ///
 ///////////////////////////////////////////////////////////
 class Query {
+    friend World;
+
 public:
-    Query() = default;
+    Query();
     Query(World* world, QueryFactory* factory);
     
     ///////////////////////////////////////////////////////////
     /// \brief Iterate through all components that match query
     ///
+    /// Disabled entities are skipped (see World::setEnabled()).
+    ///
+    /// Shared components can't be parameters, they can be read with
+    /// QueryIterator::get() or iterated with eachChunk().
+    ///
     ///////////////////////////////////////////////////////////
     template <typename Func> void each(Func&& fn);
 
+    ///////////////////////////////////////////////////////////
+    /// \brief Iterate through contiguous runs of matching entities
+    ///
+    /// Instead of once per entity, the function is called once per run
+    /// of entities that are stored next to each other, with a std::span
+    /// over each component array, and optionally a QueryChunk with the
+    /// entity ids and elapsed time as its first parameter. Runs never
+    /// span more than one chunk of ENTITY_CHUNK_SIZE entities, and full
+    /// chunks start on a COMPONENT_ARRAY_ALIGN byte boundary, which
+    /// leaves plain loops over the spans free to be vectorized.
+    ///
+    /// Spans of non-const types are accessed mutably and mark the whole
+    /// run as changed. Sparse components can't be passed as spans, but
+    /// they can still be used as filters. Disabled entities (see
+    /// World::setEnabled()) end a run, so chunks with disabled entities
+    /// are passed as several shorter runs.
+    ///
+    /// Shared components are passed by const reference instead of as a
+    /// span. Every entity of a group has the same value, so runs with
+    /// equal values are iterated one after another, and can be batched
+    /// by the value.
+    ///
+    /// Usage example:
+    /// \code
+    /// query.eachChunk([](QueryChunk chunk, std::span<Position> pos, std::span<const Velocity> vel) {
+    ///     for (size_t i = 0; i < pos.size(); ++i)
+    ///         pos[i].x += vel[i].x * chunk.dt;
+    /// });
+    ///
+    /// // Material has shared storage
+    /// query.eachChunk([&](const Material& material, std::span<const Transform> transforms) {
+    ///     renderer.draw(material, transforms);
+    /// });
+    /// \endcode
+    ///
+    ///////////////////////////////////////////////////////////
+    template <typename Func> void eachChunk(Func&& fn);
+
 private:
     ///////////////////////////////////////////////////////////
     /// \brief Actual iterator implementation
     ///////////////////////////////////////////////////////////
-    template <typename Func, typename... Cs>
-    void iterate(Func&& fn, type_wrapper<std::tuple<Cs...>>);
+    template <typename Func, typename... Ps>
+    void iterate(Func&& fn, type_wrapper<std::tuple<Ps...>>);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Iterator implementation for queries with sparse components
+    ///////////////////////////////////////////////////////////
+    template <typename Func, typename... Ps>
+    void iterateJoined(Func& fn, uint32_t since, uint32_t tick, type_wrapper<std::tuple<Ps...>>);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Chunk iterator implementation, using the types of the function parameters
+    ///////////////////////////////////////////////////////////
+    template <typename Func, typename... Rs>
+    void iterateChunks(Func& fn, type_wrapper<std::tuple<Rs...>>);
 
 private:
     World* m_world;          //!< World pointer used to create new accessors
     QueryFactory* m_factory; //!< Factory used to create new accessors
+    uint32_t m_lastRunTick;  //!< Change tick of the last time this query ran (factories are shared between queries)
 };
 
 } // namespace ply
@@ -5,6 +5,77 @@
 
 namespace ply {
 
+///////////////////////////////////////////////////////////
+namespace priv {
+    ///////////////////////////////////////////////////////////
+    /// \brief Get the argument of a chunk function parameter
+    ///
+    /// Span parameters get the run of components, and other parameters
+    /// get the value of a shared component, which is the same for the
+    /// whole group.
+    ///
+    ///////////////////////////////////////////////////////////
+    template <typename R> decltype(auto) getChunkArg(ComponentStore* store, size_t start, size_t count) {
+        using T = std::remove_cvref_t<R>;
+        using C = std::remove_reference_t<span_param_t<R>>;
+
+        if constexpr (std::is_same_v<span_param_t<R>, const T&>)
+            return *(const T*)store->data();
+        else
+            return T((C*)store->data(start), count);
+    }
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Call a chunk function with spans over a run of components
+    ///
+    /// \param fn The function, optionally taking a QueryChunk first
+    /// \param chunk The ids and meta data of the run
+    /// \param stores The component array of each parameter
+    /// \param start Index of the first entity of the run within its group
+    ///
+    ///////////////////////////////////////////////////////////
+    template <typename Func, typename... Rs>
+    void invokeChunk(
+        Func& fn,
+        const QueryChunk& chunk,
+        ComponentStore* const* stores,
+        size_t start,
+        type_wrapper<std::tuple<Rs...>>
+    ) {
+        using FirstParamType = typename first_param<std::decay_t<Func>>::type;
+        size_t count = chunk.ids.size();
+
+        [&]<size_t... Is>(std::index_sequence<Is...>) {
+            if constexpr (std::is_same_v<std::remove_cvref_t<FirstParamType>, QueryChunk>)
+                fn(chunk, getChunkArg<Rs>(stores[Is], start, count)...);
+            else
+                fn(getChunkArg<Rs>(stores[Is], start, count)...);
+        }(std::index_sequence_for<Rs...>{});
+    }
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Split a sorted list of rows into runs of consecutive rows
+    ///
+    /// Runs are also split at chunk boundaries. The function is called
+    /// with the first and past the end row of each run, and the position
+    /// of the run's first row in the list.
+    ///
+    ///////////////////////////////////////////////////////////
+    template <typename Func> void forEachRowRun(const uint32_t* rows, size_t count, Func&& fn) {
+        for (size_t j = 0; j < count;) {
+            uint32_t first = rows[j];
+            uint32_t chunkEnd = (first / ENTITY_CHUNK_SIZE + 1) * ENTITY_CHUNK_SIZE;
+
+            size_t k = j + 1;
+            while (k < count && rows[k] == rows[k - 1] + 1 && rows[k] < chunkEnd)
+                ++k;
+
+            fn((size_t)first, (size_t)first + (k - j), j);
+            j = k;
+        }
+    }
+}
+
 ///////////////////////////////////////////////////////////
 template <ComponentType... Cs> QueryFactory& QueryFactory::match() {
     PARAM_EXPAND(addInclude(typeid(Cs)));
@@ -17,6 +88,18 @@ template <ComponentType... Cs> QueryFactory& QueryFactory::exclude() {
     return *this;
 }
 
+///////////////////////////////////////////////////////////
+template <ComponentType... Cs> QueryFactory& QueryFactory::changed() {
+    PARAM_EXPAND(addChanged(typeid(Cs)));
+    return *this;
+}
+
+///////////////////////////////////////////////////////////
+template <ComponentType... Cs> QueryFactory& QueryFactory::added() {
+    PARAM_EXPAND(addAdded(typeid(Cs)));
+    return *this;
+}
+
 ///////////////////////////////////////////////////////////
 template <typename Func> void Query::each(Func&& fn) {
     // Get first parameter type
@@ -29,17 +112,32 @@ template <typename Func> void Query::each(Func&& fn) {
 
     // Get component types from function parameters
     // If first parameter is meta, use rest_param_types, otherwise use param_types
+    // (types are not decayed so that const access can be detected)
     using CTypes = typename std::conditional_t<
         HasMetaFirst,
         typename rest_param_types<std::decay_t<decltype(fn)>>::type,
         typename param_types<std::decay_t<decltype(fn)>>::type>;
 
-    iterate(std::forward<Func>(fn), type_wrapper<decayed_tuple_t<CTypes>>{});
+    iterate(std::forward<Func>(fn), type_wrapper<CTypes>{});
 }
 
 ///////////////////////////////////////////////////////////
-template <typename Func, typename... Cs>
-void Query::iterate(Func&& fn, type_wrapper<std::tuple<Cs...>>) {
+template <typename Func> void Query::eachChunk(Func&& fn) {
+    // The first parameter is optionally a QueryChunk, the rest are spans
+    using FirstParamType = typename first_param<std::decay_t<decltype(fn)>>::type;
+    constexpr bool HasChunkFirst = std::is_same_v<std::remove_cvref_t<FirstParamType>, QueryChunk>;
+
+    using SpanTypes = typename std::conditional_t<
+        HasChunkFirst,
+        typename rest_param_types<std::decay_t<decltype(fn)>>::type,
+        typename param_types<std::decay_t<decltype(fn)>>::type>;
+
+    iterateChunks(fn, type_wrapper<SpanTypes>{});
+}
+
+///////////////////////////////////////////////////////////
+template <typename Func, typename... Ps>
+void Query::iterate(Func&& fn, type_wrapper<std::tuple<Ps...>>) {
     // Get first parameter type
     using FirstParamType = typename first_param<std::decay_t<decltype(fn)>>::type;
     using DecayedType = std::remove_cv_t<std::remove_reference_t<FirstParamType>>;
@@ -47,39 +145,279 @@ void Query::iterate(Func&& fn, type_wrapper<std::tuple<Cs...>>) {
     QueryFactory& q = *m_factory;
 
     // Lock user mutexes if provided
-    std::vector<std::unique_lock<std::mutex>> locks;
-    locks.reserve(q.m_mutexes.size());
-    for (size_t m = 0; m < q.m_mutexes.size(); ++m)
-        locks.push_back(std::unique_lock<std::mutex>(*q.m_mutexes[m]));
+    priv::MutexListLock locks(q.m_mutexes);
+
+    // Change tick of this run, used to stamp mutable access and to filter changes
+    uint32_t lastRun = m_lastRunTick;
+    uint32_t thisRun = m_world->nextChangeTick();
+    bool filtered = q.hasChangeFilters();
+
+    // Column of each parameter in the precomputed column tables, and whether
+    // each is accessed mutably
+    const size_t columns[] = {q.getColumnIndex(typeid(std::decay_t<Ps>))..., 0};
+    constexpr bool writes[] = {is_mutable_param_v<Ps>..., false};
+
+    // Shared components have one value per group, which isn't indexed by entity
+    for (size_t c = 0; c < sizeof...(Ps); ++c)
+        CHECK_F(!q.m_columnShared[columns[c]], "shared components can only be iterated in chunks");
+
+    // Sparse components are joined one entity at a time
+    if (q.hasSparseFilters()) {
+        iterateJoined(fn, lastRun, thisRun, type_wrapper<std::tuple<Ps...>>{});
+        m_lastRunTick = thisRun;
+        return;
+    }
 
     // Iterate through each table, invoking function for each entity
-    for (size_t t = 0, cum = 0 /* hehe */; t < q.m_groups.size(); ++t) {
-        EntityGroup& group = *m_world->m_groups[q.m_groups[t]];
+    for (size_t t = 0, cum = 0 /* hehe */; t < q.m_matches.size(); ++t) {
+        const MatchedGroup& match = q.m_matches[t];
+        EntityGroup& group = *match.m_group;
+
+        // Skip empty groups without locking them
+        if (group.m_entities.empty())
+            continue;
 
         // Lock table
         ReadLock lock(group.m_mutex);
 
+        // Component arrays, in parameter order
+        priv::ComponentStore* stores[sizeof...(Ps) + 1];
+        for (size_t c = 0; c < sizeof...(Ps); ++c)
+            stores[c] = match.m_columns[columns[c]];
+
         // Create tuple bc it should be a little faster to access
-        Tuple<Cs*...> tuple((Cs*)group.m_components[typeid(Cs)].data()...);
+        auto tuple = [&]<size_t... Is>(std::index_sequence<Is...>) {
+            return Tuple<priv::ComponentColumn<std::decay_t<Ps>>...>(
+                priv::ComponentColumn<std::decay_t<Ps>>(stores[Is]->data())...
+            );
+        }(std::index_sequence_for<Ps...>{});
+
+        // Iterate number of entities one chunk at a time, passing each component and id
+        size_t numEntities = group.m_entities.size();
+        for (size_t start = 0; start < numEntities; start += ENTITY_CHUNK_SIZE) {
+            size_t end = std::min(start + ENTITY_CHUNK_SIZE, numEntities);
+
+            // Skip chunks that didn't change
+            if (filtered && !q.passesChangeFilters(group, start / ENTITY_CHUNK_SIZE, lastRun))
+                continue;
+
+            // Disabled entities are skipped
+            priv::forEachEnabledRun(group, start, end, [&](size_t first, size_t last) {
+                for (size_t i = first; i < last; ++i) {
+                    if constexpr (std::is_same_v<DecayedType, QueryIterator>) {
+                        QueryIterator it(
+                            group.m_entities[i], cum + i, m_world, &group, i, m_world->m_elapsed
+                        );
+                        fn(it, tuple.template get<priv::ComponentColumn<std::decay_t<Ps>>>()[i]...);
+                    } else if constexpr (std::is_same_v<DecayedType, EntityId>)
+                        fn(group.m_entities[i], tuple.template get<priv::ComponentColumn<std::decay_t<Ps>>>()[i]...);
+                    else if constexpr (std::is_integral_v<FirstParamType>)
+                        fn(cum + i, tuple.template get<priv::ComponentColumn<std::decay_t<Ps>>>()[i]...);
+                    else
+                        fn(tuple.template get<priv::ComponentColumn<std::decay_t<Ps>>>()[i]...);
+                }
+            });
+
+            // Mark components that were accessed mutably as changed
+            for (size_t c = 0; c < sizeof...(Ps); ++c) {
+                if (writes[c])
+                    stores[c]->markChanged(start, end - start, thisRun);
+            }
+        }
+
+        // Update aggregate index
+        cum += numEntities;
+    }
+
+    m_lastRunTick = thisRun;
+}
+
+///////////////////////////////////////////////////////////
+template <typename Func, typename... Ps>
+void Query::iterateJoined(Func& fn, uint32_t since, uint32_t tick, type_wrapper<std::tuple<Ps...>>) {
+    // Get first parameter type
+    using FirstParamType = typename first_param<std::decay_t<decltype(fn)>>::type;
+    using DecayedType = std::remove_cv_t<std::remove_reference_t<FirstParamType>>;
+
+    QueryFactory& q = *m_factory;
+
+    // Lock groups before sparse sets, the same order structural changes use
+    std::vector<const MatchedGroup*> matches;
+    std::vector<EntityGroup*> groups;
+    std::vector<ReadLock> locks;
+    groups.reserve(q.m_matches.size());
+    for (const MatchedGroup& match : q.m_matches) {
+        if (match.m_group->m_entities.empty())
+            continue;
+
+        locks.emplace_back(match.m_group->m_mutex);
+        matches.push_back(&match);
+        groups.push_back(match.m_group);
+    }
+    for (priv::SparseSet* set : q.m_sparseInclude)
+        locks.emplace_back(set->getMutex());
+    for (priv::SparseSet* set : q.m_sparseExclude)
+        locks.emplace_back(set->getMutex());
+
+    // Find entities that pass the filters
+    std::vector<std::vector<uint32_t>> rows = m_world->collectSparseRows(q, groups, since);
+
+    // Column of each parameter in the precomputed column tables
+    const size_t indices[] = {q.getColumnIndex(typeid(std::decay_t<Ps>))..., 0};
+
+    for (size_t g = 0, cum = 0; g < groups.size(); ++g) {
+        EntityGroup& group = *groups[g];
+        const std::vector<uint32_t>& groupRows = rows[g];
+        if (groupRows.empty())
+            continue;
+
+        // Group components are accessed by index, sparse components by id
+        const MatchedGroup& match = *matches[g];
+        auto columns = [&]<size_t... Is>(std::index_sequence<Is...>) {
+            return Tuple<priv::JoinColumn<std::decay_t<Ps>>...>(priv::makeJoinColumn<std::decay_t<Ps>>(
+                match.m_columns[indices[Is]], q.m_columnSparse[indices[Is]]
+            )...);
+        }(std::index_sequence_for<Ps...>{});
+
+        for (size_t j = 0; j < groupRows.size(); ++j) {
+            uint32_t i = groupRows[j];
+            EntityId id = group.m_entities[i];
 
-        // Iterate number of entities, passing each component and id
-        for (size_t i = 0; i < group.m_entities.size(); ++i) {
             if constexpr (std::is_same_v<DecayedType, QueryIterator>) {
-                QueryIterator it(
-                    group.m_entities[i], cum + i, m_world, &group, i, m_world->m_elapsed
-                );
-                fn(it, tuple.template get<Cs*>()[i]...);
+                QueryIterator it(id, cum + j, m_world, &group, i, m_world->m_elapsed);
+                fn(it, columns.template get<priv::JoinColumn<std::decay_t<Ps>>>().get(i, id)...);
             } else if constexpr (std::is_same_v<DecayedType, EntityId>)
-                fn(group.m_entities[i], tuple.template get<Cs*>()[i]...);
+                fn(id, columns.template get<priv::JoinColumn<std::decay_t<Ps>>>().get(i, id)...);
             else if constexpr (std::is_integral_v<FirstParamType>)
-                fn(cum + i, tuple.template get<Cs*>()[i]...);
+                fn(cum + j, columns.template get<priv::JoinColumn<std::decay_t<Ps>>>().get(i, id)...);
             else
-                fn(tuple.template get<Cs*>()[i]...);
+                fn(columns.template get<priv::JoinColumn<std::decay_t<Ps>>>().get(i, id)...);
         }
 
+        // Mark components that were accessed mutably as changed
+        (..., (is_mutable_param_v<Ps>
+                   ? m_world->markRowsChanged(&group, typeid(std::decay_t<Ps>), groupRows, tick)
+                   : void()));
+
         // Update aggregate index
-        cum += group.m_entities.size();
+        cum += groupRows.size();
+    }
+}
+
+///////////////////////////////////////////////////////////
+template <typename Func, typename... Rs>
+void Query::iterateChunks(Func& fn, type_wrapper<std::tuple<Rs...>>) {
+    QueryFactory& q = *m_factory;
+
+    // Lock user mutexes if provided
+    priv::MutexListLock mutexLocks(q.m_mutexes);
+
+    // Change tick of this run, used to stamp mutable access and to filter changes
+    uint32_t lastRun = m_lastRunTick;
+    uint32_t thisRun = m_world->nextChangeTick();
+    bool filtered = q.hasChangeFilters();
+
+    // Column of each parameter in the precomputed column tables, and whether
+    // each is accessed mutably
+    const size_t columns[] = {q.getColumnIndex(typeid(std::decay_t<span_param_t<Rs>>))..., 0};
+    constexpr bool writes[] = {is_mutable_param_v<span_param_t<Rs>>..., false};
+
+    // Sparse filters select rows that are passed as runs of consecutive rows,
+    // but sparse components themselves aren't contiguous
+    if (q.hasSparseFilters()) {
+        for (size_t c = 0; c < sizeof...(Rs); ++c)
+            CHECK_F(!q.m_columnSparse[columns[c]], "sparse components can't be iterated in chunks");
+
+        // Lock groups before sparse sets, the same order structural changes use
+        std::vector<const MatchedGroup*> matches;
+        std::vector<EntityGroup*> groups;
+        std::vector<ReadLock> locks;
+        for (const MatchedGroup& match : q.m_matches) {
+            if (match.m_group->m_entities.empty())
+                continue;
+
+            locks.emplace_back(match.m_group->m_mutex);
+            matches.push_back(&match);
+            groups.push_back(match.m_group);
+        }
+        for (priv::SparseSet* set : q.m_sparseInclude)
+            locks.emplace_back(set->getMutex());
+        for (priv::SparseSet* set : q.m_sparseExclude)
+            locks.emplace_back(set->getMutex());
+
+        std::vector<std::vector<uint32_t>> rows = m_world->collectSparseRows(q, groups, lastRun);
+
+        for (size_t g = 0, cum = 0; g < groups.size(); ++g) {
+            EntityGroup& group = *groups[g];
+
+            priv::ComponentStore* stores[sizeof...(Rs) + 1];
+            for (size_t c = 0; c < sizeof...(Rs); ++c)
+                stores[c] = matches[g]->m_columns[columns[c]];
+
+            priv::forEachRowRun(rows[g].data(), rows[g].size(), [&](size_t start, size_t end, size_t j) {
+                QueryChunk chunk{
+                    std::span<const EntityId>(group.m_entities.data() + start, end - start),
+                    (uint32_t)(cum + j),
+                    m_world->m_elapsed
+                };
+                priv::invokeChunk(fn, chunk, stores, start, type_wrapper<std::tuple<Rs...>>{});
+
+                for (size_t c = 0; c < sizeof...(Rs); ++c) {
+                    if (writes[c])
+                        stores[c]->markChanged(start, end - start, thisRun);
+                }
+            });
+
+            cum += rows[g].size();
+        }
+
+        m_lastRunTick = thisRun;
+        return;
+    }
+
+    for (size_t t = 0, cum = 0; t < q.m_matches.size(); ++t) {
+        const MatchedGroup& match = q.m_matches[t];
+        EntityGroup& group = *match.m_group;
+
+        // Skip empty groups without locking them
+        if (group.m_entities.empty())
+            continue;
+
+        ReadLock lock(group.m_mutex);
+
+        // Component arrays, in parameter order
+        priv::ComponentStore* stores[sizeof...(Rs) + 1];
+        for (size_t c = 0; c < sizeof...(Rs); ++c)
+            stores[c] = match.m_columns[columns[c]];
+
+        // One call per chunk, so change filters and change marks line up with the runs
+        size_t numEntities = group.m_entities.size();
+        for (size_t start = 0; start < numEntities; start += ENTITY_CHUNK_SIZE) {
+            size_t end = std::min(start + ENTITY_CHUNK_SIZE, numEntities);
+
+            if (filtered && !q.passesChangeFilters(group, start / ENTITY_CHUNK_SIZE, lastRun))
+                continue;
+
+            // Disabled entities split the chunk into runs of enabled entities
+            priv::forEachEnabledRun(group, start, end, [&](size_t first, size_t last) {
+                QueryChunk chunk{
+                    std::span<const EntityId>(group.m_entities.data() + first, last - first),
+                    (uint32_t)(cum + first),
+                    m_world->m_elapsed
+                };
+                priv::invokeChunk(fn, chunk, stores, first, type_wrapper<std::tuple<Rs...>>{});
+            });
+
+            for (size_t c = 0; c < sizeof...(Rs); ++c) {
+                if (writes[c])
+                    stores[c]->markChanged(start, end - start, thisRun);
+            }
+        }
+
+        cum += numEntities;
     }
+
+    m_lastRunTick = thisRun;
 }
 
 } // namespace ply
\ No newline at end of file
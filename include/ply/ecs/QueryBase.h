@@ -6,6 +6,7 @@
 #include <ply/core/Types.h>
 #include <ply/ecs/EntityGroup.h>
 #include <ply/ecs/Types.h>
+#include <span>
 #include <type_traits>
 #include <vector>
 
@@ -14,6 +15,33 @@ namespace ply {
 class World;
 class Query;
 
+namespace priv {
+    class SparseSet;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Locks a list of mutexes for the lifetime of the object
+    ///
+    ///////////////////////////////////////////////////////////
+    class MutexListLock {
+    public:
+        MutexListLock(const std::vector<std::mutex*>& mutexes);
+        ~MutexListLock();
+
+    private:
+        const std::vector<std::mutex*>& m_mutexes; //!< Mutexes to lock, in order
+    };
+}
+
+///////////////////////////////////////////////////////////
+/// \brief A group that matches a query, with its precomputed component columns
+///
+///////////////////////////////////////////////////////////
+struct MatchedGroup {
+    EntityGroup* m_group; //!< The matched group
+    std::vector<priv::ComponentStore*>
+        m_columns; //!< Component array of each column type, or NULL if the group doesn't have it
+};
+
 ///////////////////////////////////////////////////////////
 /// \brief Used to access entity components during a query
 ///
@@ -33,6 +61,10 @@ struct QueryAccessor {
     ///////////////////////////////////////////////////////////
     /// \brief Get a component from the current entity
     ///
+    /// Non-const access marks the component's chunk as changed. Use
+    /// get<const C>() for read only access, which is required for shared
+    /// components.
+    ///
     ///////////////////////////////////////////////////////////
     template <ComponentType C> C& get() const;
 
@@ -91,6 +123,16 @@ struct QueryIterator : public QueryAccessor {
     float dt; //!< Time since last frame
 };
 
+///////////////////////////////////////////////////////////
+/// \brief Extra information about a contiguous run of entities during chunk queries
+///
+///////////////////////////////////////////////////////////
+struct QueryChunk {
+    std::span<const EntityId> ids; //!< Ids of the entities in the run, in component order
+    uint32_t index;                //!< Iteration index of the first entity in the run
+    float dt;                      //!< Time since last frame
+};
+
 ///////////////////////////////////////////////////////////
 /// \brief Query base class
 ///
@@ -121,9 +163,77 @@ protected:
     ///////////////////////////////////////////////////////////
     void addExclude(const std::type_index& type);
 
+    ///////////////////////////////////////////////////////////
+    /// \brief Add a type to the changed filter (also includes the type)
+    ///////////////////////////////////////////////////////////
+    void addChanged(const std::type_index& type);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Add a type to the added filter (also includes the type)
+    ///////////////////////////////////////////////////////////
+    void addAdded(const std::type_index& type);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Check if the query has any change filters
+    ///////////////////////////////////////////////////////////
+    bool hasChangeFilters() const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Check if a chunk of a group passes the change filters
+    ///
+    /// A chunk passes if every changed filter type was changed, and every
+    /// added filter type was added, after the given tick.
+    ///
+    /// \param group The group the chunk belongs to
+    /// \param chunk The index of the chunk within the group
+    /// \param since The tick to compare chunk ticks against
+    ///
+    ///////////////////////////////////////////////////////////
+    bool passesChangeFilters(EntityGroup& group, size_t chunk, uint32_t since) const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Check if the query filters on any sparse components
+    ///
+    /// Groups never store sparse components, so these queries have to
+    /// check each entity of the groups they match.
+    ///
+    ///////////////////////////////////////////////////////////
+    bool hasSparseFilters() const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Check if an entity passes the sparse component filters
+    ///
+    /// \param id The entity to check
+    /// \param since The tick to compare change ticks against
+    ///
+    ///////////////////////////////////////////////////////////
+    bool passesSparseFilters(EntityId id, uint32_t since) const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Get the index of a component type in the precomputed columns
+    ///
+    ///////////////////////////////////////////////////////////
+    size_t getColumnIndex(std::type_index type) const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Use the decayed types of a parameter list as the column types
+    ///////////////////////////////////////////////////////////
+    template <typename... Ps> void setColumnTypes(type_wrapper<std::tuple<Ps...>>);
+
 protected:
     std::vector<std::type_index> m_include; //!< A set of comopnents to include
     std::vector<std::type_index> m_exclude; //!< A set of comopnents to exclude
+    std::vector<std::type_index> m_changed; //!< Components that must have changed since last run
+    std::vector<std::type_index> m_added;   //!< Components that must have been added since last run
+    std::vector<priv::SparseSet*> m_sparseInclude; //!< Included components with sparse storage
+    std::vector<priv::SparseSet*> m_sparseExclude; //!< Excluded components with sparse storage
+    std::vector<priv::SparseSet*> m_sparseChanged; //!< Changed filters on sparse components
+    std::vector<priv::SparseSet*> m_sparseAdded;   //!< Added filters on sparse components
+    std::vector<std::type_index> m_columnTypes; //!< Component types of precomputed columns
+    std::vector<priv::SparseSet*> m_columnSparse; //!< Sparse set of each column type, or NULL
+    std::vector<bool> m_columnShared;             //!< Does each column type have shared storage
+    std::vector<MatchedGroup> m_matches; //!< Matched groups, updated as new groups are created
+    uint32_t m_lastRunTick = 0;             //!< Change tick of the last time the query ran
     std::vector<std::mutex*>
         m_mutexes; //!< Mutexes to lock when starting the query (locked before any callbacks)
 };
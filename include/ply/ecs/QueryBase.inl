@@ -5,17 +5,59 @@
 
 namespace ply {
 
+///////////////////////////////////////////////////////////
+template <typename... Ps> void QueryBase::setColumnTypes(type_wrapper<std::tuple<Ps...>>) {
+    m_columnTypes = {typeid(std::decay_t<Ps>)...};
+}
+
 ///////////////////////////////////////////////////////////
 template <ComponentType C> bool QueryAccessor::has() const {
     auto it = m_group->m_components.find(typeid(C));
-    return it != m_group->m_components.end() && it.value().data(m_entityIdx) != nullptr;
+    if (it != m_group->m_components.end())
+        return it.value().data(m_entityIdx) != nullptr;
+
+    if (m_group->m_shared.contains(typeid(C)))
+        return true;
+
+    // Check sparse storage
+    priv::SparseSet* sparse = m_world->findSparseSet(typeid(C));
+    return sparse && sparse->contains(id);
 }
 
 ///////////////////////////////////////////////////////////
 template <ComponentType C> C& QueryAccessor::get() const {
+#ifndef NDEBUG
+    // Systems are ordered by the components they declare, undeclared access would race
+    m_world->checkSystemAccess(typeid(C), !std::is_const_v<C>);
+#endif
+
     auto it = m_group->m_components.find(typeid(C));
-    auto ptr = it != m_group->m_components.end() ? (C*)it.value().data(m_entityIdx) : nullptr;
+    if (it == m_group->m_components.end()) {
+        // Shared components have one value for the whole group, which can't be modified in place
+        auto sharedIt = m_group->m_shared.find(typeid(C));
+        if (sharedIt != m_group->m_shared.end()) {
+            CHECK_F(std::is_const_v<C>, "shared component %s can only be accessed as const", typeid(C).name());
+            return *(C*)sharedIt.value().data();
+        }
+
+        // Check sparse storage
+        priv::SparseSet* sparse = m_world->findSparseSet(typeid(C));
+        auto ptr = sparse ? (C*)sparse->get(id) : nullptr;
+        CHECK_F(ptr != nullptr, "component %s not found", typeid(C).name());
+
+        if constexpr (!std::is_const_v<C>)
+            sparse->markChanged(id, m_world->nextChangeTick());
+
+        return *ptr;
+    }
+
+    auto ptr = (C*)it.value().data(m_entityIdx);
     CHECK_F(ptr != nullptr, "component %s not found", typeid(C).name());
+
+    // Non-const access counts as a change
+    if constexpr (!std::is_const_v<C>)
+        it.value().markChanged(m_entityIdx, 1, m_world->nextChangeTick());
+
     return *ptr;
 }
 
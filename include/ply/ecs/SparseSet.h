@@ -0,0 +1,188 @@
+#pragma once
+
+#include <ply/core/Mutex.h>
+#include <ply/core/Types.h>
+#include <ply/ecs/ComponentStore.h>
+#include <ply/ecs/EntityGroup.h>
+#include <ply/ecs/Types.h>
+
+#include <cstdint>
+#include <typeindex>
+#include <vector>
+
+namespace ply {
+
+namespace priv {
+    ///////////////////////////////////////////////////////////
+    /// \brief Component storage outside of entity groups
+    ///
+    /// Stores the components of a single type in a dense array, with
+    /// a sparse index from entity handle index to dense index. Adding
+    /// and removing components is O(1) and doesn't move the entity
+    /// between groups.
+    ///
+    ///////////////////////////////////////////////////////////
+    class SparseSet {
+    public:
+        ///////////////////////////////////////////////////////////
+        /// \brief Constructor that sets type size
+        ///
+        ///////////////////////////////////////////////////////////
+        SparseSet(size_t typeSize, size_t typeAlign);
+
+        ///////////////////////////////////////////////////////////
+        /// \brief Check if an entity has a component in the set
+        ///
+        ///////////////////////////////////////////////////////////
+        bool contains(EntityId id) const;
+
+        ///////////////////////////////////////////////////////////
+        /// \brief Get the index of an entity's component in the dense array
+        ///
+        /// \return The dense index, or INVALID_INDEX if the entity isn't in the set
+        ///
+        ///////////////////////////////////////////////////////////
+        uint32_t find(EntityId id) const;
+
+        ///////////////////////////////////////////////////////////
+        /// \brief Get a pointer to an entity's component
+        ///
+        /// \return A pointer to the component, or NULL if the entity isn't in the set
+        ///
+        ///////////////////////////////////////////////////////////
+        void* get(EntityId id) const;
+
+        ///////////////////////////////////////////////////////////
+        /// \brief Add or replace the component of an entity
+        ///
+        /// \param id The entity to add the component to
+        /// \param data A pointer to the component data
+        /// \param tick The change tick to stamp the component with
+        ///
+        /// \return A pointer to the stored component
+        ///
+        ///////////////////////////////////////////////////////////
+        void* insert(EntityId id, const void* data, uint32_t tick);
+
+        ///////////////////////////////////////////////////////////
+        /// \brief Add components for a list of entities that aren't in the set
+        ///
+        /// The new components are stored contiguously, in the same order as
+        /// the list of ids.
+        ///
+        /// \param ids The entities to add components to
+        /// \param data A single component to repeat, or one component per entity
+        /// \param repeat True if the same component is used for every entity
+        /// \param tick The change tick to stamp the components with
+        ///
+        /// \return A pointer to the first added component
+        ///
+        ///////////////////////////////////////////////////////////
+        void* append(const std::vector<EntityId>& ids, const void* data, bool repeat, uint32_t tick);
+
+        ///////////////////////////////////////////////////////////
+        /// \brief Replace all components of the set
+        ///
+        /// \param ids The entities of the components
+        /// \param count The number of entities
+        /// \param data One component per entity, stored contiguously
+        /// \param tick The change tick to stamp the components with
+        ///
+        ///////////////////////////////////////////////////////////
+        void assign(const EntityId* ids, size_t count, const void* data, uint32_t tick);
+
+        ///////////////////////////////////////////////////////////
+        /// \brief Release reserved space that isn't used by components
+        ///
+        /// \return The number of bytes released
+        ///
+        ///////////////////////////////////////////////////////////
+        size_t shrinkToFit();
+
+        ///////////////////////////////////////////////////////////
+        /// \brief Remove the component of an entity
+        ///
+        /// The last component in the dense array is moved into the
+        /// removed component's place.
+        ///
+        /// \return True if the entity was in the set
+        ///
+        ///////////////////////////////////////////////////////////
+        bool remove(EntityId id, uint32_t tick);
+
+        ///////////////////////////////////////////////////////////
+        /// \brief Mark an entity's component as changed
+        ///
+        ///////////////////////////////////////////////////////////
+        void markChanged(EntityId id, uint32_t tick);
+
+        ///////////////////////////////////////////////////////////
+        /// \brief Get the list of entities in the set, in dense array order
+        ///
+        ///////////////////////////////////////////////////////////
+        const std::vector<EntityId>& getEntities() const;
+
+        ///////////////////////////////////////////////////////////
+        /// \brief Get the dense component array
+        ///
+        ///////////////////////////////////////////////////////////
+        ComponentStore& getStore();
+
+        ///////////////////////////////////////////////////////////
+        /// \brief Get the mutex protecting the set
+        ///
+        ///////////////////////////////////////////////////////////
+        SharedMutex& getMutex();
+
+        ///////////////////////////////////////////////////////////
+        /// \brief Get the number of components in the set
+        ///
+        ///////////////////////////////////////////////////////////
+        size_t size() const;
+
+        static constexpr uint32_t INVALID_INDEX = 0xFFFFFFFF; //!< Sparse index of missing entities
+
+    private:
+        ComponentStore m_store;           //!< Dense component array
+        std::vector<EntityId> m_entities; //!< Entity of each component in the dense array
+        std::vector<uint32_t> m_sparse;   //!< Dense index of each entity, by handle index
+        SharedMutex m_mutex;              //!< Mutex protecting access to the set
+    };
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Column of a joined iteration
+    ///
+    /// Components stored in the entity group are accessed by their
+    /// index in the group, while sparse components are looked up by
+    /// entity id.
+    ///
+    ///////////////////////////////////////////////////////////
+    template <typename T> struct JoinColumn {
+        T& get(size_t index, EntityId id) const {
+            if constexpr (std::is_empty_v<T>)
+                return ComponentColumn<T>::s_tag;
+            else
+                return m_sparse ? *(T*)m_sparse->get(id) : m_data[index];
+        }
+
+        T* m_data;           //!< Group component array, or NULL for sparse components
+        SparseSet* m_sparse; //!< Sparse set, or NULL for group components
+    };
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Create a join column from a precomputed column
+    ///
+    /// Components that aren't in the group have no component array,
+    /// and are looked up in the sparse set that stores them.
+    ///
+    ///////////////////////////////////////////////////////////
+    template <typename T> JoinColumn<T> makeJoinColumn(ComponentStore* store, SparseSet* sparse) {
+        if (store)
+            return JoinColumn<T>{(T*)store->data(), nullptr};
+
+        return JoinColumn<T>{nullptr, sparse};
+    }
+
+} // namespace priv
+
+} // namespace ply
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <ply/components/Spatial.h>
+#include <ply/ecs/Query.h>
+#include <ply/math/BoundingBoxTree.h>
+
+#include <limits>
+#include <mutex>
+#include <vector>
+
+namespace ply {
+
+class Observer;
+class World;
+
+///////////////////////////////////////////////////////////
+/// \brief Indexes entities by their world space bounding boxes
+///
+///////////////////////////////////////////////////////////
+class SpatialIndex {
+public:
+    ///////////////////////////////////////////////////////////
+    /// \brief Create a spatial index for the entities of a world
+    ///
+    /// \param world The world containing the entities
+    /// \param margin The distance boxes are enlarged by in the tree (see BoundingBoxTree)
+    ///
+    ///////////////////////////////////////////////////////////
+    SpatialIndex(World* world, float margin = 0.1f);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Destructor
+    ///
+    ///////////////////////////////////////////////////////////
+    ~SpatialIndex();
+
+#ifndef DOXYGEN_SKIP
+    SpatialIndex(const SpatialIndex&) = delete;
+    SpatialIndex& operator=(const SpatialIndex&) = delete;
+#endif
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Update the index with the entities that changed since the last update
+    ///
+    /// Entities with Transform and Bounds components are added to the
+    /// index, and the boxes of entities whose transform or bounds changed
+    /// are updated. After World::restoreState(), the whole index is
+    /// rebuilt from the world. This should be called after World::tick(),
+    /// and after Hierarchy::update() if world transforms are used.
+    ///
+    ///////////////////////////////////////////////////////////
+    void update();
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Rebuild the tree using the surface area heuristic
+    ///
+    /// \see BoundingBoxTree::rebuild()
+    ///
+    ///////////////////////////////////////////////////////////
+    void rebuild();
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Find the entities that overlap a box
+    ///
+    /// \param box The world space box to test
+    ///
+    /// \return The list of entities
+    ///
+    ///////////////////////////////////////////////////////////
+    std::vector<EntityId> query(const BoundingBox& box) const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Find the entities that intersect or are inside a frustum
+    ///
+    /// \param frustum The frustum to test, i.e. from Camera::getFrustum()
+    ///
+    /// \return The list of entities
+    ///
+    ///////////////////////////////////////////////////////////
+    std::vector<EntityId> query(const Frustum& frustum) const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Find the entities hit by a ray, nearest first
+    ///
+    /// \param ray The world space ray to cast
+    /// \param maxDistance The maximum distance along the ray
+    ///
+    /// \return The list of entities
+    ///
+    ///////////////////////////////////////////////////////////
+    std::vector<EntityId> raycast(const Ray& ray, float maxDistance = std::numeric_limits<float>::max()) const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Get the bounding box tree
+    ///
+    ///////////////////////////////////////////////////////////
+    const BoundingBoxTree& getTree() const;
+
+private:
+    ///////////////////////////////////////////////////////////
+    /// \brief Insert or update the box of an entity
+    ///////////////////////////////////////////////////////////
+    void setBox(EntityId id, const Matrix4f& transform, const BoundingBox& bounds);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Remove an entity from the tree
+    ///////////////////////////////////////////////////////////
+    void removeBox(EntityId id);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Replace the contents of the tree with every indexed entity of the world
+    ///////////////////////////////////////////////////////////
+    void reset();
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Convert a list of tree values to entities
+    ///////////////////////////////////////////////////////////
+    std::vector<EntityId> toEntities(const std::vector<uint32_t>& values) const;
+
+private:
+    World* m_world;                     //!< The world containing the entities
+    BoundingBoxTree m_tree;             //!< Tree of world space boxes, with entity handle indices as values
+    Query m_localChanges;               //!< Entities without world transforms whose transform changed
+    Query m_localBoundsChanges;         //!< Entities without world transforms whose bounds changed
+    Query m_worldChanges;               //!< Entities whose world transform changed
+    Query m_worldBoundsChanges;         //!< Entities with world transforms whose bounds changed
+    Query m_localEntities;              //!< All entities without world transforms, used to reset the tree
+    Query m_worldEntities;              //!< All entities with world transforms, used to reset the tree
+    std::vector<Observer*> m_observers; //!< Observers that detect removed entities
+    uint32_t m_numRestores;             //!< Restore count of the world at the last update
+
+    std::mutex m_mutex;                 //!< Protects the removed entity list
+    std::vector<EntityId> m_removed;    //!< Entities that left the index since the last update
+    std::vector<EntityId> m_entities;   //!< Entity of each proxy, by handle index
+    std::vector<uint32_t> m_proxies;    //!< Tree proxy of each entity, by handle index
+};
+
+} // namespace ply
+
+///////////////////////////////////////////////////////////
+/// \class ply::SpatialIndex
+/// \ingroup ECS
+///
+/// Keeps a BoundingBoxTree in sync with the entities that have Transform
+/// and Bounds components, so culling and picking don't need to test every
+/// entity. Entities are added and moved using change filters, so only the
+/// chunks that changed are visited, and removed entities are detected with
+/// observers. If an entity has a WorldTransform, it is used instead of its
+/// Transform.
+///
+/// Usage example:
+/// \code
+/// ply::SpatialIndex index(&world);
+///
+/// world.entity()
+///     .add(Transform())
+///     .add(Bounds{BoundingBox(Vector3f(-1.0f), Vector3f(1.0f))})
+///     .create(100);
+///
+/// // Every frame
+/// world.tick();
+/// index.update();
+///
+/// std::vector<EntityId> visible = index.query(camera.getFrustum());
+/// std::vector<EntityId> picked = index.raycast(Ray(origin, direction));
+/// \endcode
+///
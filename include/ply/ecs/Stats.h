@@ -0,0 +1,132 @@
+#pragma once
+
+#include <ply/core/Time.h>
+#include <ply/ecs/Types.h>
+
+#include <cstdint>
+#include <typeindex>
+#include <vector>
+
+namespace ply {
+
+class System;
+
+///////////////////////////////////////////////////////////
+/// \brief Memory usage of a single component array of an entity group
+///
+///////////////////////////////////////////////////////////
+struct ComponentStats {
+    std::type_index m_type = typeid(void); //!< The component type
+    size_t m_typeSize = 0;                 //!< Size of the component type in bytes
+    size_t m_bytesUsed = 0;                //!< Bytes used by the components of the entities
+    size_t m_bytesReserved = 0;            //!< Bytes allocated for the array
+};
+
+///////////////////////////////////////////////////////////
+/// \brief Size and memory usage of an entity group
+///
+///////////////////////////////////////////////////////////
+struct GroupStats {
+    EntityGroupId m_id = 0;                   //!< The id of the group
+    size_t m_numEntities = 0;                 //!< Number of entities in the group
+    std::vector<ComponentStats> m_components; //!< Usage of each component array
+    size_t m_bytesUsed = 0;                   //!< Total bytes used by the component arrays
+    size_t m_bytesReserved = 0;               //!< Total bytes allocated for the component arrays
+};
+
+///////////////////////////////////////////////////////////
+/// \brief Execution time and workload of a system
+///
+///////////////////////////////////////////////////////////
+struct SystemStats {
+    const System* m_system = nullptr; //!< The system
+    Time m_lastTime;                  //!< Execution time of the last run
+    Time m_averageTime;               //!< Average execution time since stats were reset
+    Time m_maxTime;                   //!< Longest execution time since stats were reset
+    Time m_totalTime;                 //!< Total execution time since stats were reset
+    uint64_t m_numRuns = 0;           //!< Number of runs since stats were reset
+    uint32_t m_numGroups = 0;         //!< Number of groups iterated in the last run
+    size_t m_numEntities = 0;         //!< Number of entities iterated in the last run
+    Time m_expectedTime;              //!< Smoothed execution time, used to prioritize the system
+    Time m_criticalPathTime;          //!< Expected time of the longest chain of systems starting with this one
+    Time m_serialTime;                //!< Time the system ran while no other system was running in the last tick
+    bool m_isCritical = false;        //!< Is the system on the longest chain of the schedule
+    bool m_isStraggler = false;       //!< Did the system run alone for a large part of the last tick
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Record the execution time of a run
+    ///
+    ///////////////////////////////////////////////////////////
+    void addRun(Time time);
+};
+
+///////////////////////////////////////////////////////////
+/// \brief Time spent in each phase of the last tick
+///
+///////////////////////////////////////////////////////////
+struct TickStats {
+    Time m_systemsTime;           //!< Time spent executing systems
+    Time m_removeTime;            //!< Time spent removing queued entities
+    Time m_addTime;               //!< Time spent creating queued entities
+    Time m_changeTime;            //!< Time spent applying queued component changes
+    Time m_eventsTime;            //!< Time spent dispatching batched enter and exit events
+    Time m_totalTime;             //!< Total time of the tick
+    Time m_criticalPathTime;      //!< Expected time of the longest chain of systems
+    uint32_t m_numStragglers = 0; //!< Number of systems that ran alone for a large part of the tick
+};
+
+///////////////////////////////////////////////////////////
+/// \brief Work done by a call to World::compact()
+///
+///////////////////////////////////////////////////////////
+struct CompactStats {
+    uint32_t m_numGroupsVisited = 0; //!< Number of groups checked
+    uint32_t m_numGroupsFreed = 0;   //!< Number of empty groups that were freed
+    uint32_t m_numArraysShrunk = 0;  //!< Number of arrays that released memory
+    size_t m_bytesReleased = 0;      //!< Total bytes released
+    bool m_isPassComplete = false;   //!< Did the call finish a pass over every group
+};
+
+///////////////////////////////////////////////////////////
+/// \brief Snapshot of the state and performance of a world
+///
+///////////////////////////////////////////////////////////
+struct WorldStats {
+    size_t m_numEntities = 0;           //!< Number of entities in all groups
+    std::vector<GroupStats> m_groups;   //!< Stats of each entity group
+    std::vector<SystemStats> m_systems; //!< Stats of each system, in registration order
+    TickStats m_tick;                   //!< Phase times of the last tick
+};
+
+} // namespace ply
+
+///////////////////////////////////////////////////////////
+/// \struct ply::WorldStats
+/// \ingroup ECS
+///
+/// Returned by World::getStats(). System and tick times are measured
+/// on every tick with a pair of clock reads per system and per phase,
+/// so they are always available, while group memory usage is only
+/// gathered when the stats are requested.
+///
+/// When systems run on a scheduler, each system is also given the
+/// expected time of the longest chain of systems that has to wait
+/// for it, and systems that ran while every other worker was idle
+/// for at least a quarter of the tick, and at least a millisecond,
+/// are marked as stragglers.
+/// Stragglers are usually worth splitting up, or their dependents
+/// worth loosening.
+///
+/// Usage example:
+/// \code
+/// WorldStats stats = world.getStats();
+///
+/// for (const SystemStats& system : stats.m_systems) {
+///     double average = system.m_averageTime.microseconds() / 1000.0;
+///     LOG_F(INFO, "%.3f ms, %zu entities", average, system.m_numEntities);
+///
+///     if (system.m_isStraggler)
+///         LOG_F(WARNING, "system ran alone for %lld us", system.m_serialTime.microseconds());
+/// }
+/// \endcode
+///
@@ -1,23 +1,39 @@
 #pragma once
 
 #include <ply/ecs/QueryBase.h>
+#include <ply/ecs/Stats.h>
 #include <ply/ecs/Types.h>
 
 namespace ply {
 
 class World;
 class EntityGroup;
+class SystemGroup;
 
 class System : public QueryBase {
     friend World;
 
   public:
+    ///////////////////////////////////////////////////////////
+    /// \brief Typed iterator generated from the each() function
+    ///
+    /// Receives the entity list of a group, the range to iterate, and the
+    /// component arrays of the function's parameters in declaration order
+    /// (precomputed per group when the group is matched). For joined
+    /// iteration, the sparse set of each parameter and the list of entity
+    /// indices are passed as well.
+    ///
+    ///////////////////////////////////////////////////////////
     using IteratorFn = std::function<void(
         const std::vector<EntityId>&,
-        const HashMap<std::type_index, void*>&,
+        size_t,
+        size_t,
+        priv::ComponentStore* const*,
+        priv::SparseSet* const*,
         World*,
         EntityGroup*,
-        float
+        float,
+        const uint32_t*
     )>;
 
   public:
@@ -70,6 +86,53 @@ class System : public QueryBase {
     template <ComponentType... Cs>
     System& exclude();
 
+    ///////////////////////////////////////////////////////////
+    /// \brief Only iterate entities whose components changed since the last run
+    ///
+    /// The component types are also added to the include type set. Change
+    /// tracking is done per chunk of ENTITY_CHUNK_SIZE entities, so whole
+    /// chunks are skipped when none of their components of the given types
+    /// were accessed mutably since the last time this system ran.
+    ///
+    ///////////////////////////////////////////////////////////
+    template <ComponentType... Cs>
+    System& changed();
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Only iterate entities whose components were added since the last run
+    ///
+    /// The component types are also added to the include type set. Works at
+    /// chunk granularity, the same as changed().
+    ///
+    ///////////////////////////////////////////////////////////
+    template <ComponentType... Cs>
+    System& added();
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Declare read access to components outside of the each() parameters
+    ///
+    /// Component access is inferred from the parameters of the function
+    /// passed to each(): `const C&` is a read and `C&` is a write. Use this
+    /// to declare access that the parameters don't show, such as reading
+    /// components of other entities through QueryIterator::getEntity().
+    /// Declared access is used to order systems, so that systems with
+    /// conflicting access never run at the same time. Systems don't lock
+    /// the groups they iterate, so in debug builds, QueryAccessor::get()
+    /// fails on components the system hasn't declared.
+    ///
+    ///////////////////////////////////////////////////////////
+    template <ComponentType... Cs>
+    System& reads();
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Declare write access to components outside of the each() parameters
+    ///
+    /// \see reads
+    ///
+    ///////////////////////////////////////////////////////////
+    template <ComponentType... Cs>
+    System& writes();
+
     ///////////////////////////////////////////////////////////
     /// \brief Specify that this system should run before another
     ///
@@ -86,20 +149,105 @@ class System : public QueryBase {
     ///////////////////////////////////////////////////////////
     System& after(System* system);
 
+    ///////////////////////////////////////////////////////////
+    /// \brief Put the system in a group that controls how often it runs
+    ///
+    /// Systems that aren't in a group run every tick.
+    ///
+    /// \param group The group, or NULL to remove the system from its group
+    ///
+    /// \see SystemGroup
+    ///
+    ///////////////////////////////////////////////////////////
+    System& group(SystemGroup* group);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Get the execution time and workload of the system
+    ///
+    /// Stats are updated every time the system runs, so they should
+    /// be read between ticks.
+    ///
+    ///////////////////////////////////////////////////////////
+    const SystemStats& getStats() const;
+
     ///////////////////////////////////////////////////////////
     /// \brief Set the function that will get called on all entities that match
     /// the System query
     ///
+    /// Component parameters taken by const reference are recorded as reads,
+    /// and parameters taken by non-const reference are recorded as writes.
+    /// Systems that write a component another system reads or writes are
+    /// run one after the other, in the order they were created, unless their
+    /// queries can never match the same entity group. All other systems may
+    /// run in parallel.
+    ///
     ///////////////////////////////////////////////////////////
     template <typename Func>
     System* each(Func&& fn);
 
+    ///////////////////////////////////////////////////////////
+    /// \brief Set a function that will get called on contiguous runs of
+    /// entities that match the System query
+    ///
+    /// The function takes a std::span over each component array, and
+    /// optionally a QueryChunk first, the same as Query::eachChunk().
+    /// Spans of non-const types are recorded as writes, and spans of
+    /// const types as reads. When the system is split across workers,
+    /// each run still lies within a single chunk.
+    ///
+    ///////////////////////////////////////////////////////////
+    template <typename Func>
+    System* eachChunk(Func&& fn);
+
+  private:
+    ///////////////////////////////////////////////////////////
+    /// \brief Record the component types a function reads and writes
+    ///////////////////////////////////////////////////////////
+    template <typename... Ps>
+    void addAccess(type_wrapper<std::tuple<Ps...>>);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Add a component type to the read set
+    ///////////////////////////////////////////////////////////
+    void addRead(const std::type_index& type);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Add a component type to the write set
+    ///////////////////////////////////////////////////////////
+    void addWrite(const std::type_index& type);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Check if two systems can't safely run at the same time
+    ///
+    /// Two systems conflict if one writes a component type the other reads
+    /// or writes. Systems whose queries can never match the same group don't
+    /// conflict, unless either has declared access outside its parameters.
+    ///
+    ///////////////////////////////////////////////////////////
+    bool conflictsWith(const System& other) const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Check if this system is scheduled after another, directly or
+    /// indirectly
+    ///////////////////////////////////////////////////////////
+    bool dependsOn(const System* other) const;
+
   private:
     World* m_world;                      //!< World the System is attached to
     IteratorFn m_iterator;               //!< The function that will get called
     std::vector<System*> m_dependencies; //!< The dependencies of the system
-    std::vector<EntityGroupId>
-        m_groups; //!< List of entity groups that match query
+    uint32_t m_order = 0;                //!< Registration order, used to merge deferred commands
+    SystemGroup* m_group = nullptr;      //!< Group that controls the rate of the system
+    SystemStats m_stats;                 //!< Execution time and workload
+    uint32_t m_layer = 0;                //!< Schedule layer, dependencies are always in earlier layers
+    Time m_runStart;                     //!< Start of the last run, relative to the start of the systems
+    Time m_runEnd;                       //!< End of the last run, relative to the start of the systems
+    std::vector<System*>
+        m_scheduleDependencies; //!< Explicit and inferred dependencies used for scheduling
+    std::vector<std::type_index> m_reads;  //!< Component types the system reads
+    std::vector<std::type_index> m_writes; //!< Component types the system writes
+    bool m_hasExternalAccess = false; //!< Has access been declared with reads() or writes()
+    std::vector<size_t> m_writeColumns; //!< Columns of the parameters that are accessed mutably
 };
 
 } // namespace ply
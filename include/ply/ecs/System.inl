@@ -19,35 +19,139 @@ template <ComponentType... Cs> System& System::exclude() {
     return *this;
 }
 
+///////////////////////////////////////////////////////////
+template <ComponentType... Cs> System& System::changed() {
+    PARAM_EXPAND(addChanged(typeid(Cs)));
+    return *this;
+}
+
+///////////////////////////////////////////////////////////
+template <ComponentType... Cs> System& System::added() {
+    PARAM_EXPAND(addAdded(typeid(Cs)));
+    return *this;
+}
+
+///////////////////////////////////////////////////////////
+template <ComponentType... Cs> System& System::reads() {
+    PARAM_EXPAND(addRead(typeid(Cs)));
+    m_hasExternalAccess = true;
+    return *this;
+}
+
+///////////////////////////////////////////////////////////
+template <ComponentType... Cs> System& System::writes() {
+    PARAM_EXPAND(addWrite(typeid(Cs)));
+    m_hasExternalAccess = true;
+    return *this;
+}
+
 ///////////////////////////////////////////////////////////
 namespace priv {
-    template <typename Func, typename... Cs>
-    System::IteratorFn makeSystemIteratorFn(Func&& fn, type_wrapper<std::tuple<Cs...>>) {
+    template <typename Func, typename... Ps>
+    System::IteratorFn makeSystemIteratorFn(Func&& fn, type_wrapper<std::tuple<Ps...>>) {
         // Get first parameter type
         using FirstParamType = typename first_param<std::decay_t<decltype(fn)>>::type;
         using DecayedType = std::remove_cv_t<std::remove_reference_t<FirstParamType>>;
 
         return [fn](
                    const std::vector<EntityId>& ids,
-                   const HashMap<std::type_index, void*>& ptrs,
+                   size_t start,
+                   size_t end,
+                   ComponentStore* const* stores,
+                   SparseSet* const* sparse,
                    World* world,
                    EntityGroup* group,
-                   float dt
+                   float dt,
+                   const uint32_t* rows
                ) {
+            // Joined iteration, range is of the list of entity indices
+            if (rows) {
+                // Group components are accessed by index, sparse components by id
+                auto columns = [&]<size_t... Is>(std::index_sequence<Is...>) {
+                    return Tuple<JoinColumn<std::decay_t<Ps>>...>(
+                        makeJoinColumn<std::decay_t<Ps>>(stores[Is], sparse[Is])...
+                    );
+                }(std::index_sequence_for<Ps...>{});
+
+                for (size_t j = start; j < end; ++j) {
+                    size_t i = rows[j];
+                    EntityId id = ids[i];
+
+                    if constexpr (std::is_same_v<DecayedType, QueryIterator>) {
+                        QueryIterator it(id, j, world, group, i, dt);
+                        fn(it, columns.template get<JoinColumn<std::decay_t<Ps>>>().get(i, id)...);
+                    } else if constexpr (std::is_same_v<DecayedType, EntityId>)
+                        fn(id, columns.template get<JoinColumn<std::decay_t<Ps>>>().get(i, id)...);
+                    else if constexpr (std::is_integral_v<FirstParamType>)
+                        fn(j, columns.template get<JoinColumn<std::decay_t<Ps>>>().get(i, id)...);
+                    else
+                        fn(columns.template get<JoinColumn<std::decay_t<Ps>>>().get(i, id)...);
+                }
+
+                return;
+            }
+
             // Create tuple bc it should be a little faster to access
-            Tuple<Cs*...> tuple((Cs*)ptrs.find(typeid(Cs)).value()...);
+            auto tuple = [&]<size_t... Is>(std::index_sequence<Is...>) {
+                return Tuple<ComponentColumn<std::decay_t<Ps>>...>(
+                    ComponentColumn<std::decay_t<Ps>>(stores[Is]->data())...
+                );
+            }(std::index_sequence_for<Ps...>{});
 
-            // Iterate number of entities, passing each component and id
-            for (size_t i = 0; i < ids.size(); ++i) {
+            // Iterate range of entities, passing each component and id
+            for (size_t i = start; i < end; ++i) {
                 if constexpr (std::is_same_v<DecayedType, QueryIterator>) {
                     QueryIterator it(ids[i], i, world, group, i, dt);
-                    fn(it, tuple.template get<Cs*>()[i]...);
+                    fn(it, tuple.template get<ComponentColumn<std::decay_t<Ps>>>()[i]...);
                 } else if constexpr (std::is_same_v<DecayedType, EntityId>)
-                    fn(ids[i], tuple.template get<Cs*>()[i]...);
+                    fn(ids[i], tuple.template get<ComponentColumn<std::decay_t<Ps>>>()[i]...);
                 else if constexpr (std::is_integral_v<FirstParamType>)
-                    fn(i, tuple.template get<Cs*>()[i]...);
+                    fn(i, tuple.template get<ComponentColumn<std::decay_t<Ps>>>()[i]...);
                 else
-                    fn(tuple.template get<Cs*>()[i]...);
+                    fn(tuple.template get<ComponentColumn<std::decay_t<Ps>>>()[i]...);
+            }
+        };
+    }
+}
+
+///////////////////////////////////////////////////////////
+namespace priv {
+    template <typename Func, typename... Rs>
+    System::IteratorFn makeSystemChunkIteratorFn(Func&& fn, type_wrapper<std::tuple<Rs...>>) {
+        return [fn](
+                   const std::vector<EntityId>& ids,
+                   size_t start,
+                   size_t end,
+                   ComponentStore* const* stores,
+                   SparseSet* const* sparse,
+                   World* world,
+                   EntityGroup* group,
+                   float dt,
+                   const uint32_t* rows
+               ) {
+            for (size_t c = 0; c < sizeof...(Rs); ++c)
+                CHECK_F(!sparse[c], "sparse components can't be iterated in chunks");
+
+            // Joined iteration, range is of the list of entity indices
+            if (rows) {
+                forEachRowRun(rows + start, end - start, [&](size_t first, size_t last, size_t j) {
+                    QueryChunk chunk{
+                        std::span<const EntityId>(ids.data() + first, last - first), (uint32_t)(start + j), dt
+                    };
+                    invokeChunk(fn, chunk, stores, first, type_wrapper<std::tuple<Rs...>>{});
+                });
+
+                return;
+            }
+
+            // Split the range at chunk boundaries
+            for (size_t first = start; first < end;) {
+                size_t last = std::min<size_t>((first / ENTITY_CHUNK_SIZE + 1) * ENTITY_CHUNK_SIZE, end);
+
+                QueryChunk chunk{std::span<const EntityId>(ids.data() + first, last - first), (uint32_t)first, dt};
+                invokeChunk(fn, chunk, stores, first, type_wrapper<std::tuple<Rs...>>{});
+
+                first = last;
             }
         };
     }
@@ -65,19 +169,62 @@ template <typename Func> System* System::each(Func&& fn) {
 
     // Get component types from function parameters
     // If first parameter is meta, use rest_param_types, otherwise use param_types
+    // (types are not decayed so that const access can be detected)
     using CTypes = typename std::conditional_t<
         HasMetaFirst,
         typename rest_param_types<std::decay_t<decltype(fn)>>::type,
         typename param_types<std::decay_t<decltype(fn)>>::type>;
 
+    // Record which components are read and written, and use the parameter
+    // types as the columns resolved for each matched group
+    addAccess(type_wrapper<CTypes>{});
+    setColumnTypes(type_wrapper<CTypes>{});
+
     // Create iterator
-    m_iterator =
-        priv::makeSystemIteratorFn(std::forward<Func>(fn), type_wrapper<decayed_tuple_t<CTypes>>{});
+    m_iterator = priv::makeSystemIteratorFn(std::forward<Func>(fn), type_wrapper<CTypes>{});
 
     // Register observer
     m_world->registerSystem(this);
 
+    // Shared components have one value per group, which isn't indexed by entity
+    for (size_t c = 0; c < m_columnShared.size(); ++c)
+        CHECK_F(!m_columnShared[c], "shared components can only be iterated in chunks");
+
     return this;
 }
 
+///////////////////////////////////////////////////////////
+template <typename Func> System* System::eachChunk(Func&& fn) {
+    // The first parameter is optionally a QueryChunk, the rest are spans
+    using FirstParamType = typename first_param<std::decay_t<decltype(fn)>>::type;
+    constexpr bool HasChunkFirst = std::is_same_v<std::remove_cvref_t<FirstParamType>, QueryChunk>;
+
+    using SpanTypes = typename std::conditional_t<
+        HasChunkFirst,
+        typename rest_param_types<std::decay_t<decltype(fn)>>::type,
+        typename param_types<std::decay_t<decltype(fn)>>::type>;
+    using CTypes = typename span_param<SpanTypes>::type;
+
+    addAccess(type_wrapper<CTypes>{});
+    setColumnTypes(type_wrapper<CTypes>{});
+
+    m_iterator = priv::makeSystemChunkIteratorFn(std::forward<Func>(fn), type_wrapper<SpanTypes>{});
+    m_world->registerSystem(this);
+
+    return this;
+}
+
+///////////////////////////////////////////////////////////
+template <typename... Ps> void System::addAccess(type_wrapper<std::tuple<Ps...>>) {
+    (..., (is_mutable_param_v<Ps> ? addWrite(typeid(std::decay_t<Ps>))
+                                  : addRead(typeid(std::decay_t<Ps>))));
+
+    constexpr bool writes[] = {is_mutable_param_v<Ps>..., false};
+    m_writeColumns.clear();
+    for (size_t c = 0; c < sizeof...(Ps); ++c) {
+        if (writes[c])
+            m_writeColumns.push_back(c);
+    }
+}
+
 }
\ No newline at end of file
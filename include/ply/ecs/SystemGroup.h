@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstdint>
+
+namespace ply {
+
+class World;
+
+///////////////////////////////////////////////////////////
+/// \brief A set of systems that run at their own rate
+///
+///////////////////////////////////////////////////////////
+class SystemGroup {
+    friend World;
+
+  public:
+    ///////////////////////////////////////////////////////////
+    /// \brief How often the systems of a group run
+    ///////////////////////////////////////////////////////////
+    enum Mode {
+        EveryTick,  //!< Run once every tick
+        FixedStep,  //!< Run a whole number of fixed timesteps every tick
+        EveryNTicks //!< Run once every N ticks
+    };
+
+  public:
+    SystemGroup();
+    SystemGroup(World* world);
+    SystemGroup(const SystemGroup& other) = delete;
+    SystemGroup& operator=(const SystemGroup& other) = delete;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Run the systems of the group with a fixed timestep
+    ///
+    /// Elapsed time is accumulated every tick, and the systems run once
+    /// for every whole timestep in the accumulator, with the timestep as
+    /// their elapsed time. If more than \a maxSubsteps steps are due in a
+    /// single tick, the extra time is dropped so that a slow frame can't
+    /// make the next frames slower.
+    ///
+    /// \param timestep The timestep in seconds
+    /// \param maxSubsteps The maximum number of steps in a single tick
+    ///
+    ///////////////////////////////////////////////////////////
+    SystemGroup& fixedStep(float timestep, uint32_t maxSubsteps = 4);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Run the systems of the group once every N ticks
+    ///
+    /// The systems receive the time elapsed since they last ran.
+    ///
+    /// \param n The number of ticks between each run
+    ///
+    ///////////////////////////////////////////////////////////
+    SystemGroup& everyNTicks(uint32_t n);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Get the rate mode of the group
+    ///
+    ///////////////////////////////////////////////////////////
+    Mode getMode() const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Get the fixed timestep
+    ///
+    ///////////////////////////////////////////////////////////
+    float getTimestep() const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Get the number of times the systems ran in the last tick
+    ///
+    ///////////////////////////////////////////////////////////
+    uint32_t getNumSteps() const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Get the interpolation factor between the last two steps
+    ///
+    /// For fixed step groups, this is the fraction of a timestep left
+    /// in the accumulator after the last tick, in the range [0, 1).
+    /// Rendering can blend the state of the previous and the current
+    /// step with it. For every N ticks groups, this is the fraction of
+    /// the ticks that have passed since the last run. It is always 0
+    /// for groups that run every tick.
+    ///
+    ///////////////////////////////////////////////////////////
+    float getAlpha() const;
+
+  private:
+    ///////////////////////////////////////////////////////////
+    /// \brief Advance the group by a tick and compute the number of steps due
+    ///
+    /// \param elapsed The time elapsed since the last tick
+    ///
+    ///////////////////////////////////////////////////////////
+    void update(float elapsed);
+
+  private:
+    World* m_world;          //!< World the group belongs to
+    Mode m_mode;             //!< How often the systems run
+    float m_timestep;        //!< Fixed timestep
+    uint32_t m_maxSubsteps;  //!< Maximum number of fixed steps per tick
+    uint32_t m_interval;     //!< Number of ticks between runs
+    float m_accumulator;     //!< Time not yet consumed by steps
+    uint32_t m_tickCounter;  //!< Ticks since the last run, for every N ticks groups
+    uint32_t m_numSteps;     //!< Number of steps due in the current tick
+    float m_stepTime;        //!< Elapsed time passed to the systems for each step
+};
+
+} // namespace ply
+
+///////////////////////////////////////////////////////////
+/// \class ply::SystemGroup
+/// \ingroup ECS
+///
+/// Systems that don't need to run at the frame rate, such as AI or
+/// physics, can be put in a group with its own rate. Systems of groups
+/// that aren't due in a tick are left out of that tick's schedule
+/// completely, so they don't cost anything. When a fixed step group has
+/// several steps due in one tick, all due systems run once per step, and
+/// the steps are ordered like consecutive ticks. Structural changes made by
+/// the systems are still applied at the end of the tick.
+///
+/// Usage example:
+/// \code
+/// SystemGroup& physics = world.systemGroup().fixedStep(1.0f / 60.0f);
+/// SystemGroup& ai = world.systemGroup().everyNTicks(4);
+///
+/// world.system()
+///     .group(&physics)
+///     .match<Position, Velocity>()
+///     .each([](QueryIterator it, Position& pos, const Velocity& vel) {
+///         pos.x += vel.x * it.dt;
+///     });
+///
+/// // Every frame
+/// world.tick();
+/// float alpha = physics.getAlpha();
+/// \endcode
+///
@@ -1,6 +1,11 @@
 #pragma once
 
 #include <ply/core/Handle.h>
+
+#include <cstdint>
+#include <span>
+#include <tuple>
+#include <type_traits>
 #include <typeindex>
 
 namespace ply {
@@ -17,6 +22,48 @@ typedef uint32_t EntityGroupId;
 ///////////////////////////////////////////////////////////
 typedef Handle EntityId;
 
+///////////////////////////////////////////////////////////
+/// \brief Number of entities in a chunk
+///
+/// Component arrays are contiguous, but are logically split into
+/// chunks of this many entities. Change tracking is done per chunk,
+/// so iteration with change filters can skip whole chunks at a time.
+///
+///////////////////////////////////////////////////////////
+constexpr uint32_t ENTITY_CHUNK_SIZE = 256;
+
+///////////////////////////////////////////////////////////
+/// \brief Minimum alignment of component arrays in bytes
+///
+/// Every component array starts on a cache line, and since
+/// ENTITY_CHUNK_SIZE is a multiple of it, so does every chunk.
+/// This allows aligned SIMD loads and stores over the component
+/// spans passed to eachChunk().
+///
+///////////////////////////////////////////////////////////
+constexpr uint32_t COMPONENT_ARRAY_ALIGN = 64;
+
+///////////////////////////////////////////////////////////
+/// \brief Where the components of a type are stored
+///
+///////////////////////////////////////////////////////////
+enum class ComponentStorage {
+    Archetype, //!< Stored in the entity's group, fastest to iterate (default)
+    Sparse,    //!< Stored in a sparse set outside of groups, fastest to add and remove
+    Shared     //!< Stored once per group, entities with equal values share a group
+};
+
+///////////////////////////////////////////////////////////
+/// \brief Check if a change tick is newer than another
+///
+/// Handles tick wrap around, as long as the ticks are less
+/// than 2^31 apart.
+///
+///////////////////////////////////////////////////////////
+inline bool isNewerTick(uint32_t tick, uint32_t since) {
+    return (int32_t)(tick - since) > 0;
+}
+
 ///////////////////////////////////////////////////////////
 /// \brief Constraint on components using this system
 ///
@@ -26,4 +73,40 @@ concept ComponentType = std::is_standard_layout_v<T> && std::is_trivially_copyab
 
 }
 
+///////////////////////////////////////////////////////////
+/// \brief Check if a function parameter type gives write access to a component
+///
+/// Non-const references are writes, while const references and values are reads.
+///
+///////////////////////////////////////////////////////////
+template <typename T>
+constexpr bool is_mutable_param_v =
+    std::is_reference_v<T> && !std::is_const_v<std::remove_reference_t<T>>;
+
+///////////////////////////////////////////////////////////
+/// \brief Get the component parameter type of a span parameter
+///
+/// Maps std::span<C> to C& and std::span<const C> to const C&, so
+/// chunk callbacks can share the access rules of per entity callbacks.
+/// Other parameters are shared components, which are read only.
+///
+///////////////////////////////////////////////////////////
+template <typename T>
+struct span_param {
+    using type = const T&;
+};
+
+template <typename T, size_t N>
+struct span_param<std::span<T, N>> {
+    using type = T&;
+};
+
+template <typename... Ts>
+struct span_param<std::tuple<Ts...>> {
+    using type = std::tuple<typename span_param<std::remove_cvref_t<Ts>>::type...>;
+};
+
+template <typename T>
+using span_param_t = typename span_param<std::remove_cvref_t<T>>::type;
+
 #define VALID_COMPONENT_TYPE(T) std::is_standard_layout_v<T>&& std::is_trivially_copyable_v<T>
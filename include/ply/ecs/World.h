@@ -8,21 +8,31 @@
 #include <ply/core/HandleArray.h>
 #include <ply/core/Mutex.h>
 #include <ply/core/Scheduler.h>
+#include <ply/ecs/CommandBuffer.h>
 #include <ply/ecs/Entity.h>
 #include <ply/ecs/EntityBuilder.h>
 #include <ply/ecs/EntityGroup.h>
 #include <ply/ecs/Observer.h>
 #include <ply/ecs/Query.h>
 #include <ply/ecs/QueryBase.h>
+#include <ply/ecs/SparseSet.h>
+#include <ply/ecs/Stats.h>
 #include <ply/ecs/System.h>
+#include <ply/ecs/SystemGroup.h>
 
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
 #include <typeindex>
 
 namespace ply {
 
 class QueryFactory;
 class Observer;
+class WorldState;
 
 ///////////////////////////////////////////////////////////
 /// \brief ECS World
@@ -75,6 +85,7 @@ class World {
     friend class Query;
     friend class Observer;
     friend class System;
+    friend class WorldState;
 
 public:
     ///////////////////////////////////////////////////////////
@@ -118,8 +129,17 @@ public:
     ///
     /// Upon creation through create(), the entity will be created immediately
     /// if the entity's group is not locked by another operation. Otherwise, the
-    /// entity will be created during the next call to tick(), in which case, an
-    /// empty list of ids will be returned.
+    /// entity will be created during the next call to tick(), in which case the
+    /// returned ids are reserved: they can be given components, enabled or
+    /// disabled, and removed right away (the operations are queued after the
+    /// creation), but are only valid once the entity is created.
+    ///
+    /// Entity ids are reserved without locking, so entities can be created
+    /// from systems, where creation is always deferred, and from several
+    /// threads at once. Outside of systems, creation may grow the entity
+    /// table, which is read without locking, so it must not overlap other
+    /// operations on existing entities (remove(), addComponent(),
+    /// getEntity(), ...) from other threads.
     ///
     /// Usage example:
     /// \code
@@ -134,6 +154,37 @@ public:
     ///////////////////////////////////////////////////////////
     EntityBuilder entity();
 
+    ///////////////////////////////////////////////////////////
+    /// \brief Create many entities with individual component values
+    ///
+    /// Creates \a count entities with the components \a Cs, where entity i
+    /// gets the i-th value of each column. Each column is copied into the
+    /// entity group with a single memcpy(), entity ids are allocated in one
+    /// batch, and observers receive a single OnCreate and OnEnter event for
+    /// the whole batch.
+    ///
+    /// Follows the same deferral rules as entity(): if the entity group is
+    /// locked, the columns are copied and the entities are created during the
+    /// next call to tick(), in which case the returned ids are reserved.
+    ///
+    /// Usage example:
+    /// \code
+    /// std::vector<Position> positions = loadPositions();
+    /// std::vector<Velocity> velocities(positions.size(), Velocity{0, 0});
+    ///
+    /// auto ids = world.spawn<Position, Velocity>(positions.size(), positions, velocities);
+    /// \endcode
+    ///
+    /// \param count The number of entities to create
+    /// \param columns One array of component values per component type, each
+    /// with at least \a count elements
+    ///
+    /// \return A list of entity ids that were created
+    ///
+    ///////////////////////////////////////////////////////////
+    template <ComponentType... Cs>
+    std::vector<EntityId> spawn(uint32_t count, std::span<const Cs>... columns);
+
     ///////////////////////////////////////////////////////////
     /// \brief Remove an entity
     ///
@@ -147,6 +198,47 @@ public:
     ///////////////////////////////////////////////////////////
     void remove(EntityId id);
 
+    ///////////////////////////////////////////////////////////
+    /// \brief Remove a list of entities
+    ///
+    /// Removes many entities at once. The ids are grouped by the entity
+    /// group they belong to, and each group is compacted in a single pass.
+    /// Observers receive one OnExit and one OnRemove event per group rather
+    /// than one per entity.
+    ///
+    /// Like remove(EntityId), entities in groups that are locked by another
+    /// operation are marked for removal and will be removed during the next
+    /// call to tick(). Invalid ids and ids that are already marked for removal
+    /// are ignored.
+    ///
+    /// Usage example:
+    /// \code
+    /// auto ids = world.entity().add(Position{0, 0}).create(1000);
+    /// world.remove(ids);
+    /// \endcode
+    ///
+    /// \param ids The ids of the entities to remove
+    ///
+    ///////////////////////////////////////////////////////////
+    void remove(std::span<const EntityId> ids);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Remove all entities that match a query
+    ///
+    /// Removes every entity in every entity group matched by the query.
+    /// Groups that are entirely removed are cleared without moving any
+    /// component data. Follows the same deferral rules as remove().
+    ///
+    /// Usage example:
+    /// \code
+    /// world.removeAll(world.query().match<Projectile>().compile());
+    /// \endcode
+    ///
+    /// \param query The query used to find the entities to remove
+    ///
+    ///////////////////////////////////////////////////////////
+    void removeAll(const Query& query);
+
     ///////////////////////////////////////////////////////////
     /// \brief Get an entity accessor for the specified entity
     ///
@@ -155,6 +247,10 @@ public:
     /// mutex locking tied to its lifetime, so it should be used
     /// for short-term operations only.
     ///
+    /// The lookup itself doesn't lock the world: the entity's group
+    /// is read directly from its handle entry, and only the group's
+    /// own mutex is locked by the accessor.
+    ///
     /// \param id The id of the entity to access
     ///
     /// \return An Entity accessor for the specified entity
@@ -174,6 +270,9 @@ public:
     /// locked by another operation. In that case, the component will be
     /// added during the next call to tick().
     ///
+    /// Components with sparse storage are added to their sparse set, and
+    /// the entity stays in its group.
+    ///
     /// \param id The id of the entity to add the component to
     /// \param component The component to add
     ///
@@ -194,6 +293,8 @@ public:
     /// locked by another operation. In that case, the component will be
     /// removed during the next call to tick().
     ///
+    /// \see setStorage
+    ///
     /// \param id The id of the entity to remove the component from
     ///
     /// \tparam C The component type to remove (must satisfy ComponentType
@@ -203,6 +304,105 @@ public:
     template <ComponentType C>
     void removeComponent(EntityId id);
 
+    ///////////////////////////////////////////////////////////
+    /// \brief Enable or disable an entity
+    ///
+    /// Disabled entities keep their components and their place in their
+    /// group, but are skipped by queries and systems until they are
+    /// enabled again. Unlike removing the entity or adding a tag to it,
+    /// this doesn't move any components, so toggling is O(1). Each group
+    /// keeps a bitmask of its disabled entities that iteration tests 64
+    /// entities at a time, and groups without disabled entities are
+    /// iterated the same way as before.
+    ///
+    /// Disabled entities still send and receive entity events, and can
+    /// still be accessed with getEntity().
+    ///
+    /// This operation is deferred while systems are running, or if the
+    /// entity's group is locked by another operation. In that case, the
+    /// entity is enabled or disabled during the next call to tick().
+    ///
+    /// Usage example:
+    /// \code
+    /// // Hide an enemy that is out of range, without moving its components
+    /// world.setEnabled(enemy, false);
+    ///
+    /// // ...
+    /// world.setEnabled(enemy, true);
+    /// \endcode
+    ///
+    /// \param id The id of the entity
+    /// \param enabled True to enable the entity, false to disable it
+    ///
+    ///////////////////////////////////////////////////////////
+    void setEnabled(EntityId id, bool enabled);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Check if an entity is enabled
+    ///
+    /// \param id The id of the entity
+    ///
+    /// \return False if the entity is disabled or doesn't exist
+    ///
+    ///////////////////////////////////////////////////////////
+    bool isEnabled(EntityId id);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Set how the components of a type are stored
+    ///
+    /// By default, components are stored in the group of their entity,
+    /// which makes iteration fastest but means that adding or removing a
+    /// component moves all of the entity's components to another group.
+    /// Components with sparse storage are kept in a sparse set outside
+    /// of groups instead, so adding and removing them is O(1) and never
+    /// moves other components. This is a good fit for tags and
+    /// components that are added and removed often.
+    ///
+    /// Queries and systems can match sparse components like any other
+    /// component: matching entities are found by joining the groups that
+    /// match the rest of the query with the sparse sets, starting from
+    /// the smallest sparse set. Adding and removing sparse components
+    /// doesn't move entities between groups, so it doesn't send enter
+    /// and exit events, and observers can't match sparse components.
+    ///
+    /// Components with shared storage are stored once per group, and
+    /// entities are grouped by the value of their shared components, so
+    /// all entities with the same mesh or material end up in the same
+    /// groups. Shared values are compared bytewise, so shared component
+    /// types should be plain values without padding, such as handles and
+    /// ids. Chunk iteration passes shared components by const reference
+    /// (see Query::eachChunk()), while per-entity iteration and observers
+    /// can't take them as parameters. Changing the value of a shared
+    /// component with addComponent() moves the entity to another group.
+    ///
+    /// The storage of a component type must be set before any entity
+    /// has the component.
+    ///
+    /// Usage example:
+    /// \code
+    /// world.setStorage<Stunned>(ComponentStorage::Sparse);
+    ///
+    /// world.addComponent(id, Stunned{0.5f});
+    ///
+    /// world.system()
+    ///     .match<Velocity, Stunned>()
+    ///     .each([](Velocity& vel, Stunned& stunned) { ... });
+    ///
+    /// world.setStorage<Material>(ComponentStorage::Shared);
+    ///
+    /// world.query().match<Transform, Material>().eachChunk(
+    ///     [](std::span<Transform> transforms, const Material& material) { ... }
+    /// );
+    /// \endcode
+    ///
+    /// \param storage The storage to use for the component type
+    ///
+    /// \tparam C The component type
+    ///
+    ///////////////////////////////////////////////////////////
+    template <ComponentType C>
+    void setStorage(ComponentStorage storage);
+
     ///////////////////////////////////////////////////////////
     /// \brief Get an observer for entity events
     ///
@@ -210,6 +410,13 @@ public:
     /// entity events of the specified type. Observers can filter
     /// which entities they respond to based on component types.
     ///
+    /// OnEnter and OnExit events caused by adding or removing
+    /// components are collected and sent during tick(), in one batch
+    /// per observer and entity group. Entities that left the group
+    /// again (or were removed) by then are skipped, and exit events
+    /// receive copies of the components the entities had in the group
+    /// they left.
+    ///
     /// Usage example:
     /// \code
     /// world.observer(World::OnCreate)
@@ -246,7 +453,9 @@ public:
     /// on which components they have or don't have.
     ///
     /// Systems can be assigned dependencies and dependents to control
-    /// the order in which they are executed.
+    /// the order in which they are executed. Systems that access the same
+    /// components, where at least one of them writes, are also ordered
+    /// automatically in the order they were created.
     ///
     /// Usage example:
     /// \code
@@ -279,6 +488,37 @@ public:
     ///////////////////////////////////////////////////////////
     void removeSystem(System* system);
 
+    ///////////////////////////////////////////////////////////
+    /// \brief Create a group of systems that run at their own rate
+    ///
+    /// Systems are added to the group with System::group(). A new
+    /// group runs every tick until its rate is set.
+    ///
+    /// Usage example:
+    /// \code
+    /// SystemGroup& physics = world.systemGroup().fixedStep(1.0f / 60.0f, 4);
+    /// world.system().group(&physics).match<Position, Velocity>().each(...);
+    /// \endcode
+    ///
+    /// \return The new system group
+    ///
+    /// \see SystemGroup
+    ///
+    ///////////////////////////////////////////////////////////
+    SystemGroup& systemGroup();
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Remove a system group from the world
+    ///
+    /// Systems that belong to the group are moved out of it, and
+    /// run every tick. After this call, the group pointer is no
+    /// longer valid.
+    ///
+    /// \param group Pointer to the group to remove
+    ///
+    ///////////////////////////////////////////////////////////
+    void removeSystemGroup(SystemGroup* group);
+
     ///////////////////////////////////////////////////////////
     /// \brief Create a query factory for building entity queries
     ///
@@ -314,11 +554,174 @@ public:
     /// 4. Processes entity creations that were queued
     /// 5. Processes component changes that were queued
     ///
+    /// While systems run, entity creation, removal, and component changes
+    /// are always queued, so that systems can iterate entity groups without
+    /// locking them. Each thread queues its changes into its own command
+    /// buffer, and the buffers are merged in system registration order, so
+    /// changes made by systems are applied in the same order regardless of
+    /// which worker ran them.
+    ///
+    /// Systems in a SystemGroup only run when their group is due, and
+    /// fixed step groups may run several times in one tick.
+    ///
     /// This should be called once per frame in your game loop.
     ///
     ///////////////////////////////////////////////////////////
     void tick();
 
+    ///////////////////////////////////////////////////////////
+    /// \brief Update the world for a single frame, with a given elapsed time
+    ///
+    /// The same as tick(), but the elapsed time is given instead of
+    /// measured, i.e. for replays or running the world offline.
+    ///
+    /// \param elapsed The time elapsed since the last tick in seconds
+    ///
+    ///////////////////////////////////////////////////////////
+    void tick(float elapsed);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Register a component type for loading snapshots
+    ///
+    /// Snapshots identify component types by name, so every component
+    /// type stored in a snapshot must be known before it is loaded.
+    /// Types are registered automatically when they are first added to
+    /// an entity, so this is only needed for types that haven't been
+    /// used yet when a snapshot is loaded.
+    ///
+    /// \tparam C The component type to register
+    ///
+    ///////////////////////////////////////////////////////////
+    template <ComponentType C>
+    static void registerComponent();
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Save all entities and their components to a binary snapshot file
+    ///
+    /// The snapshot stores the component arrays of every entity group as
+    /// raw contiguous blobs, along with the entity handle tables, so that
+    /// entity ids stay valid when the snapshot is loaded again. Blobs are
+    /// aligned so that the file can be memory mapped and copied one
+    /// column at a time.
+    ///
+    /// The format is meant for fast saving and loading with the same
+    /// build of a program: component types are identified by their type
+    /// name, and components are stored in the native memory layout.
+    /// Sparse sets are saved the same way, and the world that loads the
+    /// snapshot must use the same component storage.
+    ///
+    /// Queued entity creations and component changes are not saved, so
+    /// snapshots should be saved outside of tick().
+    ///
+    /// \param fname The path of the file to write
+    ///
+    /// \return True if the snapshot was saved successfully
+    ///
+    ///////////////////////////////////////////////////////////
+    bool saveSnapshot(const std::string& fname);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Replace all entities with the ones stored in a snapshot file
+    ///
+    /// The file is memory mapped, and each component array is copied with
+    /// a single memcpy(), so loading time is bound by reading the file
+    /// rather than by the number of entities. All existing entities are
+    /// removed first (sending the usual remove events), and any queued
+    /// operations are discarded. Observers receive one OnCreate and one
+    /// OnEnter event for each loaded entity group.
+    ///
+    /// Entity ids that were valid when the snapshot was saved are valid
+    /// after it is loaded.
+    ///
+    /// Usage example:
+    /// \code
+    /// world.saveSnapshot("level.snapshot");
+    ///
+    /// World other;
+    /// other.loadSnapshot("level.snapshot");
+    /// \endcode
+    ///
+    /// \param fname The path of the snapshot file
+    ///
+    /// \return True if the snapshot was loaded successfully. If it fails, the
+    /// world is not modified
+    ///
+    /// \see registerComponent
+    ///
+    ///////////////////////////////////////////////////////////
+    bool loadSnapshot(const std::string& fname);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Copy all entities and components into an in-memory state
+    ///
+    /// Every component array and entity list is copied into the state
+    /// buffer with one memcpy() each, along with the entity handle
+    /// tables and sparse sets. The buffer of the state is reused, so
+    /// capturing into the same state again doesn't allocate unless the
+    /// world grew.
+    ///
+    /// With \a delta, the state is updated against its own previous
+    /// capture instead: if the groups and their entity counts haven't
+    /// changed since then, only the chunks of components that were
+    /// changed or added since the previous capture are copied, using
+    /// the same per-chunk change ticks as change filtered queries. Writes
+    /// made through pointers that were retrieved before the previous
+    /// capture aren't tracked and won't be copied. Falls back to a full
+    /// capture when the layout has changed.
+    ///
+    /// Queued entity creations and component changes are not captured,
+    /// so states should be captured outside of tick().
+    ///
+    /// \param state The state to capture into
+    /// \param delta True to only copy the chunks changed since the previous capture
+    ///
+    /// \see restoreState
+    ///
+    ///////////////////////////////////////////////////////////
+    void captureState(WorldState& state, bool delta = false);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Replace all entities and components with a captured state
+    ///
+    /// Rewinds the world to the time the state was captured: every
+    /// entity that existed then exists again with the same id and
+    /// component values, and entities created since are gone. Groups
+    /// that kept the same entities since the capture only have their
+    /// changed chunks copied back, so rewinding a few ticks costs about
+    /// as much as the changes made in those ticks.
+    ///
+    /// Restoring is silent: no observer events are sent, any queued
+    /// operations and pending observer events are discarded, and the
+    /// restored components are marked as changed (or added, for groups
+    /// whose entities changed) so change filtered queries and systems
+    /// see them on the next tick. A state captured from another world
+    /// can be restored, as long as both worlds use the same component
+    /// storage, in which case every array is copied.
+    ///
+    /// Caches that are kept up to date with observer events can't see
+    /// the entities that were rewound, so they are rebuilt when the
+    /// restore count changes (see getNumRestores()). Hierarchy and
+    /// SpatialIndex do this on their next update().
+    ///
+    /// \param state The state to restore
+    ///
+    /// \see captureState
+    ///
+    ///////////////////////////////////////////////////////////
+    void restoreState(const WorldState& state);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Get the number of times a state was restored into the world
+    ///
+    /// Restoring sends no observer events, so caches that rely on them
+    /// compare this with the count of their last update, and rebuild
+    /// themselves from the world when it differs.
+    ///
+    /// \return The number of calls to restoreState()
+    ///
+    ///////////////////////////////////////////////////////////
+    uint32_t getNumRestores() const;
+
     ///////////////////////////////////////////////////////////
     /// \brief Set the scheduler for system execution
     ///
@@ -326,11 +729,69 @@ public:
     /// The scheduler is responsible for managing parallel execution
     /// of systems based on their dependencies.
     ///
+    /// Systems are submitted in order of their critical path, the
+    /// longest chain of dependent systems weighted by measured
+    /// execution times, so no annotations are needed for systems that
+    /// gate long chains to start early. Systems that end up running
+    /// alone for a large part of the tick are reported in the stats.
+    ///
     /// \param scheduler Pointer to the scheduler to use
     ///
+    /// \see getStats
+    ///
     ///////////////////////////////////////////////////////////
     void setScheduler(Scheduler* scheduler);
 
+    ///////////////////////////////////////////////////////////
+    /// \brief Get the state and performance stats of the world
+    ///
+    /// Reports the entity count and memory usage of every entity
+    /// group, the execution times of every system, and the time
+    /// spent in each phase of the last tick. Times are measured
+    /// on every tick, group usage is gathered by this call. This
+    /// should not be called while the world is ticking.
+    ///
+    /// \return The world stats
+    ///
+    /// \see WorldStats
+    ///
+    ///////////////////////////////////////////////////////////
+    WorldStats getStats();
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Reset the accumulated execution times of all systems
+    ///
+    ///////////////////////////////////////////////////////////
+    void resetStats();
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Release memory left behind by removed entities
+    ///
+    /// Component arrays only grow while entities are added, so after a
+    /// spike in the number of entities, most of their memory is unused.
+    /// This runs a maintenance pass over the entity groups, a few groups
+    /// at a time: component arrays and entity lists that use less than
+    /// half of their memory are shrunk to fit, and empty groups are freed
+    /// and removed from every query, system, and observer, so they don't
+    /// cost anything when iterating. Sparse sets and the entity table are
+    /// shrunk at the end of each pass. Empty groups with shared values
+    /// are kept while the next group in their id probe chain exists.
+    ///
+    /// The pass continues where the previous call stopped, and stops as
+    /// soon as the time budget is used up, so it can be called once per
+    /// frame in long running sessions. Groups are always processed whole,
+    /// so a call may go slightly over budget. This must be called outside
+    /// of tick().
+    ///
+    /// Pointers to components are invalidated for the shrunk arrays.
+    ///
+    /// \param budget The maximum time to spend, or zero to finish the pass
+    ///
+    /// \return What was done by the call
+    ///
+    ///////////////////////////////////////////////////////////
+    CompactStats compact(Time budget = Time());
+
 private:
     ///////////////////////////////////////////////////////////
     /// \brief Data for entities
@@ -340,22 +801,10 @@ private:
     /// index within that group.
     ///////////////////////////////////////////////////////////
     struct EntityData {
-        EntityGroupId m_group; //!< Group the entity belongs to
-        uint32_t m_index;      //!< Index of entity's components within group
-        bool m_isAlive;        //!< If entity is alive
-    };
-
-    ///////////////////////////////////////////////////////////
-    /// \brief Data for deferred component change operations
-    ///////////////////////////////////////////////////////////
-    struct ComponentChange {
-        ComponentChange(EntityId id, std::type_index type);
-
-        EntityId m_id;          //!< Entity that is changing
-        std::type_index m_type; //!< Type of component
-        void* m_component;      //!< Component to add or NULL for remove
-        size_t m_size;          //!< Type size
-        size_t m_align;         //!< Type alignment
+        EntityGroup* m_group; //!< Group the entity belongs to (owned by m_groups, never moves)
+        uint32_t m_index;     //!< Index of entity's components within group
+        bool m_isAlive;       //!< If entity is alive (false once queued for removal)
+        bool m_isEnabled;     //!< If entity is visited by queries and systems
     };
 
     ///////////////////////////////////////////////////////////
@@ -385,6 +834,111 @@ private:
         EntityGroup* group
     );
 
+    ///////////////////////////////////////////////////////////
+    /// \brief Invoke an observer on a list of entities
+    ///
+    /// \param observer The observer to invoke
+    /// \param ids The list of entities
+    /// \param ptrs The map of component pointers of the entities
+    /// \param group The group the entities belong to
+    ///
+    ///////////////////////////////////////////////////////////
+    void invokeObserver(
+        Observer& observer,
+        const std::vector<EntityId>& ids,
+        const HashMap<std::type_index, void*>& ptrs,
+        EntityGroup* group
+    );
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Invoke an observer with resolved component pointers
+    ///
+    /// \param columns The component pointers, in the order of the observer's parameters
+    ///
+    ///////////////////////////////////////////////////////////
+    void invokeObserver(
+        Observer& observer,
+        const std::vector<EntityId>& ids,
+        void* const* columns,
+        EntityGroup* group
+    );
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Set component storage implementation
+    ///////////////////////////////////////////////////////////
+    void setStorage(std::type_index type, ComponentStorage storage, size_t size, size_t align);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Get the sparse set of a component type
+    ///
+    /// \return The sparse set, or NULL if the type is stored in groups
+    ///
+    ///////////////////////////////////////////////////////////
+    priv::SparseSet* findSparseSet(std::type_index type) const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Check if a component type has shared storage
+    ///////////////////////////////////////////////////////////
+    bool isSharedComponent(std::type_index type) const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Check that the system running on the calling thread declared access to a component
+    ///
+    /// Systems are only ordered by the components they declare, so
+    /// components reached through a QueryAccessor that aren't parameters
+    /// of the system must be declared with System::reads() or
+    /// System::writes(). Shared components can't be modified, so they
+    /// are not checked. Does nothing outside of systems.
+    ///
+    ///////////////////////////////////////////////////////////
+    void checkSystemAccess(std::type_index type, bool write) const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Update the sparse sets a query filters on
+    ///////////////////////////////////////////////////////////
+    void resolveSparseStorage(QueryBase* query);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Find the entities of each group that pass a query's sparse filters
+    ///
+    /// When the query includes sparse components, the entities of the
+    /// smallest included sparse set are visited, otherwise all entities
+    /// of the given groups are. Archetype change filters are checked for
+    /// each entity. The groups must be locked by the caller, if needed.
+    ///
+    /// \param query The query to find entities for
+    /// \param groups The groups that match the query
+    /// \param since The tick to compare change ticks against
+    ///
+    /// \return Sorted entity indices for each group, in the same order as the groups
+    ///
+    ///////////////////////////////////////////////////////////
+    std::vector<std::vector<uint32_t>> collectSparseRows(
+        QueryBase& query,
+        const std::vector<EntityGroup*>& groups,
+        uint32_t since
+    );
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Mark the components of a list of entities in a group as changed
+    ///////////////////////////////////////////////////////////
+    void markRowsChanged(
+        EntityGroup* group,
+        std::type_index type,
+        const std::vector<uint32_t>& rows,
+        uint32_t tick
+    );
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Get a new change tick
+    ///
+    /// Every system run, query run, and structural change gets its own
+    /// tick, so that change filters can tell apart changes that happened
+    /// before and after a system last ran.
+    ///
+    ///////////////////////////////////////////////////////////
+    uint32_t nextChangeTick();
+
     ///////////////////////////////////////////////////////////
     /// \brief Remove all entities that are queued for removal
     ///
@@ -398,6 +952,21 @@ private:
     ///////////////////////////////////////////////////////////
     void removeQueuedEntities();
 
+    ///////////////////////////////////////////////////////////
+    /// \brief Remove a batch of entities from a single group
+    ///
+    /// Compacts the group's component arrays in one pass, using swap-pop
+    /// when few entities are removed and filter compaction when most of the
+    /// group is removed, then sends a single OnExit and OnRemove event for
+    /// the whole batch. The group must be write locked by the caller, and
+    /// all ids must belong to the group.
+    ///
+    /// \param group The group to remove entities from
+    /// \param ids The ids of the entities to remove
+    ///
+    ///////////////////////////////////////////////////////////
+    void removeEntities(EntityGroup* group, const std::vector<EntityId>& ids);
+
     ///////////////////////////////////////////////////////////
     /// \brief Add component to entity implementation, does not handle thread
     /// safety for original entity group
@@ -418,15 +987,132 @@ private:
     void removeComponent(EntityGroup* group, EntityId id, std::type_index type);
 
     ///////////////////////////////////////////////////////////
-    /// \brief Handles sending enter and exit queries
+    /// \brief Queue enter and exit events of an entity moving between groups
+    ///
+    /// Must be called while the entity's components are still in the old
+    /// group, with both groups locked.
+    ///
     ///////////////////////////////////////////////////////////
-    void dispatchEntityChangeEvents(
+    void queueEntityChangeEvents(
         EntityId id,
-        const HashMap<std::type_index, void*>& ptrs,
         EntityGroup* oldGroup,
+        size_t oldIndex,
         EntityGroup* newGroup
     );
 
+    ///////////////////////////////////////////////////////////
+    /// \brief Add a group to the list of groups with queued events
+    ///////////////////////////////////////////////////////////
+    void markPendingEvents(EntityGroup* group);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Send all queued enter and exit events
+    ///
+    /// Events are sent in one batch per observer and group. Exit
+    /// events are sent before enter events.
+    ///
+    ///////////////////////////////////////////////////////////
+    void dispatchQueuedEvents();
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Add an enter or exit observer to a group's observer list
+    ///////////////////////////////////////////////////////////
+    void addObserverBatch(Observer* observer, EntityGroup* group);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Get the command buffer of the calling thread
+    ///
+    /// Each thread records deferred structural changes into its own
+    /// buffer, so recording doesn't need to be synchronized. The buffer
+    /// is only looked up under a lock the first time a thread uses it.
+    ///
+    ///////////////////////////////////////////////////////////
+    priv::CommandBuffer& getCommandBuffer();
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Reserve ids for entities that will be created later
+    ///
+    /// Reservation is lock free, so it can be done from any thread,
+    /// including from systems. Ids are handed out from the free ids
+    /// that were taken from the entity table at the last sync point,
+    /// then from new indices past the end of the table. Reserved ids
+    /// are not valid until an entity is created with them.
+    ///
+    /// \param ids The array to write the reserved ids to
+    /// \param num The number of ids to reserve
+    ///
+    ///////////////////////////////////////////////////////////
+    void reserveEntities(EntityId* ids, uint32_t num);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Check if an id is reserved for an entity that hasn't been created yet
+    ///////////////////////////////////////////////////////////
+    bool isReserved(EntityId id) const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Take the free ids of the entity table for reservation
+    ///
+    /// Ids that were taken before but not handed out are given back
+    /// first. Must only be called when no other thread is using the
+    /// world, it is done at the end of every tick.
+    ///
+    ///////////////////////////////////////////////////////////
+    void refillFreeIds();
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Free the ids that were reserved when the entity table was replaced
+    ///
+    /// Called after a state or snapshot is restored, when queued
+    /// creations have been discarded.
+    ///
+    ///////////////////////////////////////////////////////////
+    void resetFreeIds();
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Defer an entity creation to the end of the tick
+    ///
+    /// \param builder A heap allocated builder, deleted after the entities are created
+    ///
+    ///////////////////////////////////////////////////////////
+    void deferCreate(EntityBuilder* builder);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Defer an entity removal to the end of the tick
+    ///
+    /// The entity must already be marked as not alive.
+    ///
+    ///////////////////////////////////////////////////////////
+    void deferRemove(EntityId id);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Defer adding a component to the end of the tick
+    ///////////////////////////////////////////////////////////
+    void deferAddComponent(
+        EntityId id,
+        std::type_index type,
+        const void* component,
+        size_t size,
+        size_t align
+    );
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Defer removing a component to the end of the tick
+    ///////////////////////////////////////////////////////////
+    void deferRemoveComponent(EntityId id, std::type_index type);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Enable or disable an entity in its locked group
+    ///////////////////////////////////////////////////////////
+    void setEnabled(EntityGroup* group, EntityId id, bool enabled);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Rebuild the disabled bits of a group from its entity data
+    ///
+    /// Used after rows are reordered in bulk.
+    ///
+    ///////////////////////////////////////////////////////////
+    void updateDisabledRows(EntityGroup* group);
+
     ///////////////////////////////////////////////////////////
     /// \brief Apply queued entity creation
     ///////////////////////////////////////////////////////////
@@ -442,16 +1128,69 @@ private:
     ///////////////////////////////////////////////////////////
     void executeSystems();
 
+    ///////////////////////////////////////////////////////////
+    /// \brief Execute the systems that are due in a pass of the tick
+    ///
+    /// Systems that run every tick are due in the first pass only. Fixed
+    /// step groups with several steps due are run once in each pass.
+    ///
+    ///////////////////////////////////////////////////////////
+    void executeSystemPass(uint32_t pass);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Check if a system should run in a pass of the current tick
+    ///////////////////////////////////////////////////////////
+    bool isSystemDue(const System& system, uint32_t pass) const;
+
     ///////////////////////////////////////////////////////////
     /// \brief Execute a single system
     ///////////////////////////////////////////////////////////
     void executeSystem(System* system);
 
+    ///////////////////////////////////////////////////////////
+    /// \brief Execute a system that filters on sparse components
+    ///////////////////////////////////////////////////////////
+    void executeJoinedSystem(System& system, uint32_t lastRun, uint32_t thisRun, float dt);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Execute a system on a contiguous range of entities in a group
+    ///////////////////////////////////////////////////////////
+    void executeSystemRange(
+        System& system,
+        const MatchedGroup& match,
+        size_t start,
+        size_t end,
+        uint32_t tick,
+        float dt
+    );
+
     ///////////////////////////////////////////////////////////
     /// \brief Build optimized systems
     ///////////////////////////////////////////////////////////
     void buildOptimizedSystems();
 
+    ///////////////////////////////////////////////////////////
+    /// \brief Order systems by the expected time of their critical path
+    ///
+    /// The critical path of a system is the longest chain of systems
+    /// that starts with it, weighted by their smoothed execution
+    /// times. Systems are submitted to the scheduler longest chain
+    /// first, so systems that gate long chains start as early as
+    /// their dependencies allow.
+    ///
+    ///////////////////////////////////////////////////////////
+    void prioritizeSystems();
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Add the time each system ran alone in the last pass to its serial time
+    ///////////////////////////////////////////////////////////
+    void measureSerialTime(uint32_t pass);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Mark the systems that ran alone for a large part of the tick
+    ///////////////////////////////////////////////////////////
+    void findStragglers(Time systemsTime);
+
     ///////////////////////////////////////////////////////////
     /// \brief Check if query matches for an entity group
     ///
@@ -471,6 +1210,11 @@ private:
     ///////////////////////////////////////////////////////////
     /// \brief Get or create entity group
     ///
+    /// Groups that have shared components are also compared by the
+    /// values of the shared components, which are given by the data
+    /// pointers of the metadata. If the group with the given id has
+    /// different values, the next free id is used.
+    ///
     /// \param id The id of the group
     ///\param components The components that will be stored in the group
     ///
@@ -482,6 +1226,60 @@ private:
         const HashMap<std::type_index, priv::ComponentMetadata>& components
     );
 
+    ///////////////////////////////////////////////////////////
+    /// \brief Get the group an entity moves to when a component is added or removed
+    ///
+    /// \param group The current group of the entity
+    /// \param type The component type that is added or removed
+    /// \param component Pointer to the added component, or NULL if the component is removed
+    /// \param size The size of the component type
+    /// \param align The alignment of the component type
+    ///
+    /// \return A pointer to the new group, which is created if needed
+    ///
+    ///////////////////////////////////////////////////////////
+    EntityGroup* getNextEntityGroup(
+        EntityGroup* group,
+        std::type_index type,
+        const void* component,
+        size_t size,
+        size_t align
+    );
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Rebuild the precomputed column tables of a query
+    ///////////////////////////////////////////////////////////
+    void findMatchedGroups(QueryBase* query);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Add a group to a query's precomputed column tables
+    ///
+    /// Resolves the component array of each of the query's column types,
+    /// so that iterating the group doesn't need any lookups.
+    ///
+    ///////////////////////////////////////////////////////////
+    void addMatchedGroup(QueryBase* query, EntityGroup* group);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Free an empty entity group
+    ///
+    /// Removes the group from the group map, and from the precomputed
+    /// tables of every query, system, and observer.
+    ///
+    /// \param group The group to free
+    ///
+    ///////////////////////////////////////////////////////////
+    void freeEntityGroup(EntityGroup* group);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Shrink the arrays of an entity group that are mostly unused
+    ///
+    /// \param group The group to shrink
+    /// \param stats The stats to add the released memory to
+    ///
+    ///////////////////////////////////////////////////////////
+    void shrinkEntityGroup(EntityGroup* group, CompactStats& stats);
+
     ///////////////////////////////////////////////////////////
     /// \brief Register observer so that dispatching events is faster
     ///////////////////////////////////////////////////////////
@@ -512,15 +1310,25 @@ private:
     SharedMutex m_groupsMutex; //!< Mutex protecting access to entity groups
     HandleArray<EntityData>
         m_entities; //!< Array of entity data mapping IDs to groups and indices
+    std::mutex m_entitiesMutex;          //!< Serializes adding and removing entities in the entity table (readers don't lock)
+    std::vector<EntityId> m_freeIds;     //!< Free ids taken from the entity table, handed out in order
+    std::atomic<uint32_t> m_numReserved; //!< Number of ids handed out since the free ids were taken
+    uint32_t m_firstNewId;               //!< Index of the first new id, handed out when the free ids run out
+    std::vector<EntityId>
+        m_removesAfterCreate; //!< Queued removals of entities whose creation was still queued
     HashMap<EntityGroupId, std::unique_ptr<EntityGroup>>
         m_groups; //!< Map of group IDs to entity groups
+    HashMap<std::type_index, std::unique_ptr<priv::SparseSet>>
+        m_sparseSets; //!< Storage of components that are kept outside of groups
+    HashSet<std::type_index> m_sharedTypes; //!< Component types that are stored once per group
 
     // Deferred operations
-    std::vector<EntityBuilder*> m_addQueue; //!< List of entities to add
-    std::vector<ComponentChange>
-        m_changeQueue;          //!< List of component changes to apply
-    uint32_t m_numRemoveQueued; //!< Tracks number of entities queued for
-                                //!< removal for optimization
+    uint32_t m_worldId; //!< Unique id of the world, used to cache command buffers per thread
+    std::vector<std::unique_ptr<priv::CommandBuffer>>
+        m_commandBuffers; //!< Command buffers of all threads, in the order they were created
+    HashMap<std::thread::id, priv::CommandBuffer*>
+        m_threadBuffers;                //!< Command buffer of each thread
+    std::mutex m_commandBuffersMutex;   //!< Mutex protecting the command buffer lists
 
     // Observers
     TypePool<Observer> m_observerPool; //!< Pool allocator for observers to
@@ -528,25 +1336,44 @@ private:
     std::vector<Observer*>
         m_observers[EntityEventType::NUM_EVENTS]; //!< Lists of observers for
                                                   //!< each event type
+    std::vector<EntityGroup*>
+        m_pendingEventGroups;        //!< Groups with enter or exit events waiting for the tick
+    std::mutex m_pendingEventsMutex; //!< Mutex protecting the list of groups with queued events
 
     // Systems
     Scheduler* m_scheduler;         //!< Scheduler for executing systems
     TypePool<System> m_systemPool;  //!< Pool allocator for systems to reduce
                                     //!< memory fragmentation
     std::vector<System*> m_systems; //!< Systems
+    TypePool<SystemGroup> m_systemGroupPool; //!< Pool allocator for system groups
+    std::vector<SystemGroup*> m_systemGroups; //!< System groups, updated every tick
     std::vector<OptimizedSystemLayer>
         m_optimizedSystems; //!< Optimized system layers
+    std::vector<System*>
+        m_prioritizedSystems; //!< Systems ordered by critical path, dependencies always first
+    Clock m_systemsClock;     //!< Measures when each system starts and ends within a tick
     bool m_systemsDirty;    //!< Have systems been added or removed
+    bool m_isExecutingSystems; //!< Are systems running (structural changes are
+                               //!< deferred)
 
     // Queries
     TypePool<QueryFactory> m_queryPool; //!< Pool allocator for query factories
     HashMap<uint32_t, QueryFactory*>
         m_queries; //!< Map of query hash to query factory for reuse
 
+    // Change tracking
+    std::atomic<uint32_t> m_changeTick; //!< Counter used to stamp component changes
+    uint32_t m_numRestores;             //!< Number of times a state was restored
+
     // Time
-    Clock m_clock;      //!< Clock used for time management
-    float m_elapsed;    //!< Time elapsed since last frame
-    bool m_isFirstTick; //!< Flag to track first tick
+    Clock m_clock;         //!< Clock used for time management
+    float m_elapsed;       //!< Time elapsed since last frame
+    bool m_isFirstTick;    //!< Flag to track first tick
+    TickStats m_tickStats; //!< Phase times of the last tick
+
+    // Maintenance
+    std::vector<EntityGroupId>
+        m_compactQueue; //!< Groups left to visit in the current compaction pass
 };
 
 } // namespace ply
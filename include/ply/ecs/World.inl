@@ -1,76 +1,125 @@
+#include <ply/core/Macros.h>
+
 #include <loguru.hpp>
 
 namespace ply {
 
+///////////////////////////////////////////////////////////
+template <ComponentType... Cs>
+std::vector<EntityId> World::spawn(uint32_t count, std::span<const Cs>... columns) {
+    if (count == 0)
+        return {};
+
+    CHECK_F(
+        ((columns.size() >= count) && ...), "spawn columns must have at least %d elements", count
+    );
+
+    // Columns are used in place, and only copied if creation is deferred
+    EntityBuilder builder(this);
+    builder.m_isSpawn = true;
+    builder.m_numCreate = count;
+    PARAM_EXPAND(priv::registerComponentType<Cs>());
+    PARAM_EXPAND(builder.addColumn(typeid(Cs), columns.data(), priv::getComponentSize<Cs>(), alignof(Cs)));
+
+    return builder.create(count);
+}
+
+///////////////////////////////////////////////////////////
+template <ComponentType C> void World::registerComponent() {
+    priv::registerComponentType<C>();
+}
+
+///////////////////////////////////////////////////////////
+template <ComponentType C> void World::setStorage(ComponentStorage storage) {
+    priv::registerComponentType<C>();
+    setStorage(typeid(C), storage, priv::getComponentSize<C>(), alignof(C));
+}
+
 ///////////////////////////////////////////////////////////
 template <ComponentType C> void World::addComponent(EntityId id, const C& component) {
+    priv::registerComponentType<C>();
+
+    // Skip entities that are removed or queued for removal, entities whose creation
+    // is queued get the component once they are created
+    if (!m_entities.isValid(id) || !m_entities[id].m_isAlive) {
+        if (isReserved(id))
+            deferAddComponent(id, typeid(C), &component, priv::getComponentSize<C>(), alignof(C));
+        return;
+    }
+
     // Get entity data
     auto& data = m_entities[id];
     auto typeId = std::type_index(typeid(C));
 
+    // Sparse components don't move the entity, so only their set needs to be locked
+    priv::SparseSet* sparse = findSparseSet(typeId);
+
     // Get group
     EntityGroup* group = nullptr;
-    {
-        // Lock group map
-        ReadLock lock(m_groupsMutex);
-        group = m_groups.find(data.m_group).value().get();
+    if (!sparse) {
+        group = data.m_group;
+        CHECK_F(group != NULL, "entity group not found");
     }
-    CHECK_F(group != NULL, "entity group not found");
 
     // Check if we should defer
-    bool defer = !group->m_mutex.try_lock();
+    SharedMutex& mutex = sparse ? sparse->getMutex() : group->m_mutex;
+    bool defer = m_isExecutingSystems || !mutex.try_lock();
 
     if (defer) {
-        // Allocate space to store component
-        uint8_t* block = (uint8_t*)MALLOC_DBG(sizeof(C));
-        memcpy(block, &component, sizeof(C));
-
-        // Add to queue
-        ComponentChange change(id, typeId);
-        change.m_component = (void*)block;
-        change.m_size = sizeof(C);
-        change.m_align = alignof(C);
-        m_changeQueue.push_back(change);
+        // Record in the thread's command buffer (copies the component)
+        deferAddComponent(id, typeId, &component, priv::getComponentSize<C>(), alignof(C));
     } else {
-        // Lock group
-        WriteLock oldGroupLock(group->m_mutex, std::adopt_lock);
+        // Lock group or sparse set
+        WriteLock oldGroupLock(mutex, std::adopt_lock);
 
         // Add component
-        addComponent(
-            group, id, typeId, (void*)&component, sizeof(C), alignof(C)
-        );
+        if (sparse)
+            sparse->insert(id, &component, nextChangeTick());
+        else
+            addComponent(group, id, typeId, (void*)&component, priv::getComponentSize<C>(), alignof(C));
     }
 }
 
 ///////////////////////////////////////////////////////////
 template <ComponentType C> void World::removeComponent(EntityId id) {
+    // Skip entities that are removed or queued for removal, entities whose creation
+    // is queued lose the component once they are created
+    if (!m_entities.isValid(id) || !m_entities[id].m_isAlive) {
+        if (isReserved(id))
+            deferRemoveComponent(id, typeid(C));
+        return;
+    }
+
     // Get entity data
     auto& data = m_entities[id];
     auto typeId = std::type_index(typeid(C));
 
+    // Sparse components don't move the entity, so only their set needs to be locked
+    priv::SparseSet* sparse = findSparseSet(typeId);
+
     // Get group
     EntityGroup* group = NULL;
-    {
-        // Lock group map
-        ReadLock lock(m_groupsMutex);
-        group = m_groups.find(data.m_group).value().get();
+    if (!sparse) {
+        group = data.m_group;
+        CHECK_F(group != NULL, "entity group not found");
     }
-    CHECK_F(group != NULL, "entity group not found");
 
     // Check if we should defer
-    bool defer = !group->m_mutex.try_lock();
+    SharedMutex& mutex = sparse ? sparse->getMutex() : group->m_mutex;
+    bool defer = m_isExecutingSystems || !mutex.try_lock();
 
     if (defer) {
-        // Add to queue
-        ComponentChange change(id, typeId);
-        change.m_component = NULL;
-        m_changeQueue.push_back(change);
+        // Record in the thread's command buffer
+        deferRemoveComponent(id, typeId);
     } else {
-        // Lock group
-        WriteLock oldGroupLock(group->m_mutex, std::adopt_lock);
+        // Lock group or sparse set
+        WriteLock oldGroupLock(mutex, std::adopt_lock);
 
         // Remove component
-        removeComponent(group, id, typeId);
+        if (sparse)
+            sparse->remove(id, nextChangeTick());
+        else
+            removeComponent(group, id, typeId);
     }
 }
 
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <ply/ecs/World.h>
+
+#include <cstdint>
+#include <typeindex>
+#include <vector>
+
+namespace ply {
+
+///////////////////////////////////////////////////////////
+/// \brief An in-memory copy of the entities and components of a world
+///
+///////////////////////////////////////////////////////////
+class WorldState {
+    friend World;
+
+public:
+    WorldState();
+    ~WorldState();
+    WorldState(const WorldState& other) = delete;
+    WorldState& operator=(const WorldState& other) = delete;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Check if the state holds a capture
+    ///
+    ///////////////////////////////////////////////////////////
+    bool isEmpty() const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Get the number of entities in the captured state
+    ///
+    ///////////////////////////////////////////////////////////
+    size_t getNumEntities() const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Get the number of bytes copied by the last capture
+    ///
+    /// A full capture copies every component array, while a delta
+    /// capture only copies the chunks that changed since the
+    /// previous one.
+    ///
+    ///////////////////////////////////////////////////////////
+    size_t getBytesCopied() const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Get the total memory used by the state in bytes
+    ///
+    ///////////////////////////////////////////////////////////
+    size_t getMemoryUsage() const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Free all memory and forget the captured state
+    ///
+    ///////////////////////////////////////////////////////////
+    void clear();
+
+private:
+    ///////////////////////////////////////////////////////////
+    /// \brief Component array of a captured group
+    ///////////////////////////////////////////////////////////
+    struct Column {
+        std::type_index m_type; //!< The component type
+        uint32_t m_size;        //!< Size of the component type
+        uint32_t m_align;       //!< Align of the component type
+        size_t m_offset;        //!< Offset of the components in the buffer
+    };
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Captured entity group
+    ///////////////////////////////////////////////////////////
+    struct Group {
+        EntityGroupId m_id;      //!< The id of the group
+        EntityGroup* m_group;    //!< The group at capture time, used to detect layout changes
+        uint32_t m_numEntities;  //!< Number of entities in the group
+        uint32_t m_firstColumn;  //!< Index of the first column in the column list
+        uint32_t m_numColumns;   //!< Number of columns
+        uint32_t m_numShared;    //!< Number of shared component values, stored after the columns
+        size_t m_entitiesOffset; //!< Offset of the entity list in the buffer
+    };
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Captured sparse set
+    ///////////////////////////////////////////////////////////
+    struct Sparse {
+        std::type_index m_type;  //!< The component type
+        uint32_t m_numEntities;  //!< Number of components in the set
+        size_t m_entitiesOffset; //!< Offset of the entity list in the buffer
+        size_t m_dataOffset;     //!< Offset of the components in the buffer
+    };
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Make sure the buffer can hold a number of bytes
+    ///
+    /// Contents are not kept when the buffer grows.
+    ///
+    /// \return True if the buffer was reallocated
+    ///
+    ///////////////////////////////////////////////////////////
+    bool reserve(size_t size);
+
+private:
+    World* m_world;                            //!< World the state was captured from
+    uint32_t m_tick;                           //!< Change tick of the world at capture time
+    std::vector<Group> m_groups;               //!< Captured entity groups
+    std::vector<Column> m_columns;             //!< Component arrays of all groups
+    std::vector<Sparse> m_sparseSets;          //!< Captured sparse sets
+    std::vector<World::EntityData> m_entities; //!< Entity data array
+    std::vector<Handle> m_handleTable;         //!< Entity handle table
+    std::vector<uint32_t> m_indexTable;        //!< Entity index table
+    uint32_t m_nextFree;                       //!< Next free entity handle index
+    std::vector<EntityId> m_pendingRemoves;    //!< Entities that were queued for removal
+    bool m_hasDisabled;                        //!< Were any entities disabled at capture time
+    uint8_t* m_data;                           //!< Buffer holding entity lists and components
+    size_t m_size;                             //!< Number of bytes used in the buffer
+    size_t m_capacity;                         //!< Size of the buffer
+    size_t m_bytesCopied;                      //!< Bytes copied by the last capture
+};
+
+} // namespace ply
+
+///////////////////////////////////////////////////////////
+/// \class ply::WorldState
+/// \ingroup ECS
+///
+/// A WorldState is a reusable buffer for World::captureState() and
+/// World::restoreState(), meant for rollback netcode and speculative
+/// simulation, where the same world is saved and rewound many times
+/// per second. Unlike snapshots, states are kept in memory in the
+/// native layout of the world, and each component array is copied
+/// with a single memcpy(). The buffer is only reallocated when the
+/// world grows, so keeping a ring of states is allocation free in the
+/// steady state.
+///
+/// Usage example:
+/// \code
+/// std::vector<WorldState> history(8);
+///
+/// // Every frame
+/// world.captureState(history[frame % history.size()], true);
+/// world.tick(dt);
+///
+/// // A late input arrived, rewind and resimulate
+/// world.restoreState(history[inputFrame % history.size()]);
+/// \endcode
+///
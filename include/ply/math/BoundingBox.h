@@ -52,7 +52,7 @@ class BoundingBox {
     /// \return True if the bounding boxes overlap
     ///
     ///////////////////////////////////////////////////////////
-    bool overlaps(const BoundingBox& bbox);
+    bool overlaps(const BoundingBox& bbox) const;
 
     Vector3f m_min;  //!< The minimum coordinate of the box
     Vector3f m_max;  //!< The maximum coordinate of the box
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <ply/math/BoundingBox.h>
+#include <ply/math/Frustum.h>
+#include <ply/math/Ray.h>
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace ply {
+
+///////////////////////////////////////////////////////////
+/// \brief A dynamic bounding volume hierarchy of axis-aligned bounding boxes
+///
+///////////////////////////////////////////////////////////
+class BoundingBoxTree {
+public:
+    ///////////////////////////////////////////////////////////
+    /// \brief Create an empty tree
+    ///
+    /// \param margin The distance leaf boxes are enlarged by, so small movements don't restructure the tree
+    ///
+    ///////////////////////////////////////////////////////////
+    BoundingBoxTree(float margin = 0.1f);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Insert a box into the tree
+    ///
+    /// \param box The bounding box
+    /// \param data A user value returned by queries
+    ///
+    /// \return The proxy id of the box, which stays the same until it is removed
+    ///
+    ///////////////////////////////////////////////////////////
+    uint32_t insert(const BoundingBox& box, uint32_t data);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Remove a box from the tree
+    ///
+    /// \param proxy The proxy id returned by insert()
+    ///
+    ///////////////////////////////////////////////////////////
+    void remove(uint32_t proxy);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Change the bounding box of a proxy
+    ///
+    /// The tree is only restructured if the new box leaves the enlarged
+    /// box stored in the tree, or is much smaller than it. Otherwise
+    /// only the leaf's box is refit.
+    ///
+    /// \param proxy The proxy id returned by insert()
+    /// \param box The new bounding box
+    ///
+    /// \return True if the proxy was reinserted
+    ///
+    ///////////////////////////////////////////////////////////
+    bool update(uint32_t proxy, const BoundingBox& box);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Rebuild the tree top-down using the surface area heuristic
+    ///
+    /// Incremental insertion produces a tree that depends on the order
+    /// of insertion. A full rebuild is slower, but gives a better tree,
+    /// which makes queries faster (i.e. after loading a scene). Proxy ids
+    /// are not changed.
+    ///
+    ///////////////////////////////////////////////////////////
+    void rebuild();
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Remove all boxes from the tree
+    ///
+    ///////////////////////////////////////////////////////////
+    void clear();
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Find all boxes that overlap a box
+    ///
+    /// \param box The box to test
+    /// \param results The list to append the user values of overlapping boxes to
+    ///
+    ///////////////////////////////////////////////////////////
+    void query(const BoundingBox& box, std::vector<uint32_t>& results) const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Find all boxes that intersect or are inside a frustum
+    ///
+    /// Subtrees that are completely inside the frustum are added without
+    /// testing each of their boxes.
+    ///
+    /// \param frustum The frustum to test
+    /// \param results The list to append the user values of visible boxes to
+    ///
+    ///////////////////////////////////////////////////////////
+    void query(const Frustum& frustum, std::vector<uint32_t>& results) const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Find all boxes hit by a ray, nearest first
+    ///
+    /// Distances are measured in multiples of the ray direction, so they
+    /// are only world distances if the direction is normalized.
+    ///
+    /// \param ray The ray to cast
+    /// \param results The list to append the user values of hit boxes to
+    /// \param maxDistance The maximum distance along the ray
+    ///
+    ///////////////////////////////////////////////////////////
+    void raycast(
+        const Ray& ray,
+        std::vector<uint32_t>& results,
+        float maxDistance = std::numeric_limits<float>::max()
+    ) const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Get the bounding box of a proxy
+    ///
+    ///////////////////////////////////////////////////////////
+    const BoundingBox& getBox(uint32_t proxy) const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Get the user value of a proxy
+    ///
+    ///////////////////////////////////////////////////////////
+    uint32_t getData(uint32_t proxy) const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Get the number of boxes in the tree
+    ///
+    ///////////////////////////////////////////////////////////
+    size_t size() const;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Get the height of the tree, where a single leaf has a height of 0
+    ///
+    ///////////////////////////////////////////////////////////
+    uint32_t getHeight() const;
+
+    static constexpr uint32_t INVALID_NODE = 0xFFFFFFFF; //!< Index used for missing nodes
+
+private:
+    ///////////////////////////////////////////////////////////
+    /// \brief A node of the tree
+    ///////////////////////////////////////////////////////////
+    struct Node {
+        bool isLeaf() const { return m_children[0] == INVALID_NODE; }
+
+        BoundingBox m_box;        //!< Enlarged box for leaves, union of children for internal nodes
+        BoundingBox m_leafBox;    //!< The exact box of leaves
+        uint32_t m_parent;        //!< Parent node, or the next free node
+        uint32_t m_children[2];   //!< Child nodes (INVALID_NODE for leaves)
+        uint32_t m_data;          //!< User value of leaves
+        int32_t m_height;         //!< Height of the subtree, or -1 for free nodes
+    };
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Allocate a node from the free list
+    ///////////////////////////////////////////////////////////
+    uint32_t allocNode();
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Return a node to the free list
+    ///////////////////////////////////////////////////////////
+    void freeNode(uint32_t node);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Attach a leaf next to the sibling that increases the total area the least
+    ///////////////////////////////////////////////////////////
+    void insertLeaf(uint32_t leaf);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Detach a leaf from the tree
+    ///////////////////////////////////////////////////////////
+    void removeLeaf(uint32_t leaf);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Refit the boxes and heights of a node and its ancestors, rebalancing them
+    ///////////////////////////////////////////////////////////
+    void refitAncestors(uint32_t node);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Rotate a node's subtree if its children's heights differ by more than one
+    ///
+    /// \return The node that replaced the given node
+    ///
+    ///////////////////////////////////////////////////////////
+    uint32_t balance(uint32_t node);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Build a subtree from a list of leaves
+    ///
+    /// \return The root of the subtree
+    ///
+    ///////////////////////////////////////////////////////////
+    uint32_t build(uint32_t* leaves, size_t count);
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Add the user values of all leaves in a subtree
+    ///////////////////////////////////////////////////////////
+    void addSubtree(uint32_t node, std::vector<uint32_t>& results) const;
+
+private:
+    std::vector<Node> m_nodes; //!< Node pool
+    uint32_t m_root;           //!< The root node
+    uint32_t m_freeList;       //!< First free node
+    size_t m_numLeaves;        //!< Number of boxes in the tree
+    float m_margin;            //!< Distance leaf boxes are enlarged by
+};
+
+} // namespace ply
+
+///////////////////////////////////////////////////////////
+/// \class ply::BoundingBoxTree
+/// \ingroup Math
+///
+/// A binary tree of bounding boxes, where each internal node's box
+/// encloses the boxes of its children. Queries skip every subtree
+/// whose box doesn't pass the test, so finding the boxes in a region
+/// takes roughly logarithmic time instead of testing every box.
+///
+/// Boxes are inserted incrementally, next to the node that increases
+/// the total surface area of the tree the least, and the tree is kept
+/// balanced with rotations. Leaf boxes are enlarged by a margin, so
+/// moving boxes usually don't need to be reinserted.
+///
+/// Usage example:
+/// \code
+///
+/// using namespace ply;
+///
+/// BoundingBoxTree tree;
+/// uint32_t proxy = tree.insert(BoundingBox(Vector3f(-1.0f), Vector3f(1.0f)), 5);
+///
+/// // Move the box
+/// tree.update(proxy, BoundingBox(Vector3f(0.0f), Vector3f(2.0f)));
+///
+/// std::vector<uint32_t> results;
+/// tree.query(BoundingBox(Vector3f(1.5f), Vector3f(3.0f)), results); // { 5 }
+///
+/// \endcode
+///
+///////////////////////////////////////////////////////////
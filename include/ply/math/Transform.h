@@ -30,6 +30,56 @@ Matrix4f toTransformMatrix(const Vector3f& t, const Vector3f& r, const Vector3f&
 ///////////////////////////////////////////////////////////
 Matrix4f toTransformMatrix(const Vector3f& t, const Quaternion& r, const Vector3f& s);
 
+///////////////////////////////////////////////////////////
+/// \brief Create transform matrices from arrays of positions, quaternions, and scales
+///
+/// Produces the same matrices as toTransformMatrix(), several at a time,
+/// using SSE, AVX2, or NEON when the compiler targets them. The inputs can
+/// either be three separate arrays (stride of 0), or fields of the same
+/// array of structs, in which case the stride is the size of the struct.
+///
+/// \param t Pointer to the first position
+/// \param r Pointer to the first quaternion orientation
+/// \param s Pointer to the first scale
+/// \param out The array to write the transform matrices to
+/// \param count The number of transforms to convert
+/// \param stride The distance between consecutive inputs in bytes, or 0 if the inputs are separate arrays
+///
+///////////////////////////////////////////////////////////
+void toTransformMatrices(
+    const Vector3f* t,
+    const Quaternion* r,
+    const Vector3f* s,
+    Matrix4f* out,
+    size_t count,
+    size_t stride = 0
+);
+
+///////////////////////////////////////////////////////////
+/// \brief Create affine 3x4 transform matrices from arrays of positions, quaternions, and scales
+///
+/// Same as toTransformMatrices(), but only the first three rows of each
+/// matrix are written (the last row is always (0, 0, 0, 1)). This is the
+/// compact layout used for instance data, where each matrix takes three
+/// consecutive Vector4f.
+///
+/// \param t Pointer to the first position
+/// \param r Pointer to the first quaternion orientation
+/// \param s Pointer to the first scale
+/// \param out The array to write the matrix rows to (3 rows per transform)
+/// \param count The number of transforms to convert
+/// \param stride The distance between consecutive inputs in bytes, or 0 if the inputs are separate arrays
+///
+///////////////////////////////////////////////////////////
+void toAffineMatrices(
+    const Vector3f* t,
+    const Quaternion* r,
+    const Vector3f* s,
+    Vector4f* out,
+    size_t count,
+    size_t stride = 0
+);
+
 using glm::perspective;
 using glm::ortho;
 using glm::lookAt;
@@ -0,0 +1,149 @@
+#include <ply/core/MappedFile.h>
+#include <ply/core/Platform.h>
+
+#ifdef PLY_PLATFORM_WINDOWS
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#include <utility>
+
+namespace ply {
+
+///////////////////////////////////////////////////////////
+MappedFile::MappedFile() : m_data(0), m_size(0), m_handle(0) {}
+
+///////////////////////////////////////////////////////////
+MappedFile::MappedFile(const std::string& fname) : m_data(0), m_size(0), m_handle(0) {
+    open(fname);
+}
+
+///////////////////////////////////////////////////////////
+MappedFile::~MappedFile() {
+    close();
+}
+
+///////////////////////////////////////////////////////////
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : m_data(std::exchange(other.m_data, nullptr)),
+      m_size(std::exchange(other.m_size, 0)),
+      m_handle(std::exchange(other.m_handle, nullptr)) {}
+
+///////////////////////////////////////////////////////////
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        close();
+
+        m_data = std::exchange(other.m_data, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+        m_handle = std::exchange(other.m_handle, nullptr);
+    }
+
+    return *this;
+}
+
+///////////////////////////////////////////////////////////
+bool MappedFile::open(const std::string& fname) {
+    close();
+
+#ifdef PLY_PLATFORM_WINDOWS
+    HANDLE file = CreateFileA(
+        fname.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        NULL,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+        NULL
+    );
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+
+    // The mapping keeps its own reference to the file
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping)
+        return false;
+
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!data) {
+        CloseHandle(mapping);
+        return false;
+    }
+
+    m_data = (const uint8_t*)data;
+    m_size = (size_t)size.QuadPart;
+    m_handle = (void*)mapping;
+#else
+    int fd = ::open(fname.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+
+    // The mapping stays valid after the file descriptor is closed
+    void* data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    // Files are mostly read front to back
+    madvise(data, (size_t)info.st_size, MADV_SEQUENTIAL);
+
+    m_data = (const uint8_t*)data;
+    m_size = (size_t)info.st_size;
+#endif
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////
+void MappedFile::close() {
+    if (!m_data)
+        return;
+
+#ifdef PLY_PLATFORM_WINDOWS
+    UnmapViewOfFile((const void*)m_data);
+    CloseHandle((HANDLE)m_handle);
+#else
+    munmap((void*)m_data, m_size);
+#endif
+
+    m_data = 0;
+    m_size = 0;
+    m_handle = 0;
+}
+
+///////////////////////////////////////////////////////////
+bool MappedFile::isOpen() const {
+    return m_data != 0;
+}
+
+///////////////////////////////////////////////////////////
+const uint8_t* MappedFile::data() const {
+    return m_data;
+}
+
+///////////////////////////////////////////////////////////
+size_t MappedFile::size() const {
+    return m_size;
+}
+
+} // namespace ply
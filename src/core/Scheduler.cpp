@@ -8,7 +8,10 @@ namespace ply {
 Scheduler::Scheduler() : m_numBusy(0), m_numStopped(0), m_shouldStop(false) {}
 
 ///////////////////////////////////////////////////////////
-Scheduler::Scheduler(uint32_t numWorkers) : m_numBusy(0), m_shouldStop(false) {
+Scheduler::Scheduler(uint32_t numWorkers)
+    : m_numBusy(numWorkers),
+      m_numStopped(0),
+      m_shouldStop(false) {
     for (uint32_t i = 0; i < numWorkers; ++i)
         m_threads.push_back(std::thread(&Scheduler::workerLoop, this, i));
 
@@ -37,8 +40,9 @@ priv::TaskStateBase* Scheduler::getNextTask(std::deque<priv::TaskStateBase*>& qu
 
         // At this point, if is finished, return it
         if (deps.size() == 0) {
+            priv::TaskStateBase* state = *it;
             queue.erase(it);
-            return *it;
+            return state;
         }
     }
 
@@ -147,7 +151,10 @@ void Scheduler::setNumWorkers(uint32_t num) {
     if (m_threads.size())
         stop();
 
+    m_threads.clear();
     m_numBusy = num;
+    m_numStopped = 0;
+    m_shouldStop = false;
 
     for (uint32_t i = 0; i < num; ++i)
         m_threads.push_back(std::thread(&Scheduler::workerLoop, this, i));
@@ -196,8 +203,12 @@ void Barrier::wait() {
     // Keep waiting until number of busy threads is 0 and the size of queue is 0
     while (m_tasks.size() > 0) {
         // Pop from back until run into a task that is not finished
-        while (m_tasks.size() > 0 && m_tasks.back()->m_isDone)
+        while (m_tasks.size() > 0 && m_tasks.back()->m_isDone) {
+            // Release the barrier's reference before dropping the task
+            if (--m_tasks.back()->m_refCount == 0)
+                delete m_tasks.back();
             m_tasks.pop_back();
+        }
 
         // Wait for another task to finish (only if there are any tasks left)
         if (m_tasks.size() > 0)
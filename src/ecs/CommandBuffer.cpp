@@ -0,0 +1,136 @@
+#include <ply/core/Allocate.h>
+#include <ply/ecs/CommandBuffer.h>
+#include <ply/ecs/EntityBuilder.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace ply {
+
+namespace priv {
+
+///////////////////////////////////////////////////////////
+CommandBuffer::CommandBuffer()
+    : m_offset(0),
+      m_blockSize(0) {}
+
+///////////////////////////////////////////////////////////
+CommandBuffer::~CommandBuffer() {
+    clear();
+
+    for (void* block : m_blocks)
+        ALIGNED_FREE_DBG(block);
+}
+
+///////////////////////////////////////////////////////////
+void CommandBuffer::create(EntityBuilder* builder, uint32_t order) {
+    m_creates.push_back(Create{builder, order});
+}
+
+///////////////////////////////////////////////////////////
+void CommandBuffer::remove(EntityId id, uint32_t order) {
+    m_removes.push_back(Remove{id, order});
+}
+
+///////////////////////////////////////////////////////////
+void CommandBuffer::addComponent(
+    EntityId id,
+    std::type_index type,
+    const void* component,
+    size_t size,
+    size_t align,
+    uint32_t order
+) {
+    void* data = allocate(size, align);
+    memcpy(data, component, size);
+
+    m_changes.push_back(Change{id, type, data, (uint32_t)size, (uint32_t)align, order});
+}
+
+///////////////////////////////////////////////////////////
+void CommandBuffer::removeComponent(EntityId id, std::type_index type, uint32_t order) {
+    m_changes.push_back(Change{id, type, nullptr, 0, 0, order});
+}
+
+///////////////////////////////////////////////////////////
+void CommandBuffer::setEnabled(EntityId id, bool enabled, uint32_t order) {
+    m_enables.push_back(Enable{id, enabled, order});
+}
+
+///////////////////////////////////////////////////////////
+bool CommandBuffer::empty() const {
+    return m_creates.empty() && m_removes.empty() && m_changes.empty() && m_enables.empty();
+}
+
+///////////////////////////////////////////////////////////
+void CommandBuffer::clear() {
+    for (auto& create : m_creates)
+        delete create.m_builder;
+
+    m_creates.clear();
+    m_removes.clear();
+    m_changes.clear();
+    m_enables.clear();
+
+    // Keep the last block for the next tick
+    if (m_blocks.size() > 1) {
+        size_t keep = m_blocks.size() - 1;
+        for (size_t i = 0; i < m_blocks.size(); ++i) {
+            if (i != keep)
+                ALIGNED_FREE_DBG(m_blocks[i]);
+        }
+
+        m_blocks[0] = m_blocks[keep];
+        m_blocks.resize(1);
+    }
+
+    m_offset = 0;
+}
+
+///////////////////////////////////////////////////////////
+std::vector<CommandBuffer::Create>& CommandBuffer::getCreates() {
+    return m_creates;
+}
+
+///////////////////////////////////////////////////////////
+std::vector<CommandBuffer::Remove>& CommandBuffer::getRemoves() {
+    return m_removes;
+}
+
+///////////////////////////////////////////////////////////
+std::vector<CommandBuffer::Change>& CommandBuffer::getChanges() {
+    return m_changes;
+}
+
+///////////////////////////////////////////////////////////
+std::vector<CommandBuffer::Enable>& CommandBuffer::getEnables() {
+    return m_enables;
+}
+
+///////////////////////////////////////////////////////////
+void* CommandBuffer::allocate(size_t size, size_t align) {
+    if (!m_blocks.empty()) {
+        uintptr_t base = (uintptr_t)m_blocks.back();
+        size_t offset = ((base + m_offset + align - 1) & ~(uintptr_t)(align - 1)) - base;
+
+        if (offset + size <= m_blockSize) {
+            m_offset = offset + size;
+            return (uint8_t*)base + offset;
+        }
+    }
+
+    // Start a new block, large enough for the payload
+    m_blockSize = std::max(BLOCK_SIZE, size);
+    m_blocks.push_back(
+        ALIGNED_MALLOC_DBG(m_blockSize, std::max<size_t>(align, alignof(std::max_align_t)))
+    );
+    m_offset = size;
+
+    return m_blocks.back();
+}
+
+} // namespace priv
+
+} // namespace ply
@@ -1,27 +1,42 @@
 #include <ply/core/Allocate.h>
+#include <ply/core/Types.h>
 #include <ply/ecs/ComponentStore.h>
 
+#include <algorithm>
 #include <cstring>
+#include <mutex>
 
 namespace ply {
 
 namespace priv {
 
+///////////////////////////////////////////////////////////
+namespace {
+    // Tag arrays point here, so their data is never null
+    alignas(COMPONENT_ARRAY_ALIGN) uint8_t s_tagData[ENTITY_CHUNK_SIZE];
+}
+
 ///////////////////////////////////////////////////////////
 ComponentStore::ComponentStore() : m_start(0),
                                    m_last(0),
                                    m_end(0),
                                    m_typeSize(0),
-                                   m_typeAlign(0) {}
+                                   m_typeAlign(0),
+                                   m_numTags(0) {}
 
 ///////////////////////////////////////////////////////////
 ComponentStore::ComponentStore(size_t size, size_t align) : m_start(0),
                                                                 m_last(0),
                                                                 m_end(0),
                                                                 m_typeSize(size),
-                                                                m_typeAlign(align) {
+                                                                m_typeAlign(align),
+                                                                m_numTags(0) {
+    // Tags don't need any space
+    if (!size)
+        return;
+
     // Allocate initial space
-    m_start = (uint8_t*)ALIGNED_MALLOC_DBG(8 * size, align);
+    m_start = (uint8_t*)ALIGNED_MALLOC_DBG(8 * size, std::max<size_t>(align, COMPONENT_ARRAY_ALIGN));
     m_last = m_start;
 
     m_end = m_start + 8 * size;
@@ -42,7 +57,12 @@ ComponentStore::ComponentStore(const ComponentStore& other) : m_start(0),
                                                               m_last(0),
                                                               m_end(0),
                                                               m_typeSize(other.m_typeSize),
-                                                              m_typeAlign(other.m_typeAlign) {
+                                                              m_typeAlign(other.m_typeAlign),
+                                                              m_numTags(other.m_numTags) {
+    m_chunkTicks = other.m_chunkTicks;
+    if (isTag())
+        return;
+
     // Reserve own memory
     reserve((size_t)(other.m_end - other.m_start) / m_typeSize);
 
@@ -63,10 +83,15 @@ ComponentStore& ComponentStore::operator=(const ComponentStore& other) {
             m_start = 0;
             m_last = 0;
             m_end = 0;
-            m_typeSize = other.m_typeSize;
-            m_typeAlign = other.m_typeAlign;
         }
 
+        m_typeSize = other.m_typeSize;
+        m_typeAlign = other.m_typeAlign;
+        m_numTags = other.m_numTags;
+        m_chunkTicks = other.m_chunkTicks;
+        if (isTag())
+            return *this;
+
         // Reserve own memory if capacity is different
         size_t otherCap = (size_t)(other.m_end - other.m_start);
         if (otherCap != (size_t)(m_end - m_start))
@@ -88,12 +113,15 @@ ComponentStore::ComponentStore(ComponentStore&& other) noexcept : m_start(other.
                                                                   m_last(other.m_last),
                                                                   m_end(other.m_end),
                                                                   m_typeSize(other.m_typeSize),
-                                                                  m_typeAlign(other.m_typeAlign) {
+                                                                  m_typeAlign(other.m_typeAlign),
+                                                                  m_numTags(other.m_numTags),
+                                                                  m_chunkTicks(std::move(other.m_chunkTicks)) {
     other.m_start = 0;
     other.m_end = 0;
     other.m_last = 0;
     other.m_typeSize = 0;
     other.m_typeAlign = 0;
+    other.m_numTags = 0;
 }
 
 ///////////////////////////////////////////////////////////
@@ -104,12 +132,15 @@ ComponentStore& ComponentStore::operator=(ComponentStore&& other) noexcept {
         m_end = other.m_end;
         m_typeSize = other.m_typeSize;
         m_typeAlign = other.m_typeAlign;
+        m_numTags = other.m_numTags;
+        m_chunkTicks = std::move(other.m_chunkTicks);
 
         other.m_start = 0;
         other.m_end = 0;
         other.m_last = 0;
         other.m_typeSize = 0;
         other.m_typeAlign = 0;
+        other.m_numTags = 0;
     }
 
     return *this;
@@ -117,9 +148,13 @@ ComponentStore& ComponentStore::operator=(ComponentStore&& other) noexcept {
 
 ///////////////////////////////////////////////////////////
 void* ComponentStore::push(const void* data, size_t instances) {
-    // Double space if out
-    if (m_last + instances * m_typeSize > m_end)
-        reserve((m_end - m_start) / m_typeSize * 2);
+    if (isTag()) {
+        m_numTags += instances;
+        updateChunks();
+        return s_tagData;
+    }
+
+    grow(size() + instances);
 
     // Keep start of new section
     void* section = m_last;
@@ -128,21 +163,118 @@ void* ComponentStore::push(const void* data, size_t instances) {
     for (size_t i = 0; i < instances; ++i, m_last += m_typeSize)
         memcpy(m_last, data, m_typeSize);
 
+    updateChunks();
+
+    return section;
+}
+
+///////////////////////////////////////////////////////////
+void* ComponentStore::append(const void* data, size_t count) {
+    if (isTag())
+        return push(data, count);
+
+    grow(size() + count);
+
+    // Copy whole block at once
+    void* section = m_last;
+    memcpy(m_last, data, count * m_typeSize);
+    m_last += count * m_typeSize;
+
+    updateChunks();
+
     return section;
 }
 
 ///////////////////////////////////////////////////////////
 void ComponentStore::remove(size_t index) {
+    if (isTag()) {
+        --m_numTags;
+        updateChunks();
+        return;
+    }
+
     // Copy last into target index
     memcpy(m_start + index * m_typeSize, m_last - m_typeSize, m_typeSize);
 
     // Decrement last
     m_last -= m_typeSize;
+
+    updateChunks();
+}
+
+///////////////////////////////////////////////////////////
+void ComponentStore::grow(size_t required) {
+    if (m_start + required * m_typeSize <= m_end)
+        return;
+
+    // Double space if out (keep doubling in case a large batch is pushed)
+    size_t capacity = std::max<size_t>((m_end - m_start) / m_typeSize, 8);
+    while (capacity < required)
+        capacity *= 2;
+
+    reserve(capacity);
+}
+
+///////////////////////////////////////////////////////////
+void ComponentStore::resize(size_t size) {
+    if (isTag()) {
+        m_numTags = size;
+        updateChunks();
+        return;
+    }
+
+    // Make sure there is enough space
+    if (m_start + size * m_typeSize > m_end)
+        reserve(size);
+
+    // Move last pointer, new elements are left uninitialized
+    m_last = m_start + size * m_typeSize;
+
+    updateChunks();
+}
+
+///////////////////////////////////////////////////////////
+void ComponentStore::markChanged(size_t index, size_t count, uint32_t tick) {
+    if (count == 0)
+        return;
+
+    size_t last = (index + count - 1) / ENTITY_CHUNK_SIZE;
+    for (size_t c = index / ENTITY_CHUNK_SIZE; c <= last && c < m_chunkTicks.size(); ++c)
+        m_chunkTicks[c].m_changed = tick;
+}
+
+///////////////////////////////////////////////////////////
+void ComponentStore::markAdded(size_t index, size_t count, uint32_t tick) {
+    if (count == 0)
+        return;
+
+    size_t last = (index + count - 1) / ENTITY_CHUNK_SIZE;
+    for (size_t c = index / ENTITY_CHUNK_SIZE; c <= last && c < m_chunkTicks.size(); ++c) {
+        m_chunkTicks[c].m_added = tick;
+        m_chunkTicks[c].m_changed = tick;
+    }
+}
+
+///////////////////////////////////////////////////////////
+uint32_t ComponentStore::getChangedTick(size_t chunk) const {
+    return m_chunkTicks[chunk].m_changed;
+}
+
+///////////////////////////////////////////////////////////
+uint32_t ComponentStore::getAddedTick(size_t chunk) const {
+    return m_chunkTicks[chunk].m_added;
+}
+
+///////////////////////////////////////////////////////////
+void ComponentStore::updateChunks() {
+    size_t numChunks = (size() + ENTITY_CHUNK_SIZE - 1) / ENTITY_CHUNK_SIZE;
+    if (numChunks != m_chunkTicks.size())
+        m_chunkTicks.resize(numChunks, ChunkTicks{0, 0});
 }
 
 ///////////////////////////////////////////////////////////
 void* ComponentStore::data(size_t index) const {
-    return m_start + index * m_typeSize;
+    return isTag() ? s_tagData : m_start + index * m_typeSize;
 }
 
 ///////////////////////////////////////////////////////////
@@ -152,8 +284,8 @@ void ComponentStore::reserve(size_t size) {
     size_t prevCap = (size_t)(m_end - m_start);    // in bytes
     size_t newCap = size * m_typeSize;               // in bytes
 
-    if (prevCap != size) {
-        m_start = (uint8_t*)ALIGNED_MALLOC_DBG(newCap, m_typeAlign);
+    if (newCap > prevCap) {
+        m_start = (uint8_t*)ALIGNED_MALLOC_DBG(newCap, std::max<size_t>(m_typeAlign, COMPONENT_ARRAY_ALIGN));
         m_last = m_start + prevSize;
         m_end = m_start + newCap;
 
@@ -167,9 +299,36 @@ void ComponentStore::reserve(size_t size) {
     }
 }
 
+///////////////////////////////////////////////////////////
+size_t ComponentStore::shrinkToFit() {
+    size_t prevCap = (size_t)(m_end - m_start);
+    size_t prevSize = (size_t)(m_last - m_start);
+    size_t newCap = std::max<size_t>(size(), 8) * m_typeSize;
+
+    if (!m_start || newCap >= prevCap)
+        return 0;
+
+    uint8_t* start = m_start;
+    m_start = (uint8_t*)ALIGNED_MALLOC_DBG(newCap, std::max<size_t>(m_typeAlign, COMPONENT_ARRAY_ALIGN));
+    m_last = m_start + prevSize;
+    m_end = m_start + newCap;
+
+    memcpy(m_start, start, prevSize);
+    ALIGNED_FREE_DBG(start);
+
+    m_chunkTicks.shrink_to_fit();
+
+    return prevCap - newCap;
+}
+
 ///////////////////////////////////////////////////////////
 size_t ComponentStore::size() const {
-    return (size_t)(m_last - m_end) / m_typeSize;
+    return isTag() ? m_numTags : (size_t)(m_last - m_start) / m_typeSize;
+}
+
+///////////////////////////////////////////////////////////
+size_t ComponentStore::capacity() const {
+    return isTag() ? m_numTags : (size_t)(m_end - m_start) / m_typeSize;
 }
 
 ///////////////////////////////////////////////////////////
@@ -182,6 +341,43 @@ size_t ComponentStore::getTypeAlign() const {
     return m_typeAlign;
 }
 
+///////////////////////////////////////////////////////////
+bool ComponentStore::isTag() const {
+    return m_typeSize == 0;
+}
+
+///////////////////////////////////////////////////////////
+namespace {
+    std::mutex& componentTypeMutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    HashMap<std::string, ComponentTypeInfo>& componentTypes() {
+        static HashMap<std::string, ComponentTypeInfo> types;
+        return types;
+    }
+}
+
+///////////////////////////////////////////////////////////
+void registerComponentType(std::type_index type, uint32_t size, uint32_t align) {
+    std::lock_guard<std::mutex> lock(componentTypeMutex());
+    componentTypes().insert(
+        std::make_pair(std::string(type.name()), ComponentTypeInfo{type, size, align})
+    );
+}
+
+///////////////////////////////////////////////////////////
+std::optional<ComponentTypeInfo> findComponentType(const std::string& name) {
+    std::lock_guard<std::mutex> lock(componentTypeMutex());
+
+    auto it = componentTypes().find(name);
+    if (it == componentTypes().end())
+        return std::nullopt;
+
+    return it->second;
+}
+
 }  // namespace priv
 
 }  // namespace ply
@@ -43,6 +43,8 @@ HashMap<std::type_index, void*> Entity::getAll() {
     HashMap<std::type_index, void*> ptrs;
     for (auto it = m_group->m_components.begin(); it != m_group->m_components.end(); ++it)
         ptrs[it.key()] = it.value().data(m_index);
+    for (auto it = m_group->m_shared.begin(); it != m_group->m_shared.end(); ++it)
+        ptrs[it.key()] = it.value().data();
 
     return ptrs;
 }
@@ -1,3 +1,4 @@
+#include <ply/core/Allocate.h>
 #include <ply/ecs/EntityBuilder.h>
 #include <ply/ecs/World.h>
 
@@ -7,73 +8,71 @@ namespace ply {
 HashMap<std::type_index, ObjectPool> EntityBuilder::s_pools;
 
 ///////////////////////////////////////////////////////////
-EntityBuilder::EntityBuilder() : m_world(0), m_numCreate(0) {}
+std::mutex EntityBuilder::s_poolMutex;
 
 ///////////////////////////////////////////////////////////
-EntityBuilder::EntityBuilder(World* world) : m_world(world), m_numCreate(0) {}
+EntityBuilder::EntityBuilder()
+    : m_world(0),
+      m_group(0),
+      m_numCreate(0),
+      m_isSpawn(false),
+      m_ownsColumns(false) {}
+
+///////////////////////////////////////////////////////////
+EntityBuilder::EntityBuilder(World* world)
+    : m_world(world),
+      m_group(0),
+      m_numCreate(0),
+      m_isSpawn(false),
+      m_ownsColumns(false) {}
 
 ///////////////////////////////////////////////////////////
 EntityBuilder::EntityBuilder(const EntityBuilder& other)
     : m_world(other.m_world),
+      m_group(other.m_group),
+      m_components(other.m_components),
       m_numCreate(other.m_numCreate),
-      m_components(other.m_components) {
-    // Create copies of components
-    if (m_components.size() > 0) {
-        for (auto it = m_components.begin(); it != m_components.end(); ++it) {
-            // Allocate new component in pool, then copy data
-            auto& mdata = it.value();
-            void* newData = s_pools[it.key()].alloc();
-
-            // Copy old to new
-            memcpy(newData, mdata.m_data, mdata.m_size);
-
-            // Update pointer
-            mdata.m_data = newData;
-        }
-    }
+      m_onCreate(other.m_onCreate),
+      m_isSpawn(other.m_isSpawn),
+      m_ownsColumns(other.m_ownsColumns) {
+    copyComponents();
 }
 
 ///////////////////////////////////////////////////////////
 EntityBuilder::EntityBuilder(EntityBuilder&& other) noexcept
     : m_world(other.m_world),
+      m_group(other.m_group),
+      m_components(std::move(other.m_components)),
       m_numCreate(other.m_numCreate),
-      m_components(std::move(other.m_components)) {
+      m_onCreate(std::move(other.m_onCreate)),
+      m_ids(std::move(other.m_ids)),
+      m_isSpawn(other.m_isSpawn),
+      m_ownsColumns(other.m_ownsColumns) {
     other.m_world = 0;
+    other.m_group = 0;
     other.m_numCreate = 0;
+    other.m_components.clear();
 }
 
 ///////////////////////////////////////////////////////////
 EntityBuilder::~EntityBuilder() {
-    // Free components if still allocated
-    if (m_components.size() > 0) {
-        for (auto it = m_components.begin(); it != m_components.end(); ++it)
-            s_pools[it.key()].free(it.value().m_data);
-
-        m_components.clear();
-    }
+    freeComponents();
 }
 
 ///////////////////////////////////////////////////////////
 EntityBuilder& EntityBuilder::operator=(const EntityBuilder& other) {
     if (this != &other) {
+        freeComponents();
+
         m_world = other.m_world;
+        m_group = other.m_group;
         m_numCreate = other.m_numCreate;
+        m_onCreate = other.m_onCreate;
         m_components = other.m_components;
+        m_isSpawn = other.m_isSpawn;
+        m_ownsColumns = other.m_ownsColumns;
 
-        // Create copies of components
-        if (m_components.size() > 0) {
-            for (auto it = m_components.begin(); it != m_components.end(); ++it) {
-                // Allocate new component in pool, then copy data
-                auto& mdata = it.value();
-                void* newData = s_pools[it.key()].alloc();
-
-                // Copy old to new
-                memcpy(newData, mdata.m_data, mdata.m_size);
-
-                // Update pointer
-                mdata.m_data = newData;
-            }
-        }
+        copyComponents();
     }
 
     return *this;
@@ -82,17 +81,112 @@ EntityBuilder& EntityBuilder::operator=(const EntityBuilder& other) {
 ///////////////////////////////////////////////////////////
 EntityBuilder& EntityBuilder::operator=(EntityBuilder&& other) noexcept {
     if (this != &other) {
+        freeComponents();
+
         m_world = other.m_world;
+        m_group = other.m_group;
         m_numCreate = other.m_numCreate;
+        m_onCreate = std::move(other.m_onCreate);
+        m_ids = std::move(other.m_ids);
         m_components = std::move(other.m_components);
+        m_isSpawn = other.m_isSpawn;
+        m_ownsColumns = other.m_ownsColumns;
 
         other.m_world = 0;
+        other.m_group = 0;
         other.m_numCreate = 0;
+        other.m_components.clear();
     }
 
     return *this;
 }
 
+///////////////////////////////////////////////////////////
+void EntityBuilder::copyComponents() {
+    for (auto it = m_components.begin(); it != m_components.end(); ++it) {
+        auto& mdata = it.value();
+        void* newData = 0;
+
+        // Tags have no data
+        if (mdata.m_size == 0) {
+            mdata.m_data = nullptr;
+            continue;
+        }
+
+        if (m_isSpawn) {
+            // Copy whole column
+            size_t size = (size_t)mdata.m_size * m_numCreate;
+            newData = MALLOC_DBG(size);
+            memcpy(newData, mdata.m_data, size);
+        } else {
+            // Allocate new component in pool, then copy data
+            std::lock_guard<std::mutex> lock(s_poolMutex);
+            newData = s_pools[it.key()].alloc();
+            memcpy(newData, mdata.m_data, mdata.m_size);
+        }
+
+        // Update pointer
+        mdata.m_data = newData;
+    }
+
+    if (m_isSpawn)
+        m_ownsColumns = true;
+}
+
+///////////////////////////////////////////////////////////
+void EntityBuilder::freeComponents() {
+    // Free components if still allocated (borrowed spawn columns belong to the caller)
+    for (auto it = m_components.begin(); it != m_components.end(); ++it) {
+        if (it.value().m_size == 0)
+            continue;
+
+        if (!m_isSpawn) {
+            std::lock_guard<std::mutex> lock(s_poolMutex);
+            s_pools[it.key()].free(it.value().m_data);
+        }
+        else if (m_ownsColumns)
+            FREE_DBG(it.value().m_data);
+    }
+
+    m_components.clear();
+}
+
+///////////////////////////////////////////////////////////
+void EntityBuilder::checkNotShared(const std::vector<std::type_index>& types) const {
+    // Shared components have one value per group, so they can't be initialized per entity
+    for (size_t i = 0; i < types.size(); ++i)
+        CHECK_F(
+            !m_world->isSharedComponent(types[i]),
+            "shared component %s can't be initialized in onCreate",
+            types[i].name()
+        );
+}
+
+///////////////////////////////////////////////////////////
+void EntityBuilder::addColumn(std::type_index type, const void* data, uint32_t size, uint32_t align) {
+    m_components[type] = priv::ComponentMetadata({(void*)data, size, align});
+}
+
+///////////////////////////////////////////////////////////
+std::vector<EntityId> EntityBuilder::deferCreate(uint32_t num) {
+    World* world = m_world;
+    m_numCreate = num;
+
+    // Ids are handed out now, the entities take them when they are created
+    m_ids.resize(num);
+    world->reserveEntities(m_ids.data(), num);
+    std::vector<EntityId> ids = m_ids;
+
+    EntityBuilder* deferred = new EntityBuilder(std::move(*this));
+
+    // Spawn columns point to the caller's memory, so they have to be copied
+    if (deferred->m_isSpawn && !deferred->m_ownsColumns)
+        deferred->copyComponents();
+
+    world->deferCreate(deferred);
+    return ids;
+}
+
 ///////////////////////////////////////////////////////////
 std::vector<EntityId> EntityBuilder::create(uint32_t num) {
     if (!m_components.size())
@@ -111,19 +205,48 @@ std::vector<EntityId> EntityBuilder::create(uint32_t num) {
 ///////////////////////////////////////////////////////////
 std::vector<EntityId>
 EntityBuilder::createImpl(uint32_t num, HashMap<std::type_index, void*>& ptrs, bool allowDefer) {
-    // Get group hash
+    // Get group hash (sparse components are stored outside of groups)
     std::vector<std::type_index> typeIds;
-    for (auto it = m_components.begin(); it != m_components.end(); ++it)
+    bool hasSparse = false;
+    bool hasShared = false;
+    EntityGroupId sharedHash = 0;
+    for (auto it = m_components.begin(); it != m_components.end(); ++it) {
+        if (m_world->findSparseSet(it.key())) {
+            hasSparse = true;
+            continue;
+        }
+
         typeIds.push_back(it.key());
 
-    EntityGroupId groupId = entityGroupHash(typeIds);
+        // Values of shared components are part of the group identity
+        if (m_world->isSharedComponent(it.key())) {
+            CHECK_F(!m_isSpawn, "shared component %s can't be spawned from columns", it.key().name());
+            hasShared = true;
+            sharedHash += sharedValueHash(it.key(), it.value().m_data, it.value().m_size);
+        }
+    }
+
+    EntityGroupId groupId = entityGroupHash(typeIds) + sharedHash;
+
+    // Structural changes are always deferred while systems run (this includes
+    // creating new groups, which updates the group lists of systems)
+    if (allowDefer && m_world->m_isExecutingSystems)
+        return deferCreate(num);
 
     // Get entity group (create if needed)
     EntityGroup* group = nullptr;
     {
         // Lock group map
         WriteLock worldLock(m_world->m_groupsMutex);
-        group = m_world->getOrCreateEntityGroup(groupId, m_components);
+
+        if (hasSparse) {
+            HashMap<std::type_index, priv::ComponentMetadata> groupComponents;
+            for (auto type : typeIds)
+                groupComponents[type] = m_components[type];
+            group = m_world->getOrCreateEntityGroup(groupId, groupComponents);
+        } else {
+            group = m_world->getOrCreateEntityGroup(groupId, m_components);
+        }
     }
 
     // Store group pointer
@@ -135,8 +258,7 @@ EntityBuilder::createImpl(uint32_t num, HashMap<std::type_index, void*>& ptrs, b
     if (defer) {
         if (allowDefer) {
             // Add to queue
-            m_world->m_addQueue.push_back(new EntityBuilder(std::move(*this)));
-            return {};
+            return deferCreate(num);
         } else {
             // If not allowed to defer, then just wait
             defer = false;
@@ -147,32 +269,71 @@ EntityBuilder::createImpl(uint32_t num, HashMap<std::type_index, void*>& ptrs, b
     // Lock access to group
     WriteLock groupLock(group->m_mutex, std::adopt_lock);
 
-    // Create entities (and ids)
-    auto& entityData = m_world->m_entities;
+    // Deferred creations reserved their ids without locking when they were queued,
+    // adding the entities to the entity table is serialized
+    std::vector<EntityId> ids = std::move(m_ids);
+
     uint32_t startIndex = group->m_entities.size();
+    {
+        std::lock_guard<std::mutex> lock(m_world->m_entitiesMutex);
+        auto& entityData = m_world->m_entities;
+
+        // Grow geometrically, so creating a few entities at a time doesn't reallocate every call.
+        // Readers of the table don't lock, so this must not overlap them (see World::entity())
+        entityData.grow(entityData.size() + num);
 
-    std::vector<EntityId> ids;
-    ids.reserve(num);
-    for (uint32_t i = 0; i < num; ++i) {
-        // Create entity data
         World::EntityData data;
-        data.m_group = groupId;
-        data.m_index = startIndex + i;
+        data.m_group = group;
         data.m_isAlive = true;
+        data.m_isEnabled = true;
+
+        // Ids removed since the last tick are reused first, so worlds that don't tick
+        // still recycle them. The rest are reserved, so they can't collide with ids
+        // handed out without the lock
+        uint32_t numPushed = 0;
+        if (ids.empty()) {
+            ids.reserve(num);
+            for (; numPushed < num && entityData.hasFreeHandle(); ++numPushed) {
+                data.m_index = startIndex + numPushed;
+                ids.push_back(entityData.push(data));
+            }
 
-        // Add to global list of entity data
-        Handle handle = entityData.push(data);
+            ids.resize(num);
+            m_world->reserveEntities(ids.data() + numPushed, num - numPushed);
+        }
 
-        // Add to lists
-        group->m_entities.push_back(handle);
-        ids.push_back(handle);
+        for (uint32_t i = numPushed; i < num; ++i) {
+            data.m_index = startIndex + i;
+            entityData.insert(ids[i], data);
+        }
     }
 
+    // Add to the group's entity list
+    group->m_entities.insert(group->m_entities.end(), ids.begin(), ids.end());
+
     // Copy components to component arrays
-    for (auto it = m_components.begin(); it != m_components.end(); ++it)
+    uint32_t tick = m_world->nextChangeTick();
+    for (auto it = m_components.begin(); it != m_components.end(); ++it) {
+        // Sparse components are stored contiguously in their set too
+        if (priv::SparseSet* sparse = hasSparse ? m_world->findSparseSet(it.key()) : nullptr) {
+            WriteLock setLock(sparse->getMutex());
+            ptrs[it.key()] = sparse->append(ids, it.value().m_data, !m_isSpawn, tick);
+            continue;
+        }
+
+        // Shared values are stored once, when the group is created
+        if (hasShared && m_world->isSharedComponent(it.key()))
+            continue;
+
         // Add component to array, using the allocated data, then store the
         // location of the new component values
-        ptrs[it.key()] = group->m_components[it.key()].push(it.value().m_data, num);
+        priv::ComponentStore& store = group->m_components.at(it.key());
+        if (m_isSpawn)
+            ptrs[it.key()] = store.append(it.value().m_data, num);
+        else
+            ptrs[it.key()] = store.push(it.value().m_data, num);
+        store.markAdded(startIndex, num, tick);
+    }
 
     return ids;
 }
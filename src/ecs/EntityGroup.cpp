@@ -2,6 +2,16 @@
 
 namespace ply {
 
+///////////////////////////////////////////////////////////
+EntityGroup::EntityGroup(
+    EntityGroupId id,
+    priv::ComponentMap::Map&& components,
+    priv::ComponentMap::Map&& shared
+) :
+    m_id(id),
+    m_components(std::move(components)),
+    m_shared(std::move(shared)) {}
+
 ///////////////////////////////////////////////////////////
 EntityGroupId entityGroupHash(const std::vector<std::type_index>& ids) {
     if (ids.size() < 0)
@@ -14,4 +24,54 @@ EntityGroupId entityGroupHash(const std::vector<std::type_index>& ids) {
     return hash;
 }
 
+///////////////////////////////////////////////////////////
+EntityGroupId sharedValueHash(std::type_index type, const void* data, size_t size) {
+    // FNV-1a over the bytes of the value, seeded with the type
+    uint32_t hash = 2166136261u ^ (uint32_t)type.hash_code();
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+namespace priv {
+
+///////////////////////////////////////////////////////////
+void setRowDisabled(EntityGroup& group, size_t row, bool disabled) {
+    size_t word = row / 64;
+    if (word >= group.m_disabled.size()) {
+        if (!disabled)
+            return;
+        group.m_disabled.resize(word + 1, 0);
+    }
+
+    uint64_t bit = (uint64_t)1 << (row % 64);
+    uint64_t& bits = group.m_disabled[word];
+    if (((bits & bit) != 0) == disabled)
+        return;
+
+    bits ^= bit;
+    if (disabled)
+        ++group.m_numDisabled;
+    else
+        --group.m_numDisabled;
+}
+
+///////////////////////////////////////////////////////////
+void swapPopDisabled(EntityGroup& group, size_t row) {
+    if (group.m_numDisabled == 0)
+        return;
+
+    // The moved row takes the place of the removed one, and the old last row is cleared
+    size_t last = group.m_entities.size();
+    if (row != last)
+        setRowDisabled(group, row, isRowDisabled(group, last));
+    setRowDisabled(group, last, false);
+}
+
+} // namespace priv
+
 } // namespace ply
\ No newline at end of file
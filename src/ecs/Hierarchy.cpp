@@ -0,0 +1,291 @@
+#include <ply/core/Scheduler.h>
+#include <ply/ecs/Hierarchy.h>
+#include <ply/ecs/World.h>
+#include <ply/math/Transform.h>
+
+#include <loguru.hpp>
+
+#include <algorithm>
+
+namespace ply {
+
+///////////////////////////////////////////////////////////
+Hierarchy::Hierarchy(World* world, Scheduler* scheduler)
+    : m_world(world),
+      m_scheduler(scheduler),
+      m_isDirty(true),
+      m_numRestores(world->getNumRestores()) {
+    m_roots = world->query().match<Transform, WorldTransform>().exclude<Parent>().compile();
+    m_children = world->query().match<Transform, WorldTransform, Parent>().compile();
+    m_parentChanges = world->query().match<Transform, WorldTransform>().changed<Parent>().compile();
+    m_localChanges = world->query().match<WorldTransform>().changed<Transform>().compile();
+    m_outputs = world->query().match<Transform, WorldTransform>().compile();
+
+    // Entities joining or leaving the hierarchy, or changing parents, require a rebuild
+    auto markDirty = [this](EntityId) { m_isDirty = true; };
+    m_observers = {
+        world->observer(World::OnCreate).match<Transform, WorldTransform>().each(markDirty),
+        world->observer(World::OnRemove).match<Transform, WorldTransform>().each(markDirty),
+        world->observer(World::OnEnter).match<Transform, WorldTransform>().each(markDirty),
+        world->observer(World::OnExit).match<Transform, WorldTransform>().each(markDirty),
+        world->observer(World::OnEnter).match<Parent>().each(markDirty),
+        world->observer(World::OnExit).match<Parent>().each(markDirty),
+    };
+}
+
+///////////////////////////////////////////////////////////
+Hierarchy::~Hierarchy() {
+    for (Observer* observer : m_observers)
+        m_world->removeObserver(observer);
+}
+
+///////////////////////////////////////////////////////////
+void Hierarchy::update() {
+    // Restores don't send events, so the node list may refer to entities that were rewound
+    uint32_t numRestores = m_world->getNumRestores();
+    if (numRestores != m_numRestores) {
+        m_numRestores = numRestores;
+        m_isDirty = true;
+    }
+
+    // Parent components that were modified in place
+    bool reparented = false;
+    m_parentChanges.each([&](const Parent&) { reparented = true; });
+
+    bool rebuilt = m_isDirty.exchange(false) || reparented;
+    if (rebuilt)
+        rebuild();
+
+    // Copy changed local transforms into the node list (a rebuild already
+    // copies all of them), converting them to matrices in one batch. Changes
+    // are tracked per chunk, so transforms that are actually the same are
+    // skipped to avoid updating their subtrees
+    std::vector<uint32_t> changedNodes;
+    std::vector<Transform> changedTransforms;
+    m_localChanges.each([&](EntityId id, const Transform& t) {
+        uint32_t node = rebuilt ? INVALID_NODE : getNode(id);
+        if (node == INVALID_NODE)
+            return;
+
+        changedNodes.push_back(node);
+        changedTransforms.push_back(t);
+    });
+
+    std::vector<Matrix4f> changedLocal(changedNodes.size());
+    toTransformMatrices(changedTransforms.data(), changedLocal.data(), changedLocal.size());
+    for (size_t i = 0; i < changedNodes.size(); ++i) {
+        uint32_t node = changedNodes[i];
+        if (changedLocal[i] != m_local[node]) {
+            m_local[node] = changedLocal[i];
+            m_changed[node] = 1;
+        }
+    }
+
+    // Compute world transforms one level at a time, since each level only
+    // depends on the one before it
+    size_t numLevels = m_levels.size() - 1;
+    for (size_t l = 0; l < numLevels; ++l) {
+        size_t start = m_levels[l];
+        size_t end = m_levels[l + 1];
+
+        // Small levels aren't worth splitting
+        constexpr size_t minBatchSize = 1024;
+        if (!m_scheduler || end - start < 2 * minBatchSize) {
+            updateNodes(start, end);
+            continue;
+        }
+
+        size_t numBatches = std::min<size_t>(
+            (end - start) / minBatchSize, std::max<uint32_t>(m_scheduler->getNumWorkers(), 1)
+        );
+        size_t batchSize = (end - start + numBatches - 1) / numBatches;
+
+        Barrier barrier = m_scheduler->barrier(numBatches);
+        for (size_t b = start; b < end; b += batchSize) {
+            size_t batchEnd = std::min(b + batchSize, end);
+            barrier.add([this, b, batchEnd]() { updateNodes(b, batchEnd); });
+        }
+        barrier.wait();
+    }
+
+    // Write world transforms of changed nodes back to their entities
+    if (std::find(m_changed.begin(), m_changed.end(), 1) == m_changed.end())
+        return;
+
+    m_outputs.each([&](QueryIterator& it, const WorldTransform&) {
+        uint32_t node = getNode(it.id);
+        if (node != INVALID_NODE && m_changed[node])
+            it.get<WorldTransform>().matrix = m_transforms[node];
+    });
+
+    std::fill(m_changed.begin(), m_changed.end(), 0);
+}
+
+///////////////////////////////////////////////////////////
+std::vector<EntityId> Hierarchy::getChildren(EntityId id) const {
+    std::vector<EntityId> children;
+
+    // Children are next to each other in the level after their parent
+    uint32_t node = getNode(id);
+    if (node == INVALID_NODE)
+        return children;
+
+    // Parent indices are sorted after the roots
+    auto range = std::equal_range(m_parents.begin() + m_levels[1], m_parents.end(), node);
+    for (auto it = range.first; it != range.second; ++it)
+        children.push_back(m_entities[it - m_parents.begin()]);
+
+    return children;
+}
+
+///////////////////////////////////////////////////////////
+uint32_t Hierarchy::getDepth(EntityId id) const {
+    uint32_t node = getNode(id);
+    if (node == INVALID_NODE)
+        return 0;
+
+    auto it = std::upper_bound(m_levels.begin(), m_levels.end(), node);
+    return (uint32_t)(it - m_levels.begin()) - 1;
+}
+
+///////////////////////////////////////////////////////////
+void Hierarchy::rebuild() {
+    // Collect all entities in the hierarchy, in storage order
+    std::vector<EntityId> entities;
+    std::vector<EntityId> parents;
+    std::vector<Transform> transforms;
+
+    m_roots.each([&](EntityId id, const Transform& t) {
+        entities.push_back(id);
+        parents.push_back(EntityId());
+        transforms.push_back(t);
+    });
+    size_t numRoots = entities.size();
+
+    m_children.each([&](EntityId id, const Transform& t, const Parent& p) {
+        entities.push_back(id);
+        parents.push_back(p.entity);
+        transforms.push_back(t);
+    });
+
+    // Local matrices are computed in one batch
+    std::vector<Matrix4f> local(transforms.size());
+    toTransformMatrices(transforms.data(), local.data(), local.size());
+
+    // Index of each entity in the collected list, by handle index
+    uint32_t maxIndex = 0;
+    for (EntityId id : entities)
+        maxIndex = std::max<uint32_t>(maxIndex, id.m_index);
+
+    std::vector<uint32_t> indices(entities.empty() ? 0 : maxIndex + 1, INVALID_NODE);
+    for (size_t i = 0; i < entities.size(); ++i)
+        indices[entities[i].m_index] = (uint32_t)i;
+
+    auto find = [&](EntityId id) -> uint32_t {
+        if (id.m_index >= indices.size())
+            return INVALID_NODE;
+
+        uint32_t i = indices[id.m_index];
+        return i != INVALID_NODE && entities[i] == id ? i : INVALID_NODE;
+    };
+
+    // List the children of each entity (in compressed rows). Entities whose parent
+    // isn't in the hierarchy become roots
+    std::vector<uint32_t> childStart(entities.size() + 1, 0);
+    std::vector<uint32_t> parentIndex(entities.size(), INVALID_NODE);
+    std::vector<uint32_t> roots;
+    roots.reserve(numRoots);
+    for (uint32_t i = 0; i < numRoots; ++i)
+        roots.push_back(i);
+
+    for (size_t i = numRoots; i < entities.size(); ++i) {
+        uint32_t p = find(parents[i]);
+        if (p == INVALID_NODE || p == i) {
+            roots.push_back((uint32_t)i);
+        } else {
+            parentIndex[i] = p;
+            ++childStart[p + 1];
+        }
+    }
+
+    for (size_t i = 0; i < entities.size(); ++i)
+        childStart[i + 1] += childStart[i];
+
+    std::vector<uint32_t> children(childStart.back());
+    std::vector<uint32_t> childCount(entities.size(), 0);
+    for (size_t i = numRoots; i < entities.size(); ++i) {
+        uint32_t p = parentIndex[i];
+        if (p != INVALID_NODE)
+            children[childStart[p] + childCount[p]++] = (uint32_t)i;
+    }
+
+    // Sort by depth, breadth first, so that siblings are contiguous and each
+    // level is in the order of its parents
+    std::vector<uint32_t> order = std::move(roots);
+    order.reserve(entities.size());
+    m_levels.clear();
+    m_levels.push_back(0);
+
+    size_t levelStart = 0;
+    while (levelStart < order.size()) {
+        size_t levelEnd = order.size();
+        for (size_t o = levelStart; o < levelEnd; ++o) {
+            uint32_t i = order[o];
+            for (uint32_t c = childStart[i]; c < childStart[i + 1]; ++c)
+                order.push_back(children[c]);
+        }
+
+        m_levels.push_back((uint32_t)levelEnd);
+        levelStart = levelEnd;
+    }
+
+    // Entities that are their own ancestors are never reached from a root
+    if (order.size() < entities.size())
+        LOG_F(WARNING, "%zu entities are skipped because of parent cycles", entities.size() - order.size());
+
+    // Store nodes in sorted order
+    m_entities.resize(order.size());
+    m_parents.resize(order.size());
+    m_local.resize(order.size());
+    m_transforms.resize(order.size());
+    m_changed.assign(order.size(), 1);
+    m_nodes.assign(indices.size(), INVALID_NODE);
+
+    for (size_t n = 0; n < order.size(); ++n) {
+        uint32_t i = order[n];
+        m_entities[n] = entities[i];
+        m_local[n] = local[i];
+        m_nodes[entities[i].m_index] = (uint32_t)n;
+    }
+    for (size_t n = 0; n < order.size(); ++n) {
+        uint32_t p = parentIndex[order[n]];
+        m_parents[n] = p != INVALID_NODE ? m_nodes[entities[p].m_index] : INVALID_NODE;
+    }
+}
+
+///////////////////////////////////////////////////////////
+void Hierarchy::updateNodes(size_t start, size_t end) {
+    for (size_t n = start; n < end; ++n) {
+        uint32_t p = m_parents[n];
+
+        // Changes propagate down to the whole subtree
+        if (p == INVALID_NODE) {
+            if (m_changed[n])
+                m_transforms[n] = m_local[n];
+        } else if (m_changed[n] || m_changed[p]) {
+            m_transforms[n] = m_transforms[p] * m_local[n];
+            m_changed[n] = 1;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////
+uint32_t Hierarchy::getNode(EntityId id) const {
+    if (id.m_index >= m_nodes.size())
+        return INVALID_NODE;
+
+    uint32_t node = m_nodes[id.m_index];
+    return node != INVALID_NODE && m_entities[node] == id ? node : INVALID_NODE;
+}
+
+} // namespace ply
@@ -5,7 +5,13 @@
 namespace ply {
 
 ///////////////////////////////////////////////////////////
-Query::Query(World* world, QueryFactory* factory) : m_world(world), m_factory(factory) {}
+Query::Query() : m_world(nullptr), m_factory(nullptr), m_lastRunTick(0) {}
+
+///////////////////////////////////////////////////////////
+Query::Query(World* world, QueryFactory* factory) :
+    m_world(world),
+    m_factory(factory),
+    m_lastRunTick(0) {}
 
 ///////////////////////////////////////////////////////////
 QueryFactory::QueryFactory(World* world) : m_world(world) {}
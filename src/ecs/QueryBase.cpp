@@ -1,8 +1,11 @@
 #include <ply/ecs/QueryBase.h>
 
 #include <ply/ecs/Query.h>
+#include <ply/ecs/SparseSet.h>
 #include <ply/ecs/World.h>
 
+#include <loguru.hpp>
+
 namespace ply {
 
 ///////////////////////////////////////////////////////////
@@ -17,7 +20,7 @@ QueryAccessor QueryAccessor::getEntity(EntityId id) const {
     // Assuming that mutexes are already locked
 
     World::EntityData& data = m_world->m_entities[id];
-    return QueryAccessor(m_world, m_world->m_groups[data.m_group].get(), this->id, data.m_index);
+    return QueryAccessor(m_world, data.m_group, id, data.m_index);
 }
 
 ///////////////////////////////////////////////////////////
@@ -33,6 +36,18 @@ QueryIterator::QueryIterator(
       index(_index),
       dt(_dt) {}
 
+///////////////////////////////////////////////////////////
+priv::MutexListLock::MutexListLock(const std::vector<std::mutex*>& mutexes) : m_mutexes(mutexes) {
+    for (std::mutex* mutex : m_mutexes)
+        mutex->lock();
+}
+
+///////////////////////////////////////////////////////////
+priv::MutexListLock::~MutexListLock() {
+    for (size_t i = m_mutexes.size(); i > 0; --i)
+        m_mutexes[i - 1]->unlock();
+}
+
 ///////////////////////////////////////////////////////////
 uint32_t QueryBase::getHash() const {
     // Use group hash as base
@@ -42,6 +57,12 @@ uint32_t QueryBase::getHash() const {
     for (auto type : m_exclude)
         base ^= type.hash_code();
 
+    // Add change filters (rotated so they don't cancel out excludes)
+    for (auto type : m_changed)
+        base ^= (uint32_t)(type.hash_code() << 7 | type.hash_code() >> 25);
+    for (auto type : m_added)
+        base ^= (uint32_t)(type.hash_code() << 13 | type.hash_code() >> 19);
+
     return base;
 }
 
@@ -69,4 +90,86 @@ void QueryBase::addExclude(const std::type_index& type) {
         m_exclude.push_back(type);
 }
 
+///////////////////////////////////////////////////////////
+void QueryBase::addChanged(const std::type_index& type) {
+    addInclude(type);
+
+    if (std::find(m_changed.begin(), m_changed.end(), type) == m_changed.end())
+        m_changed.push_back(type);
+}
+
+///////////////////////////////////////////////////////////
+void QueryBase::addAdded(const std::type_index& type) {
+    addInclude(type);
+
+    if (std::find(m_added.begin(), m_added.end(), type) == m_added.end())
+        m_added.push_back(type);
+}
+
+///////////////////////////////////////////////////////////
+bool QueryBase::hasChangeFilters() const {
+    return !m_changed.empty() || !m_added.empty();
+}
+
+///////////////////////////////////////////////////////////
+bool QueryBase::passesChangeFilters(EntityGroup& group, size_t chunk, uint32_t since) const {
+    // Sparse components aren't in the group, they are checked per entity
+    for (auto type : m_changed) {
+        auto it = group.m_components.find(type);
+        if (it != group.m_components.end() && !isNewerTick(it.value().getChangedTick(chunk), since))
+            return false;
+    }
+
+    for (auto type : m_added) {
+        auto it = group.m_components.find(type);
+        if (it != group.m_components.end() && !isNewerTick(it.value().getAddedTick(chunk), since))
+            return false;
+    }
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////
+bool QueryBase::hasSparseFilters() const {
+    return !m_sparseInclude.empty() || !m_sparseExclude.empty();
+}
+
+///////////////////////////////////////////////////////////
+bool QueryBase::passesSparseFilters(EntityId id, uint32_t since) const {
+    for (priv::SparseSet* set : m_sparseInclude) {
+        if (!set->contains(id))
+            return false;
+    }
+
+    for (priv::SparseSet* set : m_sparseExclude) {
+        if (set->contains(id))
+            return false;
+    }
+
+    // Change ticks are tracked per chunk of the dense array
+    for (priv::SparseSet* set : m_sparseChanged) {
+        size_t chunk = set->find(id) / ENTITY_CHUNK_SIZE;
+        if (!isNewerTick(set->getStore().getChangedTick(chunk), since))
+            return false;
+    }
+
+    for (priv::SparseSet* set : m_sparseAdded) {
+        size_t chunk = set->find(id) / ENTITY_CHUNK_SIZE;
+        if (!isNewerTick(set->getStore().getAddedTick(chunk), since))
+            return false;
+    }
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////
+size_t QueryBase::getColumnIndex(std::type_index type) const {
+    size_t c = 0;
+    while (c < m_columnTypes.size() && m_columnTypes[c] != type)
+        ++c;
+
+    CHECK_F(c < m_columnTypes.size(), "component %s is not matched by the query", type.name());
+    return c;
+}
+
 } // namespace ply
@@ -0,0 +1,165 @@
+#include <ply/ecs/SparseSet.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace ply {
+
+namespace priv {
+
+///////////////////////////////////////////////////////////
+SparseSet::SparseSet(size_t typeSize, size_t typeAlign) : m_store(typeSize, typeAlign) {}
+
+///////////////////////////////////////////////////////////
+bool SparseSet::contains(EntityId id) const {
+    return find(id) != INVALID_INDEX;
+}
+
+///////////////////////////////////////////////////////////
+uint32_t SparseSet::find(EntityId id) const {
+    if (id.m_index >= m_sparse.size())
+        return INVALID_INDEX;
+
+    // Make sure the slot isn't used by an older entity with the same index
+    uint32_t index = m_sparse[id.m_index];
+    if (index == INVALID_INDEX || m_entities[index] != id)
+        return INVALID_INDEX;
+
+    return index;
+}
+
+///////////////////////////////////////////////////////////
+void* SparseSet::get(EntityId id) const {
+    uint32_t index = find(id);
+    return index != INVALID_INDEX ? m_store.data(index) : nullptr;
+}
+
+///////////////////////////////////////////////////////////
+void* SparseSet::insert(EntityId id, const void* data, uint32_t tick) {
+    uint32_t index = find(id);
+
+    // Replace existing component
+    if (index != INVALID_INDEX) {
+        void* ptr = m_store.data(index);
+        memcpy(ptr, data, m_store.getTypeSize());
+        m_store.markChanged(index, 1, tick);
+        return ptr;
+    }
+
+    // Grow sparse index to fit entity
+    if (id.m_index >= m_sparse.size())
+        m_sparse.resize(id.m_index + 1, INVALID_INDEX);
+
+    index = (uint32_t)m_entities.size();
+    m_sparse[id.m_index] = index;
+    m_entities.push_back(id);
+
+    void* ptr = m_store.push(data, 1);
+    m_store.markAdded(index, 1, tick);
+
+    return ptr;
+}
+
+///////////////////////////////////////////////////////////
+void* SparseSet::append(const std::vector<EntityId>& ids, const void* data, bool repeat, uint32_t tick) {
+    if (ids.empty())
+        return nullptr;
+
+    uint32_t start = (uint32_t)m_entities.size();
+    m_entities.reserve(start + ids.size());
+
+    // New ids mostly increase, so grow the sparse index geometrically
+    for (size_t i = 0; i < ids.size(); ++i) {
+        EntityId id = ids[i];
+        if (id.m_index >= m_sparse.size())
+            m_sparse.resize(std::max<size_t>(id.m_index + 1, m_sparse.size() * 2), INVALID_INDEX);
+
+        m_sparse[id.m_index] = start + (uint32_t)i;
+        m_entities.push_back(id);
+    }
+
+    void* ptr = repeat ? m_store.push(data, ids.size()) : m_store.append(data, ids.size());
+    m_store.markAdded(start, ids.size(), tick);
+
+    return ptr;
+}
+
+///////////////////////////////////////////////////////////
+void SparseSet::assign(const EntityId* ids, size_t count, const void* data, uint32_t tick) {
+    // Clear the slots of the old entities, so the sparse index doesn't need a full reset
+    for (EntityId id : m_entities)
+        m_sparse[id.m_index] = INVALID_INDEX;
+
+    m_entities.assign(ids, ids + count);
+    for (size_t i = 0; i < count; ++i) {
+        EntityId id = ids[i];
+        if (id.m_index >= m_sparse.size())
+            m_sparse.resize(std::max<size_t>(id.m_index + 1, m_sparse.size() * 2), INVALID_INDEX);
+
+        m_sparse[id.m_index] = (uint32_t)i;
+    }
+
+    m_store.resize(count);
+    if (count > 0)
+        memcpy(m_store.data(), data, count * m_store.getTypeSize());
+    m_store.markAdded(0, count, tick);
+}
+
+///////////////////////////////////////////////////////////
+bool SparseSet::remove(EntityId id, uint32_t tick) {
+    uint32_t index = find(id);
+    if (index == INVALID_INDEX)
+        return false;
+
+    // Move back into the removed slot (swap-pop)
+    EntityId back = m_entities.back();
+    m_sparse[back.m_index] = index;
+    m_entities[index] = back;
+    m_entities.pop_back();
+    m_sparse[id.m_index] = INVALID_INDEX;
+
+    m_store.remove(index);
+    if (index < m_entities.size())
+        m_store.markChanged(index, 1, tick);
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////
+size_t SparseSet::shrinkToFit() {
+    size_t released = (m_entities.capacity() - m_entities.size()) * sizeof(EntityId);
+    m_entities.shrink_to_fit();
+
+    return released + m_store.shrinkToFit();
+}
+
+///////////////////////////////////////////////////////////
+void SparseSet::markChanged(EntityId id, uint32_t tick) {
+    uint32_t index = find(id);
+    if (index != INVALID_INDEX)
+        m_store.markChanged(index, 1, tick);
+}
+
+///////////////////////////////////////////////////////////
+const std::vector<EntityId>& SparseSet::getEntities() const {
+    return m_entities;
+}
+
+///////////////////////////////////////////////////////////
+ComponentStore& SparseSet::getStore() {
+    return m_store;
+}
+
+///////////////////////////////////////////////////////////
+SharedMutex& SparseSet::getMutex() {
+    return m_mutex;
+}
+
+///////////////////////////////////////////////////////////
+size_t SparseSet::size() const {
+    return m_entities.size();
+}
+
+} // namespace priv
+
+} // namespace ply
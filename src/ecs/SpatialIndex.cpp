@@ -0,0 +1,185 @@
+#include <ply/ecs/SpatialIndex.h>
+#include <ply/ecs/World.h>
+#include <ply/math/Functions.h>
+
+namespace ply {
+
+namespace {
+
+///////////////////////////////////////////////////////////
+/// \brief Get the axis-aligned box that encloses a transformed box
+///////////////////////////////////////////////////////////
+BoundingBox transformBox(const BoundingBox& box, const Matrix4f& m) {
+    Vector3f c = box.getCenter();
+    Vector3f h = box.getDimensions() * 0.5f;
+
+    Vector3f center, extent;
+    for (int i = 0; i < 3; ++i) {
+        center[i] = m[0][i] * c.x + m[1][i] * c.y + m[2][i] * c.z + m[3][i];
+        extent[i] = abs(m[0][i]) * h.x + abs(m[1][i]) * h.y + abs(m[2][i]) * h.z;
+    }
+
+    return BoundingBox(center - extent, center + extent);
+}
+
+} // namespace
+
+///////////////////////////////////////////////////////////
+SpatialIndex::SpatialIndex(World* world, float margin)
+    : m_world(world),
+      m_tree(margin),
+      m_numRestores(world->getNumRestores()) {
+    m_localChanges =
+        world->query().match<Bounds>().exclude<WorldTransform>().changed<Transform>().compile();
+    m_localBoundsChanges =
+        world->query().match<Transform>().exclude<WorldTransform>().changed<Bounds>().compile();
+    m_worldChanges = world->query().match<Transform, Bounds>().changed<WorldTransform>().compile();
+    m_worldBoundsChanges =
+        world->query().match<Transform, WorldTransform>().changed<Bounds>().compile();
+    m_localEntities = world->query().match<Transform, Bounds>().exclude<WorldTransform>().compile();
+    m_worldEntities = world->query().match<Transform, WorldTransform, Bounds>().compile();
+
+    // New entities show up in the change queries, only removals need observers
+    auto markRemoved = [this](EntityId id) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_removed.push_back(id);
+    };
+    m_observers = {
+        world->observer(World::OnRemove).match<Transform, Bounds>().each(markRemoved),
+        world->observer(World::OnExit).match<Transform, Bounds>().each(markRemoved),
+    };
+}
+
+///////////////////////////////////////////////////////////
+SpatialIndex::~SpatialIndex() {
+    for (Observer* observer : m_observers)
+        m_world->removeObserver(observer);
+}
+
+///////////////////////////////////////////////////////////
+void SpatialIndex::update() {
+    // Restores don't send events, so entities that were rewound can't be tracked
+    uint32_t numRestores = m_world->getNumRestores();
+    if (numRestores != m_numRestores) {
+        m_numRestores = numRestores;
+        reset();
+    }
+
+    // Removals come first, an entity that left and came back is in the change queries
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (EntityId id : m_removed)
+            removeBox(id);
+        m_removed.clear();
+    }
+
+    m_localChanges.each([&](EntityId id, const Transform& t, const Bounds& b) {
+        setBox(id, toTransformMatrix(t.position, t.rotation, t.scale), b.box);
+    });
+    m_localBoundsChanges.each([&](EntityId id, const Transform& t, const Bounds& b) {
+        setBox(id, toTransformMatrix(t.position, t.rotation, t.scale), b.box);
+    });
+    m_worldChanges.each([&](EntityId id, const WorldTransform& t, const Bounds& b) {
+        setBox(id, t.matrix, b.box);
+    });
+    m_worldBoundsChanges.each([&](EntityId id, const WorldTransform& t, const Bounds& b) {
+        setBox(id, t.matrix, b.box);
+    });
+}
+
+///////////////////////////////////////////////////////////
+void SpatialIndex::rebuild() {
+    m_tree.rebuild();
+}
+
+///////////////////////////////////////////////////////////
+std::vector<EntityId> SpatialIndex::query(const BoundingBox& box) const {
+    std::vector<uint32_t> values;
+    m_tree.query(box, values);
+    return toEntities(values);
+}
+
+///////////////////////////////////////////////////////////
+std::vector<EntityId> SpatialIndex::query(const Frustum& frustum) const {
+    std::vector<uint32_t> values;
+    m_tree.query(frustum, values);
+    return toEntities(values);
+}
+
+///////////////////////////////////////////////////////////
+std::vector<EntityId> SpatialIndex::raycast(const Ray& ray, float maxDistance) const {
+    std::vector<uint32_t> values;
+    m_tree.raycast(ray, values, maxDistance);
+    return toEntities(values);
+}
+
+///////////////////////////////////////////////////////////
+const BoundingBoxTree& SpatialIndex::getTree() const {
+    return m_tree;
+}
+
+///////////////////////////////////////////////////////////
+void SpatialIndex::setBox(EntityId id, const Matrix4f& transform, const BoundingBox& bounds) {
+    BoundingBox box = transformBox(bounds, transform);
+
+    if (id.m_index >= m_proxies.size()) {
+        m_proxies.resize(id.m_index + 1, BoundingBoxTree::INVALID_NODE);
+        m_entities.resize(id.m_index + 1);
+    }
+
+    uint32_t& proxy = m_proxies[id.m_index];
+    if (proxy != BoundingBoxTree::INVALID_NODE) {
+        if (m_entities[id.m_index] == id) {
+            m_tree.update(proxy, box);
+            return;
+        }
+
+        // The handle was reused before the old entity's removal was processed
+        m_tree.remove(proxy);
+    }
+
+    proxy = m_tree.insert(box, id.m_index);
+    m_entities[id.m_index] = id;
+}
+
+///////////////////////////////////////////////////////////
+void SpatialIndex::removeBox(EntityId id) {
+    if (id.m_index >= m_proxies.size() || m_entities[id.m_index] != id)
+        return;
+
+    uint32_t& proxy = m_proxies[id.m_index];
+    if (proxy != BoundingBoxTree::INVALID_NODE) {
+        m_tree.remove(proxy);
+        proxy = BoundingBoxTree::INVALID_NODE;
+    }
+}
+
+///////////////////////////////////////////////////////////
+void SpatialIndex::reset() {
+    m_tree.clear();
+    m_entities.clear();
+    m_proxies.clear();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_removed.clear();
+    }
+
+    m_localEntities.each([&](EntityId id, const Transform& t, const Bounds& b) {
+        setBox(id, toTransformMatrix(t.position, t.rotation, t.scale), b.box);
+    });
+    m_worldEntities.each([&](EntityId id, const WorldTransform& t, const Bounds& b) {
+        setBox(id, t.matrix, b.box);
+    });
+}
+
+///////////////////////////////////////////////////////////
+std::vector<EntityId> SpatialIndex::toEntities(const std::vector<uint32_t>& values) const {
+    std::vector<EntityId> entities;
+    entities.reserve(values.size());
+    for (uint32_t index : values)
+        entities.push_back(m_entities[index]);
+
+    return entities;
+}
+
+} // namespace ply
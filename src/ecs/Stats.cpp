@@ -0,0 +1,20 @@
+#include <ply/ecs/Stats.h>
+
+namespace ply {
+
+///////////////////////////////////////////////////////////
+void SystemStats::addRun(Time time) {
+    m_lastTime = time;
+    m_totalTime += time;
+    ++m_numRuns;
+
+    m_averageTime = m_totalTime / (int64_t)m_numRuns;
+    if (time > m_maxTime)
+        m_maxTime = time;
+
+    // Follow changes in workload within a few runs, without letting a single slow run
+    // reorder the schedule
+    m_expectedTime = m_numRuns == 1 ? time : m_expectedTime * 0.75 + time * 0.25;
+}
+
+} // namespace ply
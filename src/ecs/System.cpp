@@ -1,7 +1,24 @@
 #include <ply/ecs/System.h>
 
+#include <algorithm>
+
 namespace ply {
 
+///////////////////////////////////////////////////////////
+namespace {
+    bool containsType(const std::vector<std::type_index>& types, const std::type_index& type) {
+        return std::find(types.begin(), types.end(), type) != types.end();
+    }
+
+    bool containsAny(const std::vector<std::type_index>& a, const std::vector<std::type_index>& b) {
+        for (auto type : a) {
+            if (containsType(b, type))
+                return true;
+        }
+        return false;
+    }
+}
+
 ///////////////////////////////////////////////////////////
 System::System(World* world) : m_world(world) {}
 
@@ -56,4 +73,79 @@ System& System::after(System* system) {
     return *this;
 }
 
+///////////////////////////////////////////////////////////
+System& System::group(SystemGroup* group) {
+    m_group = group;
+    return *this;
+}
+
+///////////////////////////////////////////////////////////
+const SystemStats& System::getStats() const {
+    return m_stats;
+}
+
+///////////////////////////////////////////////////////////
+void System::addRead(const std::type_index& type) {
+    if (!containsType(m_reads, type))
+        m_reads.push_back(type);
+}
+
+///////////////////////////////////////////////////////////
+void System::addWrite(const std::type_index& type) {
+    if (!containsType(m_writes, type))
+        m_writes.push_back(type);
+}
+
+///////////////////////////////////////////////////////////
+bool System::conflictsWith(const System& other) const {
+    // Systems that never match the same group never touch the same components
+    if (!m_hasExternalAccess && !other.m_hasExternalAccess) {
+        if (containsAny(m_include, other.m_exclude) || containsAny(other.m_include, m_exclude))
+            return false;
+    }
+
+    // Change filters read the change ticks of their columns
+    auto reads = [](const System& s, const std::type_index& type) {
+        return containsType(s.m_reads, type) || containsType(s.m_changed, type) ||
+            containsType(s.m_added, type);
+    };
+
+    for (auto type : m_writes) {
+        if (containsType(other.m_writes, type) || reads(other, type))
+            return true;
+    }
+
+    for (auto type : other.m_writes) {
+        if (reads(*this, type))
+            return true;
+    }
+
+    return false;
+}
+
+///////////////////////////////////////////////////////////
+bool System::dependsOn(const System* other) const {
+    // Depth first search through dependencies
+    std::vector<const System*> stack(m_scheduleDependencies.begin(), m_scheduleDependencies.end());
+    std::vector<const System*> visited;
+
+    while (!stack.empty()) {
+        const System* system = stack.back();
+        stack.pop_back();
+
+        if (system == other)
+            return true;
+
+        if (std::find(visited.begin(), visited.end(), system) != visited.end())
+            continue;
+        visited.push_back(system);
+
+        stack.insert(
+            stack.end(), system->m_scheduleDependencies.begin(), system->m_scheduleDependencies.end()
+        );
+    }
+
+    return false;
+}
+
 } // namespace ply
\ No newline at end of file
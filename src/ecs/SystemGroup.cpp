@@ -0,0 +1,107 @@
+#include <ply/ecs/SystemGroup.h>
+
+#include <algorithm>
+#include <cmath>
+#include <loguru.hpp>
+
+namespace ply {
+
+///////////////////////////////////////////////////////////
+SystemGroup::SystemGroup() : SystemGroup(nullptr) {}
+
+///////////////////////////////////////////////////////////
+SystemGroup::SystemGroup(World* world)
+    : m_world(world),
+      m_mode(EveryTick),
+      m_timestep(0.0f),
+      m_maxSubsteps(1),
+      m_interval(1),
+      m_accumulator(0.0f),
+      m_tickCounter(0),
+      m_numSteps(0),
+      m_stepTime(0.0f) {}
+
+///////////////////////////////////////////////////////////
+SystemGroup& SystemGroup::fixedStep(float timestep, uint32_t maxSubsteps) {
+    CHECK_F(timestep > 0.0f, "fixed timestep must be greater than 0");
+    CHECK_F(maxSubsteps > 0, "max substeps must be at least 1");
+
+    m_mode = FixedStep;
+    m_timestep = timestep;
+    m_maxSubsteps = maxSubsteps;
+    m_accumulator = 0.0f;
+    return *this;
+}
+
+///////////////////////////////////////////////////////////
+SystemGroup& SystemGroup::everyNTicks(uint32_t n) {
+    CHECK_F(n > 0, "tick interval must be at least 1");
+
+    m_mode = EveryNTicks;
+    m_interval = n;
+    m_accumulator = 0.0f;
+    m_tickCounter = 0;
+    return *this;
+}
+
+///////////////////////////////////////////////////////////
+SystemGroup::Mode SystemGroup::getMode() const {
+    return m_mode;
+}
+
+///////////////////////////////////////////////////////////
+float SystemGroup::getTimestep() const {
+    return m_timestep;
+}
+
+///////////////////////////////////////////////////////////
+uint32_t SystemGroup::getNumSteps() const {
+    return m_numSteps;
+}
+
+///////////////////////////////////////////////////////////
+float SystemGroup::getAlpha() const {
+    if (m_mode == FixedStep)
+        return std::min(m_accumulator / m_timestep, 1.0f);
+    else if (m_mode == EveryNTicks)
+        return (float)m_tickCounter / m_interval;
+
+    return 0.0f;
+}
+
+///////////////////////////////////////////////////////////
+void SystemGroup::update(float elapsed) {
+    if (m_mode == FixedStep) {
+        m_accumulator += elapsed;
+        m_numSteps = (uint32_t)(m_accumulator / m_timestep);
+        m_stepTime = m_timestep;
+
+        if (m_numSteps > m_maxSubsteps) {
+            // Drop the time that can't be caught up on
+            m_numSteps = m_maxSubsteps;
+            m_accumulator = std::fmod(m_accumulator, m_timestep);
+        } else {
+            m_accumulator = std::max(m_accumulator - m_numSteps * m_timestep, 0.0f);
+        }
+    }
+
+    else if (m_mode == EveryNTicks) {
+        m_accumulator += elapsed;
+
+        if (++m_tickCounter >= m_interval) {
+            m_numSteps = 1;
+            m_stepTime = m_accumulator;
+            m_accumulator = 0.0f;
+            m_tickCounter = 0;
+        } else {
+            m_numSteps = 0;
+        }
+    }
+
+    else {
+        m_numSteps = 1;
+        m_stepTime = elapsed;
+    }
+}
+
+} // namespace ply
@@ -1,208 +1,480 @@
 #include <ply/ecs/World.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <loguru.hpp>
 #include <queue>
 
 namespace ply {
 
+namespace {
+
+///////////////////////////////////////////////////////////
+/// \brief The command buffer a thread used last, with the world it belongs to
+///////////////////////////////////////////////////////////
+struct ThreadCommandBuffer {
+    uint32_t m_worldId = 0;
+    priv::CommandBuffer* m_buffer = nullptr;
+};
+
+std::atomic<uint32_t> s_nextWorldId(1);
+thread_local ThreadCommandBuffer t_commandBuffer;
+
+// Order of the system running on this thread, stamped on recorded commands
+thread_local uint32_t t_systemOrder = priv::CommandBuffer::NO_SYSTEM;
+
+// System running on this thread, used to check undeclared component access
+thread_local const System* t_system = nullptr;
+
+///////////////////////////////////////////////////////////
+/// \brief Records the execution time of a system when it goes out of scope
+///////////////////////////////////////////////////////////
+struct SystemTimer {
+    SystemTimer(SystemStats& stats, Clock& clock) : m_stats(stats), m_clock(clock) {}
+    ~SystemTimer() { m_stats.addRun(m_clock.getElapsedTime()); }
+
+    SystemStats& m_stats;
+    Clock& m_clock;
+};
+
+///////////////////////////////////////////////////////////
+/// \brief Sets the system running on the calling thread for its lifetime
+///////////////////////////////////////////////////////////
+struct SystemOrderScope {
+    SystemOrderScope(const System* system, uint32_t order) :
+        m_prev(t_systemOrder),
+        m_prevSystem(t_system) {
+        t_systemOrder = order;
+        t_system = system;
+    }
+
+    ~SystemOrderScope() {
+        t_systemOrder = m_prev;
+        t_system = m_prevSystem;
+    }
+
+    uint32_t m_prev;
+    const System* m_prevSystem;
+};
+
+///////////////////////////////////////////////////////////
+/// \brief Fraction of the systems time a system has to run alone for to be a straggler
+///////////////////////////////////////////////////////////
+constexpr double STRAGGLER_FRACTION = 0.25;
+
+///////////////////////////////////////////////////////////
+/// \brief Serial time below which stragglers are not reported, in microseconds
+///////////////////////////////////////////////////////////
+constexpr int64_t MIN_STRAGGLER_TIME_US = 1000;
+
+///////////////////////////////////////////////////////////
+/// \brief Check if an array uses less than half of its memory
 ///////////////////////////////////////////////////////////
-World::World() : m_numRemoveQueued(0), m_elapsed(0), m_isFirstTick(true), m_scheduler(NULL) {
+bool isMostlyUnused(size_t capacity, size_t size) {
+    return capacity > 2 * std::max<size_t>(size, 8);
+}
+
+///////////////////////////////////////////////////////////
+/// \brief Check if a group has exactly the shared component values of a component map
+///////////////////////////////////////////////////////////
+bool hasSharedValues(
+    const EntityGroup& group,
+    const HashMap<std::type_index, priv::ComponentMetadata>& components,
+    const HashSet<std::type_index>& sharedTypes
+) {
+    size_t numShared = 0;
+    for (auto it = components.begin(); it != components.end(); ++it) {
+        if (!sharedTypes.contains(it.key()))
+            continue;
+
+        auto sharedIt = group.m_shared.find(it.key());
+        if (sharedIt == group.m_shared.end())
+            return false;
+
+        const priv::ComponentStore& store = sharedIt.value();
+        if (store.getTypeSize() && memcmp(store.data(), it.value().m_data, store.getTypeSize()) != 0)
+            return false;
+
+        ++numShared;
+    }
+
+    return numShared == group.m_shared.size();
+}
+
+} // namespace
+
+///////////////////////////////////////////////////////////
+World::World() :
+    m_numReserved(0),
+    m_firstNewId(0),
+    m_worldId(s_nextWorldId++),
+    m_scheduler(NULL),
+    m_systemsDirty(false),
+    m_isExecutingSystems(false),
+    m_changeTick(1),
+    m_numRestores(0),
+    m_elapsed(0),
+    m_isFirstTick(true) {
     // Set up dummy entity
     EntityId id = m_entities.push(EntityData());
     m_entities.remove(id);
     m_entities.push(EntityData());
+
+    // All other ids are handed out by reservation
+    refillFreeIds();
 }
 
 ///////////////////////////////////////////////////////////
 World::~World() {
-    // Free all queued entities
-    for (auto factory : m_addQueue) {
-        delete factory;
-    }
-
-    // Free all component changes
-    for (auto it = m_changeQueue.begin(); it != m_changeQueue.end(); ++it) {
-        if (it->m_component)
-            FREE_DBG(it->m_component);
-    }
-
-    m_addQueue.clear();
-    m_changeQueue.clear();
+    // Unapplied commands are discarded with their buffers
+    m_commandBuffers.clear();
 }
 
 ///////////////////////////////////////////////////////////
 void World::remove(EntityId entity) {
-    // Find the correct group
-    EntityGroupId groupId = m_entities[entity].m_group;
-
-    // Entity removal is protected by mutex
-    ReadLock lock(m_groupsMutex);
-
-    auto it = m_groups.find(groupId);
-    if (it == m_groups.end()) {
-        LOG_F(WARNING, "could not find entity group");
+    // Skip entities that are already removed or queued for removal, entities whose
+    // creation is queued are removed once they are created
+    if (!m_entities.isValid(entity) || !m_entities[entity].m_isAlive) {
+        if (isReserved(entity))
+            deferRemove(entity);
         return;
     }
 
-    EntityGroup* group = it.value().get();
+    // Find the correct group
+    EntityGroup* group = m_entities[entity].m_group;
+
+    // Mark entity so it can't be removed twice
+    m_entities[entity].m_isAlive = false;
 
     // Check if we need to defer
-    bool defer = !group->m_mutex.try_lock();
+    bool defer = m_isExecutingSystems || !group->m_mutex.try_lock();
 
     if (defer) {
-        // Add to remove queue if mutex not available
-        group->m_removeQueue.push_back(entity);
-
-        // Increment number of queued entities
-        ++m_numRemoveQueued;
+        // Record in the thread's command buffer if mutex not available
+        deferRemove(entity);
     } else {
         // Replace manual lock with lock object
-        std::unique_lock<std::shared_mutex> lock(group->m_mutex, std::adopt_lock);
-
-        // Get entity index
-        uint32_t index = m_entities[entity].m_index;
+        WriteLock groupLock(group->m_mutex, std::adopt_lock);
+        removeEntities(group, {entity});
+    }
+}
 
-        // Get back entity (for swap-pop operation)
-        EntityId back = group->m_entities.back();
+///////////////////////////////////////////////////////////
+void World::remove(std::span<const EntityId> ids) {
+    // Group ids by the entity group they belong to, in the order each group first
+    // appears, so events are sent in a deterministic order
+    std::vector<std::pair<EntityGroup*, std::vector<EntityId>>> batches;
+    HashMap<EntityGroup*, size_t> batchIndices;
+    for (EntityId id : ids) {
+        // Skip entities that are already removed or queued for removal
+        if (!m_entities.isValid(id)) {
+            if (isReserved(id))
+                deferRemove(id);
+            continue;
+        }
 
-        // Update index of back entity to be that of the one being removed
-        m_entities[back].m_index = index;
+        EntityData& data = m_entities[id];
+        if (!data.m_isAlive)
+            continue;
 
-        // Swap-pop for entity list in table
-        group->m_entities[index] = back;
-        group->m_entities.pop_back();
+        // Mark entity so duplicates in the list are skipped
+        data.m_isAlive = false;
 
-        // Allocate temp map to copy components for entity removed listeners
-        HashMap<std::type_index, void*> ptrs;
-        for (auto cIt = group->m_components.begin(); cIt != group->m_components.end(); ++cIt) {
-            // Get component array
-            priv::ComponentStore& store = cIt.value();
+        auto it = batchIndices.find(data.m_group);
+        if (it == batchIndices.end()) {
+            it = batchIndices.insert(std::make_pair(data.m_group, batches.size())).first;
+            batches.emplace_back(data.m_group, std::vector<EntityId>());
+        }
 
-            // Allocate space for temp block (just one entity)
-            uint32_t typeSize = store.getTypeSize();
-            uint8_t* block = (uint8_t*)MALLOC_DBG(typeSize);
-            ptrs[cIt.key()] = block;
+        batches[it->second].second.push_back(id);
+    }
 
-            // Copy the component into the ptrs map (gets sent to observers)
-            memcpy(block, store.data(index), typeSize);
+    // Remove each batch
+    for (const auto& entry : batches) {
+        EntityGroup* group = entry.first;
+        const std::vector<EntityId>& batch = entry.second;
 
-            // Remove the component
-            store.remove(index);
+        if (m_isExecutingSystems || !group->m_mutex.try_lock()) {
+            // Defer the whole batch if mutex not available
+            for (EntityId id : batch)
+                deferRemove(id);
+        } else {
+            WriteLock groupLock(group->m_mutex, std::adopt_lock);
+            removeEntities(group, batch);
         }
+    }
+}
 
-        // Remove entity from main list
-        m_entities.remove(entity);
+///////////////////////////////////////////////////////////
+void World::removeAll(const Query& query) {
+    CHECK_F(query.m_factory != NULL, "query must be compiled before it is used");
 
-        // Create a vector with just this entity for event sending
-        std::vector<EntityId> entities = {entity};
+    // Entity removal is protected by mutex
+    ReadLock lock(m_groupsMutex);
 
-        // Use ptrs to invoke all entity listeners
-        sendEntityEvent(OnExit, entities, ptrs, group);
-        sendEntityEvent(OnRemove, entities, ptrs, group);
+    for (const MatchedGroup& match : query.m_factory->m_matches) {
+        EntityGroup* group = match.m_group;
+        bool defer = m_isExecutingSystems || !group->m_mutex.try_lock();
+
+        // Collect entities that are not already queued for removal
+        std::vector<EntityId> batch;
+        batch.reserve(group->m_entities.size());
+        for (EntityId id : group->m_entities) {
+            EntityData& data = m_entities[id];
+            if (data.m_isAlive) {
+                data.m_isAlive = false;
+                batch.push_back(id);
+            }
+        }
 
-        // Free temp blocks
-        for (auto ptrIt = ptrs.begin(); ptrIt != ptrs.end(); ++ptrIt)
-            FREE_DBG(ptrIt.value());
+        if (defer) {
+            // Defer the whole batch if mutex not available
+            for (EntityId id : batch)
+                deferRemove(id);
+        } else {
+            WriteLock groupLock(group->m_mutex, std::adopt_lock);
+            removeEntities(group, batch);
+        }
     }
 }
 
 ///////////////////////////////////////////////////////////
 void World::removeQueuedEntities() {
+    // Merge the removals of all threads, in system order
+    std::vector<priv::CommandBuffer::Remove> removes;
+    for (auto& buffer : m_commandBuffers) {
+        auto& list = buffer->getRemoves();
+        removes.insert(removes.end(), list.begin(), list.end());
+        list.clear();
+    }
+
     // Skip if none to remove
-    if (m_numRemoveQueued == 0)
+    if (removes.empty())
         return;
 
+    std::stable_sort(removes.begin(), removes.end(), [](const auto& a, const auto& b) {
+        return a.m_order < b.m_order;
+    });
+
     // Entity removal is protected by mutex
     WriteLock groupsLock(m_groupsMutex);
 
-    // Clear all queues
-    for (auto it = m_groups.begin(); it != m_groups.end(); ++it) {
-        EntityGroup& group = *it.value();
-        if (!group.m_removeQueue.size())
+    // Batch removals by group, in the order each group first appears
+    std::vector<std::pair<EntityGroup*, std::vector<EntityId>>> batches;
+    HashMap<EntityGroup*, size_t> batchIndices;
+    HashSet<EntityId> queued;
+    queued.reserve(removes.size());
+    for (const auto& remove : removes) {
+        // Threads check and mark entities as removed without synchronizing, so the same
+        // entity can be queued by several of them, it is only removed once
+        if (!queued.insert(remove.m_id).second)
             continue;
 
+        // Entities whose creation is queued too are removed right after they are created
+        if (!m_entities.isValid(remove.m_id)) {
+            m_removesAfterCreate.push_back(remove.m_id);
+            continue;
+        }
+
+        EntityGroup* group = m_entities[remove.m_id].m_group;
+
+        auto it = batchIndices.find(group);
+        if (it == batchIndices.end()) {
+            it = batchIndices.insert(std::make_pair(group, batches.size())).first;
+            batches.emplace_back(group, std::vector<EntityId>());
+        }
+
+        batches[it->second].second.push_back(remove.m_id);
+    }
+
+    for (auto& batch : batches) {
         // Lock table
-        WriteLock entityLock(group.m_mutex);
+        WriteLock entityLock(batch.first->m_mutex);
 
-        // Num being removed
-        size_t numRemoved = group.m_removeQueue.size();
+        // Remove all queued entities of the group as a single batch
+        removeEntities(batch.first, batch.second);
+    }
+}
 
-        // Allocate temp map to copy components to iterate entities removed listeners
-        HashMap<std::type_index, void*> ptrs;
-        for (auto cIt = group.m_components.begin(); cIt != group.m_components.end(); ++cIt) {
-            // Get component array
-            priv::ComponentStore& store = cIt.value();
+///////////////////////////////////////////////////////////
+void World::removeEntities(EntityGroup* group, const std::vector<EntityId>& ids) {
+    size_t numRemoved = ids.size();
+    size_t groupSize = group->m_entities.size();
+    if (numRemoved == 0)
+        return;
 
-            // Allocate space for temp block
-            uint32_t typeSize = store.getTypeSize();
-            uint8_t* block = (uint8_t*)MALLOC_DBG(numRemoved * typeSize);
-            ptrs[cIt.key()] = block;
+    // Moved components are marked as changed
+    uint32_t tick = nextChangeTick();
+
+    // When the whole group is removed, take its entity list so components can be copied out in
+    // storage order instead of gathered one at a time
+    std::vector<EntityId> groupIds;
+    if (numRemoved == groupSize)
+        groupIds.swap(group->m_entities);
+    const std::vector<EntityId>& removedIds = groupIds.empty() ? ids : groupIds;
+
+    // Allocate one temp block per component to copy removed components into (gets sent to
+    // observers), in the same order as the list of removed ids
+    HashMap<std::type_index, void*> ptrs;
+    for (auto cIt = group->m_components.begin(); cIt != group->m_components.end(); ++cIt) {
+        priv::ComponentStore& store = cIt.value();
+
+        // Tags have nothing to copy
+        if (store.isTag()) {
+            ptrs[cIt.key()] = nullptr;
+            continue;
         }
 
-        // Remove each component set one by one
-        for (size_t i = 0; i < numRemoved; ++i) {
-            // Remove entities using swap-pop (or in this case move-pop)
-            // - Find the entity at the back of the array
-            // - Update the back's index to be the index of the entity that is being removed
-            // - Move the back to the removed's index for each component and the entity array
-            // - Pop back for each
-            // - Remove the entity from the global entity data array
+        uint32_t typeSize = store.getTypeSize();
+        uint8_t* block = (uint8_t*)MALLOC_DBG(numRemoved * typeSize);
 
-            // Get back
-            EntityId back = group.m_entities.back();
+        if (!groupIds.empty()) {
+            memcpy(block, store.data(), numRemoved * typeSize);
+        } else {
+            for (size_t i = 0; i < numRemoved; ++i)
+                memcpy(block + i * typeSize, store.data(m_entities[ids[i]].m_index), typeSize);
+        }
 
+        ptrs[cIt.key()] = block;
+    }
+
+    if (!groupIds.empty()) {
+        // Every entity is removed, just clear the arrays
+        for (auto cIt = group->m_components.begin(); cIt != group->m_components.end(); ++cIt)
+            cIt.value().resize(0);
+    } else if (numRemoved * 2 >= groupSize) {
+        // Most of the group is removed, so use filter compaction: walk the group once and
+        // shift survivors down, which touches each element at most once
+        std::vector<bool> removed(groupSize, false);
+        for (EntityId id : ids)
+            removed[m_entities[id].m_index] = true;
+
+        // Compact entity list first, recording where each survivor came from
+        std::vector<uint32_t> sources;
+        sources.reserve(groupSize - numRemoved);
+        for (uint32_t i = 0; i < groupSize; ++i) {
+            if (removed[i])
+                continue;
+
+            EntityId id = group->m_entities[i];
+            m_entities[id].m_index = (uint32_t)sources.size();
+            group->m_entities[sources.size()] = id;
+            sources.push_back(i);
+        }
+        group->m_entities.resize(sources.size());
+
+        // Then compact each component array one column at a time
+        for (auto cIt = group->m_components.begin(); cIt != group->m_components.end(); ++cIt) {
+            priv::ComponentStore& store = cIt.value();
+            uint32_t typeSize = store.getTypeSize();
+            uint8_t* base = (uint8_t*)store.data();
+
+            size_t firstMoved = sources.size();
+            for (size_t dst = 0; dst < sources.size(); ++dst) {
+                if (sources[dst] != dst) {
+                    if (typeSize)
+                        memcpy(base + dst * typeSize, base + sources[dst] * typeSize, typeSize);
+                    firstMoved = std::min(firstMoved, dst);
+                }
+            }
+
+            store.resize(sources.size());
+            store.markChanged(firstMoved, sources.size() - firstMoved, tick);
+        }
+    } else {
+        // Remove entities using swap-pop (or in this case move-pop)
+        // - Find the entity at the back of the array
+        // - Update the back's index to be the index of the entity that is being removed
+        // - Move the back to the removed's index for each component and the entity array
+        // - Pop back for each
+        for (EntityId id : ids) {
             // Index of entity being removed
-            uint32_t index = m_entities[group.m_removeQueue[i]].m_index;
+            uint32_t index = m_entities[id].m_index;
+
             // Update index of back to be that of the one being removed
+            EntityId back = group->m_entities.back();
             m_entities[back].m_index = index;
 
             // Swap-pop for entity list in table
-            group.m_entities[index] = back;
-            group.m_entities.pop_back();
+            group->m_entities[index] = back;
+            group->m_entities.pop_back();
 
             // Remove component at index for each component array
-            for (auto cIt = group.m_components.begin(); cIt != group.m_components.end(); ++cIt) {
-                priv::ComponentStore& store = cIt.value();
-
-                // Copy the component into the ptrs map (gets sent to observers)
-                uint32_t typeSize = store.getTypeSize();
-                uint8_t* block = (uint8_t*)ptrs[cIt.key()];
-                memcpy(block + i * typeSize, store.data(index), typeSize);
-
-                // Remove the component
-                store.remove(index);
+            for (auto cIt = group->m_components.begin(); cIt != group->m_components.end(); ++cIt) {
+                cIt.value().remove(index);
+                cIt.value().markChanged(index, 1, tick);
             }
-
-            // Remove entity from main list
-            m_entities.remove(group.m_removeQueue[i]);
         }
+    }
 
-        // Use ptrs to invoke all entity listeners
-        sendEntityEvent(OnExit, group.m_removeQueue, ptrs, &group);
-        sendEntityEvent(OnRemove, group.m_removeQueue, ptrs, &group);
+    // Rows were reordered, so the disabled bits are rebuilt from the remaining entities
+    if (group->m_numDisabled > 0)
+        updateDisabledRows(group);
 
-        // Free temp blocks
-        for (auto ptrIt = ptrs.begin(); ptrIt != ptrs.end(); ++ptrIt)
-            FREE_DBG(ptrIt.value());
+    // Remove sparse components of the removed entities
+    for (auto it = m_sparseSets.begin(); it != m_sparseSets.end(); ++it) {
+        priv::SparseSet& set = *it.value();
+        WriteLock setLock(set.getMutex());
 
-        // Clear queue
-        group.m_removeQueue.clear();
+        for (size_t i = 0; i < removedIds.size() && set.size() > 0; ++i)
+            set.remove(removedIds[i], tick);
     }
 
-    // Reset number of queued
-    m_numRemoveQueued = 0;
+    // Remove entities from main list, entities of other groups can be created at the same time
+    {
+        std::lock_guard<std::mutex> lock(m_entitiesMutex);
+        for (EntityId id : removedIds)
+            m_entities.remove(id);
+    }
+
+    // Use ptrs to invoke all entity listeners
+    sendEntityEvent(OnExit, removedIds, ptrs, group);
+    sendEntityEvent(OnRemove, removedIds, ptrs, group);
+
+    // Free temp blocks
+    for (auto ptrIt = ptrs.begin(); ptrIt != ptrs.end(); ++ptrIt) {
+        if (ptrIt.value())
+            FREE_DBG(ptrIt.value());
+    }
 }
 
 ///////////////////////////////////////////////////////////
 Entity World::getEntity(EntityId id) {
-    ReadLock lock(m_groupsMutex);
-
+    // Groups are never moved, so the group pointer can be used without the group map lock
     const auto& entityData = m_entities[id];
-    auto groupIt = m_groups.find(entityData.m_group);
-    if (groupIt == m_groups.end())
+    if (!entityData.m_group)
         return Entity();
 
-    return Entity(this, id, groupIt.value().get(), entityData.m_index);
+    return Entity(this, id, entityData.m_group, entityData.m_index);
+}
+
+///////////////////////////////////////////////////////////
+void World::setEnabled(EntityId id, bool enabled) {
+    // Skip entities that are removed or queued for removal, entities whose creation
+    // is queued are changed once they are created
+    if (!m_entities.isValid(id) || !m_entities[id].m_isAlive) {
+        if (isReserved(id))
+            getCommandBuffer().setEnabled(id, enabled, t_systemOrder);
+        return;
+    }
+
+    EntityGroup* group = m_entities[id].m_group;
+    CHECK_F(group != NULL, "entity group not found");
+
+    // Systems iterate groups without locking them, so the bits can't change while they run
+    if (m_isExecutingSystems || !group->m_mutex.try_lock()) {
+        getCommandBuffer().setEnabled(id, enabled, t_systemOrder);
+        return;
+    }
+
+    WriteLock lock(group->m_mutex, std::adopt_lock);
+    setEnabled(group, id, enabled);
+}
+
+///////////////////////////////////////////////////////////
+bool World::isEnabled(EntityId id) {
+    return m_entities.isValid(id) && m_entities[id].m_group && m_entities[id].m_isEnabled;
 }
 
 ///////////////////////////////////////////////////////////
@@ -216,6 +488,21 @@ Observer& World::observer(EntityEventType type) {
 
 ///////////////////////////////////////////////////////////
 void World::removeObserver(Observer* observer) {
+    // Remove from the observer lists of groups, dropping pending events
+    {
+        ReadLock lock(m_groupsMutex);
+        for (auto it = m_groups.begin(); it != m_groups.end(); ++it) {
+            EntityGroup* group = it.value().get();
+            WriteLock groupLock(group->m_mutex);
+
+            auto isObserver = [observer](const priv::ObserverBatch& batch) {
+                return batch.m_observer == observer;
+            };
+            std::erase_if(group->m_enterObservers, isObserver);
+            std::erase_if(group->m_exitObservers, isObserver);
+        }
+    }
+
     // Remove from list
     for (int i = 0; i < NUM_EVENTS; ++i) {
         auto it = std::find(m_observers[i].begin(), m_observers[i].end(), observer);
@@ -248,6 +535,12 @@ void World::removeSystem(System* system) {
 
     m_systems.erase(it);
 
+    // Remove from other systems' dependencies
+    for (System* other : m_systems) {
+        auto& deps = other->m_dependencies;
+        deps.erase(std::remove(deps.begin(), deps.end(), system), deps.end());
+    }
+
     // Free
     m_systemPool.free(system);
 
@@ -255,6 +548,32 @@ void World::removeSystem(System* system) {
     m_systemsDirty = true;
 }
 
+///////////////////////////////////////////////////////////
+SystemGroup& World::systemGroup() {
+    SystemGroup* group = m_systemGroupPool.alloc();
+    group->m_world = this;
+
+    m_systemGroups.push_back(group);
+    return *group;
+}
+
+///////////////////////////////////////////////////////////
+void World::removeSystemGroup(SystemGroup* group) {
+    auto it = std::find(m_systemGroups.begin(), m_systemGroups.end(), group);
+    if (it == m_systemGroups.end())
+        return;
+
+    m_systemGroups.erase(it);
+
+    // Systems of the group run every tick from now on
+    for (System* system : m_systems) {
+        if (system->m_group == group)
+            system->m_group = nullptr;
+    }
+
+    m_systemGroupPool.free(group);
+}
+
 ///////////////////////////////////////////////////////////
 EntityBuilder World::entity() {
     return EntityBuilder(this);
@@ -273,15 +592,43 @@ void World::tick() {
         m_isFirstTick = false;
     }
 
-    m_elapsed = m_clock.restart().seconds();
+    tick(m_clock.restart().seconds());
+}
+
+///////////////////////////////////////////////////////////
+void World::tick(float elapsed) {
+    m_elapsed = elapsed;
+
+    // Each phase is timed for the stats
+    Clock clock;
 
     // Systems
     executeSystems();
+    m_tickStats.m_systemsTime = clock.restart();
 
     // Entity management
     removeQueuedEntities();
+    m_tickStats.m_removeTime = clock.restart();
     addQueuedEntities();
+    if (!m_removesAfterCreate.empty()) {
+        std::vector<EntityId> ids;
+        ids.swap(m_removesAfterCreate);
+        remove(ids);
+    }
+    m_tickStats.m_addTime = clock.restart();
     changeQueuedEntities();
+    m_tickStats.m_changeTime = clock.restart();
+
+    // Enter and exit events of component changes are sent in batches
+    dispatchQueuedEvents();
+    m_tickStats.m_eventsTime = clock.restart();
+
+    // Ids freed this tick can be reserved again
+    refillFreeIds();
+
+    m_tickStats.m_totalTime = m_tickStats.m_systemsTime + m_tickStats.m_removeTime +
+                              m_tickStats.m_addTime + m_tickStats.m_changeTime +
+                              m_tickStats.m_eventsTime;
 }
 
 ///////////////////////////////////////////////////////////
@@ -289,8 +636,258 @@ void World::setScheduler(Scheduler* scheduler) {
     m_scheduler = scheduler;
 }
 
+///////////////////////////////////////////////////////////
+WorldStats World::getStats() {
+    WorldStats stats;
+    stats.m_tick = m_tickStats;
+
+    // Systems
+    stats.m_systems.reserve(m_systems.size());
+    for (System* system : m_systems) {
+        stats.m_systems.push_back(system->m_stats);
+        stats.m_systems.back().m_system = system;
+    }
+
+    // Groups
+    ReadLock lock(m_groupsMutex);
+
+    stats.m_groups.reserve(m_groups.size());
+    for (auto it = m_groups.begin(); it != m_groups.end(); ++it) {
+        EntityGroup& group = *it.value();
+        ReadLock groupLock(group.m_mutex);
+
+        GroupStats& groupStats = stats.m_groups.emplace_back();
+        groupStats.m_id = group.m_id;
+        groupStats.m_numEntities = group.m_entities.size();
+
+        auto addStore = [&groupStats](std::type_index type, const priv::ComponentStore& store) {
+            ComponentStats& compStats = groupStats.m_components.emplace_back();
+            compStats.m_type = type;
+            compStats.m_typeSize = store.getTypeSize();
+            compStats.m_bytesUsed = store.size() * store.getTypeSize();
+            compStats.m_bytesReserved = store.capacity() * store.getTypeSize();
+
+            groupStats.m_bytesUsed += compStats.m_bytesUsed;
+            groupStats.m_bytesReserved += compStats.m_bytesReserved;
+        };
+
+        for (auto compIt = group.m_components.begin(); compIt != group.m_components.end(); ++compIt)
+            addStore(compIt.key(), compIt.value());
+
+        // Shared components hold a single value for the whole group
+        for (auto compIt = group.m_shared.begin(); compIt != group.m_shared.end(); ++compIt)
+            addStore(compIt.key(), compIt.value());
+
+        stats.m_numEntities += groupStats.m_numEntities;
+    }
+
+    return stats;
+}
+
+///////////////////////////////////////////////////////////
+void World::resetStats() {
+    for (System* system : m_systems)
+        system->m_stats = SystemStats();
+}
+
+///////////////////////////////////////////////////////////
+CompactStats World::compact(Time budget) {
+    CHECK_F(!m_isExecutingSystems, "world can't be compacted while systems are running");
+
+    CompactStats stats;
+    Clock clock;
+
+    // Start a new pass with the groups that exist now
+    if (m_compactQueue.empty()) {
+        ReadLock lock(m_groupsMutex);
+        m_compactQueue.reserve(m_groups.size());
+        for (auto it = m_groups.begin(); it != m_groups.end(); ++it)
+            m_compactQueue.push_back(it.key());
+    }
+
+    // Deferred creations keep a pointer to the group they create entities in
+    bool hasQueuedCreates = false;
+    {
+        std::lock_guard<std::mutex> lock(m_commandBuffersMutex);
+        for (auto& buffer : m_commandBuffers)
+            hasQueuedCreates |= !buffer->getCreates().empty();
+    }
+
+    while (!m_compactQueue.empty()) {
+        EntityGroupId id = m_compactQueue.back();
+        m_compactQueue.pop_back();
+
+        {
+            WriteLock lock(m_groupsMutex);
+
+            // Skip groups that were freed since the pass started
+            auto it = m_groups.find(id);
+            if (it != m_groups.end()) {
+                EntityGroup* group = it.value().get();
+                ++stats.m_numGroupsVisited;
+
+                // Groups with shared values probe for the next free id, so freeing a group
+                // that has another after it would cut the probe chain of that group
+                bool endsProbeChain = m_sharedTypes.empty() || !m_groups.contains(id + 1);
+
+                if (group->m_entities.empty() && !group->m_hasPendingEvents && !hasQueuedCreates &&
+                    endsProbeChain) {
+                    for (auto colIt = group->m_components.begin(); colIt != group->m_components.end(); ++colIt)
+                        stats.m_bytesReleased += colIt.value().capacity() * colIt.value().getTypeSize();
+                    stats.m_bytesReleased += sizeof(EntityGroup);
+
+                    freeEntityGroup(group);
+                    ++stats.m_numGroupsFreed;
+                } else {
+                    shrinkEntityGroup(group, stats);
+                }
+            }
+        }
+
+        // At least one group is processed per call, so the pass always finishes
+        if (budget.microseconds() > 0 && clock.getElapsedTime().microseconds() >= budget.microseconds() &&
+            !m_compactQueue.empty())
+            return stats;
+    }
+
+    // The rest is small, and done once at the end of each pass
+    for (auto it = m_sparseSets.begin(); it != m_sparseSets.end(); ++it) {
+        priv::SparseSet* set = it.value().get();
+        WriteLock lock(set->getMutex());
+
+        if (isMostlyUnused(set->getStore().capacity(), set->size())) {
+            stats.m_bytesReleased += set->shrinkToFit();
+            ++stats.m_numArraysShrunk;
+        }
+    }
+
+    std::vector<EntityData>& entityData = m_entities.data();
+    if (isMostlyUnused(entityData.capacity(), entityData.size())) {
+        stats.m_bytesReleased += (entityData.capacity() - entityData.size()) * sizeof(EntityData);
+        entityData.shrink_to_fit();
+        ++stats.m_numArraysShrunk;
+    }
+
+    stats.m_isPassComplete = true;
+    return stats;
+}
+
 #pragma region Private
 
+///////////////////////////////////////////////////////////
+uint32_t World::nextChangeTick() {
+    return ++m_changeTick;
+}
+
+///////////////////////////////////////////////////////////
+priv::CommandBuffer& World::getCommandBuffer() {
+    if (t_commandBuffer.m_worldId == m_worldId)
+        return *t_commandBuffer.m_buffer;
+
+    std::lock_guard<std::mutex> lock(m_commandBuffersMutex);
+
+    priv::CommandBuffer*& buffer = m_threadBuffers[std::this_thread::get_id()];
+    if (!buffer) {
+        m_commandBuffers.push_back(std::make_unique<priv::CommandBuffer>());
+        buffer = m_commandBuffers.back().get();
+    }
+
+    t_commandBuffer.m_worldId = m_worldId;
+    t_commandBuffer.m_buffer = buffer;
+    return *buffer;
+}
+
+///////////////////////////////////////////////////////////
+void World::reserveEntities(EntityId* ids, uint32_t num) {
+    // The free ids don't change until the next sync point, so a single counter is
+    // enough to hand out each of them once
+    uint32_t first = m_numReserved.fetch_add(num, std::memory_order_relaxed);
+    uint32_t numFree = (uint32_t)m_freeIds.size();
+
+    for (uint32_t i = 0; i < num; ++i) {
+        uint32_t n = first + i;
+        ids[i] = n < numFree ? m_freeIds[n] : EntityId(m_firstNewId + (n - numFree));
+    }
+}
+
+///////////////////////////////////////////////////////////
+bool World::isReserved(EntityId id) const {
+    uint32_t tableSize = (uint32_t)m_entities.getHandleTable().size();
+    if (id.m_index < tableSize)
+        return m_entities.isReserved(id);
+
+    // New ids past the end of the table, up to the last one handed out
+    uint32_t numReserved = m_numReserved.load(std::memory_order_relaxed);
+    uint32_t numFree = (uint32_t)m_freeIds.size();
+    uint32_t numNew = numReserved > numFree ? numReserved - numFree : 0;
+
+    return id.m_counter == 0 && id.m_index < m_firstNewId + numNew;
+}
+
+///////////////////////////////////////////////////////////
+void World::refillFreeIds() {
+    uint32_t numReserved = m_numReserved.load(std::memory_order_relaxed);
+    uint32_t numFree = (uint32_t)m_freeIds.size();
+
+    // New ids that were handed out may not have been created yet, so they are never
+    // handed out again
+    uint32_t numNew = numReserved > numFree ? numReserved - numFree : 0;
+    m_firstNewId = std::max((uint32_t)m_entities.getHandleTable().size(), m_firstNewId + numNew);
+
+    // Give back the ids that weren't handed out, then take all free ids
+    if (numReserved < numFree)
+        m_entities.release(m_freeIds.data() + numReserved, numFree - numReserved);
+
+    m_freeIds.clear();
+    m_entities.takeFreeHandles(m_freeIds);
+    m_numReserved.store(0, std::memory_order_relaxed);
+}
+
+///////////////////////////////////////////////////////////
+void World::resetFreeIds() {
+    // The reserved ids of the new table belonged to creations that were discarded
+    const std::vector<Handle>& table = m_entities.getHandleTable();
+    std::vector<EntityId> orphans;
+    for (uint32_t i = 0; i < table.size(); ++i) {
+        EntityId id(i, table[i].m_counter);
+        if (m_entities.isReserved(id))
+            orphans.push_back(id);
+    }
+    m_entities.release(orphans.data(), (uint32_t)orphans.size());
+
+    m_freeIds.clear();
+    m_numReserved.store(0, std::memory_order_relaxed);
+    m_firstNewId = 0;
+    m_removesAfterCreate.clear();
+    refillFreeIds();
+}
+
+///////////////////////////////////////////////////////////
+void World::deferCreate(EntityBuilder* builder) {
+    getCommandBuffer().create(builder, t_systemOrder);
+}
+
+///////////////////////////////////////////////////////////
+void World::deferRemove(EntityId id) {
+    getCommandBuffer().remove(id, t_systemOrder);
+}
+
+///////////////////////////////////////////////////////////
+void World::deferAddComponent(
+    EntityId id,
+    std::type_index type,
+    const void* component,
+    size_t size,
+    size_t align
+) {
+    getCommandBuffer().addComponent(id, type, component, size, align, t_systemOrder);
+}
+
+///////////////////////////////////////////////////////////
+void World::deferRemoveComponent(EntityId id, std::type_index type) {
+    getCommandBuffer().removeComponent(id, type, t_systemOrder);
+}
+
 ///////////////////////////////////////////////////////////
 void World::addComponent(
     EntityGroup* group,
@@ -307,78 +904,64 @@ void World::addComponent(
     if (group->m_components.contains(type))
         return;
 
-    // Get list of component types
-    auto& componentMap = group->m_components;
-    std::vector<std::type_index> types;
-    types.reserve(componentMap.size());
-    for (auto it = componentMap.begin(); it != componentMap.end(); ++it)
-        types.push_back(it.key());
-
-    types.push_back(type);
-
-    // Get new group hash
-    EntityGroupId newGroupId = entityGroupHash(types);
+    // Shared components are replaced, unless the value is the same
+    bool isShared = isSharedComponent(type);
+    if (isShared) {
+        auto it = group->m_shared.find(type);
+        if (it != group->m_shared.end() && memcmp(it.value().data(), component, size) == 0)
+            return;
+    }
 
     // Get new group (create if needed)
-    EntityGroup* newGroup = nullptr;
-    {
-        // Lock group map
-        WriteLock lock(m_groupsMutex);
-
-        // Perform search first so that we don't have to create component meta map if not needed
-        auto it = m_groups.find(newGroupId);
-        if (it != m_groups.end()) {
-            newGroup = it.value().get();
-        }
-
-        else {
-            // Create component map
-            HashMap<std::type_index, priv::ComponentMetadata> componentMetaMap;
-            for (auto it = componentMap.begin(); it != componentMap.end(); ++it)
-                componentMetaMap[it.key()] = priv::ComponentMetadata(
-                    NULL, it.value().getTypeSize(), it.value().getTypeAlign()
-                );
-            componentMetaMap[type] = priv::ComponentMetadata(NULL, size, align);
-
-            newGroup = getOrCreateEntityGroup(newGroupId, componentMetaMap);
-        }
-    }
+    auto& componentMap = group->m_components;
+    EntityGroup* newGroup = getNextEntityGroup(group, type, component, size, align);
 
-    HashMap<std::type_index, void*> ptrs;
     {
         // Lock new group
         WriteLock newGroupLock(newGroup->m_mutex);
 
-        // Update entity data
+        // Queue events while the components are still in the old group
         size_t oldIndex = data.m_index;
-        data.m_group = newGroupId;
+        queueEntityChangeEvents(id, group, oldIndex, newGroup);
+
+        // Remove entity from old group (swap-pop, so the back entity takes its index)
+        EntityId back = group->m_entities.back();
+        m_entities[back].m_index = oldIndex;
+        group->m_entities[oldIndex] = back;
+        group->m_entities.pop_back();
+
+        // Update entity data
+        data.m_group = newGroup;
         data.m_index = newGroup->m_entities.size();
 
         // Add entity to new group
         newGroup->m_entities.push_back(id);
-        // Remove entity from old group
-        group->m_entities[oldIndex] = group->m_entities.back();
-        group->m_entities.pop_back();
 
-        // Add new component
+        // Move the disabled bit along with the entity
+        priv::swapPopDisabled(*group, oldIndex);
+        if (!data.m_isEnabled)
+            priv::setRowDisabled(*newGroup, data.m_index, true);
+
+        // Add new component (shared values are already stored in the group)
+        uint32_t tick = nextChangeTick();
         auto& newComponents = newGroup->m_components;
-        newComponents[type].push(&component, 1);
-        ptrs[type] = newComponents[type].data(newGroup->m_entities.size() - 1);
+        if (!isShared) {
+            newComponents.at(type).push(component, 1);
+            newComponents.at(type).markAdded(data.m_index, 1, tick);
+        }
 
         // Manage components
         for (auto it = componentMap.begin(); it != componentMap.end(); ++it) {
-            auto& componentStore = newComponents[it.key()];
+            auto& componentStore = newComponents.at(it.key());
 
             // Add components to new group
             componentStore.push(it.value().data(oldIndex), 1);
-            ptrs[it.key()] = componentStore.data(componentStore.size() - 1);
+            componentStore.markChanged(data.m_index, 1, tick);
 
             // Remove components from old group
             it.value().remove(oldIndex);
+            it.value().markChanged(oldIndex, 1, tick);
         }
-
-        // Send events
-        dispatchEntityChangeEvents(id, ptrs, group, newGroup);
     }
 }
 
@@ -388,161 +971,345 @@ void World::removeComponent(EntityGroup* group, EntityId id, std::type_index typ
     auto& data = m_entities[id];
 
     // Don't remove if component doesn't exist
-    if (!group->m_components.contains(type))
+    if (!group->m_components.contains(type) && !group->m_shared.contains(type))
         return;
 
-    // Get list of component types
-    auto& componentMap = group->m_components;
-    std::vector<std::type_index> types;
-    types.reserve(componentMap.size());
-    for (auto it = componentMap.begin(); it != componentMap.end(); ++it) {
-        if (it.key() == type)
-            continue;
-
-        types.push_back(it.key());
-    }
-
-    // Get new group hash
-    EntityGroupId newGroupId = entityGroupHash(types);
-
     // Get new group (create if needed)
-    EntityGroup* newGroup = nullptr;
-    {
-        // Lock group map
-        WriteLock lock(m_groupsMutex);
-
-        // Perform search first so that we don't have to create component meta map if not needed
-        auto it = m_groups.find(newGroupId);
-        if (it != m_groups.end()) {
-            newGroup = it.value().get();
-        }
-
-        else {
-            // Create component map
-            HashMap<std::type_index, priv::ComponentMetadata> componentMetaMap;
-            for (auto it = componentMap.begin(); it != componentMap.end(); ++it) {
-                if (it.key() == type)
-                    continue;
-
-                componentMetaMap[it.key()] = priv::ComponentMetadata(
-                    NULL, it.value().getTypeSize(), it.value().getTypeAlign()
-                );
-            }
-
-            newGroup = getOrCreateEntityGroup(newGroupId, componentMetaMap);
-        }
-    }
+    auto& componentMap = group->m_components;
+    EntityGroup* newGroup = getNextEntityGroup(group, type, nullptr, 0, 0);
 
-    HashMap<std::type_index, void*> ptrs;
     {
         // Lock new group
         WriteLock newGroupLock(newGroup->m_mutex);
 
-        // Update entity data
+        // Queue events while the components are still in the old group
         size_t oldIndex = data.m_index;
-        data.m_group = newGroupId;
+        queueEntityChangeEvents(id, group, oldIndex, newGroup);
+
+        // Remove entity from old group (swap-pop, so the back entity takes its index)
+        EntityId back = group->m_entities.back();
+        m_entities[back].m_index = oldIndex;
+        group->m_entities[oldIndex] = back;
+        group->m_entities.pop_back();
+
+        // Update entity data
+        data.m_group = newGroup;
         data.m_index = newGroup->m_entities.size();
 
         // Add entity to new group
         newGroup->m_entities.push_back(id);
-        // Remove entity from old group
-        group->m_entities[oldIndex] = group->m_entities.back();
-        group->m_entities.pop_back();
+
+        // Move the disabled bit along with the entity
+        priv::swapPopDisabled(*group, oldIndex);
+        if (!data.m_isEnabled)
+            priv::setRowDisabled(*newGroup, data.m_index, true);
 
         // Manage components
+        uint32_t tick = nextChangeTick();
         for (auto it = componentMap.begin(); it != componentMap.end(); ++it) {
-            if (it.key() == type) {
-                // Save NULL pointer for removed component
-                ptrs[type] = NULL;
-            } else {
+            if (it.key() != type) {
                 // Add components to new group
-                auto& componentStore = newGroup->m_components[it.key()];
+                auto& componentStore = newGroup->m_components.at(it.key());
                 componentStore.push(it.value().data(oldIndex), 1);
-                ptrs[it.key()] = componentStore.data(componentStore.size() - 1);
-
-                // Remove components from old group
-                it.value().remove(oldIndex);
+                componentStore.markChanged(data.m_index, 1, tick);
             }
+
+            // Remove components from old group
+            it.value().remove(oldIndex);
+            it.value().markChanged(oldIndex, 1, tick);
         }
+    }
+}
 
-        // Send events
-        dispatchEntityChangeEvents(id, ptrs, group, newGroup);
+///////////////////////////////////////////////////////////
+EntityGroup* World::getNextEntityGroup(
+    EntityGroup* group,
+    std::type_index type,
+    const void* component,
+    size_t size,
+    size_t align
+) {
+    // Get list of component types, and the hash of the shared values
+    auto& componentMap = group->m_components;
+    std::vector<std::type_index> types;
+    types.reserve(componentMap.size() + group->m_shared.size() + 1);
+    for (auto it = componentMap.begin(); it != componentMap.end(); ++it) {
+        if (it.key() != type)
+            types.push_back(it.key());
     }
+
+    EntityGroupId sharedHash = 0;
+    for (auto it = group->m_shared.begin(); it != group->m_shared.end(); ++it) {
+        if (it.key() == type)
+            continue;
+
+        types.push_back(it.key());
+        sharedHash += sharedValueHash(it.key(), it.value().data(), it.value().getTypeSize());
+    }
+
+    bool hasShared = sharedHash != 0 || (component && isSharedComponent(type));
+    if (component) {
+        types.push_back(type);
+        if (isSharedComponent(type))
+            sharedHash += sharedValueHash(type, component, size);
+    }
+
+    // Get new group hash
+    EntityGroupId newGroupId = entityGroupHash(types) + sharedHash;
+
+    // Lock group map
+    WriteLock lock(m_groupsMutex);
+
+    // Perform search first so that we don't have to create component meta map if not needed
+    // (groups with shared values are compared by value, which needs the map)
+    if (!hasShared) {
+        auto it = m_groups.find(newGroupId);
+        if (it != m_groups.end() && it.value()->m_shared.empty())
+            return it.value().get();
+    }
+
+    // Create component map, shared components point to their values
+    HashMap<std::type_index, priv::ComponentMetadata> componentMetaMap;
+    for (auto it = componentMap.begin(); it != componentMap.end(); ++it) {
+        if (it.key() != type)
+            componentMetaMap[it.key()] =
+                priv::ComponentMetadata(NULL, it.value().getTypeSize(), it.value().getTypeAlign());
+    }
+
+    for (auto it = group->m_shared.begin(); it != group->m_shared.end(); ++it) {
+        if (it.key() != type)
+            componentMetaMap[it.key()] = priv::ComponentMetadata(
+                it.value().data(), it.value().getTypeSize(), it.value().getTypeAlign()
+            );
+    }
+
+    if (component)
+        componentMetaMap[type] = priv::ComponentMetadata((void*)component, size, align);
+
+    return getOrCreateEntityGroup(newGroupId, componentMetaMap);
 }
 
 ///////////////////////////////////////////////////////////
-void World::dispatchEntityChangeEvents(
+void World::queueEntityChangeEvents(
     EntityId id,
-    const HashMap<std::type_index, void*>& ptrs,
     EntityGroup* oldGroup,
+    size_t oldIndex,
     EntityGroup* newGroup
 ) {
-    // Detect enter queries
-    auto& enterQueries = m_observers[(uint32_t)EntityEventType::OnEnter];
-    for (auto observer : enterQueries) {
-        Observer& q = *observer;
-        if (q.m_watchGroups.contains(newGroup->m_id) && !q.m_watchGroups.contains(oldGroup->m_id)) {
-            // Lock mutexes if provided
-            std::vector<std::unique_lock<std::mutex>> locks;
-            locks.reserve(q.m_mutexes.size());
-            for (size_t m = 0; m < q.m_mutexes.size(); ++m)
-                locks.push_back(std::unique_lock<std::mutex>(*q.m_mutexes[m]));
+    bool queued = false;
+
+    // Observers that watch the new group but not the old one see the entity enter
+    // (only the id is kept, components are found when the batch is sent)
+    for (priv::ObserverBatch& batch : newGroup->m_enterObservers) {
+        if (!batch.m_observer->m_watchGroups.contains(oldGroup->m_id)) {
+            batch.m_ids.push_back(id);
+            queued = true;
+        }
+    }
+    if (queued)
+        markPendingEvents(newGroup);
+
+    // Observers that watch the old group but not the new one see the entity exit
+    // (components are copied, since they are removed from the old group)
+    queued = false;
+    for (priv::ObserverBatch& batch : oldGroup->m_exitObservers) {
+        if (batch.m_observer->m_watchGroups.contains(newGroup->m_id))
+            continue;
 
-            // Invoke observer
-            q.m_iterator({id}, ptrs, this, newGroup, m_elapsed);
+        batch.m_ids.push_back(id);
+        for (size_t c = 0; c < batch.m_columns.size(); ++c) {
+            if (batch.m_columns[c])
+                batch.m_data[c].push(batch.m_columns[c]->data(oldIndex), 1);
         }
+        queued = true;
+    }
+    if (queued)
+        markPendingEvents(oldGroup);
+}
+
+///////////////////////////////////////////////////////////
+void World::markPendingEvents(EntityGroup* group) {
+    if (group->m_hasPendingEvents)
+        return;
+
+    group->m_hasPendingEvents = true;
+
+    std::lock_guard<std::mutex> lock(m_pendingEventsMutex);
+    m_pendingEventGroups.push_back(group);
+}
+
+///////////////////////////////////////////////////////////
+void World::dispatchQueuedEvents() {
+    std::vector<EntityGroup*> groups;
+    {
+        std::lock_guard<std::mutex> lock(m_pendingEventsMutex);
+        groups.swap(m_pendingEventGroups);
     }
 
-    // Detect exit queries
-    auto& exitQueries = m_observers[(uint32_t)EntityEventType::OnExit];
-    for (auto observer : exitQueries) {
-        Observer& q = *observer;
-        if (q.m_watchGroups.contains(oldGroup->m_id) && !q.m_watchGroups.contains(newGroup->m_id)) {
-            // Lock mutexes if provided
-            std::vector<std::unique_lock<std::mutex>> locks;
-            locks.reserve(q.m_mutexes.size());
-            for (size_t m = 0; m < q.m_mutexes.size(); ++m)
-                locks.push_back(std::unique_lock<std::mutex>(*q.m_mutexes[m]));
+    for (EntityGroup* group : groups) {
+        // Observers may change components, but those changes are deferred
+        // to the next tick while the group is locked
+        WriteLock lock(group->m_mutex);
+        group->m_hasPendingEvents = false;
 
-            // Invoke observer
-            q.m_iterator({id}, ptrs, this, newGroup, m_elapsed);
+        // Send exits first, with the copies of the removed components
+        void* columns[Observer::MAX_COLUMNS];
+        for (priv::ObserverBatch& batch : group->m_exitObservers) {
+            if (batch.m_ids.empty())
+                continue;
+
+            for (size_t c = 0; c < batch.m_data.size(); ++c)
+                columns[c] = batch.m_columns[c] ? batch.m_data[c].data() : nullptr;
+            invokeObserver(*batch.m_observer, batch.m_ids, columns, group);
+
+            batch.m_ids.clear();
+            for (priv::ComponentStore& data : batch.m_data)
+                data.resize(0);
+        }
+
+        // Entities that left the group again, or were removed, are skipped
+        std::vector<uint32_t> rows;
+        for (priv::ObserverBatch& batch : group->m_enterObservers) {
+            if (batch.m_ids.empty())
+                continue;
+
+            rows.clear();
+            for (EntityId id : batch.m_ids) {
+                if (m_entities.isValid(id) && m_entities[id].m_group == group)
+                    rows.push_back(m_entities[id].m_index);
+            }
+            batch.m_ids.clear();
+
+            // Entered entities were appended to the group, so they are almost
+            // always contiguous, and each run of them is sent at once
+            std::sort(rows.begin(), rows.end());
+            rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+
+            for (size_t r = 0; r < rows.size();) {
+                size_t end = r + 1;
+                while (end < rows.size() && rows[end] == rows[end - 1] + 1)
+                    ++end;
+
+                std::vector<EntityId> ids(
+                    group->m_entities.begin() + rows[r], group->m_entities.begin() + rows[end - 1] + 1
+                );
+                for (size_t c = 0; c < batch.m_columns.size(); ++c)
+                    columns[c] = batch.m_columns[c] ? batch.m_columns[c]->data(rows[r]) : nullptr;
+                invokeObserver(*batch.m_observer, ids, columns, group);
+
+                r = end;
+            }
         }
     }
 }
 
+///////////////////////////////////////////////////////////
+void World::addObserverBatch(Observer* observer, EntityGroup* group) {
+    // Only enter and exit events are batched
+    auto isObserving = [observer](const std::vector<Observer*>& observers) {
+        return std::find(observers.begin(), observers.end(), observer) != observers.end();
+    };
+
+    std::vector<priv::ObserverBatch>* batches = nullptr;
+    if (isObserving(m_observers[OnEnter]))
+        batches = &group->m_enterObservers;
+    else if (isObserving(m_observers[OnExit]))
+        batches = &group->m_exitObservers;
+    else
+        return;
+
+    priv::ObserverBatch batch;
+    batch.m_observer = observer;
+    for (auto type : observer->m_columnTypes) {
+        auto it = group->m_components.find(type);
+        if (it != group->m_components.end()) {
+            batch.m_columns.push_back(&it.value());
+            batch.m_data.push_back(
+                priv::ComponentStore(it.value().getTypeSize(), it.value().getTypeAlign())
+            );
+        } else {
+            batch.m_columns.push_back(nullptr);
+            batch.m_data.push_back(priv::ComponentStore());
+        }
+    }
+
+    batches->push_back(std::move(batch));
+}
+
 ///////////////////////////////////////////////////////////
 void World::addQueuedEntities() {
+    // Merge the creations of all threads, in system order (observers that create
+    // entities record new commands, which are applied next tick)
+    std::vector<priv::CommandBuffer::Create> creates;
+    for (auto& buffer : m_commandBuffers) {
+        auto& list = buffer->getCreates();
+        creates.insert(creates.end(), list.begin(), list.end());
+        list.clear();
+    }
+
+    std::stable_sort(creates.begin(), creates.end(), [](const auto& a, const auto& b) {
+        return a.m_order < b.m_order;
+    });
+
     // Process all entity creation requests
-    for (auto factory : m_addQueue) {
+    for (const auto& create : creates) {
+        EntityBuilder* factory = create.m_builder;
+
         // Create entities (and ids)
         HashMap<std::type_index, void*> ptrs;
         std::vector<EntityId> ids = factory->createImpl(factory->m_numCreate, ptrs, false);
 
+        // Invoke deferred init function
+        if (factory->m_onCreate)
+            factory->m_onCreate(ptrs, ids.size());
+
         // Send add event
         factory->sendEvent(ids, ptrs);
 
         // Free factory
         delete factory;
     }
-
-    // Clear queue
-    m_addQueue.clear();
 }
 
 ///////////////////////////////////////////////////////////
 void World::changeQueuedEntities() {
+    // Merge the component changes of all threads, in system order. Payloads stay
+    // in the arenas of their buffers until all changes are applied
+    std::vector<priv::CommandBuffer::Change> changes;
+    for (auto& buffer : m_commandBuffers) {
+        auto& list = buffer->getChanges();
+        changes.insert(changes.end(), list.begin(), list.end());
+        list.clear();
+    }
+
+    std::stable_sort(changes.begin(), changes.end(), [](const auto& a, const auto& b) {
+        return a.m_order < b.m_order;
+    });
+
     // Process all component changes
-    for (auto& change : m_changeQueue) {
+    for (auto& change : changes) {
+        // Skip entities that have been removed since the change was queued
+        if (!m_entities.isValid(change.m_id) || !m_entities[change.m_id].m_isAlive)
+            continue;
+
+        // Sparse components are changed in place
+        priv::SparseSet* sparse = findSparseSet(change.m_type);
+        if (sparse) {
+            WriteLock lock(sparse->getMutex());
+
+            if (change.m_component)
+                sparse->insert(change.m_id, change.m_component, nextChangeTick());
+            else
+                sparse->remove(change.m_id, nextChangeTick());
+
+            continue;
+        }
+
         // Get entity data
         auto& data = m_entities[change.m_id];
 
         // Get group
-        EntityGroup* group = nullptr;
-        {
-            // Lock group map
-            ReadLock lock(m_groupsMutex);
-            group = m_groups.find(data.m_group).value().get();
-        }
+        EntityGroup* group = data.m_group;
         CHECK_F(group != NULL, "entity group not found");
 
         // Lock group
@@ -553,17 +1320,39 @@ void World::changeQueuedEntities() {
             addComponent(
                 group, change.m_id, change.m_type, change.m_component, change.m_size, change.m_align
             );
-
-            // Free
-            FREE_DBG(change.m_component);
         } else {
             // Remove component
             removeComponent(group, change.m_id, change.m_type);
         }
     }
 
-    // Clear component changes
-    m_changeQueue.clear();
+    // Enabled states don't depend on the group, so they are applied after the entities moved
+    std::vector<priv::CommandBuffer::Enable> enables;
+    for (auto& buffer : m_commandBuffers) {
+        auto& list = buffer->getEnables();
+        enables.insert(enables.end(), list.begin(), list.end());
+        list.clear();
+    }
+
+    std::stable_sort(enables.begin(), enables.end(), [](const auto& a, const auto& b) {
+        return a.m_order < b.m_order;
+    });
+
+    for (const auto& enable : enables) {
+        if (!m_entities.isValid(enable.m_id) || !m_entities[enable.m_id].m_isAlive)
+            continue;
+
+        EntityGroup* group = m_entities[enable.m_id].m_group;
+        WriteLock lock(group->m_mutex);
+        setEnabled(group, enable.m_id, enable.m_isEnabled);
+    }
+
+    // Reset the arenas of buffers that are done (commands recorded by observers
+    // while applying are kept for the next tick)
+    for (auto& buffer : m_commandBuffers) {
+        if (buffer->empty())
+            buffer->clear();
+    }
 }
 
 ///////////////////////////////////////////////////////////
@@ -574,6 +1363,35 @@ void World::executeSystems() {
         m_systemsDirty = false;
     }
 
+    // Advance system groups, a pass is needed for each step of the busiest group
+    uint32_t numPasses = 1;
+    for (SystemGroup* group : m_systemGroups) {
+        group->update(m_elapsed);
+        numPasses = std::max(numPasses, group->m_numSteps);
+    }
+
+    // Longest chains go first, using the times of the previous tick
+    if (m_scheduler)
+        prioritizeSystems();
+
+    for (System* system : m_systems)
+        system->m_stats.m_serialTime = Time();
+
+    // Structural changes are deferred until all systems are done, so that
+    // systems don't need to lock the groups they iterate
+    m_isExecutingSystems = true;
+    m_systemsClock.restart();
+
+    for (uint32_t pass = 0; pass < numPasses; ++pass)
+        executeSystemPass(pass);
+
+    m_isExecutingSystems = false;
+
+    findStragglers(m_systemsClock.getElapsedTime());
+}
+
+///////////////////////////////////////////////////////////
+void World::executeSystemPass(uint32_t pass) {
     // Single thread
     if (!m_scheduler) {
         // Iterate through each layer
@@ -581,7 +1399,8 @@ void World::executeSystems() {
             // Execute each system in the layer
             for (System* system : layer.m_systems) {
                 // Run the system's iterator function
-                executeSystem(system);
+                if (isSystemDue(*system, pass))
+                    executeSystem(system);
             }
         }
     }
@@ -589,86 +1408,241 @@ void World::executeSystems() {
     // Multi thread
     else {
         // Create a barrier with the scheduler
-        auto barrier = m_scheduler->barrier(m_systems.size());
-
-        // Maps systems to their task handles in the scheduler
-        HashMap<System*, TaskHandle> taskHandles;
-
-        // Process each layer
-        for (const auto& layer : m_optimizedSystems) {
-            // For each system in the current layer
-            for (System* system : layer.m_systems) {
-                // Get dependencies for this system
-                std::vector<TaskHandle> systemDependencies;
-                systemDependencies.reserve(system->m_dependencies.size());
-
-                // Add task dependencies from previous layers
-                for (const auto& dep : system->m_dependencies) {
-                    auto it = taskHandles.find(dep);
-                    if (it != taskHandles.end()) {
-                        systemDependencies.push_back(it->second);
-                    }
+        auto barrier = m_scheduler->barrier();
+
+        // Maps systems to the task handles their dependents have to wait on
+        HashMap<System*, std::vector<TaskHandle>> taskHandles;
+
+        // Workers start the first ready task in submission order, so systems are
+        // submitted longest chain first, and the critical chain is also raised above
+        // other work on the scheduler
+        for (System* system : m_prioritizedSystems) {
+            // Get dependencies for this system
+            std::vector<TaskHandle> systemDependencies;
+            systemDependencies.reserve(system->m_scheduleDependencies.size());
+
+            // Dependencies are always submitted first
+            for (const auto& dep : system->m_scheduleDependencies) {
+                auto it = taskHandles.find(dep);
+                if (it != taskHandles.end()) {
+                    systemDependencies.insert(
+                        systemDependencies.end(), it->second.begin(), it->second.end()
+                    );
                 }
+            }
 
-                // Add task to scheduler with dependencies
-                auto task =
-                    barrier.add(std::bind(&World::executeSystem, this, system), systemDependencies);
-
-                // Store task handle for future dependencies
-                taskHandles[system] = task.getHandle();
+            // Systems that aren't due are left out of the graph, their dependents
+            // wait on their dependencies instead so that ordering is kept
+            if (!isSystemDue(*system, pass)) {
+                std::sort(systemDependencies.begin(), systemDependencies.end());
+                systemDependencies.erase(
+                    std::unique(systemDependencies.begin(), systemDependencies.end()),
+                    systemDependencies.end()
+                );
+                taskHandles[system] = std::move(systemDependencies);
+                continue;
             }
+
+            // Add task to scheduler with dependencies
+            auto priority = system->m_stats.m_isCritical ? Scheduler::High : Scheduler::Medium;
+            auto task = barrier.add(
+                [this, system]() {
+                    system->m_runStart = m_systemsClock.getElapsedTime();
+                    executeSystem(system);
+                    system->m_runEnd = m_systemsClock.getElapsedTime();
+                },
+                systemDependencies,
+                priority
+            );
+
+            // Store task handle for future dependencies
+            taskHandles[system] = {task.getHandle()};
         }
 
         // Wait for all tasks to complete
         barrier.wait();
+        measureSerialTime(pass);
     }
 }
 
+///////////////////////////////////////////////////////////
+bool World::isSystemDue(const System& system, uint32_t pass) const {
+    if (system.m_group)
+        return pass < system.m_group->m_numSteps;
+
+    return pass == 0;
+}
+
 ///////////////////////////////////////////////////////////
 void World::executeSystem(System* system) {
     System& q = *system;
 
+    // Commands recorded by the system are merged in system order
+    SystemOrderScope order(system, q.m_order);
+
+    // Grouped systems receive the time of a step of their group
+    float dt = q.m_group ? q.m_group->m_stepTime : m_elapsed;
+
+    // Time the system, the workload counters are filled while it runs
+    Clock clock;
+    SystemTimer timer(q.m_stats, clock);
+    q.m_stats.m_numGroups = 0;
+    q.m_stats.m_numEntities = 0;
+
     // Lock mutexes if provided
-    std::vector<std::unique_lock<std::mutex>> locks;
-    locks.reserve(q.m_mutexes.size());
-    for (size_t m = 0; m < q.m_mutexes.size(); ++m)
-        locks.push_back(std::unique_lock<std::mutex>(*q.m_mutexes[m]));
+    priv::MutexListLock locks(q.m_mutexes);
 
     // Special type of system
     if (q.m_include.empty() && q.m_exclude.empty()) {
         // Iterate through no groups, just invoke once
-        q.m_iterator({Handle()}, {}, this, nullptr, m_elapsed);
+        q.m_iterator({Handle()}, 0, 1, nullptr, nullptr, this, nullptr, dt, nullptr);
+        return;
+    }
+
+    // Change tick of this run, used to stamp mutable access and to filter changes
+    uint32_t lastRun = q.m_lastRunTick;
+    uint32_t thisRun = nextChangeTick();
+    bool filtered = q.hasChangeFilters();
+
+    // Sparse components are joined one entity at a time
+    if (q.hasSparseFilters()) {
+        executeJoinedSystem(q, lastRun, thisRun, dt);
+        q.m_lastRunTick = thisRun;
         return;
     }
 
     // Iterate through groups that match system query
-    for (auto it = q.m_groups.begin(); it != q.m_groups.end(); ++it) {
-        // Get group
-        EntityGroup* group = NULL;
-        {
-            ReadLock lock(m_groupsMutex);
-            group = m_groups.find(*it).value().get();
-        }
-        if (!group)
+    for (const MatchedGroup& match : q.m_matches) {
+        // The group is not locked: systems that access the same components
+        // are ordered by the schedule, and structural changes are deferred
+        // while systems run
+        size_t numEntities = match.m_group->m_entities.size();
+        if (!filtered) {
+            if (numEntities) {
+                executeSystemRange(q, match, 0, numEntities, thisRun, dt);
+                ++q.m_stats.m_numGroups;
+            }
             continue;
+        }
 
-        ReadLock lock(group->m_mutex);
+        size_t numIterated = q.m_stats.m_numEntities;
 
-        // Map of component pointers
-        HashMap<std::type_index, void*> ptrs;
-        for (auto it = group->m_components.begin(); it != group->m_components.end(); ++it)
-            ptrs[it.key()] = it.value().data();
+        // Invoke system on each run of chunks that pass the change filters
+        size_t runStart = 0;
+        for (size_t start = 0; start < numEntities; start += ENTITY_CHUNK_SIZE) {
+            size_t end = std::min<size_t>(start + ENTITY_CHUNK_SIZE, numEntities);
+
+            if (!q.passesChangeFilters(*match.m_group, start / ENTITY_CHUNK_SIZE, lastRun)) {
+                // Flush previous run
+                if (runStart < start)
+                    executeSystemRange(q, match, runStart, start, thisRun, dt);
+                runStart = end;
+            }
+        }
+
+        if (runStart < numEntities)
+            executeSystemRange(q, match, runStart, numEntities, thisRun, dt);
+
+        if (q.m_stats.m_numEntities > numIterated)
+            ++q.m_stats.m_numGroups;
+    }
+
+    q.m_lastRunTick = thisRun;
+}
+
+///////////////////////////////////////////////////////////
+void World::executeJoinedSystem(System& system, uint32_t lastRun, uint32_t thisRun, float dt) {
+    // Get groups
+    std::vector<EntityGroup*> groups;
+    groups.reserve(system.m_matches.size());
+    for (const MatchedGroup& match : system.m_matches)
+        groups.push_back(match.m_group);
+
+    // Find entities that pass the filters (nothing is locked, structural changes
+    // are deferred while systems run)
+    std::vector<std::vector<uint32_t>> rows = collectSparseRows(system, groups, lastRun);
+
+    for (size_t g = 0; g < groups.size(); ++g) {
+        EntityGroup* group = groups[g];
+        if (rows[g].empty())
+            continue;
 
-        // Invoke system
-        q.m_iterator(group->m_entities, ptrs, this, group, m_elapsed);
+        // Invoke system on the list of entities
+        system.m_iterator(
+            group->m_entities,
+            0,
+            rows[g].size(),
+            system.m_matches[g].m_columns.data(),
+            system.m_columnSparse.data(),
+            this,
+            group,
+            dt,
+            rows[g].data()
+        );
+
+        // Mark components that were accessed mutably as changed
+        for (auto type : system.m_writes)
+            markRowsChanged(group, type, rows[g], thisRun);
+
+        ++system.m_stats.m_numGroups;
+        system.m_stats.m_numEntities += rows[g].size();
     }
 }
 
+///////////////////////////////////////////////////////////
+void World::executeSystemRange(
+    System& system,
+    const MatchedGroup& match,
+    size_t start,
+    size_t end,
+    uint32_t tick,
+    float dt
+) {
+    // Invoke system on each run of enabled entities
+    priv::forEachEnabledRun(*match.m_group, start, end, [&](size_t first, size_t last) {
+        system.m_iterator(
+            match.m_group->m_entities,
+            first,
+            last,
+            match.m_columns.data(),
+            system.m_columnSparse.data(),
+            this,
+            match.m_group,
+            dt,
+            nullptr
+        );
+
+        system.m_stats.m_numEntities += last - first;
+    });
+
+    // Mark components that were accessed mutably as changed
+    for (size_t c : system.m_writeColumns)
+        match.m_columns[c]->markChanged(start, end - start, tick);
+}
+
 ///////////////////////////////////////////////////////////
 void World::buildOptimizedSystems() {
     // Clear previous optimized systems
     m_optimizedSystems.clear();
 
+    // Start with the explicit dependencies
+    for (size_t i = 0; i < m_systems.size(); ++i) {
+        m_systems[i]->m_scheduleDependencies = m_systems[i]->m_dependencies;
+        m_systems[i]->m_order = (uint32_t)i;
+    }
+
+    // Order systems with conflicting component access, in the order they were
+    // registered, unless explicit dependencies already order them
+    for (size_t i = 0; i < m_systems.size(); ++i) {
+        for (size_t j = i + 1; j < m_systems.size(); ++j) {
+            System* a = m_systems[i];
+            System* b = m_systems[j];
+
+            if (a->conflictsWith(*b) && !b->dependsOn(a) && !a->dependsOn(b))
+                b->m_scheduleDependencies.push_back(a);
+        }
+    }
+
     // Build dependency graph
     HashMap<System*, std::vector<System*>> graph;
     HashMap<System*, int> inDegree;
@@ -681,7 +1655,7 @@ void World::buildOptimizedSystems() {
 
     // Add dependencies
     for (auto system : m_systems) {
-        for (auto dep : system->m_dependencies) {
+        for (auto dep : system->m_scheduleDependencies) {
             graph[dep].push_back(system); // Dependency -> System direction
             inDegree[system]++;
         }
@@ -710,6 +1684,7 @@ void World::buildOptimizedSystems() {
             zeroDependencySystems.pop();
 
             // Add system to current layer
+            currentSystem->m_layer = (uint32_t)m_optimizedSystems.size();
             currentLayer.m_systems.push_back(currentSystem);
             processedSystems.push_back(currentSystem);
         }
@@ -741,6 +1716,139 @@ void World::buildOptimizedSystems() {
     }
 }
 
+///////////////////////////////////////////////////////////
+void World::prioritizeSystems() {
+    // Dependents are always in later layers, so walking the layers backwards finishes
+    // the chain of each system before its dependencies read it
+    HashMap<System*, System*> nextOnChain;
+    for (System* system : m_systems) {
+        system->m_stats.m_criticalPathTime = system->m_stats.m_expectedTime;
+        system->m_stats.m_isCritical = false;
+    }
+
+    for (auto layer = m_optimizedSystems.rbegin(); layer != m_optimizedSystems.rend(); ++layer) {
+        for (System* system : layer->m_systems) {
+            for (System* dep : system->m_scheduleDependencies) {
+                Time path = dep->m_stats.m_expectedTime + system->m_stats.m_criticalPathTime;
+                if (path > dep->m_stats.m_criticalPathTime) {
+                    dep->m_stats.m_criticalPathTime = path;
+                    nextOnChain[dep] = system;
+                }
+            }
+        }
+    }
+
+    // A dependency's chain is never shorter than its dependents', and ties are broken by
+    // layer, so the order stays a valid topological order
+    m_prioritizedSystems.clear();
+    for (const auto& layer : m_optimizedSystems)
+        m_prioritizedSystems.insert(m_prioritizedSystems.end(), layer.m_systems.begin(), layer.m_systems.end());
+
+    std::sort(m_prioritizedSystems.begin(), m_prioritizedSystems.end(), [](const System* a, const System* b) {
+        if (a->m_stats.m_criticalPathTime != b->m_stats.m_criticalPathTime)
+            return a->m_stats.m_criticalPathTime > b->m_stats.m_criticalPathTime;
+        if (a->m_layer != b->m_layer)
+            return a->m_layer < b->m_layer;
+        return a->m_order < b->m_order;
+    });
+
+    // Mark the longest chain, its systems get a higher priority than other work
+    m_tickStats.m_criticalPathTime = Time();
+    if (m_prioritizedSystems.empty())
+        return;
+
+    System* system = m_prioritizedSystems.front();
+    m_tickStats.m_criticalPathTime = system->m_stats.m_criticalPathTime;
+
+    while (system) {
+        system->m_stats.m_isCritical = true;
+
+        auto it = nextOnChain.find(system);
+        system = it != nextOnChain.end() ? it->second : nullptr;
+    }
+}
+
+///////////////////////////////////////////////////////////
+void World::measureSerialTime(uint32_t pass) {
+    // Sweep the start and end times of the systems that ran, ends first when
+    // they are equal so that back to back systems don't overlap
+    struct Event {
+        Time m_time;
+        System* m_system;
+        bool m_isStart;
+    };
+
+    std::vector<Event> events;
+    for (System* system : m_prioritizedSystems) {
+        if (!isSystemDue(*system, pass))
+            continue;
+
+        // Runs shorter than the clock resolution don't cover any time, and would sort
+        // their end before their start
+        if (system->m_runEnd <= system->m_runStart)
+            continue;
+
+        events.push_back(Event{system->m_runStart, system, true});
+        events.push_back(Event{system->m_runEnd, system, false});
+    }
+
+    std::sort(events.begin(), events.end(), [](const Event& a, const Event& b) {
+        if (a.m_time != b.m_time)
+            return a.m_time < b.m_time;
+        return !a.m_isStart && b.m_isStart;
+    });
+
+    // Time between two events is serial if exactly one system was running
+    std::vector<System*> running;
+    for (size_t i = 0; i < events.size(); ++i) {
+        const Event& event = events[i];
+
+        if (i > 0 && running.size() == 1)
+            running.front()->m_stats.m_serialTime += event.m_time - events[i - 1].m_time;
+
+        if (event.m_isStart) {
+            running.push_back(event.m_system);
+        } else {
+            auto it = std::find(running.begin(), running.end(), event.m_system);
+            if (it != running.end())
+                running.erase(it);
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////
+void World::findStragglers(Time systemsTime) {
+    // A single worker, or a single system, is always serial
+    bool isParallel = m_scheduler && m_scheduler->getNumWorkers() > 1 && m_prioritizedSystems.size() > 1;
+    Time threshold = systemsTime * STRAGGLER_FRACTION;
+
+    m_tickStats.m_numStragglers = 0;
+    for (System* system : m_systems) {
+        SystemStats& stats = system->m_stats;
+        bool wasStraggler = stats.m_isStraggler;
+
+        // Short serial runs aren't worth reporting, as in small worlds where every system
+        // finishes in a few microseconds
+        stats.m_isStraggler = isParallel && stats.m_serialTime >= threshold &&
+                              stats.m_serialTime.microseconds() >= MIN_STRAGGLER_TIME_US;
+        if (!stats.m_isStraggler)
+            continue;
+
+        ++m_tickStats.m_numStragglers;
+
+        // Only reported when it starts, stats hold the ongoing state
+        if (!wasStraggler) {
+            LOG_F(
+                WARNING,
+                "system %u ran alone for %lld of %lld us of systems time",
+                system->m_order,
+                (long long)stats.m_serialTime.microseconds(),
+                (long long)systemsTime.microseconds()
+            );
+        }
+    }
+}
+
 ///////////////////////////////////////////////////////////
 void World::sendEntityEvent(
     EntityEventType type,
@@ -751,6 +1859,14 @@ void World::sendEntityEvent(
     if (ids.size() == 0)
         return;
 
+    // Groups keep their own lists of enter and exit observers
+    if (type == OnEnter || type == OnExit) {
+        auto& batches = type == OnEnter ? group->m_enterObservers : group->m_exitObservers;
+        for (priv::ObserverBatch& batch : batches)
+            invokeObserver(*batch.m_observer, ids, ptrs, group);
+        return;
+    }
+
     auto& listeners = m_observers[(uint32_t)type];
 
     // Iterate through listeners, and send event to all matching listeners
@@ -758,17 +1874,41 @@ void World::sendEntityEvent(
         Observer& q = *listener;
 
         // Only invoke if part of observer's watch list
-        if (q.m_watchGroups.contains(group->m_id)) {
-            // Lock mutexes if provided
-            std::vector<std::unique_lock<std::mutex>> locks;
-            locks.reserve(q.m_mutexes.size());
-            for (size_t m = 0; m < q.m_mutexes.size(); ++m)
-                locks.push_back(std::unique_lock<std::mutex>(*q.m_mutexes[m]));
+        if (q.m_watchGroups.contains(group->m_id))
+            invokeObserver(q, ids, ptrs, group);
+    }
+}
 
-            // Invoke observer
-            q.m_iterator(ids, ptrs, this, group, m_elapsed);
-        }
+///////////////////////////////////////////////////////////
+void World::invokeObserver(
+    Observer& observer,
+    const std::vector<EntityId>& ids,
+    const HashMap<std::type_index, void*>& ptrs,
+    EntityGroup* group
+) {
+    // Component pointers in parameter order (the event map is only looked up
+    // for the observer's own parameters)
+    void* columns[Observer::MAX_COLUMNS];
+    for (size_t c = 0; c < observer.m_columnTypes.size(); ++c) {
+        auto it = ptrs.find(observer.m_columnTypes[c]);
+        columns[c] = it != ptrs.end() ? it.value() : nullptr;
     }
+
+    invokeObserver(observer, ids, columns, group);
+}
+
+///////////////////////////////////////////////////////////
+void World::invokeObserver(
+    Observer& observer,
+    const std::vector<EntityId>& ids,
+    void* const* columns,
+    EntityGroup* group
+) {
+    // Lock mutexes if provided
+    priv::MutexListLock locks(observer.m_mutexes);
+
+    // Invoke observer
+    observer.m_iterator(ids, columns, this, group, m_elapsed);
 }
 
 ///////////////////////////////////////////////////////////
@@ -777,11 +1917,15 @@ bool World::matchesForGroup(EntityGroup& group, QueryBase* query) {
 
     // Check if matches (if no query specifiers, never matches)
     bool match = !(q.m_include.empty() && q.m_exclude.empty());
-    for (size_t t = 0; t < q.m_include.size(); ++t)
-        match &= group.m_components.contains(q.m_include[t]);
+    // Sparse components are never in groups, they are checked per entity
+    for (size_t t = 0; t < q.m_include.size(); ++t) {
+        std::type_index type = q.m_include[t];
+        match &= group.m_components.contains(type) || group.m_shared.contains(type) ||
+            m_sparseSets.contains(type);
+    }
 
     for (size_t t = 0; t < q.m_exclude.size(); ++t)
-        match &= !group.m_components.contains(q.m_exclude[t]);
+        match &= !group.m_components.contains(q.m_exclude[t]) && !group.m_shared.contains(q.m_exclude[t]);
 
     return match;
 }
@@ -792,25 +1936,42 @@ EntityGroup* World::getOrCreateEntityGroup(
     const HashMap<std::type_index, priv::ComponentMetadata>& components
 ) {
     auto groupIt = m_groups.find(id);
-    if (groupIt == m_groups.end()) {
-        // Insert table
-        groupIt = m_groups.emplace(std::make_pair(id, std::make_unique<EntityGroup>())).first;
 
-        auto group = groupIt->second.get();
-        group->m_id = id;
+    // Groups with different shared values can hash to the same id, so probe for a free id
+    if (!m_sharedTypes.empty()) {
+        while (groupIt != m_groups.end() && !hasSharedValues(*groupIt->second, components, m_sharedTypes))
+            groupIt = m_groups.find(++id);
+    }
 
-        // Create component arrays
+    if (groupIt == m_groups.end()) {
+        // Create component arrays (the set of arrays can't change after this)
+        priv::ComponentMap::Map componentStores, sharedStores;
         for (auto it = components.begin(); it != components.end(); ++it) {
             const priv::ComponentMetadata& meta = it.value();
-            group->m_components[it.key()] = priv::ComponentStore(meta.m_size, meta.m_align);
+
+            // Shared components keep a single copy of their value
+            if (isSharedComponent(it.key())) {
+                priv::ComponentStore& store = sharedStores[it.key()] =
+                    priv::ComponentStore(meta.m_size, meta.m_align);
+                store.push(meta.m_data, 1);
+            } else
+                componentStores[it.key()] = priv::ComponentStore(meta.m_size, meta.m_align);
         }
 
+        // Insert table
+        auto newGroup = std::make_unique<EntityGroup>(id, std::move(componentStores), std::move(sharedStores));
+        groupIt = m_groups.emplace(std::make_pair(id, std::move(newGroup))).first;
+
+        auto group = groupIt->second.get();
+
         // Register group with observers
         for (size_t i = 0; i < EntityEventType::NUM_EVENTS; ++i) {
             for (size_t o = 0; o < m_observers[i].size(); ++o) {
                 Observer* observer = m_observers[i][o];
-                if (matchesForGroup(*group, observer))
+                if (matchesForGroup(*group, observer)) {
                     observer->m_watchGroups.insert(id);
+                    addObserverBatch(observer, group);
+                }
             }
         }
 
@@ -818,14 +1979,14 @@ EntityGroup* World::getOrCreateEntityGroup(
         for (size_t s = 0; s < m_systems.size(); ++s) {
             System* system = m_systems[s];
             if (matchesForGroup(*group, system))
-                system->m_groups.push_back(id);
+                addMatchedGroup(system, group);
         }
 
         // Register group with queries
         for (auto it = m_queries.begin(); it != m_queries.end(); ++it) {
             QueryFactory* q = it.value();
             if (matchesForGroup(*group, q))
-                q->m_groups.push_back(id);
+                addMatchedGroup(q, group);
         }
     }
 
@@ -836,11 +1997,23 @@ EntityGroup* World::getOrCreateEntityGroup(
 void World::registerObserver(Observer* observer) {
     ReadLock lock(m_groupsMutex);
 
+    // Sparse components don't move entities between groups, so they can't be observed
+    resolveSparseStorage(observer);
+    CHECK_F(!observer->hasSparseFilters(), "observers can't match components with sparse storage");
+
+    // Shared components aren't stored per entity, so they can't be passed to observers
+    for (size_t c = 0; c < observer->m_columnShared.size(); ++c)
+        CHECK_F(!observer->m_columnShared[c], "observers can't take shared components as parameters");
+
     // Create set of groups to watch
     for (auto it = m_groups.begin(); it != m_groups.end(); ++it) {
         EntityGroup* group = it.value().get();
-        if (matchesForGroup(*group, observer))
+        if (matchesForGroup(*group, observer)) {
             observer->m_watchGroups.insert(it.key());
+
+            WriteLock groupLock(group->m_mutex);
+            addObserverBatch(observer, group);
+        }
     }
 }
 
@@ -848,12 +2021,9 @@ void World::registerObserver(Observer* observer) {
 void World::registerSystem(System* system) {
     ReadLock lock(m_groupsMutex);
 
-    // Create set of groups to watch
-    for (auto it = m_groups.begin(); it != m_groups.end(); ++it) {
-        EntityGroup* group = it.value().get();
-        if (matchesForGroup(*group, system))
-            system->m_groups.push_back(it.key());
-    }
+    // Precompute the parameter columns of the groups that match
+    resolveSparseStorage(system);
+    findMatchedGroups(system);
 
     m_systemsDirty = true;
 }
@@ -872,22 +2042,308 @@ QueryFactory* World::registerQuery(QueryFactory* query) {
     *q = *query;
     m_queries[hash] = q;
 
-    // Update groups that match
-    q->m_groups.clear();
+    // Precompute columns of the groups that match
+    q->m_columnTypes = q->m_include;
+    resolveSparseStorage(q);
+    findMatchedGroups(q);
+
+    return q;
+}
+
+///////////////////////////////////////////////////////////
+void World::findMatchedGroups(QueryBase* query) {
+    query->m_matches.clear();
     for (auto it = m_groups.begin(); it != m_groups.end(); ++it) {
-        EntityGroup& group = *it.value();
-        if (matchesForGroup(group, q))
-            q->m_groups.push_back(group.m_id);
+        EntityGroup* group = it.value().get();
+        if (matchesForGroup(*group, query))
+            addMatchedGroup(query, group);
     }
+}
 
-    return q;
+///////////////////////////////////////////////////////////
+void World::addMatchedGroup(QueryBase* query, EntityGroup* group) {
+    // The set of arrays of a group is fixed at creation (see priv::ComponentMap),
+    // so column pointers stay valid for the lifetime of the group
+    MatchedGroup match;
+    match.m_group = group;
+    match.m_columns.reserve(query->m_columnTypes.size());
+    for (auto type : query->m_columnTypes) {
+        auto it = group->m_components.find(type);
+        if (it != group->m_components.end()) {
+            match.m_columns.push_back(&it.value());
+            continue;
+        }
+
+        // Shared columns point to the single value of the group
+        auto sharedIt = group->m_shared.find(type);
+        match.m_columns.push_back(sharedIt != group->m_shared.end() ? &sharedIt.value() : nullptr);
+    }
+
+    query->m_matches.push_back(std::move(match));
 }
 
-#pragma endregion
+///////////////////////////////////////////////////////////
+void World::freeEntityGroup(EntityGroup* group) {
+    // Remove the group from precomputed tables, keeping the order of the other groups
+    auto removeMatch = [group](QueryBase* query) {
+        auto& matches = query->m_matches;
+        matches.erase(
+            std::remove_if(
+                matches.begin(),
+                matches.end(),
+                [group](const MatchedGroup& match) { return match.m_group == group; }
+            ),
+            matches.end()
+        );
+    };
+
+    for (System* system : m_systems)
+        removeMatch(system);
+
+    for (auto it = m_queries.begin(); it != m_queries.end(); ++it)
+        removeMatch(it.value());
+
+    // Observer batches are owned by the group
+    for (size_t i = 0; i < EntityEventType::NUM_EVENTS; ++i) {
+        for (Observer* observer : m_observers[i])
+            observer->m_watchGroups.erase(group->m_id);
+    }
+
+    m_groups.erase(group->m_id);
+}
+
+///////////////////////////////////////////////////////////
+void World::shrinkEntityGroup(EntityGroup* group, CompactStats& stats) {
+    WriteLock lock(group->m_mutex);
+
+    for (auto it = group->m_components.begin(); it != group->m_components.end(); ++it) {
+        priv::ComponentStore& store = it.value();
+        if (isMostlyUnused(store.capacity(), store.size())) {
+            stats.m_bytesReleased += store.shrinkToFit();
+            ++stats.m_numArraysShrunk;
+        }
+    }
+
+    std::vector<EntityId>& entities = group->m_entities;
+    if (isMostlyUnused(entities.capacity(), entities.size())) {
+        stats.m_bytesReleased += (entities.capacity() - entities.size()) * sizeof(EntityId);
+        entities.shrink_to_fit();
+        ++stats.m_numArraysShrunk;
+    }
+
+    // Exited components are only kept until the next tick, but their arrays keep their size
+    for (priv::ObserverBatch& batch : group->m_exitObservers) {
+        for (size_t c = 0; c < batch.m_data.size(); ++c) {
+            priv::ComponentStore& data = batch.m_data[c];
+            if (batch.m_columns[c] && isMostlyUnused(data.capacity(), data.size())) {
+                stats.m_bytesReleased += data.shrinkToFit();
+                ++stats.m_numArraysShrunk;
+            }
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////
+void World::setStorage(std::type_index type, ComponentStorage storage, size_t size, size_t align) {
+    WriteLock lock(m_groupsMutex);
+
+    // Components can't be moved between storages once entities have them
+    for (auto it = m_groups.begin(); it != m_groups.end(); ++it) {
+        CHECK_F(
+            !it.value()->m_components.contains(type) && !it.value()->m_shared.contains(type),
+            "storage of component %s can't be changed after it is added to entities",
+            type.name()
+        );
+    }
+
+    if (storage == ComponentStorage::Sparse) {
+        if (!m_sparseSets.contains(type))
+            m_sparseSets[type] = std::make_unique<priv::SparseSet>(size, align);
+    } else {
+        auto it = m_sparseSets.find(type);
+        if (it != m_sparseSets.end()) {
+            CHECK_F(
+                it.value()->size() == 0,
+                "storage of component %s can't be changed after it is added to entities",
+                type.name()
+            );
+            m_sparseSets.erase(it);
+        }
+    }
+
+    if (storage == ComponentStorage::Shared)
+        m_sharedTypes.insert(type);
+    else
+        m_sharedTypes.erase(type);
+
+    // Update systems and queries that were created before the storage was set
+    for (System* system : m_systems) {
+        resolveSparseStorage(system);
+        findMatchedGroups(system);
+    }
+    for (auto it = m_queries.begin(); it != m_queries.end(); ++it) {
+        resolveSparseStorage(it.value());
+        findMatchedGroups(it.value());
+    }
+}
+
+///////////////////////////////////////////////////////////
+priv::SparseSet* World::findSparseSet(std::type_index type) const {
+    if (m_sparseSets.empty())
+        return nullptr;
+
+    auto it = m_sparseSets.find(type);
+    return it != m_sparseSets.end() ? it.value().get() : nullptr;
+}
+
+///////////////////////////////////////////////////////////
+bool World::isSharedComponent(std::type_index type) const {
+    return !m_sharedTypes.empty() && m_sharedTypes.contains(type);
+}
+
+///////////////////////////////////////////////////////////
+void World::checkSystemAccess(std::type_index type, bool write) const {
+    const System* system = t_system;
+    if (!system || isSharedComponent(type))
+        return;
+
+    // Writes also allow reads
+    const std::vector<std::type_index>& writes = system->m_writes;
+    const std::vector<std::type_index>& reads = system->m_reads;
+    bool declared = std::find(writes.begin(), writes.end(), type) != writes.end() ||
+        (!write && std::find(reads.begin(), reads.end(), type) != reads.end());
+
+    CHECK_F(
+        declared,
+        "system accessed component %s without declaring it, declare it with %s",
+        type.name(),
+        write ? "writes()" : "reads()"
+    );
+}
+
+///////////////////////////////////////////////////////////
+void World::resolveSparseStorage(QueryBase* query) {
+    QueryBase& q = *query;
+
+    auto resolve = [this](const std::vector<std::type_index>& types, std::vector<priv::SparseSet*>& sets) {
+        sets.clear();
+        for (auto type : types) {
+            if (priv::SparseSet* set = findSparseSet(type))
+                sets.push_back(set);
+        }
+    };
+
+    resolve(q.m_include, q.m_sparseInclude);
+    resolve(q.m_exclude, q.m_sparseExclude);
+    resolve(q.m_changed, q.m_sparseChanged);
+    resolve(q.m_added, q.m_sparseAdded);
+
+    // Sparse set of each column, used to join sparse components
+    q.m_columnSparse.clear();
+    q.m_columnShared.clear();
+    for (auto type : q.m_columnTypes) {
+        q.m_columnSparse.push_back(findSparseSet(type));
+        q.m_columnShared.push_back(isSharedComponent(type));
+    }
+}
+
+///////////////////////////////////////////////////////////
+std::vector<std::vector<uint32_t>> World::collectSparseRows(
+    QueryBase& query,
+    const std::vector<EntityGroup*>& groups,
+    uint32_t since
+) {
+    QueryBase& q = query;
+    std::vector<std::vector<uint32_t>> rows(groups.size());
+
+    if (!q.m_sparseInclude.empty()) {
+        // Visit the entities of the smallest included set, and sort them into their groups
+        priv::SparseSet* smallest = *std::min_element(
+            q.m_sparseInclude.begin(),
+            q.m_sparseInclude.end(),
+            [](priv::SparseSet* a, priv::SparseSet* b) { return a->size() < b->size(); }
+        );
+
+        HashMap<EntityGroup*, uint32_t> slots;
+        for (uint32_t g = 0; g < groups.size(); ++g)
+            slots[groups[g]] = g;
+
+        for (EntityId id : smallest->getEntities()) {
+            const EntityData& data = m_entities[id];
+            if (!data.m_isEnabled)
+                continue;
+
+            auto it = slots.find(data.m_group);
+            if (it != slots.end() && q.passesSparseFilters(id, since))
+                rows[it->second].push_back(data.m_index);
+        }
+
+        // Visit entities in storage order
+        for (auto& groupRows : rows)
+            std::sort(groupRows.begin(), groupRows.end());
+    } else {
+        // Only excluded sparse components, so every enabled entity of the groups is checked
+        for (size_t g = 0; g < groups.size(); ++g) {
+            const std::vector<EntityId>& ids = groups[g]->m_entities;
+            priv::forEachEnabledRun(*groups[g], 0, ids.size(), [&](size_t first, size_t last) {
+                for (size_t i = first; i < last; ++i) {
+                    if (q.passesSparseFilters(ids[i], since))
+                        rows[g].push_back((uint32_t)i);
+                }
+            });
+        }
+    }
+
+    // Group components are filtered by chunk
+    if (q.hasChangeFilters()) {
+        for (size_t g = 0; g < groups.size(); ++g) {
+            EntityGroup& group = *groups[g];
+            auto end = std::remove_if(rows[g].begin(), rows[g].end(), [&](uint32_t row) {
+                return !q.passesChangeFilters(group, row / ENTITY_CHUNK_SIZE, since);
+            });
+            rows[g].erase(end, rows[g].end());
+        }
+    }
+
+    return rows;
+}
+
+///////////////////////////////////////////////////////////
+void World::setEnabled(EntityGroup* group, EntityId id, bool enabled) {
+    EntityData& data = m_entities[id];
+    data.m_isEnabled = enabled;
+    priv::setRowDisabled(*group, data.m_index, !enabled);
+}
+
+///////////////////////////////////////////////////////////
+void World::updateDisabledRows(EntityGroup* group) {
+    group->m_disabled.clear();
+    group->m_numDisabled = 0;
+
+    const std::vector<EntityId>& ids = group->m_entities;
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (!m_entities[ids[i]].m_isEnabled)
+            priv::setRowDisabled(*group, i, true);
+    }
+}
 
 ///////////////////////////////////////////////////////////
-World::ComponentChange::ComponentChange(EntityId id, std::type_index type)
-    : m_id(id),
-      m_type(type) {}
+void World::markRowsChanged(
+    EntityGroup* group,
+    std::type_index type,
+    const std::vector<uint32_t>& rows,
+    uint32_t tick
+) {
+    auto it = group->m_components.find(type);
+    if (it != group->m_components.end()) {
+        for (uint32_t row : rows)
+            it.value().markChanged(row, 1, tick);
+    } else if (priv::SparseSet* set = findSparseSet(type)) {
+        for (uint32_t row : rows)
+            set->markChanged(group->m_entities[row], tick);
+    }
+}
+
+#pragma endregion
 
 }
\ No newline at end of file
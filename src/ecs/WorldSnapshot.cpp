@@ -0,0 +1,648 @@
+#include <ply/core/MappedFile.h>
+#include <ply/ecs/World.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <loguru.hpp>
+
+namespace ply {
+
+namespace {
+
+    ///////////////////////////////////////////////////////////
+    constexpr uint32_t SNAPSHOT_MAGIC = 0x53594C50; // "PLYS"
+    constexpr uint32_t SNAPSHOT_VERSION = 3;
+    constexpr uint64_t SNAPSHOT_BLOB_ALIGN = 64;
+    constexpr uint32_t SNAPSHOT_NO_GROUP = 0xFFFFFFFF;
+    constexpr uint32_t SNAPSHOT_ENTITY_ALIVE = 1 << 0;
+    constexpr uint32_t SNAPSHOT_ENTITY_DISABLED = 1 << 1;
+
+    static_assert(sizeof(Handle) == sizeof(uint32_t), "handles must be 32 bits");
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Snapshot file header
+    ///////////////////////////////////////////////////////////
+    struct SnapshotHeader {
+        uint32_t m_magic;          //!< Must be SNAPSHOT_MAGIC
+        uint32_t m_version;        //!< Format version
+        uint32_t m_numTypes;       //!< Number of component types
+        uint32_t m_numGroups;      //!< Number of entity groups
+        uint32_t m_numColumns;     //!< Total number of component arrays
+        uint32_t m_numEntities;    //!< Number of entity data entries
+        uint32_t m_numHandles;     //!< Number of handle table entries
+        uint32_t m_nextFree;       //!< Next free handle index
+        uint32_t m_numSparse;      //!< Number of sparse sets
+        uint32_t m_padding;        //!< Unused
+        uint64_t m_typesOffset;    //!< Offset of the type table
+        uint64_t m_namesOffset;    //!< Offset of the type name strings
+        uint64_t m_groupsOffset;   //!< Offset of the group table
+        uint64_t m_columnsOffset;  //!< Offset of the column table
+        uint64_t m_entitiesOffset; //!< Offset of the entity data table
+        uint64_t m_handlesOffset;  //!< Offset of the handle table
+        uint64_t m_indicesOffset;  //!< Offset of the index table
+        uint64_t m_sparseOffset;   //!< Offset of the sparse set table
+    };
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Component type entry
+    ///////////////////////////////////////////////////////////
+    struct SnapshotType {
+        uint32_t m_nameOffset; //!< Offset of the name within the name strings
+        uint32_t m_nameLength; //!< Length of the name
+        uint32_t m_size;       //!< Size of the type
+        uint32_t m_align;      //!< Align of the type
+    };
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Entity group entry
+    ///////////////////////////////////////////////////////////
+    struct SnapshotGroup {
+        uint32_t m_numEntities;    //!< Number of entities in the group
+        uint32_t m_firstColumn;    //!< Index of the first column in the column table
+        uint32_t m_numColumns;     //!< Number of columns
+        uint32_t m_numShared;      //!< Number of shared component values, stored after the columns
+        uint64_t m_entitiesOffset; //!< Offset of the group's entity id list
+    };
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Component array entry
+    ///////////////////////////////////////////////////////////
+    struct SnapshotColumn {
+        uint32_t m_type;       //!< Index into the type table
+        uint32_t m_padding;    //!< Unused
+        uint64_t m_dataOffset; //!< Offset of the raw component data
+    };
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Sparse set entry
+    ///////////////////////////////////////////////////////////
+    struct SnapshotSparse {
+        uint32_t m_type;           //!< Index into the type table
+        uint32_t m_numEntities;    //!< Number of components in the set
+        uint64_t m_entitiesOffset; //!< Offset of the set's entity id list
+        uint64_t m_dataOffset;     //!< Offset of the raw component data
+    };
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Entity data entry
+    ///////////////////////////////////////////////////////////
+    struct SnapshotEntity {
+        uint32_t m_group;   //!< Index into the group table, or SNAPSHOT_NO_GROUP
+        uint32_t m_index;   //!< Index within the group
+        uint32_t m_flags;   //!< SNAPSHOT_ENTITY_ALIVE and SNAPSHOT_ENTITY_DISABLED bits
+    };
+
+    ///////////////////////////////////////////////////////////
+    uint64_t alignOffset(uint64_t offset, uint64_t align) {
+        return (offset + align - 1) / align * align;
+    }
+
+} // namespace
+
+///////////////////////////////////////////////////////////
+bool World::saveSnapshot(const std::string& fname) {
+    CHECK_F(!m_isExecutingSystems, "snapshots can't be saved while systems are running");
+
+    ReadLock lock(m_groupsMutex);
+
+    // Collect non-empty groups, and keep them locked while saving
+    std::vector<EntityGroup*> groups;
+    std::vector<ReadLock> groupLocks;
+    for (auto it = m_groups.begin(); it != m_groups.end(); ++it) {
+        EntityGroup* group = it.value().get();
+        groupLocks.emplace_back(group->m_mutex);
+
+        if (group->m_entities.size() > 0)
+            groups.push_back(group);
+    }
+
+    // Sparse sets are locked after groups
+    std::vector<std::pair<std::type_index, priv::SparseSet*>> sparseSets;
+    for (auto it = m_sparseSets.begin(); it != m_sparseSets.end(); ++it) {
+        priv::SparseSet* set = it.value().get();
+        groupLocks.emplace_back(set->getMutex());
+
+        if (set->size() > 0)
+            sparseSets.push_back(std::make_pair(it.key(), set));
+    }
+
+    // Build type, group, and column tables
+    HashMap<std::type_index, uint32_t> typeIndices;
+    std::vector<SnapshotType> types;
+    std::string names;
+    std::vector<SnapshotGroup> groupTable(groups.size());
+    std::vector<SnapshotColumn> columns;
+    std::vector<const priv::ComponentStore*> stores;
+
+    // Adds a type to the type table if it hasn't been seen, and returns its index
+    auto addType = [&](std::type_index key, const priv::ComponentStore& store) {
+        auto typeIt = typeIndices.find(key);
+        if (typeIt == typeIndices.end()) {
+            const char* name = key.name();
+            SnapshotType type;
+            type.m_nameOffset = (uint32_t)names.size();
+            type.m_nameLength = (uint32_t)strlen(name);
+            type.m_size = (uint32_t)store.getTypeSize();
+            type.m_align = (uint32_t)store.getTypeAlign();
+            names.append(name);
+
+            typeIt = typeIndices.emplace(std::make_pair(key, (uint32_t)types.size())).first;
+            types.push_back(type);
+        }
+
+        return typeIt->second;
+    };
+
+    for (size_t g = 0; g < groups.size(); ++g) {
+        EntityGroup* group = groups[g];
+        groupTable[g].m_numEntities = (uint32_t)group->m_entities.size();
+        groupTable[g].m_firstColumn = (uint32_t)columns.size();
+        groupTable[g].m_numColumns = (uint32_t)group->m_components.size();
+        groupTable[g].m_numShared = (uint32_t)group->m_shared.size();
+
+        auto addColumn = [&](std::type_index type, priv::ComponentStore& store) {
+            SnapshotColumn column;
+            column.m_type = addType(type, store);
+            column.m_padding = 0;
+            columns.push_back(column);
+            stores.push_back(&store);
+        };
+
+        for (auto it = group->m_components.begin(); it != group->m_components.end(); ++it)
+            addColumn(it.key(), it.value());
+        for (auto it = group->m_shared.begin(); it != group->m_shared.end(); ++it)
+            addColumn(it.key(), it.value());
+    }
+
+    std::vector<SnapshotSparse> sparseTable(sparseSets.size());
+    for (size_t s = 0; s < sparseSets.size(); ++s) {
+        priv::SparseSet* set = sparseSets[s].second;
+        sparseTable[s].m_type = addType(sparseSets[s].first, set->getStore());
+        sparseTable[s].m_numEntities = (uint32_t)set->size();
+    }
+
+    // Lay out the file
+    SnapshotHeader header;
+    header.m_magic = SNAPSHOT_MAGIC;
+    header.m_version = SNAPSHOT_VERSION;
+    header.m_numTypes = (uint32_t)types.size();
+    header.m_numGroups = (uint32_t)groupTable.size();
+    header.m_numColumns = (uint32_t)columns.size();
+    header.m_numEntities = m_entities.size();
+    header.m_numHandles = (uint32_t)m_entities.getHandleTable().size();
+    header.m_nextFree = m_entities.getNextFree();
+    header.m_numSparse = (uint32_t)sparseTable.size();
+    header.m_padding = 0;
+
+    uint64_t offset = sizeof(SnapshotHeader);
+    header.m_typesOffset = offset;
+    offset += types.size() * sizeof(SnapshotType);
+    header.m_namesOffset = offset;
+    offset = alignOffset(offset + names.size(), 8);
+    header.m_groupsOffset = offset;
+    offset += groupTable.size() * sizeof(SnapshotGroup);
+    header.m_columnsOffset = offset;
+    offset += columns.size() * sizeof(SnapshotColumn);
+    header.m_sparseOffset = offset;
+    offset += sparseTable.size() * sizeof(SnapshotSparse);
+
+    // Raw blobs are aligned so that they can be used directly from a mapped file
+    for (size_t g = 0; g < groups.size(); ++g) {
+        SnapshotGroup& entry = groupTable[g];
+
+        offset = alignOffset(offset, SNAPSHOT_BLOB_ALIGN);
+        entry.m_entitiesOffset = offset;
+        offset += entry.m_numEntities * sizeof(EntityId);
+
+        // Shared columns hold a single value
+        for (uint32_t c = 0; c < entry.m_numColumns + entry.m_numShared; ++c) {
+            SnapshotColumn& column = columns[entry.m_firstColumn + c];
+            offset = alignOffset(offset, SNAPSHOT_BLOB_ALIGN);
+            column.m_dataOffset = offset;
+            offset += (uint64_t)(c < entry.m_numColumns ? entry.m_numEntities : 1) * types[column.m_type].m_size;
+        }
+    }
+
+    for (SnapshotSparse& entry : sparseTable) {
+        offset = alignOffset(offset, SNAPSHOT_BLOB_ALIGN);
+        entry.m_entitiesOffset = offset;
+        offset += entry.m_numEntities * sizeof(EntityId);
+
+        offset = alignOffset(offset, SNAPSHOT_BLOB_ALIGN);
+        entry.m_dataOffset = offset;
+        offset += (uint64_t)entry.m_numEntities * types[entry.m_type].m_size;
+    }
+
+    offset = alignOffset(offset, SNAPSHOT_BLOB_ALIGN);
+    header.m_entitiesOffset = offset;
+    offset += header.m_numEntities * sizeof(SnapshotEntity);
+    offset = alignOffset(offset, SNAPSHOT_BLOB_ALIGN);
+    header.m_handlesOffset = offset;
+    offset += header.m_numHandles * sizeof(Handle);
+    header.m_indicesOffset = offset;
+
+    // Convert entity data, using group table indices instead of group ids
+    std::vector<SnapshotEntity> entities(
+        header.m_numEntities, SnapshotEntity{SNAPSHOT_NO_GROUP, 0, 0}
+    );
+    for (size_t g = 0; g < groups.size(); ++g) {
+        const std::vector<EntityId>& ids = groups[g]->m_entities;
+        for (size_t i = 0; i < ids.size(); ++i) {
+            const EntityData& data = m_entities[ids[i]];
+            SnapshotEntity& entry = entities[m_entities.getIndex(ids[i])];
+            entry.m_group = (uint32_t)g;
+            entry.m_index = data.m_index;
+            entry.m_flags = (data.m_isAlive ? SNAPSHOT_ENTITY_ALIVE : 0) |
+                (data.m_isEnabled ? 0 : SNAPSHOT_ENTITY_DISABLED);
+        }
+    }
+
+    // Write
+    std::ofstream file(fname, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        LOG_F(ERROR, "Failed to open snapshot file for writing: %s", fname.c_str());
+        return false;
+    }
+
+    uint64_t position = 0;
+    auto write = [&](uint64_t at, const void* data, size_t size) {
+        // Pad up to the requested offset
+        static const char zeros[SNAPSHOT_BLOB_ALIGN] = {};
+        while (position < at) {
+            size_t pad = (size_t)std::min<uint64_t>(at - position, sizeof(zeros));
+            file.write(zeros, pad);
+            position += pad;
+        }
+
+        file.write((const char*)data, size);
+        position += size;
+    };
+
+    write(0, &header, sizeof(header));
+    write(header.m_typesOffset, types.data(), types.size() * sizeof(SnapshotType));
+    write(header.m_namesOffset, names.data(), names.size());
+    write(header.m_groupsOffset, groupTable.data(), groupTable.size() * sizeof(SnapshotGroup));
+    write(header.m_columnsOffset, columns.data(), columns.size() * sizeof(SnapshotColumn));
+    write(header.m_sparseOffset, sparseTable.data(), sparseTable.size() * sizeof(SnapshotSparse));
+
+    for (size_t g = 0; g < groups.size(); ++g) {
+        const SnapshotGroup& entry = groupTable[g];
+        write(entry.m_entitiesOffset, groups[g]->m_entities.data(), entry.m_numEntities * sizeof(EntityId));
+
+        for (uint32_t c = 0; c < entry.m_numColumns + entry.m_numShared; ++c) {
+            const SnapshotColumn& column = columns[entry.m_firstColumn + c];
+            size_t size = (size_t)(c < entry.m_numColumns ? entry.m_numEntities : 1) * types[column.m_type].m_size;
+            write(column.m_dataOffset, stores[entry.m_firstColumn + c]->data(), size);
+        }
+    }
+
+    for (size_t s = 0; s < sparseTable.size(); ++s) {
+        const SnapshotSparse& entry = sparseTable[s];
+        priv::SparseSet* set = sparseSets[s].second;
+        write(entry.m_entitiesOffset, set->getEntities().data(), entry.m_numEntities * sizeof(EntityId));
+        size_t size = (size_t)entry.m_numEntities * types[entry.m_type].m_size;
+        write(entry.m_dataOffset, set->getStore().data(), size);
+    }
+
+    write(header.m_entitiesOffset, entities.data(), entities.size() * sizeof(SnapshotEntity));
+    write(header.m_handlesOffset, m_entities.getHandleTable().data(), header.m_numHandles * sizeof(Handle));
+    write(header.m_indicesOffset, m_entities.getIndexTable().data(), header.m_numHandles * sizeof(uint32_t));
+
+    if (!file.good()) {
+        LOG_F(ERROR, "Failed to write snapshot file: %s", fname.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////
+bool World::loadSnapshot(const std::string& fname) {
+    CHECK_F(!m_isExecutingSystems, "snapshots can't be loaded while systems are running");
+
+    MappedFile file;
+    if (!file.open(fname)) {
+        LOG_F(ERROR, "Failed to open snapshot file: %s", fname.c_str());
+        return false;
+    }
+
+    const uint8_t* base = file.data();
+    uint64_t fileSize = file.size();
+
+    // Checks that a range of the file is in bounds
+    auto inBounds = [fileSize](uint64_t offset, uint64_t size) {
+        return offset <= fileSize && size <= fileSize - offset;
+    };
+
+    // Header
+    if (!inBounds(0, sizeof(SnapshotHeader))) {
+        LOG_F(ERROR, "Invalid snapshot file: %s", fname.c_str());
+        return false;
+    }
+
+    SnapshotHeader header;
+    memcpy(&header, base, sizeof(header));
+    if (header.m_magic != SNAPSHOT_MAGIC || header.m_version != SNAPSHOT_VERSION) {
+        LOG_F(ERROR, "Invalid snapshot file or unsupported version: %s", fname.c_str());
+        return false;
+    }
+
+    // Check table bounds
+    bool valid = inBounds(header.m_typesOffset, (uint64_t)header.m_numTypes * sizeof(SnapshotType)) &&
+        inBounds(header.m_groupsOffset, (uint64_t)header.m_numGroups * sizeof(SnapshotGroup)) &&
+        inBounds(header.m_columnsOffset, (uint64_t)header.m_numColumns * sizeof(SnapshotColumn)) &&
+        inBounds(header.m_entitiesOffset, (uint64_t)header.m_numEntities * sizeof(SnapshotEntity)) &&
+        inBounds(header.m_handlesOffset, (uint64_t)header.m_numHandles * sizeof(Handle)) &&
+        inBounds(header.m_indicesOffset, (uint64_t)header.m_numHandles * sizeof(uint32_t)) &&
+        inBounds(header.m_sparseOffset, (uint64_t)header.m_numSparse * sizeof(SnapshotSparse)) &&
+        header.m_numEntities <= header.m_numHandles;
+    if (!valid) {
+        LOG_F(ERROR, "Corrupt snapshot file: %s", fname.c_str());
+        return false;
+    }
+
+    const SnapshotType* types = (const SnapshotType*)(base + header.m_typesOffset);
+    const SnapshotGroup* groups = (const SnapshotGroup*)(base + header.m_groupsOffset);
+    const SnapshotColumn* columns = (const SnapshotColumn*)(base + header.m_columnsOffset);
+    const SnapshotSparse* sparseSets = (const SnapshotSparse*)(base + header.m_sparseOffset);
+
+    // Resolve component types by name
+    std::vector<priv::ComponentTypeInfo> typeInfos;
+    typeInfos.reserve(header.m_numTypes);
+    for (uint32_t t = 0; t < header.m_numTypes; ++t) {
+        const SnapshotType& type = types[t];
+        if (!inBounds(header.m_namesOffset + type.m_nameOffset, type.m_nameLength)) {
+            LOG_F(ERROR, "Corrupt snapshot file: %s", fname.c_str());
+            return false;
+        }
+
+        std::string name(
+            (const char*)base + header.m_namesOffset + type.m_nameOffset, type.m_nameLength
+        );
+        auto info = priv::findComponentType(name);
+        if (!info) {
+            LOG_F(ERROR, "Snapshot contains unregistered component type: %s", name.c_str());
+            return false;
+        }
+
+        if (info->m_size != type.m_size || info->m_align != type.m_align) {
+            LOG_F(ERROR, "Snapshot component type layout does not match: %s", name.c_str());
+            return false;
+        }
+
+        typeInfos.push_back(*info);
+    }
+
+    // Check group and column bounds
+    for (uint32_t g = 0; g < header.m_numGroups; ++g) {
+        const SnapshotGroup& group = groups[g];
+        valid &= inBounds(group.m_entitiesOffset, (uint64_t)group.m_numEntities * sizeof(EntityId));
+        valid &= (uint64_t)group.m_firstColumn + group.m_numColumns + group.m_numShared <= header.m_numColumns;
+
+        for (uint32_t c = 0; valid && c < group.m_numColumns + group.m_numShared; ++c) {
+            const SnapshotColumn& column = columns[group.m_firstColumn + c];
+            uint64_t numElements = c < group.m_numColumns ? group.m_numEntities : 1;
+            valid &= column.m_type < header.m_numTypes &&
+                inBounds(column.m_dataOffset, numElements * types[column.m_type].m_size);
+        }
+    }
+
+    for (uint32_t s = 0; s < header.m_numSparse; ++s) {
+        const SnapshotSparse& entry = sparseSets[s];
+        valid &= entry.m_type < header.m_numTypes &&
+            inBounds(entry.m_entitiesOffset, (uint64_t)entry.m_numEntities * sizeof(EntityId)) &&
+            inBounds(entry.m_dataOffset, (uint64_t)entry.m_numEntities * types[entry.m_type].m_size);
+    }
+
+    if (!valid) {
+        LOG_F(ERROR, "Corrupt snapshot file: %s", fname.c_str());
+        return false;
+    }
+
+    // Component storage must match the storage set in this world
+    for (uint32_t g = 0; g < header.m_numGroups; ++g) {
+        const SnapshotGroup& group = groups[g];
+        for (uint32_t c = 0; c < group.m_numColumns + group.m_numShared; ++c) {
+            std::type_index type = typeInfos[columns[group.m_firstColumn + c].m_type].m_type;
+            if (findSparseSet(type) || isSharedComponent(type) != (c >= group.m_numColumns)) {
+                LOG_F(ERROR, "Snapshot component storage does not match: %s", type.name());
+                return false;
+            }
+        }
+    }
+
+    for (uint32_t s = 0; s < header.m_numSparse; ++s) {
+        std::type_index type = typeInfos[sparseSets[s].m_type].m_type;
+        if (!findSparseSet(type)) {
+            LOG_F(ERROR, "Snapshot component storage does not match: %s", type.name());
+            return false;
+        }
+    }
+
+    // Entity data, handle tables and entity lists must agree, they are used as indices
+    // once they are restored
+    const SnapshotEntity* entities = (const SnapshotEntity*)(base + header.m_entitiesOffset);
+    const Handle* handles = (const Handle*)(base + header.m_handlesOffset);
+    const uint32_t* indices = (const uint32_t*)(base + header.m_indicesOffset);
+
+    // Finds the entity data index of an id, or the number of entities if the id is not in use
+    auto findEntity = [&](EntityId id) {
+        if (id.m_index >= header.m_numHandles)
+            return header.m_numEntities;
+
+        Handle entry = handles[id.m_index];
+        if (entry.m_counter != id.m_counter || entry.m_index >= header.m_numEntities ||
+            indices[entry.m_index] != id.m_index)
+            return header.m_numEntities;
+
+        return entry.m_index;
+    };
+
+    std::vector<uint32_t> groupSizes(header.m_numGroups, 0);
+    for (uint32_t e = 0; valid && e < header.m_numEntities; ++e) {
+        const SnapshotEntity& entry = entities[e];
+        valid &= indices[e] < header.m_numHandles && handles[indices[e]].m_index == e;
+
+        if (entry.m_group < header.m_numGroups) {
+            valid &= entry.m_index < groups[entry.m_group].m_numEntities;
+            ++groupSizes[entry.m_group];
+        }
+    }
+
+    // Each group slot belongs to the entity that points to it
+    for (uint32_t g = 0; valid && g < header.m_numGroups; ++g) {
+        const SnapshotGroup& group = groups[g];
+        const EntityId* ids = (const EntityId*)(base + group.m_entitiesOffset);
+        valid &= groupSizes[g] == group.m_numEntities;
+
+        for (uint32_t i = 0; valid && i < group.m_numEntities; ++i) {
+            uint32_t e = findEntity(ids[i]);
+            valid &= e < header.m_numEntities && entities[e].m_group == g && entities[e].m_index == i;
+        }
+    }
+
+    std::vector<uint32_t> sparseSeen(header.m_numHandles, SNAPSHOT_NO_GROUP);
+    for (uint32_t s = 0; valid && s < header.m_numSparse; ++s) {
+        const SnapshotSparse& entry = sparseSets[s];
+        const EntityId* ids = (const EntityId*)(base + entry.m_entitiesOffset);
+
+        for (uint32_t i = 0; valid && i < entry.m_numEntities; ++i) {
+            valid &= findEntity(ids[i]) < header.m_numEntities && sparseSeen[ids[i].m_index] != s;
+            if (valid)
+                sparseSeen[ids[i].m_index] = s;
+        }
+    }
+
+    // The free list may only visit unused handles, once each
+    std::vector<bool> isFree(header.m_numHandles, false);
+    for (uint32_t h = header.m_nextFree; valid && h < header.m_numHandles; h = handles[h].m_index) {
+        Handle entry = handles[h];
+        bool isUsed = entry.m_index < header.m_numEntities && indices[entry.m_index] == h;
+        valid &= !isFree[h] && !isUsed;
+        isFree[h] = true;
+    }
+
+    if (!valid) {
+        LOG_F(ERROR, "Corrupt snapshot file: %s", fname.c_str());
+        return false;
+    }
+
+    // Remove all existing entities
+    {
+        ReadLock lock(m_groupsMutex);
+        for (auto it = m_groups.begin(); it != m_groups.end(); ++it) {
+            EntityGroup* group = it.value().get();
+            WriteLock groupLock(group->m_mutex);
+
+            if (group->m_entities.size() > 0)
+                removeEntities(group, std::vector<EntityId>(group->m_entities));
+        }
+    }
+
+    // Discard queued operations, they refer to the old entities
+    for (auto& buffer : m_commandBuffers)
+        buffer->clear();
+
+    // Create groups and copy component arrays
+    uint32_t tick = nextChangeTick();
+    std::vector<EntityGroup*> loadedGroups(header.m_numGroups);
+
+    for (uint32_t g = 0; g < header.m_numGroups; ++g) {
+        const SnapshotGroup& entry = groups[g];
+
+        // Group ids depend on type hashes, so they are recomputed rather than saved
+        std::vector<std::type_index> typeIds;
+        EntityGroupId sharedHash = 0;
+        HashMap<std::type_index, priv::ComponentMetadata> componentMetaMap;
+        for (uint32_t c = 0; c < entry.m_numColumns + entry.m_numShared; ++c) {
+            const SnapshotColumn& column = columns[entry.m_firstColumn + c];
+            const priv::ComponentTypeInfo& info = typeInfos[column.m_type];
+            typeIds.push_back(info.m_type);
+
+            // Shared values are read directly from the file
+            void* data = NULL;
+            if (c >= entry.m_numColumns) {
+                data = (void*)(base + column.m_dataOffset);
+                sharedHash += sharedValueHash(info.m_type, data, info.m_size);
+            }
+            componentMetaMap[info.m_type] = priv::ComponentMetadata(data, info.m_size, info.m_align);
+        }
+
+        EntityGroup* group = nullptr;
+        {
+            WriteLock lock(m_groupsMutex);
+            group = getOrCreateEntityGroup(entityGroupHash(typeIds) + sharedHash, componentMetaMap);
+        }
+        loadedGroups[g] = group;
+
+        WriteLock groupLock(group->m_mutex);
+
+        // Entity list
+        group->m_entities.resize(entry.m_numEntities);
+        memcpy(group->m_entities.data(), base + entry.m_entitiesOffset, entry.m_numEntities * sizeof(EntityId));
+
+        // Component arrays, one copy each
+        for (uint32_t c = 0; c < entry.m_numColumns; ++c) {
+            const SnapshotColumn& column = columns[entry.m_firstColumn + c];
+            const priv::ComponentTypeInfo& info = typeInfos[column.m_type];
+
+            priv::ComponentStore& store = group->m_components.at(info.m_type);
+            store.resize(entry.m_numEntities);
+            memcpy(store.data(), base + column.m_dataOffset, (size_t)entry.m_numEntities * info.m_size);
+            store.markAdded(0, entry.m_numEntities, tick);
+        }
+    }
+
+    // Entity handle tables
+    std::vector<EntityData> entityData(header.m_numEntities);
+    bool hasDisabled = false;
+    for (uint32_t e = 0; e < header.m_numEntities; ++e) {
+        const SnapshotEntity& entry = entities[e];
+        EntityData& data = entityData[e];
+
+        if (entry.m_group < header.m_numGroups) {
+            data.m_group = loadedGroups[entry.m_group];
+            data.m_index = entry.m_index;
+            data.m_isAlive = (entry.m_flags & SNAPSHOT_ENTITY_ALIVE) != 0;
+            data.m_isEnabled = (entry.m_flags & SNAPSHOT_ENTITY_DISABLED) == 0;
+            hasDisabled |= !data.m_isEnabled;
+        } else {
+            data.m_group = nullptr;
+            data.m_index = 0;
+            data.m_isAlive = false;
+            data.m_isEnabled = false;
+        }
+    }
+
+    std::vector<Handle> handleTable(header.m_numHandles);
+    std::vector<uint32_t> indexTable(header.m_numHandles);
+    memcpy(handleTable.data(), base + header.m_handlesOffset, header.m_numHandles * sizeof(Handle));
+    memcpy(indexTable.data(), base + header.m_indicesOffset, header.m_numHandles * sizeof(uint32_t));
+    m_entities.restore(
+        std::move(entityData), std::move(handleTable), std::move(indexTable), header.m_nextFree
+    );
+    resetFreeIds();
+
+    if (hasDisabled) {
+        for (EntityGroup* group : loadedGroups) {
+            WriteLock groupLock(group->m_mutex);
+            updateDisabledRows(group);
+        }
+    }
+
+    // Sparse sets, existing components were removed along with their entities
+    for (uint32_t s = 0; s < header.m_numSparse; ++s) {
+        const SnapshotSparse& entry = sparseSets[s];
+        priv::SparseSet* set = findSparseSet(typeInfos[entry.m_type].m_type);
+        WriteLock setLock(set->getMutex());
+
+        std::vector<EntityId> ids(entry.m_numEntities);
+        memcpy(ids.data(), base + entry.m_entitiesOffset, entry.m_numEntities * sizeof(EntityId));
+        set->append(ids, base + entry.m_dataOffset, false, tick);
+    }
+
+    // Entities that were queued for removal when the snapshot was saved are queued again
+    for (EntityGroup* group : loadedGroups) {
+        for (EntityId id : group->m_entities) {
+            if (!m_entities[id].m_isAlive)
+                deferRemove(id);
+        }
+    }
+
+    // Send one create and enter event per group
+    for (EntityGroup* group : loadedGroups) {
+        ReadLock groupLock(group->m_mutex);
+
+        HashMap<std::type_index, void*> ptrs;
+        for (auto it = group->m_components.begin(); it != group->m_components.end(); ++it)
+            ptrs[it.key()] = it.value().data();
+
+        sendEntityEvent(OnCreate, group->m_entities, ptrs, group);
+        sendEntityEvent(OnEnter, group->m_entities, ptrs, group);
+    }
+
+    return true;
+}
+
+} // namespace ply
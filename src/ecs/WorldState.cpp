@@ -0,0 +1,499 @@
+#include <ply/core/Allocate.h>
+#include <ply/ecs/WorldState.h>
+
+#include <algorithm>
+#include <cstring>
+#include <loguru.hpp>
+
+namespace ply {
+
+namespace {
+
+    ///////////////////////////////////////////////////////////
+    constexpr size_t STATE_BLOB_ALIGN = 64;
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Reserve an aligned range of a state buffer
+    ///////////////////////////////////////////////////////////
+    size_t allocateBlob(size_t& size, size_t bytes) {
+        size_t offset = (size + STATE_BLOB_ALIGN - 1) & ~(STATE_BLOB_ALIGN - 1);
+        size = offset + bytes;
+        return offset;
+    }
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Get the last tick a chunk of a component array was written to
+    ///////////////////////////////////////////////////////////
+    uint32_t getChunkTick(const priv::ComponentStore& store, size_t chunk) {
+        uint32_t changed = store.getChangedTick(chunk);
+        uint32_t added = store.getAddedTick(chunk);
+        return isNewerTick(added, changed) ? added : changed;
+    }
+
+    ///////////////////////////////////////////////////////////
+    /// \brief Copy the chunks of a component array written to after a tick
+    ///
+    /// \return The number of bytes copied
+    ///
+    ///////////////////////////////////////////////////////////
+    size_t copyChangedChunks(
+        uint8_t* dst,
+        const uint8_t* src,
+        const priv::ComponentStore& store,
+        size_t numElements,
+        uint32_t tick
+    ) {
+        size_t typeSize = store.getTypeSize();
+        size_t numChunks = (numElements + ENTITY_CHUNK_SIZE - 1) / ENTITY_CHUNK_SIZE;
+        size_t copied = 0;
+
+        // Merge runs of changed chunks into a single copy
+        for (size_t c = 0; c < numChunks;) {
+            if (!isNewerTick(getChunkTick(store, c), tick)) {
+                ++c;
+                continue;
+            }
+
+            size_t end = c + 1;
+            while (end < numChunks && isNewerTick(getChunkTick(store, end), tick))
+                ++end;
+
+            size_t first = c * ENTITY_CHUNK_SIZE;
+            size_t last = std::min(end * ENTITY_CHUNK_SIZE, numElements);
+            memcpy(dst + first * typeSize, src + first * typeSize, (last - first) * typeSize);
+            copied += (last - first) * typeSize;
+
+            c = end;
+        }
+
+        return copied;
+    }
+
+} // namespace
+
+///////////////////////////////////////////////////////////
+WorldState::WorldState()
+    : m_world(nullptr),
+      m_tick(0),
+      m_nextFree(0),
+      m_hasDisabled(false),
+      m_data(nullptr),
+      m_size(0),
+      m_capacity(0),
+      m_bytesCopied(0) {}
+
+///////////////////////////////////////////////////////////
+WorldState::~WorldState() {
+    clear();
+}
+
+///////////////////////////////////////////////////////////
+bool WorldState::isEmpty() const {
+    return m_world == nullptr;
+}
+
+///////////////////////////////////////////////////////////
+size_t WorldState::getNumEntities() const {
+    size_t numEntities = 0;
+    for (const Group& group : m_groups)
+        numEntities += group.m_numEntities;
+    return numEntities;
+}
+
+///////////////////////////////////////////////////////////
+size_t WorldState::getBytesCopied() const {
+    return m_bytesCopied;
+}
+
+///////////////////////////////////////////////////////////
+size_t WorldState::getMemoryUsage() const {
+    return m_capacity + m_entities.capacity() * sizeof(World::EntityData) +
+        m_handleTable.capacity() * sizeof(Handle) + m_indexTable.capacity() * sizeof(uint32_t) +
+        m_groups.capacity() * sizeof(Group) + m_columns.capacity() * sizeof(Column) +
+        m_sparseSets.capacity() * sizeof(Sparse) + m_pendingRemoves.capacity() * sizeof(EntityId);
+}
+
+///////////////////////////////////////////////////////////
+void WorldState::clear() {
+    if (m_data)
+        ALIGNED_FREE_DBG(m_data);
+
+    m_world = nullptr;
+    m_tick = 0;
+    m_groups = std::vector<Group>();
+    m_columns = std::vector<Column>();
+    m_sparseSets = std::vector<Sparse>();
+    m_entities = std::vector<World::EntityData>();
+    m_handleTable = std::vector<Handle>();
+    m_indexTable = std::vector<uint32_t>();
+    m_nextFree = 0;
+    m_pendingRemoves = std::vector<EntityId>();
+    m_hasDisabled = false;
+    m_data = nullptr;
+    m_size = 0;
+    m_capacity = 0;
+    m_bytesCopied = 0;
+}
+
+///////////////////////////////////////////////////////////
+bool WorldState::reserve(size_t size) {
+    if (size <= m_capacity)
+        return false;
+
+    if (m_data)
+        ALIGNED_FREE_DBG(m_data);
+
+    // Leave room to grow, the world usually keeps growing for a while
+    m_capacity = std::max(size, m_capacity + m_capacity / 2);
+    m_data = (uint8_t*)ALIGNED_MALLOC_DBG(m_capacity, STATE_BLOB_ALIGN);
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////
+void World::captureState(WorldState& state, bool delta) {
+    CHECK_F(!m_isExecutingSystems, "world state can't be captured while systems are running");
+
+    ReadLock lock(m_groupsMutex);
+
+    // Lay out the buffer, and check if the layout matches the previous capture. The layout
+    // is written in place so capturing into the same state again doesn't allocate
+    bool sameLayout = state.m_world == this;
+    size_t numGroups = 0;
+    size_t numColumns = 0;
+    size_t size = 0;
+
+    for (auto it = m_groups.begin(); it != m_groups.end(); ++it) {
+        EntityGroup* group = it.value().get();
+
+        WorldState::Group entry;
+        entry.m_id = group->m_id;
+        entry.m_group = group;
+        entry.m_numEntities = (uint32_t)group->m_entities.size();
+        entry.m_firstColumn = (uint32_t)numColumns;
+        entry.m_numColumns = (uint32_t)group->m_components.size();
+        entry.m_numShared = (uint32_t)group->m_shared.size();
+        entry.m_entitiesOffset = allocateBlob(size, entry.m_numEntities * sizeof(EntityId));
+
+        if (numGroups < state.m_groups.size()) {
+            const WorldState::Group& prev = state.m_groups[numGroups];
+            sameLayout &= prev.m_id == entry.m_id && prev.m_group == entry.m_group &&
+                prev.m_numEntities == entry.m_numEntities && prev.m_numColumns == entry.m_numColumns &&
+                prev.m_numShared == entry.m_numShared;
+            state.m_groups[numGroups] = entry;
+        } else {
+            sameLayout = false;
+            state.m_groups.push_back(entry);
+        }
+        ++numGroups;
+
+        auto addColumn = [&](std::type_index type, const priv::ComponentStore& store, size_t numElements) {
+            WorldState::Column column{
+                type,
+                (uint32_t)store.getTypeSize(),
+                (uint32_t)store.getTypeAlign(),
+                allocateBlob(size, numElements * store.getTypeSize())
+            };
+
+            if (numColumns < state.m_columns.size()) {
+                sameLayout &= state.m_columns[numColumns].m_type == column.m_type;
+                state.m_columns[numColumns] = column;
+            } else {
+                sameLayout = false;
+                state.m_columns.push_back(column);
+            }
+            ++numColumns;
+        };
+
+        for (auto colIt = group->m_components.begin(); colIt != group->m_components.end(); ++colIt)
+            addColumn(colIt.key(), colIt.value(), entry.m_numEntities);
+
+        // Shared values identify the group, so they are needed to recreate it
+        for (auto colIt = group->m_shared.begin(); colIt != group->m_shared.end(); ++colIt)
+            addColumn(colIt.key(), colIt.value(), 1);
+    }
+
+    sameLayout &= numGroups == state.m_groups.size() && numColumns == state.m_columns.size();
+    state.m_groups.resize(numGroups);
+    state.m_columns.resize(numColumns, WorldState::Column{typeid(void), 0, 0, 0});
+
+    // Sparse sets are expected to be small, they are always copied whole
+    state.m_sparseSets.clear();
+    for (auto it = m_sparseSets.begin(); it != m_sparseSets.end(); ++it) {
+        priv::SparseSet* set = it.value().get();
+
+        WorldState::Sparse entry{it.key(), (uint32_t)set->size(), 0, 0};
+        entry.m_entitiesOffset = allocateBlob(size, entry.m_numEntities * sizeof(EntityId));
+        entry.m_dataOffset = allocateBlob(size, entry.m_numEntities * set->getStore().getTypeSize());
+        state.m_sparseSets.push_back(entry);
+    }
+
+    // Contents of a new buffer are undefined, so everything has to be copied
+    if (state.reserve(size))
+        sameLayout = false;
+    state.m_size = size;
+
+    delta &= sameLayout;
+    size_t copied = 0;
+    state.m_hasDisabled = false;
+
+    // Entity lists are always copied, they are small compared to the components
+    for (const WorldState::Group& entry : state.m_groups) {
+        EntityGroup* group = entry.m_group;
+
+        // Shared values are copied even if the group is empty (they don't change once the
+        // group is created, so they are only copied with the full layout)
+        for (uint32_t c = 0; c < entry.m_numShared && !delta; ++c) {
+            const WorldState::Column& column = state.m_columns[entry.m_firstColumn + entry.m_numColumns + c];
+            memcpy(state.m_data + column.m_offset, group->m_shared.at(column.m_type).data(), column.m_size);
+            copied += column.m_size;
+        }
+
+        if (entry.m_numEntities == 0)
+            continue;
+
+        ReadLock groupLock(group->m_mutex);
+        state.m_hasDisabled |= group->m_numDisabled > 0;
+
+        memcpy(state.m_data + entry.m_entitiesOffset, group->m_entities.data(), entry.m_numEntities * sizeof(EntityId));
+        copied += entry.m_numEntities * sizeof(EntityId);
+
+        for (uint32_t c = 0; c < entry.m_numColumns; ++c) {
+            const WorldState::Column& column = state.m_columns[entry.m_firstColumn + c];
+            const priv::ComponentStore& store = group->m_components.at(column.m_type);
+            uint8_t* dst = state.m_data + column.m_offset;
+
+            if (delta) {
+                copied += copyChangedChunks(dst, (const uint8_t*)store.data(), store, entry.m_numEntities, state.m_tick);
+            } else {
+                memcpy(dst, store.data(), (size_t)entry.m_numEntities * column.m_size);
+                copied += (size_t)entry.m_numEntities * column.m_size;
+            }
+        }
+    }
+
+    for (const WorldState::Sparse& entry : state.m_sparseSets) {
+        if (entry.m_numEntities == 0)
+            continue;
+
+        priv::SparseSet* set = findSparseSet(entry.m_type);
+        ReadLock setLock(set->getMutex());
+
+        size_t dataSize = entry.m_numEntities * set->getStore().getTypeSize();
+        memcpy(state.m_data + entry.m_entitiesOffset, set->getEntities().data(), entry.m_numEntities * sizeof(EntityId));
+        memcpy(state.m_data + entry.m_dataOffset, set->getStore().data(), dataSize);
+        copied += entry.m_numEntities * sizeof(EntityId) + dataSize;
+    }
+
+    // Entity handle tables, copy assignment reuses the memory of the state
+    state.m_entities = m_entities.data();
+    state.m_handleTable = m_entities.getHandleTable();
+    state.m_indexTable = m_entities.getIndexTable();
+    state.m_nextFree = m_entities.getNextFree();
+
+    // Entities queued for removal are only possible while removals are queued
+    bool hasQueuedRemoves = false;
+    {
+        std::lock_guard<std::mutex> buffersLock(m_commandBuffersMutex);
+        for (auto& buffer : m_commandBuffers)
+            hasQueuedRemoves |= !buffer->getRemoves().empty();
+    }
+
+    state.m_pendingRemoves.clear();
+    for (const WorldState::Group& entry : state.m_groups) {
+        if (!hasQueuedRemoves)
+            break;
+
+        const EntityId* ids = (const EntityId*)(state.m_data + entry.m_entitiesOffset);
+        for (uint32_t i = 0; i < entry.m_numEntities; ++i) {
+            if (!m_entities[ids[i]].m_isAlive)
+                state.m_pendingRemoves.push_back(ids[i]);
+        }
+    }
+
+    // Any write after this point gets a later tick
+    state.m_world = this;
+    state.m_tick = nextChangeTick();
+    state.m_bytesCopied = copied;
+}
+
+///////////////////////////////////////////////////////////
+void World::restoreState(const WorldState& state) {
+    CHECK_F(!m_isExecutingSystems, "world state can't be restored while systems are running");
+    CHECK_F(!state.isEmpty(), "can't restore an empty world state");
+
+    for (const WorldState::Sparse& entry : state.m_sparseSets)
+        CHECK_F(findSparseSet(entry.m_type) != nullptr, "world state component storage does not match");
+
+    // Discard queued operations and events, they refer to the current entities
+    for (auto& buffer : m_commandBuffers)
+        buffer->clear();
+
+    {
+        std::lock_guard<std::mutex> lock(m_pendingEventsMutex);
+        for (EntityGroup* group : m_pendingEventGroups) {
+            for (priv::ObserverBatch& batch : group->m_enterObservers)
+                batch.m_ids.clear();
+
+            for (priv::ObserverBatch& batch : group->m_exitObservers) {
+                batch.m_ids.clear();
+                for (priv::ComponentStore& data : batch.m_data)
+                    data.resize(0);
+            }
+
+            group->m_hasPendingEvents = false;
+        }
+        m_pendingEventGroups.clear();
+    }
+
+    // Chunks that weren't written to since the capture still hold the captured values,
+    // but only if the state came from this world
+    bool delta = state.m_world == this;
+    uint32_t tick = nextChangeTick();
+
+    // Find or recreate the captured groups
+    std::vector<EntityGroup*> groups(state.m_groups.size());
+    bool remapGroups = false;
+    {
+        WriteLock lock(m_groupsMutex);
+
+        for (size_t g = 0; g < state.m_groups.size(); ++g) {
+            const WorldState::Group& entry = state.m_groups[g];
+
+            // Groups with shared values are also compared by value, which needs the map
+            auto it = m_groups.find(entry.m_id);
+            if (it != m_groups.end() && entry.m_numShared == 0 && it.value()->m_shared.empty()) {
+                groups[g] = it.value().get();
+            } else {
+                HashMap<std::type_index, priv::ComponentMetadata> componentMetaMap;
+                for (uint32_t c = 0; c < entry.m_numColumns + entry.m_numShared; ++c) {
+                    const WorldState::Column& column = state.m_columns[entry.m_firstColumn + c];
+                    void* data = c < entry.m_numColumns ? NULL : state.m_data + column.m_offset;
+                    componentMetaMap[column.m_type] = priv::ComponentMetadata(data, column.m_size, column.m_align);
+                }
+
+                groups[g] = getOrCreateEntityGroup(entry.m_id, componentMetaMap);
+            }
+
+            remapGroups |= groups[g] != entry.m_group;
+        }
+
+        // Groups that didn't exist when the state was captured are emptied
+        HashSet<EntityGroup*> restored;
+        for (EntityGroup* group : groups)
+            restored.insert(group);
+
+        for (auto it = m_groups.begin(); it != m_groups.end(); ++it) {
+            EntityGroup* group = it.value().get();
+            if (restored.count(group) || group->m_entities.empty())
+                continue;
+
+            WriteLock groupLock(group->m_mutex);
+            group->m_entities.clear();
+            for (auto colIt = group->m_components.begin(); colIt != group->m_components.end(); ++colIt)
+                colIt.value().resize(0);
+        }
+    }
+
+    // Copy entity lists and component arrays
+    for (size_t g = 0; g < groups.size(); ++g) {
+        const WorldState::Group& entry = state.m_groups[g];
+        EntityGroup* group = groups[g];
+        WriteLock groupLock(group->m_mutex);
+
+        const EntityId* ids = (const EntityId*)(state.m_data + entry.m_entitiesOffset);
+        size_t idsSize = entry.m_numEntities * sizeof(EntityId);
+
+        // Rows only line up with the capture if the group holds the same entities
+        bool sameRows = delta && group == entry.m_group && group->m_entities.size() == entry.m_numEntities &&
+            (idsSize == 0 || memcmp(group->m_entities.data(), ids, idsSize) == 0);
+
+        if (!sameRows) {
+            group->m_entities.resize(entry.m_numEntities);
+            if (idsSize > 0)
+                memcpy(group->m_entities.data(), ids, idsSize);
+        }
+
+        for (uint32_t c = 0; c < entry.m_numColumns; ++c) {
+            const WorldState::Column& column = state.m_columns[entry.m_firstColumn + c];
+            priv::ComponentStore& store = group->m_components.at(column.m_type);
+            const uint8_t* src = state.m_data + column.m_offset;
+
+            if (sameRows) {
+                copyChangedChunks((uint8_t*)store.data(), src, store, entry.m_numEntities, state.m_tick);
+
+                // Stamp the restored chunks so change filters see the rollback
+                size_t numChunks = (entry.m_numEntities + ENTITY_CHUNK_SIZE - 1) / ENTITY_CHUNK_SIZE;
+                for (size_t chunk = 0; chunk < numChunks; ++chunk) {
+                    if (isNewerTick(getChunkTick(store, chunk), state.m_tick))
+                        store.markChanged(chunk * ENTITY_CHUNK_SIZE, ENTITY_CHUNK_SIZE, tick);
+                }
+            } else {
+                store.resize(entry.m_numEntities);
+                if (entry.m_numEntities > 0)
+                    memcpy(store.data(), src, (size_t)entry.m_numEntities * column.m_size);
+                store.markAdded(0, entry.m_numEntities, tick);
+            }
+        }
+    }
+
+    // Entity handle tables
+    m_entities.restore(state.m_entities, state.m_handleTable, state.m_indexTable, state.m_nextFree);
+    resetFreeIds();
+
+    if (remapGroups) {
+        HashMap<EntityGroup*, EntityGroup*> groupMap;
+        for (size_t g = 0; g < groups.size(); ++g)
+            groupMap[state.m_groups[g].m_group] = groups[g];
+
+        for (EntityData& data : m_entities.data()) {
+            if (data.m_group)
+                data.m_group = groupMap.at(data.m_group);
+        }
+    }
+
+    // Disabled bits are rebuilt from the restored entity data, if either side has any
+    {
+        ReadLock lock(m_groupsMutex);
+
+        bool hasDisabled = state.m_hasDisabled;
+        for (auto it = m_groups.begin(); it != m_groups.end() && !hasDisabled; ++it)
+            hasDisabled = it.value()->m_numDisabled > 0;
+
+        for (auto it = m_groups.begin(); it != m_groups.end() && hasDisabled; ++it) {
+            WriteLock groupLock(it.value()->m_mutex);
+            updateDisabledRows(it.value().get());
+        }
+    }
+
+    // Sparse sets, the ones that weren't captured are emptied
+    for (auto it = m_sparseSets.begin(); it != m_sparseSets.end(); ++it) {
+        priv::SparseSet* set = it.value().get();
+        WriteLock setLock(set->getMutex());
+
+        auto entry = std::find_if(state.m_sparseSets.begin(), state.m_sparseSets.end(), [&](const WorldState::Sparse& s) {
+            return s.m_type == it.key();
+        });
+
+        if (entry != state.m_sparseSets.end()) {
+            const EntityId* ids = (const EntityId*)(state.m_data + entry->m_entitiesOffset);
+            set->assign(ids, entry->m_numEntities, state.m_data + entry->m_dataOffset, tick);
+        } else if (set->size() > 0) {
+            set->assign(nullptr, 0, nullptr, tick);
+        }
+    }
+
+    // Entities that were queued for removal when the state was captured are queued again
+    for (EntityId id : state.m_pendingRemoves)
+        deferRemove(id);
+
+    // No events were sent, caches detect the restore with the count instead
+    ++m_numRestores;
+}
+
+///////////////////////////////////////////////////////////
+uint32_t World::getNumRestores() const {
+    return m_numRestores;
+}
+
+} // namespace ply
@@ -0,0 +1,586 @@
+#include <ply/math/BoundingBoxTree.h>
+#include <ply/math/Functions.h>
+
+#include <loguru.hpp>
+
+#include <algorithm>
+#include <utility>
+
+namespace ply {
+
+namespace {
+
+///////////////////////////////////////////////////////////
+BoundingBox merge(const BoundingBox& a, const BoundingBox& b) {
+    return BoundingBox(min(a.m_min, b.m_min), max(a.m_max, b.m_max));
+}
+
+///////////////////////////////////////////////////////////
+/// \brief Half the surface area of a box, the cost metric of the tree
+///////////////////////////////////////////////////////////
+float area(const BoundingBox& box) {
+    Vector3f d = box.m_max - box.m_min;
+    return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+///////////////////////////////////////////////////////////
+bool containsBox(const BoundingBox& outer, const BoundingBox& inner) {
+    return outer.m_min.x <= inner.m_min.x && outer.m_min.y <= inner.m_min.y &&
+           outer.m_min.z <= inner.m_min.z && outer.m_max.x >= inner.m_max.x &&
+           outer.m_max.y >= inner.m_max.y && outer.m_max.z >= inner.m_max.z;
+}
+
+///////////////////////////////////////////////////////////
+/// \brief Result of testing a box against a frustum
+///////////////////////////////////////////////////////////
+enum class Containment {
+    Outside,
+    Intersects,
+    Inside
+};
+
+///////////////////////////////////////////////////////////
+Containment classify(const Frustum& frustum, const BoundingBox& box) {
+    Containment result = Containment::Inside;
+
+    for (uint32_t i = 0; i < 6; ++i) {
+        const Plane& plane = frustum.getPlane((Frustum::Side)i);
+
+        // Corners furthest along and against the plane normal
+        Vector3f vmax, vmin;
+        vmax.x = plane.n.x > 0.0f ? box.m_max.x : box.m_min.x;
+        vmax.y = plane.n.y > 0.0f ? box.m_max.y : box.m_min.y;
+        vmax.z = plane.n.z > 0.0f ? box.m_max.z : box.m_min.z;
+        vmin.x = plane.n.x > 0.0f ? box.m_min.x : box.m_max.x;
+        vmin.y = plane.n.y > 0.0f ? box.m_min.y : box.m_max.y;
+        vmin.z = plane.n.z > 0.0f ? box.m_min.z : box.m_max.z;
+
+        if (dist(plane, vmax) < 0.0f)
+            return Containment::Outside;
+        if (dist(plane, vmin) < 0.0f)
+            result = Containment::Intersects;
+    }
+
+    return result;
+}
+
+///////////////////////////////////////////////////////////
+/// \brief Intersect a ray with a box using the slab method
+///
+/// \param tEntry The distance along the ray where it enters the box (0 if it starts inside)
+///
+///////////////////////////////////////////////////////////
+bool intersect(const Ray& ray, const BoundingBox& box, float maxDistance, float& tEntry) {
+    float tMin = 0.0f;
+    float tMax = maxDistance;
+
+    for (int i = 0; i < 3; ++i) {
+        float o = ray.m_origin[i];
+        float d = ray.m_direction[i];
+
+        // Parallel to the slab, must start inside it
+        if (d == 0.0f) {
+            if (o < box.m_min[i] || o > box.m_max[i])
+                return false;
+            continue;
+        }
+
+        float inv = 1.0f / d;
+        float t1 = (box.m_min[i] - o) * inv;
+        float t2 = (box.m_max[i] - o) * inv;
+        if (t1 > t2)
+            std::swap(t1, t2);
+
+        tMin = std::max(tMin, t1);
+        tMax = std::min(tMax, t2);
+        if (tMin > tMax)
+            return false;
+    }
+
+    tEntry = tMin;
+    return true;
+}
+
+} // namespace
+
+///////////////////////////////////////////////////////////
+BoundingBoxTree::BoundingBoxTree(float margin)
+    : m_root(INVALID_NODE),
+      m_freeList(INVALID_NODE),
+      m_numLeaves(0),
+      m_margin(margin) {}
+
+///////////////////////////////////////////////////////////
+uint32_t BoundingBoxTree::insert(const BoundingBox& box, uint32_t data) {
+    uint32_t leaf = allocNode();
+
+    Node& node = m_nodes[leaf];
+    node.m_box = BoundingBox(box.m_min - Vector3f(m_margin), box.m_max + Vector3f(m_margin));
+    node.m_leafBox = box;
+    node.m_data = data;
+    node.m_height = 0;
+
+    insertLeaf(leaf);
+    ++m_numLeaves;
+
+    return leaf;
+}
+
+///////////////////////////////////////////////////////////
+void BoundingBoxTree::remove(uint32_t proxy) {
+    CHECK_F(proxy < m_nodes.size() && m_nodes[proxy].isLeaf(), "invalid bounding box tree proxy: %u", proxy);
+
+    removeLeaf(proxy);
+    freeNode(proxy);
+    --m_numLeaves;
+}
+
+///////////////////////////////////////////////////////////
+bool BoundingBoxTree::update(uint32_t proxy, const BoundingBox& box) {
+    CHECK_F(proxy < m_nodes.size() && m_nodes[proxy].isLeaf(), "invalid bounding box tree proxy: %u", proxy);
+
+    Node& node = m_nodes[proxy];
+    node.m_leafBox = box;
+
+    // Reinsert if the box moved out of the enlarged box, or if the enlarged
+    // box is too loose (i.e. after the box shrinks)
+    BoundingBox fat(box.m_min - Vector3f(m_margin), box.m_max + Vector3f(m_margin));
+    BoundingBox loose(fat.m_min - Vector3f(4.0f * m_margin), fat.m_max + Vector3f(4.0f * m_margin));
+    if (containsBox(node.m_box, box) && !containsBox(node.m_box, loose))
+        return false;
+
+    removeLeaf(proxy);
+    m_nodes[proxy].m_box = fat;
+    insertLeaf(proxy);
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////
+void BoundingBoxTree::rebuild() {
+    if (m_numLeaves < 3)
+        return;
+
+    // Free all internal nodes, keeping leaves in place so proxy ids stay valid
+    std::vector<uint32_t> leaves;
+    leaves.reserve(m_numLeaves);
+    for (uint32_t i = 0; i < m_nodes.size(); ++i) {
+        if (m_nodes[i].m_height < 0)
+            continue;
+
+        if (m_nodes[i].isLeaf())
+            leaves.push_back(i);
+        else
+            freeNode(i);
+    }
+
+    m_root = build(leaves.data(), leaves.size());
+    m_nodes[m_root].m_parent = INVALID_NODE;
+}
+
+///////////////////////////////////////////////////////////
+void BoundingBoxTree::clear() {
+    m_nodes.clear();
+    m_root = INVALID_NODE;
+    m_freeList = INVALID_NODE;
+    m_numLeaves = 0;
+}
+
+///////////////////////////////////////////////////////////
+void BoundingBoxTree::query(const BoundingBox& box, std::vector<uint32_t>& results) const {
+    if (m_root == INVALID_NODE)
+        return;
+
+    std::vector<uint32_t> stack;
+    stack.push_back(m_root);
+
+    while (!stack.empty()) {
+        const Node& node = m_nodes[stack.back()];
+        stack.pop_back();
+
+        if (!node.m_box.overlaps(box))
+            continue;
+
+        if (node.isLeaf()) {
+            if (node.m_leafBox.overlaps(box))
+                results.push_back(node.m_data);
+        } else {
+            stack.push_back(node.m_children[0]);
+            stack.push_back(node.m_children[1]);
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////
+void BoundingBoxTree::query(const Frustum& frustum, std::vector<uint32_t>& results) const {
+    if (m_root == INVALID_NODE)
+        return;
+
+    std::vector<uint32_t> stack;
+    stack.push_back(m_root);
+
+    while (!stack.empty()) {
+        uint32_t index = stack.back();
+        stack.pop_back();
+
+        const Node& node = m_nodes[index];
+        if (node.isLeaf()) {
+            if (frustum.contains(node.m_leafBox))
+                results.push_back(node.m_data);
+            continue;
+        }
+
+        Containment c = classify(frustum, node.m_box);
+        if (c == Containment::Inside) {
+            addSubtree(index, results);
+        } else if (c == Containment::Intersects) {
+            stack.push_back(node.m_children[0]);
+            stack.push_back(node.m_children[1]);
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////
+void BoundingBoxTree::raycast(const Ray& ray, std::vector<uint32_t>& results, float maxDistance) const {
+    if (m_root == INVALID_NODE)
+        return;
+
+    std::vector<std::pair<float, uint32_t>> hits;
+    std::vector<uint32_t> stack;
+    stack.push_back(m_root);
+
+    while (!stack.empty()) {
+        const Node& node = m_nodes[stack.back()];
+        stack.pop_back();
+
+        float t;
+        if (!intersect(ray, node.m_box, maxDistance, t))
+            continue;
+
+        if (node.isLeaf()) {
+            if (intersect(ray, node.m_leafBox, maxDistance, t))
+                hits.push_back(std::make_pair(t, node.m_data));
+        } else {
+            stack.push_back(node.m_children[0]);
+            stack.push_back(node.m_children[1]);
+        }
+    }
+
+    std::sort(hits.begin(), hits.end());
+    for (auto& hit : hits)
+        results.push_back(hit.second);
+}
+
+///////////////////////////////////////////////////////////
+const BoundingBox& BoundingBoxTree::getBox(uint32_t proxy) const {
+    return m_nodes[proxy].m_leafBox;
+}
+
+///////////////////////////////////////////////////////////
+uint32_t BoundingBoxTree::getData(uint32_t proxy) const {
+    return m_nodes[proxy].m_data;
+}
+
+///////////////////////////////////////////////////////////
+size_t BoundingBoxTree::size() const {
+    return m_numLeaves;
+}
+
+///////////////////////////////////////////////////////////
+uint32_t BoundingBoxTree::getHeight() const {
+    return m_root != INVALID_NODE ? (uint32_t)m_nodes[m_root].m_height : 0;
+}
+
+///////////////////////////////////////////////////////////
+uint32_t BoundingBoxTree::allocNode() {
+    uint32_t index = m_freeList;
+    if (index != INVALID_NODE) {
+        m_freeList = m_nodes[index].m_parent;
+    } else {
+        index = (uint32_t)m_nodes.size();
+        m_nodes.push_back(Node());
+    }
+
+    Node& node = m_nodes[index];
+    node.m_parent = INVALID_NODE;
+    node.m_children[0] = INVALID_NODE;
+    node.m_children[1] = INVALID_NODE;
+    node.m_data = 0;
+    node.m_height = 0;
+
+    return index;
+}
+
+///////////////////////////////////////////////////////////
+void BoundingBoxTree::freeNode(uint32_t node) {
+    m_nodes[node].m_parent = m_freeList;
+    m_nodes[node].m_height = -1;
+    m_freeList = node;
+}
+
+///////////////////////////////////////////////////////////
+void BoundingBoxTree::insertLeaf(uint32_t leaf) {
+    m_nodes[leaf].m_parent = INVALID_NODE;
+
+    if (m_root == INVALID_NODE) {
+        m_root = leaf;
+        return;
+    }
+
+    // Descend towards the cheapest sibling. The cost of a sibling is the area
+    // of the new parent, plus the area every ancestor grows by
+    BoundingBox leafBox = m_nodes[leaf].m_box;
+    uint32_t index = m_root;
+    while (!m_nodes[index].isLeaf()) {
+        const Node& node = m_nodes[index];
+
+        float nodeArea = area(node.m_box);
+        float combinedArea = area(merge(node.m_box, leafBox));
+
+        // Cost of making the leaf a sibling of this node
+        float cost = 2.0f * combinedArea;
+
+        // Minimum cost of pushing the leaf further down
+        float inheritance = 2.0f * (combinedArea - nodeArea);
+
+        float childCosts[2];
+        for (int i = 0; i < 2; ++i) {
+            const Node& child = m_nodes[node.m_children[i]];
+            float merged = area(merge(child.m_box, leafBox));
+            childCosts[i] = (child.isLeaf() ? merged : merged - area(child.m_box)) + inheritance;
+        }
+
+        if (cost < childCosts[0] && cost < childCosts[1])
+            break;
+
+        index = childCosts[0] < childCosts[1] ? node.m_children[0] : node.m_children[1];
+    }
+
+    // Create a new parent for the leaf and its sibling
+    uint32_t sibling = index;
+    uint32_t oldParent = m_nodes[sibling].m_parent;
+    uint32_t newParent = allocNode();
+
+    Node& parent = m_nodes[newParent];
+    parent.m_parent = oldParent;
+    parent.m_box = merge(leafBox, m_nodes[sibling].m_box);
+    parent.m_height = m_nodes[sibling].m_height + 1;
+    parent.m_children[0] = sibling;
+    parent.m_children[1] = leaf;
+
+    if (oldParent != INVALID_NODE) {
+        uint32_t* children = m_nodes[oldParent].m_children;
+        children[children[0] == sibling ? 0 : 1] = newParent;
+    } else {
+        m_root = newParent;
+    }
+
+    m_nodes[sibling].m_parent = newParent;
+    m_nodes[leaf].m_parent = newParent;
+
+    refitAncestors(newParent);
+}
+
+///////////////////////////////////////////////////////////
+void BoundingBoxTree::removeLeaf(uint32_t leaf) {
+    if (leaf == m_root) {
+        m_root = INVALID_NODE;
+        return;
+    }
+
+    // Replace the leaf's parent with its sibling
+    uint32_t parent = m_nodes[leaf].m_parent;
+    uint32_t grandParent = m_nodes[parent].m_parent;
+    uint32_t* siblings = m_nodes[parent].m_children;
+    uint32_t sibling = siblings[0] == leaf ? siblings[1] : siblings[0];
+
+    m_nodes[sibling].m_parent = grandParent;
+    freeNode(parent);
+
+    if (grandParent != INVALID_NODE) {
+        uint32_t* children = m_nodes[grandParent].m_children;
+        children[children[0] == parent ? 0 : 1] = sibling;
+        refitAncestors(grandParent);
+    } else {
+        m_root = sibling;
+    }
+}
+
+///////////////////////////////////////////////////////////
+void BoundingBoxTree::refitAncestors(uint32_t index) {
+    while (index != INVALID_NODE) {
+        index = balance(index);
+
+        Node& node = m_nodes[index];
+        const Node& a = m_nodes[node.m_children[0]];
+        const Node& b = m_nodes[node.m_children[1]];
+        node.m_box = merge(a.m_box, b.m_box);
+        node.m_height = 1 + std::max(a.m_height, b.m_height);
+
+        index = node.m_parent;
+    }
+}
+
+///////////////////////////////////////////////////////////
+uint32_t BoundingBoxTree::balance(uint32_t iA) {
+    Node& A = m_nodes[iA];
+    if (A.isLeaf() || A.m_height < 2)
+        return iA;
+
+    // Rotate the taller child up, and move its shorter child down to A
+    int up = m_nodes[A.m_children[1]].m_height > m_nodes[A.m_children[0]].m_height ? 1 : 0;
+    uint32_t iB = A.m_children[up];
+    uint32_t iC = A.m_children[1 - up];
+    Node& B = m_nodes[iB];
+    Node& C = m_nodes[iC];
+
+    if (B.m_height - C.m_height < 2)
+        return iA;
+
+    uint32_t iF = B.m_children[0];
+    uint32_t iG = B.m_children[1];
+    Node& F = m_nodes[iF];
+    Node& G = m_nodes[iG];
+
+    // B takes A's place
+    B.m_parent = A.m_parent;
+    A.m_parent = iB;
+    if (B.m_parent != INVALID_NODE) {
+        uint32_t* children = m_nodes[B.m_parent].m_children;
+        children[children[0] == iA ? 0 : 1] = iB;
+    } else {
+        m_root = iB;
+    }
+
+    // B keeps its taller child, the other one becomes A's child
+    uint32_t iKeep = F.m_height > G.m_height ? iF : iG;
+    uint32_t iMove = iKeep == iF ? iG : iF;
+    Node& keep = m_nodes[iKeep];
+    Node& move = m_nodes[iMove];
+
+    B.m_children[0] = iA;
+    B.m_children[1] = iKeep;
+    A.m_children[up] = iMove;
+    move.m_parent = iA;
+
+    A.m_box = merge(C.m_box, move.m_box);
+    A.m_height = 1 + std::max(C.m_height, move.m_height);
+    B.m_box = merge(A.m_box, keep.m_box);
+    B.m_height = 1 + std::max(A.m_height, keep.m_height);
+
+    return iB;
+}
+
+///////////////////////////////////////////////////////////
+uint32_t BoundingBoxTree::build(uint32_t* leaves, size_t count) {
+    if (count == 1)
+        return leaves[0];
+
+    // Bin leaf centroids along the longest axis of their bounds
+    BoundingBox centroids(m_nodes[leaves[0]].m_box.getCenter(), m_nodes[leaves[0]].m_box.getCenter());
+    for (size_t i = 1; i < count; ++i) {
+        Vector3f c = m_nodes[leaves[i]].m_box.getCenter();
+        centroids = merge(centroids, BoundingBox(c, c));
+    }
+
+    Vector3f extent = centroids.getDimensions();
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+    constexpr int numBins = 16;
+    size_t split = count / 2;
+
+    if (extent[axis] > 0.0f) {
+        float scale = numBins / extent[axis];
+        auto binOf = [&](uint32_t leaf) {
+            float c = m_nodes[leaf].m_box.getCenter()[axis];
+            return std::min((int)((c - centroids.m_min[axis]) * scale), numBins - 1);
+        };
+
+        size_t binCounts[numBins] = {};
+        BoundingBox binBoxes[numBins];
+        for (size_t i = 0; i < count; ++i) {
+            int b = binOf(leaves[i]);
+            const BoundingBox& box = m_nodes[leaves[i]].m_box;
+            binBoxes[b] = binCounts[b]++ ? merge(binBoxes[b], box) : box;
+        }
+
+        // Area of everything right of each split, swept from the right
+        float rightCosts[numBins] = {};
+        BoundingBox right;
+        size_t rightCount = 0;
+        for (int b = numBins - 1; b > 0; --b) {
+            if (binCounts[b]) {
+                right = rightCount ? merge(right, binBoxes[b]) : binBoxes[b];
+                rightCount += binCounts[b];
+            }
+            rightCosts[b] = rightCount * area(right);
+        }
+
+        // Find the split with the lowest surface area cost
+        float bestCost = std::numeric_limits<float>::max();
+        int bestSplit = -1;
+        BoundingBox left;
+        size_t leftCount = 0;
+        for (int b = 0; b < numBins - 1; ++b) {
+            if (binCounts[b]) {
+                left = leftCount ? merge(left, binBoxes[b]) : binBoxes[b];
+                leftCount += binCounts[b];
+            }
+
+            float cost = leftCount * area(left) + rightCosts[b + 1];
+            if (leftCount && leftCount < count && cost < bestCost) {
+                bestCost = cost;
+                bestSplit = b;
+            }
+        }
+
+        if (bestSplit >= 0) {
+            uint32_t* mid = std::partition(leaves, leaves + count, [&](uint32_t leaf) {
+                return binOf(leaf) <= bestSplit;
+            });
+            split = mid - leaves;
+        }
+    }
+
+    // Median split when centroids can't be separated
+    if (split == 0 || split == count) {
+        split = count / 2;
+        std::nth_element(leaves, leaves + split, leaves + count, [&](uint32_t a, uint32_t b) {
+            return m_nodes[a].m_box.getCenter()[axis] < m_nodes[b].m_box.getCenter()[axis];
+        });
+    }
+
+    uint32_t a = build(leaves, split);
+    uint32_t b = build(leaves + split, count - split);
+    uint32_t index = allocNode();
+
+    Node& node = m_nodes[index];
+    node.m_children[0] = a;
+    node.m_children[1] = b;
+    node.m_box = merge(m_nodes[a].m_box, m_nodes[b].m_box);
+    node.m_height = 1 + std::max(m_nodes[a].m_height, m_nodes[b].m_height);
+    m_nodes[a].m_parent = index;
+    m_nodes[b].m_parent = index;
+
+    return index;
+}
+
+///////////////////////////////////////////////////////////
+void BoundingBoxTree::addSubtree(uint32_t index, std::vector<uint32_t>& results) const {
+    std::vector<uint32_t> stack;
+    stack.push_back(index);
+
+    while (!stack.empty()) {
+        const Node& node = m_nodes[stack.back()];
+        stack.pop_back();
+
+        if (node.isLeaf()) {
+            results.push_back(node.m_data);
+        } else {
+            stack.push_back(node.m_children[0]);
+            stack.push_back(node.m_children[1]);
+        }
+    }
+}
+
+} // namespace ply
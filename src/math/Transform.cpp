@@ -1,8 +1,285 @@
 #include <ply/math/Functions.h>
 #include <ply/math/Transform.h>
 
+#include <loguru.hpp>
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+    #define PLY_SIMD_AVX2
+    #define PLY_SIMD_SSE
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define PLY_SIMD_SSE
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+    #include <arm_neon.h>
+    #define PLY_SIMD_NEON
+#endif
+
 namespace ply {
 
+namespace {
+
+///////////////////////////////////////////////////////////
+/// \brief Input arrays of a batch transform conversion
+///////////////////////////////////////////////////////////
+struct TransformStreams {
+    const float* m_t;    //!< First position component
+    const float* m_q[4]; //!< Quaternion x, y, z, and w components
+    const float* m_s;    //!< First scale component
+    size_t m_tStride;    //!< Distance between positions, in floats
+    size_t m_qStride;    //!< Distance between quaternions, in floats
+    size_t m_sStride;    //!< Distance between scales, in floats
+};
+
+///////////////////////////////////////////////////////////
+/// \brief How matrices are written to the output array
+///////////////////////////////////////////////////////////
+enum class MatrixLayout {
+    ColumnMajor, //!< 4x4, one column after another
+    RowMajor,    //!< 4x4, one row after another
+    Affine       //!< First 3 rows of a 4x4 matrix
+};
+
+///////////////////////////////////////////////////////////
+/// \brief Single lane fallback, used for remainders
+///////////////////////////////////////////////////////////
+struct ScalarLanes {
+    using V = float;
+    static constexpr size_t N = 1;
+
+    static V set1(float x) { return x; }
+    static V add(V a, V b) { return a + b; }
+    static V sub(V a, V b) { return a - b; }
+    static V mul(V a, V b) { return a * b; }
+    static V gather(const float* p, size_t) { return *p; }
+
+    static void storeTransposed(V a, V b, V c, V d, float* out, size_t) {
+        out[0] = a;
+        out[1] = b;
+        out[2] = c;
+        out[3] = d;
+    }
+};
+
+#ifdef PLY_SIMD_SSE
+///////////////////////////////////////////////////////////
+/// \brief 4 lanes with SSE
+///////////////////////////////////////////////////////////
+struct SseLanes {
+    using V = __m128;
+    static constexpr size_t N = 4;
+
+    static V set1(float x) { return _mm_set1_ps(x); }
+    static V add(V a, V b) { return _mm_add_ps(a, b); }
+    static V sub(V a, V b) { return _mm_sub_ps(a, b); }
+    static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+    static V gather(const float* p, size_t stride) {
+        return _mm_setr_ps(p[0], p[stride], p[2 * stride], p[3 * stride]);
+    }
+
+    // Lane i of a, b, c, and d is written to out + i * step
+    static void storeTransposed(V a, V b, V c, V d, float* out, size_t step) {
+        _MM_TRANSPOSE4_PS(a, b, c, d);
+        _mm_storeu_ps(out, a);
+        _mm_storeu_ps(out + step, b);
+        _mm_storeu_ps(out + 2 * step, c);
+        _mm_storeu_ps(out + 3 * step, d);
+    }
+};
+#endif
+
+#ifdef PLY_SIMD_AVX2
+///////////////////////////////////////////////////////////
+/// \brief 8 lanes with AVX2
+///////////////////////////////////////////////////////////
+struct Avx2Lanes {
+    using V = __m256;
+    static constexpr size_t N = 8;
+
+    static V set1(float x) { return _mm256_set1_ps(x); }
+    static V add(V a, V b) { return _mm256_add_ps(a, b); }
+    static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+    static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+    static V gather(const float* p, size_t stride) {
+        __m256i index = _mm256_mullo_epi32(
+            _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32((int)stride)
+        );
+        return _mm256_i32gather_ps(p, index, 4);
+    }
+
+    // Transposed in two halves of 4 lanes
+    static void storeTransposed(V a, V b, V c, V d, float* out, size_t step) {
+        SseLanes::storeTransposed(
+            _mm256_castps256_ps128(a),
+            _mm256_castps256_ps128(b),
+            _mm256_castps256_ps128(c),
+            _mm256_castps256_ps128(d),
+            out,
+            step
+        );
+        SseLanes::storeTransposed(
+            _mm256_extractf128_ps(a, 1),
+            _mm256_extractf128_ps(b, 1),
+            _mm256_extractf128_ps(c, 1),
+            _mm256_extractf128_ps(d, 1),
+            out + 4 * step,
+            step
+        );
+    }
+};
+#endif
+
+#ifdef PLY_SIMD_NEON
+///////////////////////////////////////////////////////////
+/// \brief 4 lanes with NEON
+///////////////////////////////////////////////////////////
+struct NeonLanes {
+    using V = float32x4_t;
+    static constexpr size_t N = 4;
+
+    static V set1(float x) { return vdupq_n_f32(x); }
+    static V add(V a, V b) { return vaddq_f32(a, b); }
+    static V sub(V a, V b) { return vsubq_f32(a, b); }
+    static V mul(V a, V b) { return vmulq_f32(a, b); }
+    static V gather(const float* p, size_t stride) {
+        float lanes[4] = {p[0], p[stride], p[2 * stride], p[3 * stride]};
+        return vld1q_f32(lanes);
+    }
+
+    // Lane i of a, b, c, and d is written to out + i * step
+    static void storeTransposed(V a, V b, V c, V d, float* out, size_t step) {
+        float32x4x2_t ab = vtrnq_f32(a, b);
+        float32x4x2_t cd = vtrnq_f32(c, d);
+        vst1q_f32(out, vcombine_f32(vget_low_f32(ab.val[0]), vget_low_f32(cd.val[0])));
+        vst1q_f32(out + step, vcombine_f32(vget_low_f32(ab.val[1]), vget_low_f32(cd.val[1])));
+        vst1q_f32(out + 2 * step, vcombine_f32(vget_high_f32(ab.val[0]), vget_high_f32(cd.val[0])));
+        vst1q_f32(out + 3 * step, vcombine_f32(vget_high_f32(ab.val[1]), vget_high_f32(cd.val[1])));
+    }
+};
+#endif
+
+#if defined(PLY_SIMD_AVX2)
+using SimdLanes = Avx2Lanes;
+#elif defined(PLY_SIMD_SSE)
+using SimdLanes = SseLanes;
+#elif defined(PLY_SIMD_NEON)
+using SimdLanes = NeonLanes;
+#else
+using SimdLanes = ScalarLanes;
+#endif
+
+///////////////////////////////////////////////////////////
+/// \brief Convert transforms, N at a time, starting from an index
+///
+/// Inputs are loaded into one register per component (structure of
+/// arrays), so every lane computes the same matrix elements as the
+/// scalar toTransformMatrix(). The matrices are then transposed back
+/// into the output layout.
+///
+/// \return The index of the first transform that wasn't converted
+///
+///////////////////////////////////////////////////////////
+template <typename S>
+size_t convertTransforms(const TransformStreams& in, size_t i, size_t count, float* out, MatrixLayout layout) {
+    using V = typename S::V;
+
+    const V zero = S::set1(0.0f);
+    const V one = S::set1(1.0f);
+    const size_t size = layout == MatrixLayout::Affine ? 12 : 16;
+
+    for (; i + S::N <= count; i += S::N) {
+        const float* t = in.m_t + i * in.m_tStride;
+        const float* s = in.m_s + i * in.m_sStride;
+        size_t q = i * in.m_qStride;
+
+        V tx = S::gather(t, in.m_tStride);
+        V ty = S::gather(t + 1, in.m_tStride);
+        V tz = S::gather(t + 2, in.m_tStride);
+        V qx = S::gather(in.m_q[0] + q, in.m_qStride);
+        V qy = S::gather(in.m_q[1] + q, in.m_qStride);
+        V qz = S::gather(in.m_q[2] + q, in.m_qStride);
+        V qw = S::gather(in.m_q[3] + q, in.m_qStride);
+        V sx = S::gather(s, in.m_sStride);
+        V sy = S::gather(s + 1, in.m_sStride);
+        V sz = S::gather(s + 2, in.m_sStride);
+
+        // Products are doubled up front (exact, so results match the scalar version)
+        V x2 = S::add(qx, qx);
+        V y2 = S::add(qy, qy);
+        V z2 = S::add(qz, qz);
+        V xx = S::mul(qx, x2);
+        V yy = S::mul(qy, y2);
+        V zz = S::mul(qz, z2);
+        V xy = S::mul(qx, y2);
+        V xz = S::mul(qx, z2);
+        V yz = S::mul(qy, z2);
+        V wx = S::mul(qw, x2);
+        V wy = S::mul(qw, y2);
+        V wz = S::mul(qw, z2);
+
+        // Element (row, column) of the scaled rotation matrix
+        V m00 = S::mul(sx, S::sub(one, S::add(yy, zz)));
+        V m10 = S::mul(sx, S::add(xy, wz));
+        V m20 = S::mul(sx, S::sub(xz, wy));
+        V m01 = S::mul(sy, S::sub(xy, wz));
+        V m11 = S::mul(sy, S::sub(one, S::add(xx, zz)));
+        V m21 = S::mul(sy, S::add(yz, wx));
+        V m02 = S::mul(sz, S::add(xz, wy));
+        V m12 = S::mul(sz, S::sub(yz, wx));
+        V m22 = S::mul(sz, S::sub(one, S::add(xx, yy)));
+
+        float* o = out + i * size;
+        if (layout == MatrixLayout::ColumnMajor) {
+            S::storeTransposed(m00, m10, m20, zero, o, size);
+            S::storeTransposed(m01, m11, m21, zero, o + 4, size);
+            S::storeTransposed(m02, m12, m22, zero, o + 8, size);
+            S::storeTransposed(tx, ty, tz, one, o + 12, size);
+        } else {
+            S::storeTransposed(m00, m01, m02, tx, o, size);
+            S::storeTransposed(m10, m11, m12, ty, o + 4, size);
+            S::storeTransposed(m20, m21, m22, tz, o + 8, size);
+            if (layout == MatrixLayout::RowMajor)
+                S::storeTransposed(zero, zero, zero, one, o + 12, size);
+        }
+    }
+
+    return i;
+}
+
+///////////////////////////////////////////////////////////
+/// \brief Convert transforms with the widest available lanes, then the remainder one at a time
+///////////////////////////////////////////////////////////
+void convertTransformArrays(
+    const Vector3f* t,
+    const Quaternion* r,
+    const Vector3f* s,
+    float* out,
+    size_t count,
+    size_t stride,
+    MatrixLayout layout
+) {
+    if (!count)
+        return;
+
+    CHECK_F(stride % sizeof(float) == 0, "transform stride must be a multiple of sizeof(float)");
+
+    TransformStreams in;
+    in.m_t = &t->x;
+    in.m_q[0] = &r->x;
+    in.m_q[1] = &r->y;
+    in.m_q[2] = &r->z;
+    in.m_q[3] = &r->w;
+    in.m_s = &s->x;
+    in.m_tStride = (stride ? stride : sizeof(Vector3f)) / sizeof(float);
+    in.m_qStride = (stride ? stride : sizeof(Quaternion)) / sizeof(float);
+    in.m_sStride = (stride ? stride : sizeof(Vector3f)) / sizeof(float);
+
+    size_t i = convertTransforms<SimdLanes>(in, 0, count, out, layout);
+    convertTransforms<ScalarLanes>(in, i, count, out, layout);
+}
+
+} // namespace
+
 ///////////////////////////////////////////////////////////
 Matrix4f toTransformMatrix(const Vector3f& t, const Vector3f& r, const Vector3f& k) {
     Vector3f rot(radians(r.x), radians(r.y), radians(r.z));
@@ -89,4 +366,32 @@ Matrix4f toTransformMatrix(const Vector3f& t, const Quaternion& q, const Vector3
 #endif
 }
 
+///////////////////////////////////////////////////////////
+void toTransformMatrices(
+    const Vector3f* t,
+    const Quaternion* r,
+    const Vector3f* s,
+    Matrix4f* out,
+    size_t count,
+    size_t stride
+) {
+#ifndef USE_ROW_MAJOR
+    convertTransformArrays(t, r, s, (float*)out, count, stride, MatrixLayout::ColumnMajor);
+#else
+    convertTransformArrays(t, r, s, (float*)out, count, stride, MatrixLayout::RowMajor);
+#endif
+}
+
+///////////////////////////////////////////////////////////
+void toAffineMatrices(
+    const Vector3f* t,
+    const Quaternion* r,
+    const Vector3f* s,
+    Vector4f* out,
+    size_t count,
+    size_t stride
+) {
+    convertTransformArrays(t, r, s, (float*)out, count, stride, MatrixLayout::Affine);
+}
+
 }  // namespace ply
\ No newline at end of file